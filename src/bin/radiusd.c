@@ -138,6 +138,8 @@ static int thread_instantiate(TALLOC_CTX *ctx, fr_event_list_t *el, UNUSED void
 #ifdef WITH_TLS
 	if (fr_openssl_thread_init(main_config->openssl_async_pool_init,
 				   main_config->openssl_async_pool_max) < 0) return -1;
+
+	if (fr_tls_offload_thread_init(ctx, el, main_config->openssl_offload_threads) < 0) return -1;
 #endif
 	return 0;
 }
@@ -854,6 +856,9 @@ int main(int argc, char *argv[])
 		schedule->max_workers = config->max_workers;
 		schedule->max_networks = config->max_networks;
 		schedule->stats_interval = config->stats_interval;
+		schedule->timer_wheel_tick = config->timer_wheel_tick;
+		schedule->network_cpus = config->network_cpus;
+		schedule->worker_cpus = config->worker_cpus;
 
 		schedule->network.max_outstanding = config->max_requests;
 
@@ -45,6 +45,7 @@ typedef struct {
 	fr_io_set_fd_t			fd_set;		//!< Set the file descriptor to the instance.
 
 	fr_io_data_read_t		read;		//!< Read from a socket to a data buffer
+	fr_io_data_read_pending_t	read_pending;	//!< How many packets a batched read has buffered.
 	fr_io_data_write_t		write;		//!< Write from a data buffer to a socket
 
 	fr_io_data_inject_t		inject;		//!< Inject a packet into a socket.
@@ -63,6 +64,7 @@ typedef struct {
 
 	fr_io_track_create_t		track_create;  	//!< create a tracking structure
 	fr_io_track_cmp_t		track_compare;	//!< compare two tracking structures
+	fr_io_track_hash_t		track_hash;	//!< hash a tracking structure
 
 	fr_io_connection_set_t		connection_set;	//!< set src/dst IP/port of a connection
 	fr_io_network_get_t		network_get;	//!< get dynamic network information
@@ -175,6 +175,24 @@ typedef size_t (*fr_io_nak_t)(fr_listen_t *li, void *packet_ctx, uint8_t *const
  */
 typedef ssize_t (*fr_io_data_read_t)(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time, uint8_t *buffer, size_t buffer_len, size_t *leftover);
 
+/** Return how many packets can be read without going back to the kernel.
+ *
+ * Datagram sockets can read multiple packets with a single system
+ * call (e.g. recvmmsg()).  The read routine then returns one packet
+ * per call, and buffers the rest.
+ *
+ * The socket may no longer be readable once the kernel has handed
+ * over all of its packets, so the network side calls this function
+ * after every read.  If it returns >0, the network side calls the
+ * read routine again, instead of waiting for the next event.
+ *
+ * @param[in] li		the listener for this socket
+ * @return
+ *	- 0 nothing is buffered.
+ *	- >0 the number of packets which are buffered.
+ */
+typedef unsigned int (*fr_io_data_read_pending_t)(fr_listen_t *li);
+
 /** Write a socket.
  *
  *  If the socket is a datagram socket, then the function can read or
@@ -301,6 +319,24 @@ typedef void *(*fr_io_track_create_t)(void const *instance, void *thread_instanc
  */
 typedef int (*fr_io_track_cmp_t)(void const *instance, void *thread_instance, fr_client_t *client, void const *one, void const *two);
 
+/** Hash a tracking structure for storing in a duplicate detection hash table.
+ *
+ * If this function is provided, the tracking table is a hash table
+ * instead of an rbtree.  Lookups are then O(1), instead of
+ * O(log n) calls to #fr_io_track_cmp_t.
+ *
+ * The hash must only use the fields which are checked by the
+ * #fr_io_track_cmp_t function.  i.e. if the comparison function
+ * says that two packets are identical, they must have the same hash.
+ *
+ * @param[in] instance		the context for this function
+ * @param[in] thread_instance	the thread instance for this function
+ * @param[in] client		the client associated with this packet
+ * @param[in] packet		packet tracking structure
+ * @return the hash of the tracking structure.
+ */
+typedef uint32_t (*fr_io_track_hash_t)(void const *instance, void *thread_instance, fr_client_t *client, void const *packet);
+
 /**  Handle an error on the socket.
  *
  *  In general, the only thing to do on errors is to close the
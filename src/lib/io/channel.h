@@ -58,7 +58,7 @@ typedef struct fr_listen fr_listen_t;
 #include <freeradius-devel/util/log.h>
 
 #include <sys/types.h>
-#include <sys/event.h>
+#include <freeradius-devel/util/event.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,7 +33,7 @@ RCSID("$Id$")
 
 #include <fcntl.h>
 #include <string.h>
-#include <sys/event.h>
+#include <freeradius-devel/util/event.h>
 
 #define FR_CONTROL_MAX_TYPES	(32)
 
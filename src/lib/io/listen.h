@@ -50,6 +50,9 @@ struct fr_listen {
 
 	size_t			default_message_size;	//!< copied from app_io, but may be changed
 	size_t			num_messages;		//!< for the message ring buffer
+
+	uint32_t		shard;			//!< which socket this is, when multiple SO_REUSEPORT
+							///< sockets are bound to the same address and port.
 };
 
 /**
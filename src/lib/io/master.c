@@ -114,6 +114,8 @@ struct fr_io_client_s {
 	fr_io_thread_t			*thread;
 	fr_event_timer_t const		*ev;		//!< when we clean up the client
 	fr_rb_tree_t			*table;		//!< tracking table for packets
+	fr_hash_table_t			*hash;		//!< tracking table for packets, used instead of
+							///< "table" if the application can hash them.
 
 	fr_heap_t			*pending;	//!< pending packets for this client
 	fr_hash_table_t			*addresses;	//!< list of src/dst addresses used by this client
@@ -174,12 +176,38 @@ static int track_free(fr_io_track_t *track)
 	return 0;
 }
 
+/*
+ *	The tracking table is either a hash table, or an rbtree,
+ *	depending on whether or not the application can hash
+ *	tracking structures.
+ */
+static inline CC_HINT(always_inline) fr_io_track_t *track_table_find(fr_io_client_t *client, fr_io_track_t const *track)
+{
+	if (client->hash) return fr_hash_table_find(client->hash, track);
+
+	return fr_rb_find(client->table, track);
+}
+
+static inline CC_HINT(always_inline) bool track_table_insert(fr_io_client_t *client, fr_io_track_t *track)
+{
+	if (client->hash) return fr_hash_table_insert(client->hash, track);
+
+	return fr_rb_insert(client->table, track);
+}
+
+static inline CC_HINT(always_inline) bool track_table_delete(fr_io_client_t *client, fr_io_track_t *track)
+{
+	if (client->hash) return fr_hash_table_delete(client->hash, track);
+
+	return fr_rb_delete(client->table, track);
+}
+
 static int track_dedup_free(fr_io_track_t *track)
 {
-	fr_assert(track->client->table != NULL);
-	fr_assert(fr_rb_find(track->client->table, track) != NULL);
+	fr_assert((track->client->table != NULL) || (track->client->hash != NULL));
+	fr_assert(track_table_find(track->client, track) != NULL);
 
-	if (!fr_rb_delete(track->client->table, track)) {
+	if (!track_table_delete(track->client, track)) {
 		fr_assert(0);
 	}
 
@@ -307,6 +335,76 @@ static int8_t track_cmp(void const *one, void const *two)
 }
 
 
+/*
+ *	Hash the fields which are checked by fr_ipaddr_cmp().
+ */
+static uint32_t ipaddr_hash(fr_ipaddr_t const *ipaddr, uint32_t hash)
+{
+	size_t len = ((ipaddr->prefix + 7) & -8) >> 3;
+
+	hash = fr_hash_update(&ipaddr->af, sizeof(ipaddr->af), hash);
+	hash = fr_hash_update(&ipaddr->prefix, sizeof(ipaddr->prefix), hash);
+
+	switch (ipaddr->af) {
+	case AF_INET:
+		return fr_hash_update(&ipaddr->addr.v4, len, hash);
+
+#ifdef HAVE_STRUCT_SOCKADDR_IN6
+	case AF_INET6:
+		hash = fr_hash_update(&ipaddr->scope_id, sizeof(ipaddr->scope_id), hash);
+		return fr_hash_update(&ipaddr->addr.v6, len, hash);
+#endif
+
+	default:
+		return hash;
+	}
+}
+
+/*
+ *	Hash the fields which are checked by address_cmp().
+ */
+static uint32_t address_hash(fr_io_address_t const *address, uint32_t hash)
+{
+	hash = fr_hash_update(&address->socket.inet.src_port, sizeof(address->socket.inet.src_port), hash);
+	hash = fr_hash_update(&address->socket.inet.dst_port, sizeof(address->socket.inet.dst_port), hash);
+	hash = fr_hash_update(&address->socket.inet.ifindex, sizeof(address->socket.inet.ifindex), hash);
+	hash = ipaddr_hash(&address->socket.inet.src_ipaddr, hash);
+
+	return ipaddr_hash(&address->socket.inet.dst_ipaddr, hash);
+}
+
+static uint32_t track_hash(void const *one)
+{
+	fr_io_track_t const *a = talloc_get_type_abort_const(one, fr_io_track_t);
+	uint32_t hash;
+
+	fr_assert(a->client != NULL);
+	fr_assert(!a->client->connection);
+
+	/*
+	 *	Unconnected sockets must hash src/dst ip/port.
+	 */
+	hash = a->client->inst->app_io->track_hash(a->client->inst->app_io_instance,
+						   a->client->thread->child->thread_instance,
+						   a->client->radclient,
+						   a->packet);
+
+	return address_hash(a->address, hash);
+}
+
+static uint32_t track_connected_hash(void const *one)
+{
+	fr_io_track_t const *a = talloc_get_type_abort_const(one, fr_io_track_t);
+
+	fr_assert(a->client != NULL);
+	fr_assert(a->client->connection);
+
+	return a->client->inst->app_io->track_hash(a->client->inst->app_io_instance,
+						   a->client->connection->child->thread_instance,
+						   a->client->connection->client->radclient,
+						   a->packet);
+}
+
 static int8_t track_connected_cmp(void const *one, void const *two)
 {
 	fr_io_track_t const *a = talloc_get_type_abort_const(one, fr_io_track_t);
@@ -580,8 +678,13 @@ static fr_io_connection_t *fr_io_connection_alloc(fr_io_instance_t const *inst,
 	 *	#todo - unify the code with static clients?
 	 */
 	if (inst->app_io->track_duplicates) {
-		MEM(connection->client->table = fr_rb_inline_talloc_alloc(client, fr_io_track_t, node,
-									  track_connected_cmp, NULL));
+		if (inst->app_io->track_hash) {
+			MEM(connection->client->hash = fr_hash_table_alloc(client, track_connected_hash,
+									   track_connected_cmp, NULL));
+		} else {
+			MEM(connection->client->table = fr_rb_inline_talloc_alloc(client, fr_io_track_t, node,
+										  track_connected_cmp, NULL));
+		}
 	}
 
 	/*
@@ -980,7 +1083,12 @@ static fr_io_client_t *client_alloc(TALLOC_CTX *ctx, fr_io_client_state_t state,
 	 */
 	if (inst->app_io->track_duplicates) {
 		fr_assert(inst->app_io->track_compare != NULL);
-		MEM(client->table = fr_rb_inline_talloc_alloc(client, fr_io_track_t, node, track_cmp, NULL));
+
+		if (inst->app_io->track_hash) {
+			MEM(client->hash = fr_hash_table_alloc(client, track_hash, track_cmp, NULL));
+		} else {
+			MEM(client->table = fr_rb_inline_talloc_alloc(client, fr_io_track_t, node, track_cmp, NULL));
+		}
 	}
 
 	/*
@@ -1081,7 +1189,7 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 	/*
 	 *	No existing duplicate.  Return the new tracking entry.
 	 */
-	old = fr_rb_find(client->table, track);
+	old = track_table_find(client, track);
 	if (!old) goto do_insert;
 
 	fr_assert(old->client == client);
@@ -1150,7 +1258,7 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 	} else {
 		fr_assert(client == old->client);
 
-		if (!fr_rb_delete(client->table, old)) {
+		if (!track_table_delete(client, old)) {
 			fr_assert(0);
 		}
 		if (old->ev) (void) fr_event_timer_delete(&old->ev);
@@ -1161,7 +1269,7 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 	}
 
 do_insert:
-	if (!fr_rb_insert(client->table, track)) {
+	if (!track_table_insert(client, track)) {
 		fr_assert(0);
 	}
 
@@ -1813,6 +1921,22 @@ have_client:
 	return 0;
 }
 
+/** Return how many packets the child socket has buffered.
+ *
+ */
+static unsigned int mod_read_pending(fr_listen_t *li)
+{
+	fr_io_instance_t const	*inst;
+	fr_io_connection_t	*connection;
+	fr_listen_t		*child;
+
+	get_inst(li, &inst, NULL, &connection, &child);
+
+	if (!inst->app_io->read_pending) return 0;
+
+	return inst->app_io->read_pending(child);
+}
+
 /** Inject a packet to a connection.
  *
  *  Always called in the context of the network.
@@ -2346,6 +2470,7 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, fr_time_t request_ti
 		client->state = PR_CLIENT_NAK;
 		TALLOC_FREE(client->pending);
 		if (client->table) TALLOC_FREE(client->table);
+		if (client->hash) TALLOC_FREE(client->hash);
 		fr_assert(client->packets == 0);
 
 		/*
@@ -2679,6 +2804,11 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		inst->app_io->network_get(&inst->ipproto, &inst->dynamic_clients, &inst->networks, inst->app_io_instance);
 	}
 
+	if ((inst->num_shards > 1) && (inst->ipproto != IPPROTO_UDP)) {
+		cf_log_err(conf, "'num_shards' can only be used with UDP sockets");
+		return -1;
+	}
+
 	if ((inst->ipproto == IPPROTO_TCP) && !inst->app_io->connection_set) {
 		cf_log_err(inst->app_io_conf, "Missing 'connection set' API for proto_%s", inst->app_io->common.name);
 		return -1;
@@ -2922,25 +3052,23 @@ int fr_io_listen_free(fr_listen_t *li)
 	return 0;
 }
 
-int fr_master_io_listen(fr_io_instance_t *inst, fr_schedule_t *sc,
-			size_t default_message_size, size_t num_messages)
+/** Open one socket for a listener, and add it to the scheduler
+ *
+ * @param[in] inst			of the master IO handler.
+ * @param[in] sc			to add the socket to.
+ * @param[in] default_message_size	for the message ring buffer.
+ * @param[in] num_messages		for the message ring buffer.
+ * @param[in] shard			which SO_REUSEPORT socket this is.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int master_io_listen_shard(fr_io_instance_t *inst, fr_schedule_t *sc,
+				  size_t default_message_size, size_t num_messages, uint32_t shard)
 {
 	fr_listen_t	*li, *child;
 	fr_io_thread_t	*thread;
 
-	/*
-	 *	No IO paths, so we don't initialize them.
-	 */
-	if (!inst->app_io) {
-		fr_assert(!inst->dynamic_clients);
-		return 0;
-	}
-
-	if (!inst->app_io->common.thread_inst_size) {
-		fr_strerror_const("IO modules MUST set 'thread_inst_size' when using the master IO handler.");
-		return -1;
-	}
-
 	/*
 	 *	Build the #fr_listen_t.  This describes the complete
 	 *	path data takes from the socket to the decoder and
@@ -2964,6 +3092,7 @@ int fr_master_io_listen(fr_io_instance_t *inst, fr_schedule_t *sc,
 	li->app = inst->app;
 	li->app_instance = inst->app_instance;
 	li->server_cs = inst->server_cs;
+	li->shard = shard;
 
 	/*
 	 *	Set configurable parameters for message ring buffer.
@@ -3055,9 +3184,11 @@ int fr_master_io_listen(fr_io_instance_t *inst, fr_schedule_t *sc,
 	li->name = child->name;
 
 	/*
-	 *	Record which socket we opened.
+	 *	Record which socket we opened.  The other shards are
+	 *	bound to the same address and port, so we only check
+	 *	the first one.
 	 */
-	if (child->app_io_addr) {
+	if (child->app_io_addr && (shard == 0)) {
 		fr_listen_t *other;
 
 		other = listen_find_any(thread->child);
@@ -3086,6 +3217,40 @@ int fr_master_io_listen(fr_io_instance_t *inst, fr_schedule_t *sc,
 	return 0;
 }
 
+int fr_master_io_listen(fr_io_instance_t *inst, fr_schedule_t *sc,
+			size_t default_message_size, size_t num_messages)
+{
+	uint32_t	i, num_shards;
+
+	/*
+	 *	No IO paths, so we don't initialize them.
+	 */
+	if (!inst->app_io) {
+		fr_assert(!inst->dynamic_clients);
+		return 0;
+	}
+
+	if (!inst->app_io->common.thread_inst_size) {
+		fr_strerror_const("IO modules MUST set 'thread_inst_size' when using the master IO handler.");
+		return -1;
+	}
+
+	/*
+	 *	Open one SO_REUSEPORT socket per shard.  The kernel
+	 *	spreads the packets across the sockets, and the
+	 *	scheduler spreads the sockets across the network
+	 *	threads.  Each socket has its own client and tracking
+	 *	tables.
+	 */
+	num_shards = inst->num_shards ? inst->num_shards : 1;
+
+	for (i = 0; i < num_shards; i++) {
+		if (master_io_listen_shard(inst, sc, default_message_size, num_messages, i) < 0) return -1;
+	}
+
+	return 0;
+}
+
 /*
  *	Used to create a tracking structure for fr_network_sendto_worker()
  */
@@ -3141,6 +3306,7 @@ fr_app_io_t fr_master_app_io = {
 	.track_duplicates	= true,
 
 	.read			= mod_read,
+	.read_pending		= mod_read_pending,
 	.write			= mod_write,
 	.inject			= mod_inject,
 
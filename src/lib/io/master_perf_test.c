@@ -0,0 +1,189 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Performance tests for the master IO duplicate detection table
+ *
+ * Compares the rbtree, which is used when the application only
+ * provides track_compare(), with the hash table, which is used when it
+ * also provides track_hash().
+ *
+ * @file src/lib/io/master_perf_test.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void master_perf_init(void);
+#define TEST_INIT master_perf_init()
+
+#include <freeradius-devel/util/acutest.h>
+
+/*
+ *	This counterintuitive #include gives these separately-compiled tests
+ *	access to the tracking table, which master.h doesn't reveal
+ *	to those who #include it.
+ */
+#include "master.c"
+
+#define MASTER_PERF_DUPS	4		//!< Number of duplicate lookups per packet.
+
+static TALLOC_CTX	*autofree;
+
+static void master_perf_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+		fr_perror("master_perf_test");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_time_start();
+}
+
+/*
+ *	The same as proto_radius_udp.
+ */
+static int perf_track_compare(UNUSED void const *instance, UNUSED void *thread_instance, UNUSED fr_client_t *client,
+			      void const *one, void const *two)
+{
+	int ret;
+	uint8_t const *a = one;
+	uint8_t const *b = two;
+
+	ret = (a[1] < b[1]) - (a[1] > b[1]);
+	if (ret != 0) return ret;
+
+	return (a[0] < b[0]) - (a[0] > b[0]);
+}
+
+static uint32_t perf_track_hash(UNUSED void const *instance, UNUSED void *thread_instance, UNUSED fr_client_t *client,
+				void const *packet)
+{
+	return fr_hash(packet, 2);
+}
+
+static fr_app_io_t const perf_app_io = {
+	.common = {
+		.name = "perf",
+	},
+	.track_duplicates = true,
+	.track_compare = perf_track_compare,
+	.track_hash = perf_track_hash
+};
+
+/** Track "num" packets from one client, as an accounting NAS with many packets outstanding would send
+ *
+ * Every 256 packets use a new source port, so that all of them can be
+ * outstanding at the same time.  Each packet is looked up several
+ * times, as retransmissions would be, then removed.
+ */
+static void do_test_track(unsigned int num, unsigned int reps, bool hashed)
+{
+	fr_io_instance_t	inst = { .app_io = &perf_app_io };
+	fr_listen_t		child = { 0 };
+	fr_io_thread_t		thread = { .child = &child };
+	fr_client_t		radclient = { 0 };
+	fr_io_client_t		*client;
+	fr_io_track_t		**tracks;
+	fr_time_t		start, end;
+	fr_time_delta_t		used = fr_time_delta_wrap(0);
+	unsigned int		i, j, k, found = 0;
+
+	MEM(client = talloc_zero(autofree, fr_io_client_t));
+	client->inst = &inst;
+	client->thread = &thread;
+	client->radclient = &radclient;
+
+	MEM(tracks = talloc_zero_array(client, fr_io_track_t *, num));
+
+	for (i = 0; i < num; i++) {
+		fr_io_address_t *address;
+
+		MEM(address = talloc_zero(client, fr_io_address_t));
+		address->socket.inet.src_ipaddr = (fr_ipaddr_t){ .af = AF_INET, .prefix = 32,
+								 .addr.v4.s_addr = htonl(0x0a000001) };
+		address->socket.inet.dst_ipaddr = (fr_ipaddr_t){ .af = AF_INET, .prefix = 32,
+								 .addr.v4.s_addr = htonl(0x0a000002) };
+		address->socket.inet.src_port = 1024 + (i / 256);
+		address->socket.inet.dst_port = 1813;
+
+		MEM(tracks[i] = talloc_zero(client, fr_io_track_t));
+		tracks[i]->client = client;
+		tracks[i]->address = address;
+		MEM(tracks[i]->packet = talloc_zero_array(tracks[i], uint8_t, 2));
+		tracks[i]->packet[0] = FR_RADIUS_CODE_ACCOUNTING_REQUEST;
+		tracks[i]->packet[1] = i & 0xff;
+	}
+
+	for (i = 0; i < reps; i++) {
+		if (hashed) {
+			MEM(client->hash = fr_hash_table_alloc(client, track_hash, track_cmp, NULL));
+		} else {
+			MEM(client->table = fr_rb_inline_talloc_alloc(client, fr_io_track_t, node, track_cmp, NULL));
+		}
+
+		start = fr_time();
+		for (j = 0; j < num; j++) {
+			if (!track_table_find(client, tracks[j])) (void) track_table_insert(client, tracks[j]);
+		}
+		for (k = 0; k < MASTER_PERF_DUPS; k++) {
+			for (j = 0; j < num; j++) if (track_table_find(client, tracks[j])) found++;
+		}
+		for (j = 0; j < num; j++) (void) track_table_delete(client, tracks[j]);
+		end = fr_time();
+		used = fr_time_delta_add(used, fr_time_sub(end, start));
+
+		TALLOC_FREE(client->hash);
+		TALLOC_FREE(client->table);
+	}
+
+	talloc_free(client);
+
+	TEST_CHECK(found == (num * reps * MASTER_PERF_DUPS));
+	TEST_MSG("found=%u", found);
+
+	TEST_MSG_ALWAYS("table=%s", hashed ? "hash" : "rbtree");
+	TEST_MSG_ALWAYS("repetitions=%u", reps);
+	TEST_MSG_ALWAYS("packets=%u", num);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * num * (MASTER_PERF_DUPS + 2))/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+#define test_func(_table, _hashed, _count) \
+static void test_ ## _table ## _ ## _count(void)\
+{\
+	do_test_track(_count, 1000000 / _count, _hashed);\
+}
+
+#define test_funcs(_table, _hashed) \
+	test_func(_table, _hashed, 100) \
+	test_func(_table, _hashed, 1000) \
+	test_func(_table, _hashed, 10000) \
+	test_func(_table, _hashed, 100000)
+
+test_funcs(rbtree, false)
+test_funcs(hash, true)
+
+#define count_tests(_table) \
+	{ #_table "_100", test_ ## _table ## _100},\
+	{ #_table "_1000", test_ ## _table ## _1000},\
+	{ #_table "_10000", test_ ## _table ## _10000},\
+	{ #_table "_100000", test_ ## _table ## _100000},\
+
+TEST_LIST = {
+	count_tests(rbtree)
+	count_tests(hash)
+
+	{ NULL }
+};
@@ -0,0 +1,7 @@
+TARGET		:= master_perf_test$(E)
+SOURCES		:= master_perf_test.c
+
+TGT_LDLIBS	:= $(LIBS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-io$(L)
+
+TGT_INSTALLDIR	:=
@@ -64,6 +64,7 @@ typedef struct {
 	fr_time_delta_t		predicted;		//!< predicted processing time for one packet
 
 	bool			blocked;		//!< is this worker blocked?
+	bool			local;			//!< is this worker on our NUMA node?
 
 	fr_channel_t		*channel;		//!< channel to the worker
 	fr_worker_t		*worker;		//!< worker pointer
@@ -108,6 +109,11 @@ typedef struct {
  *	"Power of Two-Choices" and
  *	https://www.eecs.harvard.edu/~michaelm/postscripts/mythesis.pdf
  *	https://www.eecs.harvard.edu/~michaelm/postscripts/tpds2001.pdf
+ *
+ *	When the threads are pinned to CPUs on more than one NUMA
+ *	node, we prefer the workers on our own node, so that packets
+ *	don't cross the interconnect.  We only send packets to a
+ *	remote worker when the local ones are much busier.
  */
 struct fr_network_s {
 	char const		*name;			//!< Network ID for logging.
@@ -140,6 +146,9 @@ struct fr_network_s {
 	int			max_workers;		//!< maximum number of allowed workers
 	int			num_sockets;		//!< actually a counter...
 
+	int			numa_node;		//!< NUMA node we're running on, or -1 for unknown.
+	int			num_local;		//!< number of workers on our NUMA node.
+
 	int			signal_pipe[2];		//!< Pipe for signalling the worker in an orderly way.
 							///< This is more deterministic than using async signals.
 
@@ -147,6 +156,7 @@ struct fr_network_s {
 
 	fr_network_config_t	config;			//!< configuration
 	fr_network_worker_t	*workers[MAX_WORKERS]; 	//!< each worker
+	fr_network_worker_t	*local[MAX_WORKERS];	//!< workers on our NUMA node
 };
 
 static void fr_network_post_event(fr_event_list_t *el, fr_time_t now, void *uctx);
@@ -508,6 +518,32 @@ static void fr_network_recv_reply(void *ctx, fr_channel_t *ch, fr_channel_data_t
 	}
 }
 
+/** Rebuild the list of workers which are on the same NUMA node as the network
+ *
+ * If we don't know where we're running, or if all of the workers are
+ * local, then the list is left empty, and we choose from all workers.
+ *
+ * @param nr the network
+ */
+static void fr_network_workers_local(fr_network_t *nr)
+{
+	int i;
+
+	nr->num_local = 0;
+	if (nr->numa_node < 0) return;
+
+	for (i = 0; i < nr->num_workers; i++) {
+		fr_network_worker_t *w = nr->workers[i];
+
+		if (!w) continue;
+
+		w->local = (fr_worker_numa_node(w->worker) == nr->numa_node);
+		if (w->local) nr->local[nr->num_local++] = w;
+	}
+
+	if (nr->num_local == nr->num_workers) nr->num_local = 0;
+}
+
 /** Handle a network control message callback for a channel
  *
  * This is called from the event loop when we get a notification
@@ -574,6 +610,7 @@ static void fr_network_channel_callback(void *ctx, void const *data, size_t data
 			}
 		}
 		nr->num_workers--;
+		fr_network_workers_local(nr);
 	}
 		break;
 	}
@@ -604,12 +641,28 @@ retry:
 		}
 
 	} else if (nr->num_blocked == 0) {
+		fr_network_worker_t **workers = nr->workers;
+		int num_workers = nr->num_workers;
 		int64_t cmp;
 		uint32_t one, two;
 
-		one = fr_rand() % nr->num_workers;
+		/*
+		 *	Choose from the workers on our NUMA node, if
+		 *	there are any.
+		 */
+		if (nr->num_local > 0) {
+			workers = nr->local;
+			num_workers = nr->num_local;
+		}
+
+		if (num_workers == 1) {
+			worker = workers[0];
+			goto check_remote;
+		}
+
+		one = fr_rand() % num_workers;
 		do {
-			two = fr_rand() % nr->num_workers;
+			two = fr_rand() % num_workers;
 		} while (two == one);
 
 		/*
@@ -620,18 +673,30 @@ retry:
 		 *	outstanding requests, then choose the worker
 		 *	which has used the least total CPU time.
 		 */
-		cmp = (OUTSTANDING(nr->workers[one]) - OUTSTANDING(nr->workers[two]));
+		cmp = (OUTSTANDING(workers[one]) - OUTSTANDING(workers[two]));
 		if (cmp < 0) {
-			worker = nr->workers[one];
+			worker = workers[one];
 
 		} else if (cmp > 0) {
-			worker = nr->workers[two];
+			worker = workers[two];
 
-		} else if (fr_time_delta_lt(nr->workers[one]->cpu_time, nr->workers[two]->cpu_time)) {
-			worker = nr->workers[one];
+		} else if (fr_time_delta_lt(workers[one]->cpu_time, workers[two]->cpu_time)) {
+			worker = workers[one];
 
 		} else {
-			worker = nr->workers[two];
+			worker = workers[two];
+		}
+
+	check_remote:
+		/*
+		 *	The local workers are much busier than a
+		 *	random one.  Send the packet to that one
+		 *	instead, even if it's on another node.
+		 */
+		if (workers != nr->workers) {
+			fr_network_worker_t *other = nr->workers[fr_rand() % nr->num_workers];
+
+			if ((OUTSTANDING(other) * 2) < OUTSTANDING(worker)) worker = other;
 		}
 	} else {
 		int i;
@@ -877,8 +942,15 @@ next_message:
 	/*
 	 *	Poll this socket, but not too often.  We have to go
 	 *	service other sockets, too.
+	 *
+	 *	Unless the IO path still has packets buffered from
+	 *	a batched read.  The socket may not become readable
+	 *	again, so they'd never be read.  There are at most
+	 *	"recv_batch" of them, and reading them doesn't touch
+	 *	the socket.
 	 */
-	if (num_messages > 16) {
+	if ((num_messages > 16) &&
+	    (!s->listen->app_io->read_pending || (s->listen->app_io->read_pending(s->listen) == 0))) {
 		s->cd = cd;
 		return;
 	}
@@ -908,7 +980,14 @@ next_message:
 		 *	Since we have a message set for each
 		 *	fr_io_socket_t, no "head of line"
 		 *	blocking issues can happen for stream sockets.
+		 *
+		 *	If the packet was discarded, but the IO path
+		 *	still has buffered packets, read those now.
+		 *	The socket may not become readable again.
 		 */
+		if (s->listen->app_io->read_pending &&
+		    (s->listen->app_io->read_pending(s->listen) > 0)) goto next_message;
+
 		s->cd = cd;
 		return;
 	}
@@ -1012,6 +1091,27 @@ next_message:
 		num_messages++;
 		goto next_message;
 	}
+
+	/*
+	 *	The IO path read multiple datagrams with one system
+	 *	call.  Hand all of them to the workers now, as the
+	 *	socket may not become readable again.
+	 *
+	 *	We don't count these against the limit above, as the
+	 *	number of buffered packets is already bounded by the
+	 *	IO path.
+	 */
+	if (s->listen->app_io->read_pending &&
+	    (s->listen->app_io->read_pending(s->listen) > 0)) {
+		cd = (fr_channel_data_t *) fr_message_reserve(s->ms, s->listen->default_message_size);
+		if (!cd) {
+			ERROR("Failed allocating message size %zd! - Closing socket",
+			      s->listen->default_message_size);
+			fr_network_socket_dead(nr, s);
+			return;
+		}
+		goto next_message;
+	}
 }
 
 int fr_network_sendto_worker(fr_network_t *nr, fr_listen_t *li, void *packet_ctx, uint8_t const *data, size_t data_len, fr_time_t recv_time)
@@ -1523,6 +1623,7 @@ static void fr_network_worker_started_callback(void *ctx, void const *data, size
 		if (nr->workers[i]) continue;
 
 		nr->workers[i] = w;
+		fr_network_workers_local(nr);
 		return;
 	}
 
@@ -1887,6 +1988,7 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const
 	nr->lvl = lvl;
 
 	nr->max_workers = MAX_WORKERS;
+	nr->numa_node = -1;
 	nr->num_workers = 0;
 	nr->signal_pipe[0] = -1;
 	nr->signal_pipe[1] = -1;
@@ -1991,6 +2093,19 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const
 	return nr;
 }
 
+/** Tell the network which NUMA node it's running on
+ *
+ * Must be called from the network thread.
+ *
+ * @param nr	the network
+ * @param node	NUMA node, or -1 for unknown.
+ */
+void fr_network_numa_node_set(fr_network_t *nr, int node)
+{
+	nr->numa_node = node;
+	fr_network_workers_local(nr);
+}
+
 int fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats)
 {
 	if (num < 0) return -1;
@@ -78,6 +78,8 @@ int		fr_network_destroy(fr_network_t *nr) CC_HINT(nonnull);
 
 void		fr_network(fr_network_t *nr) CC_HINT(nonnull);
 
+void		fr_network_numa_node_set(fr_network_t *nr, int node) CC_HINT(nonnull);
+
 int		fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats) CC_HINT(nonnull);
 
 void		fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log) CC_HINT(nonnull);
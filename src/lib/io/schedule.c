@@ -28,6 +28,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/autoconf.h>
 
+#include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/io/schedule.h>
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/rb.h>
@@ -35,6 +36,11 @@ RCSID("$Id$")
 #include <freeradius-devel/server/trigger.h>
 
 #include <pthread.h>
+#include <dirent.h>
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif
 
 /*
  *	Other OS's have sem_init, OS X doesn't.
@@ -87,6 +93,8 @@ typedef struct {
 
 	unsigned int	id;			//!< a unique ID
 	int		uses;			//!< how many network threads are using it
+	int		cpu;			//!< CPU we're pinned to, or -1 for none
+	int		numa_node;		//!< NUMA node of that CPU, or -1 for unknown
 	fr_time_t	cpu_time;		//!< how much CPU time this worker has used
 
 	fr_dlist_t	entry;			//!< our entry into the linked list of workers
@@ -107,6 +115,8 @@ typedef struct {
 	pthread_t	pthread_id;		//!< the thread of this network
 
 	unsigned int	id;			//!< a unique ID
+	int		cpu;			//!< CPU we're pinned to, or -1 for none
+	int		numa_node;		//!< NUMA node of that CPU, or -1 for unknown
 
 	fr_dlist_t	entry;			//!< our entry into the linked list of networks
 
@@ -144,6 +154,9 @@ struct fr_schedule_s {
 	fr_dlist_head_t	workers;		//!< list of workers
 	fr_dlist_head_t	networks;		//!< list of networks
 
+	int		*worker_cpus;		//!< CPUs to pin workers to, or NULL
+	int		*network_cpus;		//!< CPUs to pin networks to, or NULL
+
 	fr_network_t	*single_network;	//!< for single-threaded mode
 	fr_worker_t	*single_worker;		//!< for single-threaded mode
 };
@@ -159,6 +172,141 @@ int fr_schedule_worker_id(void)
 	return worker_id;
 }
 
+/** Parse a list of CPUs, e.g. "0-3,8,10-11"
+ *
+ * @param[in] ctx	to allocate the array in.
+ * @param[out] out	array of CPU numbers, in the order given.
+ * @param[in] name	of the configuration item, for error messages.
+ * @param[in] str	to parse.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int fr_schedule_cpus_parse(TALLOC_CTX *ctx, int **out, char const *name, char const *str)
+{
+	char const	*p = str;
+	int		*cpus;
+	size_t		num = 0;
+
+	MEM(cpus = talloc_array(ctx, int, 0));
+
+	while (*p) {
+		char		*end;
+		unsigned long	first, last;
+
+		first = last = strtoul(p, &end, 10);
+		if (end == p) goto invalid;
+		p = end;
+
+		if (*p == '-') {
+			p++;
+			last = strtoul(p, &end, 10);
+			if ((end == p) || (last < first)) goto invalid;
+			p = end;
+		}
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+		if (last >= CPU_SETSIZE) {
+			fr_strerror_printf("Invalid value for '%s' - CPU %lu is larger than the maximum of %u",
+					   name, last, CPU_SETSIZE - 1);
+			talloc_free(cpus);
+			return -1;
+		}
+#endif
+
+		MEM(cpus = talloc_realloc(ctx, cpus, int, num + (last - first) + 1));
+		while (first <= last) cpus[num++] = (int)first++;
+
+		if (!*p) break;
+
+		if (*p != ',') {
+		invalid:
+			fr_strerror_printf("Invalid value for '%s' - Expected a list of CPUs such as \"0-3,8\", "
+					   "got \"%s\"", name, str);
+			talloc_free(cpus);
+			return -1;
+		}
+		p++;
+		if (!*p) goto invalid;
+	}
+
+	if (!num) goto invalid;
+
+	*out = cpus;
+	return 0;
+}
+
+/** Return the NUMA node which a CPU belongs to
+ *
+ * Linux puts a "nodeN" link into the sysfs directory for each CPU.
+ *
+ * @param[in] cpu	to look up.
+ * @return
+ *	- the NUMA node.
+ *	- -1 if we can't tell.
+ */
+static int fr_schedule_numa_node(int cpu)
+{
+	char		path[64];
+	DIR		*dir;
+	struct dirent	*dp;
+	int		node = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+	dir = opendir(path);
+	if (!dir) return -1;
+
+	while ((dp = readdir(dir)) != NULL) {
+		char *end;
+
+		if (strncmp(dp->d_name, "node", 4) != 0) continue;
+
+		node = strtol(dp->d_name + 4, &end, 10);
+		if ((end == dp->d_name + 4) || *end) {
+			node = -1;
+			continue;
+		}
+		break;
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/** Pin the calling thread to a CPU
+ *
+ * This is done before the thread allocates anything, so that
+ * (with the default first-touch policy) its memory comes from
+ * the CPU's NUMA node.
+ *
+ * @param[in] cpu	to pin the thread to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int fr_schedule_thread_pin(int cpu)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t	set;
+	int		ret;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret != 0) {
+		fr_strerror_printf("Failed pinning thread to CPU %d: %s", cpu, fr_syserror(ret));
+		return -1;
+	}
+
+	return 0;
+#else
+	fr_strerror_printf("Failed pinning thread to CPU %d: Not supported on this platform", cpu);
+	return -1;
+#endif
+}
+
 /** Entry point for worker threads
  *
  * @param[in] arg	the fr_schedule_worker_t
@@ -166,7 +314,7 @@ int fr_schedule_worker_id(void)
  */
 static void *fr_schedule_worker_thread(void *arg)
 {
-	TALLOC_CTX			*ctx;
+	TALLOC_CTX			*ctx = NULL;
 	fr_schedule_worker_t		*sw = talloc_get_type_abort(arg, fr_schedule_worker_t);
 	fr_schedule_t			*sc = sw->sc;
 	fr_schedule_child_status_t	status = FR_CHILD_FAIL;
@@ -204,6 +352,14 @@ static void *fr_schedule_worker_thread(void *arg)
 
 	snprintf(worker_name, sizeof(worker_name), "Worker %d", sw->id);
 
+	if (sw->cpu >= 0) {
+		if (fr_schedule_thread_pin(sw->cpu) < 0) {
+			PERROR("%s - Failed setting CPU affinity", worker_name);
+			goto fail;
+		}
+		DEBUG2("%s - Pinned to CPU %d (NUMA node %d)", worker_name, sw->cpu, sw->numa_node);
+	}
+
 	sw->ctx = ctx = talloc_init("%s", worker_name);
 	if (!ctx) {
 		ERROR("%s - Failed allocating memory", worker_name);
@@ -218,12 +374,18 @@ static void *fr_schedule_worker_thread(void *arg)
 		goto fail;
 	}
 
+	if (fr_event_list_timer_wheel(sw->el, sc->config->timer_wheel_tick) < 0) {
+		PERROR("%s - Failed creating timer wheel", worker_name);
+		goto fail;
+	}
+
 
 	sw->worker = fr_worker_create(ctx, sw->el, worker_name, sc->log, sc->lvl, &sc->config->worker);
 	if (!sw->worker) {
 		PERROR("%s - Failed creating worker", worker_name);
 		goto fail;
 	}
+	fr_worker_numa_node_set(sw->worker, sw->numa_node);
 
 	/*
 	 *	@todo make this a registry
@@ -314,7 +476,7 @@ static void stats_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
  */
 static void *fr_schedule_network_thread(void *arg)
 {
-	TALLOC_CTX			*ctx;
+	TALLOC_CTX			*ctx = NULL;
 	fr_schedule_network_t		*sn = talloc_get_type_abort(arg, fr_schedule_network_t);
 	fr_schedule_t			*sc = sn->sc;
 	fr_schedule_child_status_t	status = FR_CHILD_FAIL;
@@ -352,6 +514,14 @@ static void *fr_schedule_network_thread(void *arg)
 
 	INFO("%s - Starting", network_name);
 
+	if (sn->cpu >= 0) {
+		if (fr_schedule_thread_pin(sn->cpu) < 0) {
+			PERROR("%s - Failed setting CPU affinity", network_name);
+			goto fail;
+		}
+		DEBUG2("%s - Pinned to CPU %d (NUMA node %d)", network_name, sn->cpu, sn->numa_node);
+	}
+
 	sn->ctx = ctx = talloc_init("%s", network_name);
 	if (!ctx) {
 		ERROR("%s - Failed allocating memory", network_name);
@@ -364,11 +534,17 @@ static void *fr_schedule_network_thread(void *arg)
 		goto fail;
 	}
 
+	if (fr_event_list_timer_wheel(el, sc->config->timer_wheel_tick) < 0) {
+		PERROR("%s - Failed creating timer wheel", network_name);
+		goto fail;
+	}
+
 	sn->nr = fr_network_create(ctx, el, network_name, sc->log, sc->lvl, &sc->config->network);
 	if (!sn->nr) {
 		PERROR("%s - Failed creating network", network_name);
 		goto fail;
 	}
+	fr_network_numa_node_set(sn->nr, sn->numa_node);
 
 	sn->status = FR_CHILD_RUNNING;
 
@@ -570,6 +746,30 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		if (sc->config->max_workers > 64) sc->config->max_workers = 64;
 	}
 
+	/*
+	 *	Threads are pinned to the listed CPUs in turn.  If
+	 *	there are more threads than CPUs, we wrap around.
+	 */
+	if (sc->config->network_cpus &&
+	    (fr_schedule_cpus_parse(sc, &sc->network_cpus, "network_cpus", sc->config->network_cpus) < 0)) {
+	cpus_fail:
+		PERROR("Failed configuring CPU affinity");
+		talloc_free(sc);
+		return NULL;
+	}
+
+	if (sc->config->worker_cpus &&
+	    (fr_schedule_cpus_parse(sc, &sc->worker_cpus, "worker_cpus", sc->config->worker_cpus) < 0)) {
+		goto cpus_fail;
+	}
+
+#ifndef HAVE_PTHREAD_SETAFFINITY_NP
+	if (sc->network_cpus || sc->worker_cpus) {
+		fr_strerror_const("Setting thread CPU affinity is not supported on this platform");
+		goto cpus_fail;
+	}
+#endif
+
 	/*
 	 *	Create the lists which hold the workers and networks.
 	 */
@@ -607,6 +807,8 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 
 		sn->id = i;
 		sn->sc = sc;
+		sn->cpu = sc->network_cpus ? sc->network_cpus[i % talloc_array_length(sc->network_cpus)] : -1;
+		sn->numa_node = (sn->cpu >= 0) ? fr_schedule_numa_node(sn->cpu) : -1;
 		sn->status = FR_CHILD_INITIALIZING;
 		fr_dlist_insert_head(&sc->networks, sn);
 
@@ -666,6 +868,8 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 
 		sw->id = i;
 		sw->sc = sc;
+		sw->cpu = sc->worker_cpus ? sc->worker_cpus[i % talloc_array_length(sc->worker_cpus)] : -1;
+		sw->numa_node = (sw->cpu >= 0) ? fr_schedule_numa_node(sw->cpu) : -1;
 		sw->status = FR_CHILD_INITIALIZING;
 		fr_dlist_insert_head(&sc->workers, sw);
 
@@ -884,12 +1088,21 @@ fr_network_t *fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li)
 		nr = sc->single_network;
 	} else {
 		fr_schedule_network_t *sn;
+		unsigned int i, n;
 
 		/*
+		 *	Listeners with multiple SO_REUSEPORT sockets
+		 *	have one socket per network thread.
+		 *	Everything else goes to the first network.
+		 *
 		 *	@todo - round robin it among the listeners?
 		 *	or maybe add it to the same parent thread?
 		 */
 		sn = fr_dlist_head(&sc->networks);
+		n = li->shard % fr_dlist_num_elements(&sc->networks);
+
+		for (i = 0; i < n; i++) sn = fr_dlist_next(&sc->networks, sn);
+
 		nr = sn->nr;
 	}
 
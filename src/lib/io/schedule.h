@@ -68,6 +68,10 @@ typedef struct {
 	fr_network_config_t network;		//!< configuration for each network;
 
 	fr_time_delta_t	stats_interval;		//!< print channel statistics
+	fr_time_delta_t	timer_wheel_tick;	//!< granularity of the timer wheel, 0 to disable it
+
+	char const	*network_cpus;		//!< CPUs to pin network threads to, e.g. "0-3,8"
+	char const	*worker_cpus;		//!< CPUs to pin worker threads to
 } fr_schedule_config_t;
 
 int			fr_schedule_worker_id(void);
@@ -129,6 +129,8 @@ struct fr_worker_s {
 	bool			was_sleeping;	//!< used to suppress multiple sleep signals in a row
 	bool			exiting;	//!< are we exiting?
 
+	int			numa_node;	//!< NUMA node we're running on, or -1 for unknown.
+
 	fr_time_t		checked_timeout; //!< when we last checked the tails of the queues
 
 	fr_event_timer_t const	*ev_cleanup;	//!< timer for max_request_time
@@ -1366,6 +1368,7 @@ nomem:
 	}
 
 	worker->name = talloc_strdup(worker, name); /* thread locality */
+	worker->numa_node = -1;
 
 	unlang_thread_instantiate(worker);
 
@@ -1678,6 +1681,28 @@ static void worker_verify(fr_worker_t *worker)
 }
 #endif
 
+/** Tell the worker which NUMA node it's running on
+ *
+ * Must be called before the worker is added to any network.
+ *
+ * @param worker	the worker
+ * @param node		NUMA node, or -1 for unknown.
+ */
+void fr_worker_numa_node_set(fr_worker_t *worker, int node)
+{
+	worker->numa_node = node;
+}
+
+/** Return the NUMA node the worker is running on
+ *
+ * @param worker	the worker
+ * @return the NUMA node, or -1 for unknown.
+ */
+int fr_worker_numa_node(fr_worker_t const *worker)
+{
+	return worker->numa_node;
+}
+
 int fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats)
 {
 	if (num < 0) return -1;
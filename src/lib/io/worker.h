@@ -83,6 +83,10 @@ void		fr_worker_post_event(fr_event_list_t *el, fr_time_t now, void *uctx);
 
 fr_channel_t	*fr_worker_channel_create(fr_worker_t *worker, TALLOC_CTX *ctx, fr_control_t *master) CC_HINT(nonnull);
 
+void		fr_worker_numa_node_set(fr_worker_t *worker, int node) CC_HINT(nonnull);
+
+int		fr_worker_numa_node(fr_worker_t const *worker) CC_HINT(nonnull);
+
 int		fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats) CC_HINT(nonnull);
 
 int		fr_worker_listen_cancel(fr_worker_t *worker, fr_listen_t const *li);
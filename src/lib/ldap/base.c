@@ -610,6 +610,203 @@ static void ldap_trunk_search_results_debug(request_t *request, fr_ldap_query_t
 	REXDENT();
 }
 
+/** A search which is in progress, and the identical searches waiting on its results
+ *
+ */
+struct fr_ldap_shared_search_s {
+	fr_rb_node_t		node;			//!< Entry in the trunk's tree of searches in progress.
+	fr_ldap_thread_trunk_t	*ttrunk;		//!< Trunk the search was submitted to.
+	fr_ldap_query_t		*leader;		//!< The query which was sent to the server.
+							///< NULL once the results have been distributed.
+	fr_dlist_head_t		queries;		//!< All queries sharing the results, including the leader.
+	LDAPMessage		*result;		//!< Results shared between the queries.
+};
+
+/** Compare two arrays of attribute names
+ *
+ */
+static int8_t ldap_attrs_cmp(char const * const *a, char const * const *b)
+{
+	int ret;
+
+	if (a == b) return 0;
+	if (!a) return -1;
+	if (!b) return 1;
+
+	for (; *a && *b; a++, b++) {
+		ret = strcmp(*a, *b);
+		if (ret != 0) return CMP(ret, 0);
+	}
+
+	return CMP(*a != NULL, *b != NULL);
+}
+
+/** Compare two searches, by the parameters which determine their results
+ *
+ */
+static int8_t ldap_shared_search_cmp(void const *one, void const *two)
+{
+	fr_ldap_query_t const	*a = ((fr_ldap_shared_search_t const *)one)->leader;
+	fr_ldap_query_t const	*b = ((fr_ldap_shared_search_t const *)two)->leader;
+	int8_t			ret;
+
+	ret = CMP(a->search.scope, b->search.scope);
+	if (ret != 0) return ret;
+
+	ret = CMP(strcmp(a->dn ? a->dn : "", b->dn ? b->dn : ""), 0);
+	if (ret != 0) return ret;
+
+	ret = CMP(strcmp(a->search.filter ? a->search.filter : "", b->search.filter ? b->search.filter : ""), 0);
+	if (ret != 0) return ret;
+
+	return ldap_attrs_cmp(a->search.attrs, b->search.attrs);
+}
+
+/** Fail all queries waiting on a shared search
+ *
+ */
+static void ldap_shared_search_fail(fr_ldap_shared_search_t *shared)
+{
+	fr_ldap_query_t *query = NULL;
+
+	if (fr_rb_node_inline_in_tree(&shared->node)) fr_rb_remove(shared->ttrunk->searches, shared);
+	shared->leader = NULL;
+
+	while ((query = fr_dlist_next(&shared->queries, query))) {
+		query->ret = LDAP_RESULT_ERROR;
+		if (query->request) unlang_interpret_mark_runnable(query->request);
+	}
+}
+
+/** Stop a query sharing the results of a search
+ *
+ * If the query was the one sent to the server, and the results haven't arrived,
+ * the next query in the list is sent in its place.
+ */
+static void ldap_shared_search_leave(fr_ldap_query_t *query)
+{
+	fr_ldap_shared_search_t	*shared = query->shared;
+	fr_ldap_query_t		*next;
+
+	fr_dlist_remove(&shared->queries, query);
+	query->shared = NULL;
+	query->request = NULL;
+
+	/*
+	 *	The results belong to the shared search.
+	 */
+	if (query->result == shared->result) query->result = NULL;
+
+	if (fr_dlist_num_elements(&shared->queries) == 0) {
+		if (fr_rb_node_inline_in_tree(&shared->node)) fr_rb_remove(shared->ttrunk->searches, shared);
+		if (shared->result) ldap_msgfree(shared->result);
+		talloc_free(shared);
+		return;
+	}
+
+	if (shared->leader != query) return;
+
+	/*
+	 *	The search is still in progress, but the
+	 *	request that sent it no longer wants the
+	 *	results.  Send one of the waiting queries
+	 *	instead.
+	 */
+	next = fr_dlist_head(&shared->queries);
+	shared->leader = next;
+
+	switch (trunk_request_enqueue(&next->treq, shared->ttrunk->trunk, next->request, next, NULL)) {
+	case TRUNK_ENQUEUE_OK:
+	case TRUNK_ENQUEUE_IN_BACKLOG:
+		break;
+
+	default:
+		ldap_shared_search_fail(shared);
+		break;
+	}
+}
+
+/** Join an identical search which is in progress, or start a new shared search
+ *
+ * @param[in] query	to share results with.
+ * @param[in] request	to resume when results arrive.
+ * @param[in] ttrunk	the search is being run on.
+ * @return
+ *	- true if the query is waiting on an existing search.
+ *	- false if the query is the first, and must be sent.
+ */
+static bool ldap_shared_search_join(fr_ldap_query_t *query, request_t *request, fr_ldap_thread_trunk_t *ttrunk)
+{
+	fr_ldap_shared_search_t	*shared, find = { .leader = query };
+
+	if (!ttrunk->searches) {
+		MEM(ttrunk->searches = fr_rb_inline_talloc_alloc(ttrunk, fr_ldap_shared_search_t, node,
+								  ldap_shared_search_cmp, NULL));
+	}
+
+	query->request = request;
+
+	shared = fr_rb_find(ttrunk->searches, &find);
+	if (shared) {
+		ROPTIONAL(RDEBUG2, DEBUG2, "Waiting on identical LDAP search already in progress");
+		fr_dlist_insert_tail(&shared->queries, query);
+		query->shared = shared;
+		return true;
+	}
+
+	/*
+	 *	Not parented by the trunk, as it must last
+	 *	as long as any of the queries using it.
+	 */
+	MEM(shared = talloc_zero(NULL, fr_ldap_shared_search_t));
+	shared->ttrunk = ttrunk;
+	shared->leader = query;
+	fr_dlist_talloc_init(&shared->queries, fr_ldap_query_t, shared_entry);
+	fr_dlist_insert_tail(&shared->queries, query);
+	fr_rb_insert(ttrunk->searches, shared);
+	query->shared = shared;
+
+	return false;
+}
+
+/** Pass the results of a shared search to all the queries waiting on it
+ *
+ * Called once the query which was sent to the server has its results, or has failed.
+ * Once this has been called, identical searches are sent to the server again.
+ *
+ * @param[in] query	which has completed.
+ */
+void fr_ldap_shared_search_complete(fr_ldap_query_t *query)
+{
+	fr_ldap_shared_search_t	*shared = query->shared;
+	fr_ldap_query_t		*waiting = NULL;
+
+	if (!shared || (shared->leader != query)) return;
+
+	fr_rb_remove(shared->ttrunk->searches, shared);
+	shared->leader = NULL;
+	shared->result = query->result;
+
+	while ((waiting = fr_dlist_next(&shared->queries, waiting))) {
+		if (waiting == query) continue;
+
+		waiting->ret = query->ret;
+		waiting->result = shared->result;
+
+		/*
+		 *	Results processing needs the handle, so
+		 *	the connection must last until the waiting
+		 *	query is done with it.
+		 */
+		if (query->ldap_conn) {
+			waiting->ldap_conn = query->ldap_conn;
+			fr_dlist_insert_tail(&waiting->ldap_conn->refs, waiting);
+		}
+
+		if (waiting->request) unlang_interpret_mark_runnable(waiting->request);
+	}
+}
+
 /** Handle the return code from parsed LDAP results to set the module rcode
  *
  */
@@ -643,6 +840,8 @@ static void ldap_trunk_query_cancel(UNUSED request_t *request, UNUSED fr_signal_
 {
 	fr_ldap_query_t	*query = talloc_get_type_abort(uctx, fr_ldap_query_t);
 
+	if (query->shared) ldap_shared_search_leave(query);
+
 	/*
 	 *	Query may have completed, but the request
 	 *	not yet have been resumed.
@@ -715,6 +914,13 @@ unlang_action_t fr_ldap_trunk_search(TALLOC_CTX *ctx,
 
 	query = fr_ldap_search_alloc(ctx, base_dn, scope, filter, attrs, serverctrls, clientctrls);
 
+	/*
+	 *	Controls may make the results specific to
+	 *	this query, so only plain searches are shared.
+	 */
+	if (ttrunk->config.coalesce_searches && !query->serverctrls[0].control && !query->clientctrls[0].control &&
+	    ldap_shared_search_join(query, request, ttrunk)) goto push;
+
 	switch (trunk_request_enqueue(&query->treq, ttrunk->trunk, request, query, NULL)) {
 	case TRUNK_ENQUEUE_OK:
 	case TRUNK_ENQUEUE_IN_BACKLOG:
@@ -727,6 +933,7 @@ unlang_action_t fr_ldap_trunk_search(TALLOC_CTX *ctx,
 		return UNLANG_ACTION_FAIL;
 	}
 
+push:
 	action = unlang_function_push(request, NULL, ldap_trunk_query_results,
 				      ldap_trunk_query_cancel, ~FR_SIGNAL_CANCEL, UNLANG_SUB_FRAME, query);
 
@@ -944,6 +1151,12 @@ static int _ldap_query_free(fr_ldap_query_t *query)
 {
 	int 	i;
 
+	/*
+	 *	Results shared with other queries are freed
+	 *	by the last query using them.
+	 */
+	if (query->shared) ldap_shared_search_leave(query);
+
 	/*
 	 *	Free any results which were retrieved
 	 */
@@ -310,6 +310,10 @@ typedef struct {
 	fr_time_delta_t		reconnection_delay;	//!< How long to wait before attempting to reconnect.
 
 	fr_time_delta_t		idle_timeout;		//!< How long to wait before closing unused connections.
+
+	bool			coalesce_searches;	//!< If an identical search is already in progress on
+							///< the same trunk, wait for its results instead of
+							///< sending another.
 } fr_ldap_config_t;
 
 /** libldap global configuration data
@@ -404,12 +408,17 @@ typedef struct fr_ldap_thread_trunk_s {
 	trunk_t			*trunk;			//!< Connection trunk
 	fr_ldap_thread_t	*t;			//!< Thread this connection is associated with
 	fr_event_timer_t const	*ev;			//!< Event to close the thread when it has been idle.
+	fr_rb_tree_t		*searches;		//!< Searches in progress which other requests
+							///< can wait on.  Only used if coalesce_searches
+							///< is set.
 } fr_ldap_thread_trunk_t;
 
 typedef struct fr_ldap_referral_s fr_ldap_referral_t;
 
 typedef struct fr_ldap_query_s fr_ldap_query_t;
 
+typedef struct fr_ldap_shared_search_s fr_ldap_shared_search_t;
+
 typedef void (*fr_ldap_result_parser_t)(LDAP *handle, fr_ldap_query_t *query, LDAPMessage *head, void *rctx);
 
 /** LDAP query structure
@@ -467,6 +476,11 @@ struct fr_ldap_query_s {
 	LDAPMessage		*result;		//!< Head of LDAP results list.
 
 	fr_ldap_result_code_t	ret;			//!< Result code
+
+	fr_ldap_shared_search_t	*shared;		//!< Identical searches this query is sharing
+							///< results with.
+	fr_dlist_t		shared_entry;		//!< Entry in the list of queries sharing results.
+	request_t		*request;		//!< Request to resume when shared results arrive.
 };
 
 /** Parsed LDAP referral structure
@@ -742,6 +756,8 @@ unlang_action_t fr_ldap_trunk_search(TALLOC_CTX *ctx,
 				     char const *base_dn, int scope, char const *filter, char const * const *attrs,
 				     LDAPControl **serverctrls, LDAPControl **clientctrls);
 
+void		fr_ldap_shared_search_complete(fr_ldap_query_t *query);
+
 unlang_action_t fr_ldap_trunk_modify(TALLOC_CTX *ctx,
 				     fr_ldap_query_t **out, request_t *request, fr_ldap_thread_trunk_t *ttrunk,
 				     char const *dn, LDAPMod *mods[],
@@ -108,5 +108,7 @@ conf_parser_t const fr_ldap_option_config[] = {
 
 	{ FR_CONF_OFFSET("reconnection_delay", fr_ldap_config_t, reconnection_delay), .dflt = "10" },
 
+	{ FR_CONF_OFFSET("coalesce_searches", fr_ldap_config_t, coalesce_searches), .dflt = "no" },
+
 	CONF_PARSER_TERMINATOR
 };
@@ -523,6 +523,11 @@ static void ldap_request_fail(request_t *request, void *preq, UNUSED void *rctx,
 	query->treq = NULL;
 	query->ret = LDAP_RESULT_ERROR;
 
+	/*
+	 *	Any identical searches waiting on this one fail too.
+	 */
+	if (query->shared) fr_ldap_shared_search_complete(query);
+
 	/*
 	 *	Ensure request is runnable.
 	 */
@@ -874,6 +879,12 @@ static void ldap_trunk_request_demux(fr_event_list_t *el, trunk_connection_t *tc
 		if (query->parser && (rcode == LDAP_PROC_SUCCESS)) query->parser(ldap_conn->handle, query,
 										 result, query->treq->rctx);
 
+		/*
+		 *	Pass the results to any identical searches
+		 *	waiting on this one.
+		 */
+		if (query->shared) fr_ldap_shared_search_complete(query);
+
 		/*
 		 *	Set the request as runnable
 		 */
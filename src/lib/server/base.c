@@ -86,6 +86,13 @@ int server_init(CONF_SECTION *cs)
 	 */
 	if (xlat_protocols_register() < 0) return -1;
 
+#ifdef HAVE_REGEX
+	/*
+	 *	Register the radmin commands for the runtime regex caches.
+	 */
+	if (regex_cache_init() < 0) return -1;
+#endif
+
 	/*
 	 *	And then load the virtual servers.
 	 */
@@ -193,6 +193,14 @@ void dependency_features_init(CONF_SECTION *cs)
 #endif
 				);
 
+	dependency_feature_add(cs, "event-epoll",
+#ifdef WITH_EVENT_EPOLL
+				true
+#else
+				false
+#endif
+				);
+
 	dependency_feature_add(cs, "regex-pcre",
 #ifdef HAVE_REGEX_PCRE
 				true
@@ -32,10 +32,17 @@
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/perm.h>
 #include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/table.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 typedef struct {
 	int			fd;			//!< File descriptor associated with an entry.
 	uint32_t		hash;			//!< Hash for cheap comparison.
@@ -570,3 +577,547 @@ int exfile_close(exfile_t *ef, int fd)
 	}
 	return exfile_close_lock(ef, fd);
 }
+
+/*
+ *	The writer thread.
+ *
+ *	Workers format their entries as normal, copy them into a single
+ *	chunk of memory, and push that onto their own lock-free ring.
+ *	Each ring has exactly one producer (the worker) and one consumer
+ *	(the writer), so it only needs a pair of atomic indexes.
+ *	A dedicated thread drains all of the queues, and writes each run
+ *	of entries for the same file with as few writev() calls as
+ *	possible, whilst holding the file open (and locked) once.
+ *
+ *	The writer uses its own exfile_t handle, so descriptors are cached
+ *	between passes, and files which have been rotated are re-opened,
+ *	exactly as they would be for a worker.  Triggers are not run for
+ *	that handle, as there's no interpreter in the writer thread.
+ */
+#define EXFILE_WRITER_MAX_IOV	1024		//!< Maximum iovecs passed to a single writev() call.
+#define EXFILE_WRITER_MAX_PASS	4096		//!< Maximum entries written per pass.
+
+/** An entry queued by a worker
+ *
+ * The filename, header and data are allocated in the same chunk, directly after the struct.
+ */
+typedef struct {
+	char const		*filename;		//!< File to write the entry to.
+	char const		*header;		//!< Written before the entry if the file is empty.
+	size_t			header_len;		//!< Length of the header.
+	uint8_t const		*data;			//!< Data to write.
+	size_t			data_len;		//!< Length of the data.
+} exfile_writer_entry_t;
+
+struct exfile_writer_thread_s {
+	exfile_writer_t		*writer;		//!< Writer which drains our queue.
+
+	exfile_writer_entry_t	**ring;			//!< Entries waiting to be written.
+	uint32_t		mask;			//!< Size of the ring, minus one.
+	atomic_uint_fast32_t	head;			//!< Next slot the worker writes to.
+	atomic_uint_fast32_t	tail;			//!< Next slot the writer reads from.
+
+	atomic_uint_fast64_t	pending;		//!< Bytes queued, but not yet written.
+	atomic_bool		detached;		//!< The worker has exited.  Free once the queue is empty.
+	fr_dlist_t		entry;			//!< Entry in the writer's list of workers.
+};
+
+struct exfile_writer_s {
+	exfile_writer_config_t	config;			//!< How to batch, and what to do when queues are full.
+	char const		*name;			//!< Used in log messages.
+
+	exfile_t		*ef;			//!< Only used by the writer thread.
+	mode_t			permissions;		//!< To create new files with.
+	gid_t			group;			//!< To set on files, or -1.
+	bool			fsync;			//!< fsync() after each run of entries.
+
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	pthread_cond_t		wake;			//!< Signalled to wake the writer.
+	pthread_cond_t		drained;		//!< Broadcast by the writer after each pass.
+	pthread_t		pthread_id;		//!< Of the writer thread.
+	bool			running;		//!< The writer thread has been started.
+	bool			stop;			//!< The writer thread should exit.
+	bool			flush;			//!< A worker wants its entries written now.
+	fr_dlist_head_t		threads;		//!< Workers which queue entries.
+
+	atomic_uint_fast64_t	dropped;		//!< Entries discarded because a queue was full.
+};
+
+static fr_table_num_sorted_t const exfile_writer_overflow_table[] = {
+	{ L("block"),	EXFILE_WRITER_OVERFLOW_BLOCK	},
+	{ L("drop"),	EXFILE_WRITER_OVERFLOW_DROP	}
+};
+static size_t exfile_writer_overflow_table_len = NUM_ELEMENTS(exfile_writer_overflow_table);
+
+conf_parser_t const exfile_writer_config[] = {
+	{ FR_CONF_OFFSET("entries", exfile_writer_config_t, num_entries), .dflt = "4096" },
+	{ FR_CONF_OFFSET("flush_size", exfile_writer_config_t, flush_size), .dflt = "65536" },
+	{ FR_CONF_OFFSET("flush_interval", exfile_writer_config_t, flush_interval), .dflt = "0.1" },
+	{ FR_CONF_OFFSET("overflow", exfile_writer_config_t, overflow),
+	  .func = cf_table_parse_int,
+	  .uctx = &(cf_table_parse_ctx_t){ .table = exfile_writer_overflow_table, .len = &exfile_writer_overflow_table_len },
+	  .dflt = "block" },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Add an entry to a worker's ring
+ *
+ * @note Must only be called by the worker which owns the ring.
+ */
+static inline CC_HINT(always_inline) bool exfile_writer_push(exfile_writer_thread_t *wt, exfile_writer_entry_t *e)
+{
+	uint_fast32_t head = atomic_load_explicit(&wt->head, memory_order_relaxed);
+
+	if ((head - atomic_load_explicit(&wt->tail, memory_order_acquire)) > wt->mask) return false;
+
+	wt->ring[head & wt->mask] = e;
+	atomic_store_explicit(&wt->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+/** Remove an entry from a worker's ring
+ *
+ * @note Must only be called by the writer thread.
+ */
+static inline CC_HINT(always_inline) exfile_writer_entry_t *exfile_writer_pop(exfile_writer_thread_t *wt)
+{
+	uint_fast32_t		tail = atomic_load_explicit(&wt->tail, memory_order_relaxed);
+	exfile_writer_entry_t	*e;
+
+	if (tail == atomic_load_explicit(&wt->head, memory_order_acquire)) return NULL;
+
+	e = wt->ring[tail & wt->mask];
+	atomic_store_explicit(&wt->tail, tail + 1, memory_order_release);
+
+	return e;
+}
+
+/** Write all of an iovec array, dealing with short writes
+ *
+ */
+static int exfile_writer_writev(int fd, struct iovec *vector, int vector_len)
+{
+	while (vector_len > 0) {
+		ssize_t wrote;
+
+		wrote = writev(fd, vector, vector_len);
+		if (wrote < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		while ((vector_len > 0) && ((size_t)wrote >= vector->iov_len)) {
+			wrote -= vector->iov_len;
+			vector++;
+			vector_len--;
+		}
+
+		if (vector_len > 0) {
+			vector->iov_base = (uint8_t *)vector->iov_base + wrote;
+			vector->iov_len -= wrote;
+		}
+	}
+
+	return 0;
+}
+
+/** Write a run of entries for the same file
+ *
+ */
+static void exfile_writer_run(exfile_writer_t *writer, exfile_writer_entry_t **entries, size_t num)
+{
+	struct iovec	vector[EXFILE_WRITER_MAX_IOV];
+	char const	*filename = entries[0]->filename;
+	off_t		offset;
+	size_t		i = 0;
+	int		fd, n = 0;
+
+	fd = exfile_open(writer->ef, filename, writer->permissions, &offset);
+	if (fd < 0) {
+		PERROR("%s - Failed to open %s, discarding %zu entries", writer->name, filename, num);
+		return;
+	}
+
+	if ((writer->group != (gid_t)-1) && (chown(filename, -1, writer->group) < 0)) {
+		WARN("%s - Unable to change system group of \"%s\": %s", writer->name, filename, fr_syserror(errno));
+	}
+
+	/*
+	 *	Only the first entry can be at the start of the file.
+	 */
+	if ((offset == 0) && entries[0]->header) {
+		vector[n].iov_base = UNCONST(char *, entries[0]->header);
+		vector[n].iov_len = entries[0]->header_len;
+		n++;
+	}
+
+	while (i < num) {
+		vector[n].iov_base = UNCONST(uint8_t *, entries[i]->data);
+		vector[n].iov_len = entries[i]->data_len;
+		n++;
+		i++;
+
+		if ((n < EXFILE_WRITER_MAX_IOV) && (i < num)) continue;
+
+		if (exfile_writer_writev(fd, vector, n) < 0) {
+			ERROR("%s - Failed writing to %s, discarding %zu entries: %s",
+			      writer->name, filename, num - i + n, fr_syserror(errno));
+			break;
+		}
+		n = 0;
+	}
+
+	if (writer->fsync && (fsync(fd) < 0)) {
+		ERROR("%s - Failed syncing %s to persistent storage: %s", writer->name, filename, fr_syserror(errno));
+	}
+
+	exfile_close(writer->ef, fd);
+}
+
+/** Take entries from every worker's queue, and write them out
+ *
+ * @return the number of entries written.
+ */
+static size_t exfile_writer_pass(exfile_writer_t *writer)
+{
+	exfile_writer_entry_t	*entries[EXFILE_WRITER_MAX_PASS];
+	exfile_writer_thread_t	*wt, *next;
+	size_t			num = 0, i, start;
+	uint64_t		dropped;
+
+	pthread_mutex_lock(&writer->mutex);
+	for (wt = fr_dlist_head(&writer->threads); wt; wt = next) {
+		bool	detached = atomic_load_explicit(&wt->detached, memory_order_acquire);
+		bool	empty = false;
+
+		next = fr_dlist_next(&writer->threads, wt);
+
+		while (num < EXFILE_WRITER_MAX_PASS) {
+			exfile_writer_entry_t *e;
+
+			e = exfile_writer_pop(wt);
+			if (!e) {
+				empty = true;
+				break;
+			}
+
+			atomic_fetch_sub_explicit(&wt->pending, e->header_len + e->data_len, memory_order_relaxed);
+			entries[num++] = e;
+		}
+
+		/*
+		 *	The worker had gone before we started, and
+		 *	everything it queued has been taken.
+		 */
+		if (detached && empty) {
+			fr_dlist_remove(&writer->threads, wt);
+			talloc_free(wt);
+		}
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	/*
+	 *	Write each run of entries for the same file together.
+	 *	Most of the time all the entries are for the same file.
+	 */
+	for (start = 0, i = 1; i <= num; i++) {
+		if ((i < num) && (strcmp(entries[i]->filename, entries[start]->filename) == 0)) continue;
+
+		exfile_writer_run(writer, &entries[start], i - start);
+		start = i;
+	}
+
+	for (i = 0; i < num; i++) talloc_free(entries[i]);
+
+	dropped = atomic_exchange_explicit(&writer->dropped, 0, memory_order_relaxed);
+	if (dropped > 0) WARN("%s - Discarded %"PRIu64" entries, as the queues were full", writer->name, dropped);
+
+	return num;
+}
+
+static void *exfile_writer_thread(void *uctx)
+{
+	exfile_writer_t *writer = talloc_get_type_abort(uctx, exfile_writer_t);
+
+	DEBUG2("%s - Writer thread started", writer->name);
+
+	pthread_mutex_lock(&writer->mutex);
+	while (!writer->stop) {
+		if (!writer->flush) {
+			struct timespec when = fr_time_to_timespec(fr_time_add(fr_time(), writer->config.flush_interval));
+
+			(void) pthread_cond_timedwait(&writer->wake, &writer->mutex, &when);
+		}
+		writer->flush = false;
+		pthread_mutex_unlock(&writer->mutex);
+
+		/*
+		 *	Keep going until the queues are empty, so that
+		 *	a full pass doesn't leave entries waiting for
+		 *	another interval.
+		 */
+		while (exfile_writer_pass(writer) == EXFILE_WRITER_MAX_PASS);
+
+		pthread_mutex_lock(&writer->mutex);
+		pthread_cond_broadcast(&writer->drained);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	while (exfile_writer_pass(writer) > 0);
+
+	DEBUG2("%s - Writer thread exiting", writer->name);
+
+	return NULL;
+}
+
+static int _exfile_writer_free(exfile_writer_t *writer)
+{
+	exfile_writer_thread_t *wt;
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->stop = true;
+	pthread_cond_signal(&writer->wake);
+	pthread_mutex_unlock(&writer->mutex);
+
+	if (writer->running) pthread_join(writer->pthread_id, NULL);
+
+	while ((wt = fr_dlist_pop_head(&writer->threads))) talloc_free(wt);
+
+	pthread_cond_destroy(&writer->drained);
+	pthread_cond_destroy(&writer->wake);
+	pthread_mutex_destroy(&writer->mutex);
+
+	return 0;
+}
+
+/** Allocate a writer, which writes entries queued by workers in a dedicated thread
+ *
+ * The thread is started when the first worker calls exfile_writer_thread_alloc().
+ *
+ * @param[in] ctx		to allocate the writer in.
+ * @param[in] config		batching and overflow configuration.
+ * @param[in] name		to prefix log messages with.
+ * @param[in] locking		whether or not to lock the files, see exfile_init().
+ * @param[in] permissions	to create new files with.
+ * @param[in] group		to set on files, or -1 to leave the group alone.
+ * @param[in] fsync		whether to fsync() files after writing to them.
+ * @return
+ *	- A new writer.
+ *	- NULL on error.
+ */
+exfile_writer_t *exfile_writer_alloc(TALLOC_CTX *ctx, exfile_writer_config_t const *config, char const *name,
+				     bool locking, mode_t permissions, gid_t group, bool fsync)
+{
+	exfile_writer_t *writer;
+
+	/*
+	 *	As with exfile_init(), this may be called with
+	 *	module instance data, which is read-only once
+	 *	the module has been instantiated.
+	 */
+	MEM(writer = talloc_zero(NULL, exfile_writer_t));
+	talloc_link_ctx(ctx, writer);
+
+	writer->config = *config;
+	writer->name = talloc_typed_strdup(writer, name);
+	writer->permissions = permissions;
+	writer->group = group;
+	writer->fsync = fsync;
+	fr_dlist_talloc_init(&writer->threads, exfile_writer_thread_t, entry);
+	atomic_init(&writer->dropped, 0);
+
+	writer->ef = exfile_init(writer, 256, fr_time_delta_from_sec(30), locking);
+	if (!writer->ef) {
+		fr_strerror_const("Failed creating log file context");
+		talloc_free(writer);
+		return NULL;
+	}
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->wake, NULL);
+	pthread_cond_init(&writer->drained, NULL);
+	talloc_set_destructor(writer, _exfile_writer_free);
+
+	return writer;
+}
+
+/** Allocate a queue for a worker, starting the writer thread if necessary
+ *
+ * @param[in] writer	to write the worker's entries.
+ * @return
+ *	- A new queue, to pass to exfile_writer_write().
+ *	- NULL on error.
+ */
+exfile_writer_thread_t *exfile_writer_thread_alloc(exfile_writer_t *writer)
+{
+	exfile_writer_thread_t	*wt;
+	uint32_t		size;
+	int			ret;
+
+	/*
+	 *	Freed by the writer, so it can't be in the worker's ctx.
+	 */
+	MEM(wt = talloc_zero(NULL, exfile_writer_thread_t));
+	wt->writer = writer;
+	atomic_init(&wt->head, 0);
+	atomic_init(&wt->tail, 0);
+	atomic_init(&wt->pending, 0);
+	atomic_init(&wt->detached, false);
+
+	for (size = 16; size < writer->config.num_entries; size <<= 1);
+	MEM(wt->ring = talloc_array(wt, exfile_writer_entry_t *, size));
+	wt->mask = size - 1;
+
+	pthread_mutex_lock(&writer->mutex);
+	if (!writer->running) {
+		ret = pthread_create(&writer->pthread_id, NULL, exfile_writer_thread, writer);
+		if (ret != 0) {
+			pthread_mutex_unlock(&writer->mutex);
+			fr_strerror_printf("Failed creating writer thread: %s", fr_syserror(ret));
+			talloc_free(wt);
+			return NULL;
+		}
+		writer->running = true;
+	}
+	fr_dlist_insert_tail(&writer->threads, wt);
+	pthread_mutex_unlock(&writer->mutex);
+
+	return wt;
+}
+
+/** Signal that a worker is exiting
+ *
+ * The writer frees the queue once everything in it has been written.
+ * When the last worker exits, we wait for the writer thread to finish.
+ * This has to happen before any global cleanup is done, as the writer
+ * may still need to log.
+ *
+ * @param[in] wt	to free.
+ */
+void exfile_writer_thread_free(exfile_writer_thread_t *wt)
+{
+	exfile_writer_t		*writer = wt->writer;
+	exfile_writer_thread_t	*other = NULL;
+
+	pthread_mutex_lock(&writer->mutex);
+	atomic_store_explicit(&wt->detached, true, memory_order_release);
+
+	while ((other = fr_dlist_next(&writer->threads, other))) {
+		if (!atomic_load_explicit(&other->detached, memory_order_relaxed)) break;
+	}
+
+	if (other || !writer->running) {
+		writer->flush = true;
+		pthread_cond_signal(&writer->wake);
+		pthread_mutex_unlock(&writer->mutex);
+		return;
+	}
+
+	writer->stop = true;
+	pthread_cond_signal(&writer->wake);
+	pthread_mutex_unlock(&writer->mutex);
+
+	pthread_join(writer->pthread_id, NULL);
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->running = false;
+	writer->stop = false;
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+/** Queue an entry to be written by the writer thread
+ *
+ * @param[in] wt		the worker's queue.
+ * @param[in] filename		to write to.
+ * @param[in] header		written before the entry, if the file is empty.  May be NULL.
+ * @param[in] header_len	number of elements in header.
+ * @param[in] vector		data to write.
+ * @param[in] vector_len	number of elements in vector.
+ * @return
+ *	- The number of bytes queued, not including the header.
+ *	- -1 if the queue is full, and the overflow policy is "drop".
+ */
+ssize_t exfile_writer_write(exfile_writer_thread_t *wt, char const *filename,
+			    struct iovec const *header, size_t header_vector_len,
+			    struct iovec const *vector, size_t vector_len)
+{
+	exfile_writer_t		*writer = wt->writer;
+	exfile_writer_entry_t	*e;
+	size_t			filename_len = strlen(filename), header_len = 0, data_len = 0, i;
+	uint8_t			*p;
+	uint64_t		pending;
+
+	if (!header) header_vector_len = 0;
+	for (i = 0; i < header_vector_len; i++) header_len += header[i].iov_len;
+	for (i = 0; i < vector_len; i++) data_len += vector[i].iov_len;
+
+	/*
+	 *	One chunk for everything, so the writer only has
+	 *	one thing to free.
+	 */
+	MEM(e = talloc_size(NULL, sizeof(*e) + filename_len + 1 + header_len + data_len));
+	talloc_set_name_const(e, "exfile_writer_entry_t");
+	p = (uint8_t *)(e + 1);
+
+	memcpy(p, filename, filename_len + 1);
+	e->filename = (char const *)p;
+	p += filename_len + 1;
+
+	if (header_len) {
+		e->header = (char const *)p;
+		for (i = 0; i < header_vector_len; i++) {
+			memcpy(p, header[i].iov_base, header[i].iov_len);
+			p += header[i].iov_len;
+		}
+	} else {
+		e->header = NULL;
+	}
+	e->header_len = header_len;
+
+	e->data = p;
+	for (i = 0; i < vector_len; i++) {
+		memcpy(p, vector[i].iov_base, vector[i].iov_len);
+		p += vector[i].iov_len;
+	}
+	e->data_len = data_len;
+
+	/*
+	 *	Account for the entry before it's visible to the
+	 *	writer, so the count never goes negative.
+	 */
+	pending = atomic_fetch_add_explicit(&wt->pending, header_len + data_len, memory_order_relaxed);
+
+	while (!exfile_writer_push(wt, e)) {
+		if (writer->config.overflow == EXFILE_WRITER_OVERFLOW_DROP) {
+			atomic_fetch_sub_explicit(&wt->pending, header_len + data_len, memory_order_relaxed);
+			atomic_fetch_add_explicit(&writer->dropped, 1, memory_order_relaxed);
+			talloc_free(e);
+			fr_strerror_printf("Queue for %s is full", filename);
+			return -1;
+		}
+
+		/*
+		 *	Wake the writer, and wait for it to make
+		 *	some space.
+		 */
+		pthread_mutex_lock(&writer->mutex);
+		writer->flush = true;
+		pthread_cond_signal(&writer->wake);
+		pthread_cond_wait(&writer->drained, &writer->mutex);
+		pthread_mutex_unlock(&writer->mutex);
+	}
+
+	/*
+	 *	Only wake the writer when we cross the threshold,
+	 *	otherwise it'll be woken by the flush interval.
+	 */
+	if ((pending < writer->config.flush_size) && ((pending + header_len + data_len) >= writer->config.flush_size)) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->flush = true;
+		pthread_cond_signal(&writer->wake);
+		pthread_mutex_unlock(&writer->mutex);
+	}
+
+	return data_len;
+}
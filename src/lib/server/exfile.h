@@ -26,6 +26,9 @@
 RCSIDH(exfile_h, "$Id$")
 
 #include <freeradius-devel/server/request.h>
+#include <freeradius-devel/server/cf_parse.h>
+
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +48,44 @@ int		exfile_open(exfile_t *lf, char const *filename, mode_t permissions, off_t *
 
 int		exfile_close(exfile_t *lf, CC_RELEASE_HANDLE("exfile_fd") int fd);
 
+/*
+ *	Worker threads queueing lines for a dedicated writer thread.
+ */
+typedef struct exfile_writer_s exfile_writer_t;
+typedef struct exfile_writer_thread_s exfile_writer_thread_t;
+
+/** What to do when a worker's queue is full
+ *
+ */
+typedef enum {
+	EXFILE_WRITER_OVERFLOW_BLOCK = 0,		//!< Wait for the writer to drain the queue.
+	EXFILE_WRITER_OVERFLOW_DROP			//!< Discard the entry, and return an error.
+} exfile_writer_overflow_t;
+
+/** Configuration for a writer thread
+ *
+ */
+typedef struct {
+	uint32_t			num_entries;	//!< Maximum entries queued by each worker.
+	size_t				flush_size;	//!< Wake the writer when a worker has queued this
+							///< many bytes.
+	fr_time_delta_t			flush_interval;	//!< Maximum time an entry spends in the queue.
+	exfile_writer_overflow_t	overflow;	//!< What to do when a worker's queue is full.
+} exfile_writer_config_t;
+
+extern conf_parser_t const exfile_writer_config[];
+
+exfile_writer_t	*exfile_writer_alloc(TALLOC_CTX *ctx, exfile_writer_config_t const *config, char const *name,
+				     bool locking, mode_t permissions, gid_t group, bool fsync);
+
+exfile_writer_thread_t *exfile_writer_thread_alloc(exfile_writer_t *writer);
+
+void		exfile_writer_thread_free(exfile_writer_thread_t *wt);
+
+ssize_t		exfile_writer_write(exfile_writer_thread_t *wt, char const *filename,
+				    struct iovec const *header, size_t header_len,
+				    struct iovec const *vector, size_t vector_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -91,6 +91,8 @@ static int num_networks_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITE
 static int num_workers_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 static int num_workers_dflt(CONF_PAIR **out, void *parent, CONF_SECTION *cs, fr_token_t quote, conf_parser_t const *rule);
 
+static int timer_wheel_tick_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+
 static int lib_dir_on_read(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
 static int talloc_pool_size_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
@@ -175,10 +177,16 @@ static const conf_parser_t thread_config[] = {
 	  .func = num_workers_parse, .dflt_func = num_workers_dflt },
 
 	{ FR_CONF_OFFSET_TYPE_FLAGS("stats_interval", FR_TYPE_TIME_DELTA, CONF_FLAG_HIDDEN, main_config_t, stats_interval) },
+	{ FR_CONF_OFFSET("timer_wheel_tick", main_config_t, timer_wheel_tick), .dflt = "0",
+	  .func = timer_wheel_tick_parse },
+
+	{ FR_CONF_OFFSET("network_cpus", main_config_t, network_cpus) },
+	{ FR_CONF_OFFSET("worker_cpus", main_config_t, worker_cpus) },
 
 #ifdef WITH_TLS
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_init", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_init), .dflt = "64" },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_max", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_max), .dflt = "1024" },
+	{ FR_CONF_OFFSET("openssl_offload_threads", main_config_t, openssl_offload_threads), .dflt = "0" },
 #endif
 
 	CONF_PARSER_TERMINATOR
@@ -362,6 +370,33 @@ static int max_request_time_parse(TALLOC_CTX *ctx, void *out, void *parent,
 	return 0;
 }
 
+static int timer_wheel_tick_parse(TALLOC_CTX *ctx, void *out, void *parent,
+				  CONF_ITEM *ci, conf_parser_t const *rule)
+{
+	int		ret;
+	fr_time_delta_t	value;
+
+	if ((ret = cf_pair_parse_value(ctx, out, parent, ci, rule)) < 0) return ret;
+
+	memcpy(&value, out, sizeof(value));
+
+	/*
+	 *	Zero disables the wheel.  Otherwise, very small ticks
+	 *	mean the wheel covers very little time, and servicing
+	 *	it means walking through many empty ticks.
+	 */
+	if (fr_time_delta_ispos(value)) {
+		FR_TIME_DELTA_BOUND_CHECK("timer_wheel_tick", value, >=, fr_time_delta_from_usec(100));
+		FR_TIME_DELTA_BOUND_CHECK("timer_wheel_tick", value, <=, fr_time_delta_from_sec(1));
+	} else {
+		value = fr_time_delta_wrap(0);
+	}
+
+	memcpy(out, &value, sizeof(value));
+
+	return 0;
+}
+
 static int lib_dir_on_read(UNUSED TALLOC_CTX *ctx, UNUSED void *out, UNUSED void *parent,
 			 CONF_ITEM *ci, UNUSED conf_parser_t const *rule)
 {
@@ -417,7 +452,8 @@ static int num_networks_parse(TALLOC_CTX *ctx, void *out, void *parent,
 
 	memcpy(&value, out, sizeof(value));
 
-	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, ==, 1);
+	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, >=, 1);
+	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, <=, 64);
 
 	memcpy(out, &value, sizeof(value));
 
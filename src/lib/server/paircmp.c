@@ -97,17 +97,16 @@ int paircmp_pairs(UNUSED request_t *request, fr_pair_t const *check, fr_pair_t *
 			REDEBUG("Error stringifying operand for regular expression");
 
 		regex_error:
-			talloc_free(preg);
 			talloc_free(expr);
 			talloc_free(value);
 			return -2;
 		}
 
 		/*
-		 *	Include substring matches.
+		 *	Include substring matches.  The expression is
+		 *	owned by the per-thread cache, so we don't free it.
 		 */
-		slen = regex_compile(request, &preg, expr_p, talloc_array_length(expr_p) - 1,
-				     NULL, true, true);
+		slen = regex_cache_compile(&preg, expr_p, talloc_array_length(expr_p) - 1, NULL, true);
 		if (slen <= 0) {
 			REMARKER(expr_p, -slen, "%s", fr_strerror());
 
@@ -139,7 +138,6 @@ int paircmp_pairs(UNUSED request_t *request, fr_pair_t const *check, fr_pair_t *
 		}
 
 		talloc_free(regmatch);
-		talloc_free(preg);
 		talloc_free(expr);
 		talloc_free(value);
 
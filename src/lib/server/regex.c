@@ -25,9 +25,19 @@
 
 RCSID("$Id$")
 
+#include <freeradius-devel/server/command.h>
 #include <freeradius-devel/server/regex.h>
 #include <freeradius-devel/server/request_data.h>
+#include <freeradius-devel/util/atexit.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
 
 #ifdef HAVE_REGEX
 
@@ -45,6 +55,7 @@ typedef struct {
  * Allows use of %{n} expansions.
  *
  * @note If preg was runtime-compiled, it will be consumed and *preg will be set to NULL.
+ * @note If preg came from the regex cache, a reference to it is kept.
  * @note regmatch will be consumed and *regmatch will be set to NULL.
  * @note Their lifetimes will be bound to the match request data.
  *
@@ -82,10 +93,14 @@ void regex_sub_to_request(request_t *request, regex_t **preg, fr_regmatch_t **re
 	MEM(new_rc = talloc(request, fr_regcapture_t));
 
 	/*
-	 *	Steal runtime pregs, leave precompiled ones
+	 *	Steal runtime pregs, leave precompiled ones, and
+	 *	reference cached ones so that they outlive any
+	 *	eviction from the cache.
 	 */
 #if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
-	if (!(*preg)->precompiled) {
+	if ((*preg)->cached) {
+		MEM(new_rc->preg = talloc_reference(new_rc, *preg));
+	} else if (!(*preg)->precompiled) {
 		new_rc->preg = talloc_steal(new_rc, *preg);
 		*preg = NULL;
 	} else {
@@ -406,4 +421,320 @@ int regex_request_to_sub(TALLOC_CTX *ctx, char **out, request_t *request, uint32
 	return 0;
 }
 #  endif
+
+/** Counters for one thread's cache
+ *
+ * Only the owning thread writes them, but radmin reads them from
+ * another thread, so they're atomic.
+ */
+typedef struct {
+	atomic_uint_fast64_t	hits;
+	atomic_uint_fast64_t	misses;
+	atomic_uint_fast64_t	evictions;
+	atomic_uint_fast64_t	jitd;
+	atomic_uint_fast64_t	entries;
+} regex_cache_counters_t;
+
+/*
+ *	There's a single writer, so a relaxed load and store is
+ *	enough, and avoids a locked instruction on every lookup.
+ */
+#define REGEX_CACHE_STAT_ADD(_cache, _field, _num) \
+	atomic_store_explicit(&(_cache)->stats._field, \
+			      atomic_load_explicit(&(_cache)->stats._field, memory_order_relaxed) + (_num), \
+			      memory_order_relaxed)
+
+#define REGEX_CACHE_STAT_LOAD(_cache, _field) atomic_load_explicit(&(_cache)->stats._field, memory_order_relaxed)
+
+/** Per-thread cache of runtime compiled expressions
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< In the list of all caches.  Must be first.
+	fr_hash_table_t		*ht;		//!< Entries by pattern and flags.
+	fr_dlist_head_t		lru;		//!< Most recently used at the head.
+	regex_cache_counters_t	stats;		//!< Counters for this thread.
+} regex_cache_t;
+
+typedef struct {
+	char const		*pattern;	//!< Expanded pattern.
+	size_t			len;		//!< Length of the pattern.
+	uint8_t			flags;		//!< Compilation flags, and whether subcaptures are enabled.
+	bool			jit_tried;	//!< Whether we've tried to JIT the pattern.
+	regex_t			*preg;		//!< Compiled pattern.
+	fr_dlist_t		entry;		//!< In the LRU list.
+} regex_cache_entry_t;
+
+static _Thread_local regex_cache_t *regex_cache;
+
+/*
+ *	So that radmin can sum the counters for all threads.
+ */
+static pthread_mutex_t		regex_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t		regex_cache_list = FR_DLIST_HEAD_INITIALISER(regex_cache_list);
+static regex_cache_stats_t	regex_cache_retired;	//!< Counters from threads which have exited.
+
+static uint32_t regex_cache_entry_hash(void const *data)
+{
+	regex_cache_entry_t const *entry = data;
+
+	return fr_hash_update(&entry->flags, sizeof(entry->flags), fr_hash(entry->pattern, entry->len));
+}
+
+static int8_t regex_cache_entry_cmp(void const *one, void const *two)
+{
+	regex_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->flags, b->flags);
+	if (ret != 0) return ret;
+
+	ret = CMP(a->len, b->len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->pattern, b->pattern, a->len);
+	return CMP(ret, 0);
+}
+
+/** Drop the cache's link to the compiled pattern
+ *
+ * If a request still has subcaptures from it, the pattern is
+ * reparented to the subcapture data, and freed along with it.
+ */
+static int _regex_cache_entry_free(regex_cache_entry_t *entry)
+{
+	talloc_unlink(entry, entry->preg);
+
+	return 0;
+}
+
+static int _regex_cache_free(regex_cache_t *cache)
+{
+	pthread_mutex_lock(&regex_cache_mutex);
+	fr_dlist_remove(&regex_cache_list, cache);
+	regex_cache_retired.hits += REGEX_CACHE_STAT_LOAD(cache, hits);
+	regex_cache_retired.misses += REGEX_CACHE_STAT_LOAD(cache, misses);
+	regex_cache_retired.evictions += REGEX_CACHE_STAT_LOAD(cache, evictions);
+	regex_cache_retired.jitd += REGEX_CACHE_STAT_LOAD(cache, jitd);
+	pthread_mutex_unlock(&regex_cache_mutex);
+
+	return 0;
+}
+
+static int _regex_cache_free_on_exit(void *arg)
+{
+	return talloc_free(arg);
+}
+
+/** Thread local init for the regex cache
+ *
+ */
+static int regex_cache_thread_init(void)
+{
+	regex_cache_t *cache;
+
+	cache = talloc_zero(NULL, regex_cache_t);
+	if (!cache) {
+	oom:
+		fr_strerror_const("Out of memory");
+		talloc_free(cache);
+		return -1;
+	}
+
+	cache->ht = fr_hash_table_alloc(cache, regex_cache_entry_hash, regex_cache_entry_cmp, NULL);
+	if (!cache->ht) goto oom;
+	fr_dlist_talloc_init(&cache->lru, regex_cache_entry_t, entry);
+
+	atomic_init(&cache->stats.hits, 0);
+	atomic_init(&cache->stats.misses, 0);
+	atomic_init(&cache->stats.evictions, 0);
+	atomic_init(&cache->stats.jitd, 0);
+	atomic_init(&cache->stats.entries, 0);
+
+	pthread_mutex_lock(&regex_cache_mutex);
+	fr_dlist_insert_tail(&regex_cache_list, cache);
+	pthread_mutex_unlock(&regex_cache_mutex);
+	talloc_set_destructor(cache, _regex_cache_free);
+
+	/*
+	 *	Free on thread exit
+	 */
+	fr_atexit_thread_local(regex_cache, _regex_cache_free_on_exit, cache);
+
+	return 0;
+}
+
+/** Find or compile a runtime expression
+ *
+ * Patterns which are built from expansions are usually the same for
+ * many requests, so each thread keeps the last #REGEX_CACHE_MAX it has
+ * compiled.
+ *
+ * @note The compiled expression is owned by the cache, and must not be freed.
+ *	 It is only valid until the next call to this function, unless it
+ *	 was passed to #regex_sub_to_request.
+ *
+ * @param[out] out		Where to write the compiled expression.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] flags		controlling matching.  May be NULL.
+ * @param[in] subcaptures	Whether to compile the regular expression to store subcapture
+ *				data.
+ * @return the same as #regex_compile.
+ */
+ssize_t regex_cache_compile(regex_t **out, char const *pattern, size_t len,
+			    fr_regex_flags_t const *flags, bool subcaptures)
+{
+	regex_cache_t		*cache;
+	regex_cache_entry_t	find, *entry;
+	regex_t			*preg;
+	ssize_t			slen;
+
+	if (unlikely(!regex_cache) && (regex_cache_thread_init() < 0)) return -1;
+	cache = regex_cache;
+
+	find = (regex_cache_entry_t) {
+		.pattern = pattern,
+		.len = len,
+		.flags = (subcaptures << 6)
+	};
+	if (flags) {
+		find.flags |= (flags->ignore_case << 0) | (flags->multiline << 1) | (flags->dot_all << 2) |
+			      (flags->unicode << 3) | (flags->extended << 4);
+	}
+
+	entry = fr_hash_table_find(cache->ht, &find);
+	if (entry) {
+		REGEX_CACHE_STAT_ADD(cache, hits, 1);
+
+		/*
+		 *	It's been used more than once, so it's
+		 *	likely to be used again, and worth the
+		 *	cost of the JIT.
+		 */
+		if (!entry->jit_tried) {
+			entry->jit_tried = true;
+			if (regex_jit(entry->preg)) REGEX_CACHE_STAT_ADD(cache, jitd, 1);
+		}
+
+		fr_dlist_remove(&cache->lru, entry);
+		fr_dlist_insert_head(&cache->lru, entry);
+
+		*out = entry->preg;
+		return len;
+	}
+
+	REGEX_CACHE_STAT_ADD(cache, misses, 1);
+
+	/*
+	 *	Compile it as a runtime expression, as many patterns
+	 *	are only ever seen once, and the JIT is expensive.
+	 *	It's JIT'd the first time it's found in the cache.
+	 */
+	entry = talloc_zero(cache, regex_cache_entry_t);
+	if (!entry) {
+	oom:
+		fr_strerror_const("Out of memory");
+		talloc_free(entry);
+		*out = NULL;
+		return -1;
+	}
+
+	slen = regex_compile(entry, &preg, pattern, len, flags, subcaptures, true);
+	if (slen <= 0) {
+		talloc_free(entry);
+		*out = NULL;
+		return slen;
+	}
+#if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
+	preg->cached = true;
+#endif
+
+	entry->pattern = talloc_bstrndup(entry, pattern, len);
+	if (!entry->pattern) goto oom;
+	entry->len = len;
+	entry->flags = find.flags;
+	entry->preg = preg;
+
+	/*
+	 *	Make room for the new entry.
+	 */
+	if (fr_dlist_num_elements(&cache->lru) >= REGEX_CACHE_MAX) {
+		regex_cache_entry_t *old = fr_dlist_pop_tail(&cache->lru);
+
+		(void) fr_hash_table_remove(cache->ht, old);
+		talloc_free(old);
+		REGEX_CACHE_STAT_ADD(cache, evictions, 1);
+		REGEX_CACHE_STAT_ADD(cache, entries, -1);
+	}
+
+	if (!fr_hash_table_insert(cache->ht, entry)) goto oom;
+	fr_dlist_insert_head(&cache->lru, entry);
+	talloc_set_destructor(entry, _regex_cache_entry_free);
+	REGEX_CACHE_STAT_ADD(cache, entries, 1);
+
+	*out = preg;
+	return slen;
+}
+
+/** Sum the regex cache counters for all threads
+ *
+ * @param[out] stats	Where to write the totals.
+ */
+void regex_cache_stats(regex_cache_stats_t *stats)
+{
+	pthread_mutex_lock(&regex_cache_mutex);
+	*stats = regex_cache_retired;
+	fr_dlist_foreach(&regex_cache_list, regex_cache_t, cache) {
+		stats->hits += REGEX_CACHE_STAT_LOAD(cache, hits);
+		stats->misses += REGEX_CACHE_STAT_LOAD(cache, misses);
+		stats->evictions += REGEX_CACHE_STAT_LOAD(cache, evictions);
+		stats->jitd += REGEX_CACHE_STAT_LOAD(cache, jitd);
+		stats->entries += REGEX_CACHE_STAT_LOAD(cache, entries);
+	}
+	pthread_mutex_unlock(&regex_cache_mutex);
+}
+
+static int cmd_stats_regex(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	regex_cache_stats_t stats;
+
+	regex_cache_stats(&stats);
+
+	fprintf(fp, "cache.hits\t\t%" PRIu64 "\n", stats.hits);
+	fprintf(fp, "cache.misses\t\t%" PRIu64 "\n", stats.misses);
+	fprintf(fp, "cache.evictions\t\t%" PRIu64 "\n", stats.evictions);
+	fprintf(fp, "cache.jit\t\t%" PRIu64 "\n", stats.jitd);
+	fprintf(fp, "cache.entries\t\t%" PRIu64 "\n", stats.entries);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_regex_table[] = {
+	{
+		.parent = "stats",
+		.name = "regex",
+		.func = cmd_stats_regex,
+		.help = "Show statistics for the runtime regular expression caches.",
+		.read_only = true,
+	},
+
+	CMD_TABLE_END
+};
+
+/** Register the radmin commands for the regex caches
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int regex_cache_init(void)
+{
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_regex_table) < 0) {
+		PERROR("Failed registering radmin commands for regular expressions");
+		return -1;
+	}
+
+	return 0;
+}
 #endif
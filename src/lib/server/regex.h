@@ -40,8 +40,32 @@ extern "C" {
  */
 #  define REQUEST_MAX_REGEX 32
 
+/*
+ *	Maximum number of runtime compiled expressions each thread
+ *	keeps around.  The least recently used ones are freed first.
+ */
+#  define REGEX_CACHE_MAX 256
+
+/** Counters for the runtime regex caches
+ *
+ */
+typedef struct {
+	uint64_t	hits;		//!< Expressions found in the cache.
+	uint64_t	misses;		//!< Expressions which had to be compiled.
+	uint64_t	evictions;	//!< Expressions freed to make room for new ones.
+	uint64_t	jitd;		//!< Expressions JIT compiled after being found in the cache.
+	uint64_t	entries;	//!< Expressions currently cached.
+} regex_cache_stats_t;
+
 void	regex_sub_to_request(request_t *request, regex_t **preg, fr_regmatch_t **regmatch);
 
+ssize_t	regex_cache_compile(regex_t **out, char const *pattern, size_t len,
+			    fr_regex_flags_t const *flags, bool subcaptures);
+
+void	regex_cache_stats(regex_cache_stats_t *stats);
+
+int	regex_cache_init(void);
+
 int	regex_request_to_sub(TALLOC_CTX *ctx, char **out, request_t *request, uint32_t num);
 
 /*
@@ -46,6 +46,7 @@
  */
 RCSID("$Id$")
 
+#include <freeradius-devel/server/command.h>
 #include <freeradius-devel/server/request.h>
 #include <freeradius-devel/server/request_data.h>
 #include <freeradius-devel/server/state.h>
@@ -54,10 +55,29 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/md5.h>
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/rand.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** Maximum number of shards a thread safe state tree is split into
+ *
+ */
+#define STATE_TREE_SHARDS_MAX		16
+
+/** Minimum number of sessions each shard should be able to track
+ *
+ */
+#define STATE_TREE_SHARD_SESSIONS_MIN	64
+
+typedef struct state_shard_s state_shard_t;
+
 /** Holds a state value, and associated fr_pair_ts and data
  *
  */
@@ -121,6 +141,7 @@ typedef struct {
 	request_t		*thawed;			//!< The request that thawed this entry.
 
 	fr_state_tree_t		*state_tree;			//!< Tree this entry belongs to.
+	state_shard_t		*shard;				//!< Shard this entry is accounted against.
 } fr_state_entry_t;
 
 /** A child of a fr_state_entry_t
@@ -142,19 +163,43 @@ typedef struct {
 	request_t		*thawed;			//!< The request that thawed this entry.
 } state_child_entry_t;
 
-struct fr_state_tree_s {
-	uint64_t		id;				//!< Next ID to assign.
+/** An independently locked portion of the state tree
+ *
+ * Entries are assigned to a shard using a hash of their state value,
+ * so workers processing different sessions rarely contend.
+ */
+struct state_shard_s {
+	pthread_mutex_t		mutex;				//!< Synchronisation mutex.
+
+	fr_rb_tree_t		*tree;				//!< rbtree used to lookup state value.
+	fr_dlist_head_t		to_expire;			//!< Linked list of entries to free.
+
+	atomic_uint_fast32_t	used_sessions;			//!< How many sessions in this shard are currently
+								///< in progress.  Entries may be freed without
+								///< the mutex held.
+
 	uint64_t		timed_out;			//!< Number of states that were cleaned up due to
 								//!< timeout.
+	uint64_t		locked;				//!< Number of times the mutex was acquired.
+	uint64_t		contended;			//!< Number of times the mutex was held by another
+								///< thread when we tried to acquire it.
+};
+
+struct fr_state_tree_s {
+	atomic_uint_fast64_t	id;				//!< Next ID to assign.
+
 	uint32_t		max_sessions;			//!< Maximum number of sessions we track.
-	uint32_t		used_sessions;			//!< How many sessions are currently in progress.
-	fr_rb_tree_t		*tree;				//!< rbtree used to lookup state value.
-	fr_dlist_head_t		to_expire;			//!< Linked list of entries to free.
+	atomic_uint_fast32_t	used_sessions;			//!< How many sessions are currently in progress,
+								///< across all shards.
+
+	state_shard_t		*shards;			//!< Array of shards.
+	uint32_t		num_shards;			//!< How many shards there are.
+	atomic_uint_fast32_t	expire_next;			//!< Next shard to check for expired entries,
+								///< in addition to the one being inserted into.
 
 	fr_time_delta_t		timeout;			//!< How long to wait before cleaning up state entries.
 
-	bool			thread_safe;			//!< Whether we lock the tree whilst modifying it.
-	pthread_mutex_t		mutex;				//!< Synchronisation mutex.
+	bool			thread_safe;			//!< Whether we lock the shards whilst modifying them.
 
 	uint8_t			server_id;			//!< ID to use for load balancing.
 	uint32_t		context_id;			//!< ID binding state values to a context such
@@ -163,10 +208,39 @@ struct fr_state_tree_s {
 	fr_dict_attr_t const	*da;				//!< State attribute used.
 };
 
-#define PTHREAD_MUTEX_LOCK if (state->thread_safe) pthread_mutex_lock
-#define PTHREAD_MUTEX_UNLOCK if (state->thread_safe) pthread_mutex_unlock
+static void state_entry_unlink(state_shard_t *shard, fr_state_entry_t *entry);
+
+/** Lock a shard, recording whether we had to wait for it
+ *
+ */
+static inline CC_HINT(always_inline) void state_shard_lock(fr_state_tree_t *state, state_shard_t *shard)
+{
+	if (!state->thread_safe) return;
+
+	if (pthread_mutex_trylock(&shard->mutex) != 0) {
+		pthread_mutex_lock(&shard->mutex);
+		shard->contended++;
+	}
+	shard->locked++;
+}
+
+static inline CC_HINT(always_inline) void state_shard_unlock(fr_state_tree_t *state, state_shard_t *shard)
+{
+	if (!state->thread_safe) return;
+
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/** Return the shard responsible for a state value
+ *
+ * The value must already have been xor'd with the context_id.
+ */
+static inline CC_HINT(always_inline) state_shard_t *state_shard(fr_state_tree_t *state, fr_state_entry_t const *entry)
+{
+	if (state->num_shards == 1) return &state->shards[0];
 
-static void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry);
+	return &state->shards[fr_hash(entry->state, sizeof(entry->state)) % state->num_shards];
+}
 
 /** Compare two fr_state_entry_t based on their state value i.e. the value of the attribute
  *
@@ -185,26 +259,79 @@ static int8_t state_entry_cmp(void const *one, void const *two)
  */
 static int _state_tree_free(fr_state_tree_t *state)
 {
-	fr_state_entry_t *entry;
-
-	if (state->thread_safe) pthread_mutex_destroy(&state->mutex);
+	fr_state_entry_t	*entry;
+	uint32_t		i;
 
 	DEBUG4("Freeing state tree %p", state);
 
-	while ((entry = fr_dlist_head(&state->to_expire))) {
-		DEBUG4("Freeing state entry %p (%"PRIu64")", entry, entry->id);
-		state_entry_unlink(state, entry);
-		talloc_free(entry);
+	for (i = 0; i < state->num_shards; i++) {
+		state_shard_t *shard = &state->shards[i];
+
+		if (!shard->tree) continue;	/* Partially initialised */
+
+		if (state->thread_safe) pthread_mutex_destroy(&shard->mutex);
+
+		while ((entry = fr_dlist_head(&shard->to_expire))) {
+			DEBUG4("Freeing state entry %p (%"PRIu64")", entry, entry->id);
+			state_entry_unlink(shard, entry);
+			talloc_free(entry);
+		}
+
+		/*
+		 *	Free the rbtree
+		 */
+		talloc_free(shard->tree);
 	}
 
-	/*
-	 *	Free the rbtree
-	 */
-	talloc_free(state->tree);
+	return 0;
+}
+
+static int cmd_stats_state(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	fr_state_tree_t		*state = talloc_get_type_abort(ctx, fr_state_tree_t);
+	fr_state_shard_stats_t	stats;
+	uint32_t		i;
+
+	fprintf(fp, "sessions.used\t\t%u\n",
+		(unsigned int) atomic_load_explicit(&state->used_sessions, memory_order_relaxed));
+	fprintf(fp, "sessions.max\t\t%u\n", state->max_sessions);
+	fprintf(fp, "entries.created\t\t%" PRIu64 "\n", fr_state_entries_created(state));
+	fprintf(fp, "entries.timeout\t\t%" PRIu64 "\n", fr_state_entries_timeout(state));
+	fprintf(fp, "entries.tracked\t\t%" PRIu64 "\n", fr_state_entries_tracked(state));
+
+	for (i = 0; i < fr_state_shards(state); i++) {
+		if (fr_state_shard_stats(&stats, state, i) < 0) continue;
+
+		fprintf(fp, "shard.%u.tracked\t\t%" PRIu64 "\n", i, stats.tracked);
+		fprintf(fp, "shard.%u.sessions\t%u\n", i, stats.used_sessions);
+		fprintf(fp, "shard.%u.timeout\t\t%" PRIu64 "\n", i, stats.timed_out);
+		fprintf(fp, "shard.%u.locked\t\t%" PRIu64 "\n", i, stats.locked);
+		fprintf(fp, "shard.%u.contended\t%" PRIu64 "\n", i, stats.contended);
+	}
 
 	return 0;
 }
 
+static fr_cmd_table_t cmd_state_table[] = {
+	{
+		.parent = "stats",
+		.name = "state",
+		.help = "Statistics for session state.",
+		.read_only = true
+	},
+
+	{
+		.parent = "stats state",
+		.add_name = true,
+		.name = "self",
+		.func = cmd_stats_state,
+		.help = "Show session counts, and per-shard statistics for a virtual server's session state.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
 /** Initialise a new state tree
  *
  * @param[in] ctx		to link the lifecycle of the state tree to.
@@ -215,21 +342,41 @@ static int _state_tree_free(fr_state_tree_t *state)
  * @param[in] server_id		ID byte to use in load-balancing operations.
  * @param[in] context_id	Specifies a unique ctx id to prevent states being
  *				used in contexts for which they weren't intended.
+ * @param[in] name		of the virtual server the tree belongs to.  Used to
+ *				register the "stats state <name>" radmin command.
+ *				May be NULL.
  * @return
  *	- A new state tree.
  *	- NULL on failure.
  */
 fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, bool thread_safe,
 				    uint32_t max_sessions, fr_time_delta_t timeout,
-				    uint8_t server_id, uint32_t context_id)
+				    uint8_t server_id, uint32_t context_id, char const *name)
 {
 	fr_state_tree_t *state;
+	uint32_t	i;
 
 	state = talloc_zero(NULL, fr_state_tree_t);
 	if (!state) return 0;
 
 	state->max_sessions = max_sessions;
 	state->timeout = timeout;
+	atomic_init(&state->id, 0);
+	atomic_init(&state->used_sessions, 0);
+	atomic_init(&state->expire_next, 0);
+
+	/*
+	 *	Only split the tree if there are multiple
+	 *	threads to contend for it, and each shard
+	 *	still gets a reasonable share of the
+	 *	sessions.
+	 */
+	state->num_shards = 1;
+	if (thread_safe) {
+		state->num_shards = max_sessions / STATE_TREE_SHARD_SESSIONS_MIN;
+		if (state->num_shards > STATE_TREE_SHARDS_MAX) state->num_shards = STATE_TREE_SHARDS_MAX;
+		if (state->num_shards == 0) state->num_shards = 1;
+	}
 
 	/*
 	 *	Create a break in the contexts.
@@ -240,30 +387,48 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, b
 	 */
 	talloc_link_ctx(ctx, state);
 
-	if (thread_safe && (pthread_mutex_init(&state->mutex, NULL) != 0)) {
+	state->thread_safe = thread_safe;
+
+	state->shards = talloc_zero_array(state, state_shard_t, state->num_shards);
+	if (!state->shards) {
 		talloc_free(state);
 		return NULL;
 	}
+	talloc_set_destructor(state, _state_tree_free);
 
-	fr_dlist_talloc_init(&state->to_expire, fr_state_entry_t, free_entry);
+	for (i = 0; i < state->num_shards; i++) {
+		state_shard_t *shard = &state->shards[i];
 
-	/*
-	 *	We need to do controlled freeing of the
-	 *	rbtree, so that all the state entries
-	 *	are freed before it's destroyed.  Hence
-	 *	it being parented from the NULL ctx.
-	 */
-	state->tree = fr_rb_inline_talloc_alloc(NULL, fr_state_entry_t, node, state_entry_cmp, NULL);
-	if (!state->tree) {
-		talloc_free(state);
-		return NULL;
+		atomic_init(&shard->used_sessions, 0);
+
+		fr_dlist_talloc_init(&shard->to_expire, fr_state_entry_t, free_entry);
+
+		if (thread_safe && (pthread_mutex_init(&shard->mutex, NULL) != 0)) {
+			talloc_free(state);
+			return NULL;
+		}
+
+		/*
+		 *	We need to do controlled freeing of the
+		 *	rbtree, so that all the state entries
+		 *	are freed before it's destroyed.  Hence
+		 *	it being parented from the NULL ctx.
+		 */
+		shard->tree = fr_rb_inline_talloc_alloc(NULL, fr_state_entry_t, node, state_entry_cmp, NULL);
+		if (!shard->tree) {
+			if (thread_safe) pthread_mutex_destroy(&shard->mutex);
+			talloc_free(state);
+			return NULL;
+		}
 	}
-	talloc_set_destructor(state, _state_tree_free);
 
 	state->da = da;		/* Remember which attribute we use to load/store state */
 	state->server_id = server_id;
 	state->context_id = context_id;
-	state->thread_safe = thread_safe;
+
+	if (name && (fr_command_register_hook(NULL, name, state, cmd_state_table) < 0)) {
+		PWARN("Failed registering radmin commands for the %s state tree", name);
+	}
 
 	return state;
 }
@@ -272,15 +437,15 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, b
  *
  */
 static inline CC_HINT(always_inline)
-void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry)
+void state_entry_unlink(state_shard_t *shard, fr_state_entry_t *entry)
 {
 	/*
 	 *	Check the memory is still valid
 	 */
 	(void) talloc_get_type_abort(entry, fr_state_entry_t);
 
-	fr_dlist_remove(&state->to_expire, entry);
-	fr_rb_delete(state->tree, entry);
+	fr_dlist_remove(&shard->to_expire, entry);
+	fr_rb_delete(shard->tree, entry);
 
 	DEBUG4("State ID %" PRIu64 " unlinked", entry->id);
 }
@@ -320,56 +485,40 @@ static int _state_entry_free(fr_state_entry_t *entry)
 
 	DEBUG4("State ID %" PRIu64 " freed", entry->id);
 
-	entry->state_tree->used_sessions--;
+	if (entry->shard) {
+		atomic_fetch_sub_explicit(&entry->shard->used_sessions, 1, memory_order_relaxed);
+		atomic_fetch_sub_explicit(&entry->state_tree->used_sessions, 1, memory_order_relaxed);
+	}
 
 	return 0;
 }
 
-/** Create a new state entry
+/** Remove expired entries from a shard
  *
- * @note Called with the mutex held.
+ * @note Called with the shard's mutex held.
+ *
+ * @param[out] to_free	Where to add the entries which should be freed.
+ * @param[in] shard	to clean.
+ * @param[in] now	The current time.
+ * @return The number of entries that expired.
  */
-static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *request,
-					    fr_pair_list_t *reply_list, fr_state_entry_t *old)
+static uint64_t state_shard_expire(fr_dlist_head_t *to_free, state_shard_t *shard, fr_time_t now)
 {
-	size_t			i;
-	uint32_t		x;
-	fr_time_t		now = fr_time();
-	fr_pair_t		*vp;
 	fr_state_entry_t	*entry, *next;
-
-	uint8_t			old_state[sizeof(old->state)];
-	int			old_tries = 0;
 	uint64_t		timed_out = 0;
-	bool			too_many = false;
-	fr_dlist_head_t		to_free;
-
-	/*
-	 *	Shouldn't be in any lists if it's being reused
-	 */
-	fr_assert(!old ||
-		  (!fr_dlist_entry_in_list(&old->expire_entry) &&
-		   !fr_rb_node_inline_in_tree(&old->node)));
-
-	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
 
-	/*
-	 *	Clean up expired entries
-	 */
-	for (entry = fr_dlist_head(&state->to_expire);
+	for (entry = fr_dlist_head(&shard->to_expire);
 	     entry != NULL;
 	     entry = next) {
  		(void)talloc_get_type_abort(entry, fr_state_entry_t);	/* Allow examination */
-		next = fr_dlist_next(&state->to_expire, entry);		/* Advance *before* potential unlinking */
-
-		if (entry == old) continue;
+		next = fr_dlist_next(&shard->to_expire, entry);		/* Advance *before* potential unlinking */
 
 		/*
 		 *	Too old, we can delete it.
 		 */
 		if (fr_time_lt(entry->cleanup, now)) {
-			state_entry_unlink(state, entry);
-			fr_dlist_insert_tail(&to_free, entry);
+			state_entry_unlink(shard, entry);
+			fr_dlist_insert_tail(to_free, entry);
 			timed_out++;
 			continue;
 		}
@@ -377,46 +526,130 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 		break;
 	}
 
-	state->timed_out += timed_out;
+	shard->timed_out += timed_out;
 
-	if (!old) {
-		too_many = (state->used_sessions == (uint32_t) state->max_sessions);
-		if (!too_many) state->used_sessions++;	/* preemptively increment whilst we hold the mutex */
-	} else {
-		old_tries = old->tries;
-		memcpy(old_state, old->state, sizeof(old_state));
+	return timed_out;
+}
+
+/** Remove expired entries from the state tree
+ *
+ * The shard a new entry is going into is always checked, along with one
+ * other shard in turn, so entries still expire from shards which see no
+ * new sessions.  If all is true, every shard is checked.
+ *
+ * @note Called with no shards locked.
+ *
+ * @param[out] to_free	Where to add the entries which should be freed.
+ * @param[in] state	tree to clean.
+ * @param[in] shard	the new entry is going into.
+ * @param[in] now	The current time.
+ * @param[in] all	check every shard.
+ * @return The number of entries that expired.
+ */
+static uint64_t state_tree_expire(fr_dlist_head_t *to_free, fr_state_tree_t *state, state_shard_t *shard,
+				  fr_time_t now, bool all)
+{
+	state_shard_t	*other;
+	uint64_t	timed_out;
+	uint32_t	i;
+
+	if (all) {
+		for (i = 0, timed_out = 0; i < state->num_shards; i++) {
+			other = &state->shards[i];
+
+			state_shard_lock(state, other);
+			timed_out += state_shard_expire(to_free, other, now);
+			state_shard_unlock(state, other);
+		}
+
+		return timed_out;
 	}
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_lock(state, shard);
+	timed_out = state_shard_expire(to_free, shard, now);
+	state_shard_unlock(state, shard);
 
-	if (timed_out > 0) RWDEBUG("Cleaning up %"PRIu64" timed out state entries", timed_out);
+	if (state->num_shards == 1) return timed_out;
 
-	/*
-	 *	Now free the unlinked entries.
-	 *
-	 *	We do it here as freeing may involve significantly more
-	 *	work than just freeing the data.
-	 *
-	 *	If there's request data that was persisted it will now
-	 *	be freed also, and it may have complex destructors associated
-	 *	with it.
-	 */
-	while ((entry = fr_dlist_head(&to_free)) != NULL) {
-		fr_dlist_remove(&to_free, entry);
+	other = &state->shards[atomic_fetch_add_explicit(&state->expire_next, 1, memory_order_relaxed) %
+			       state->num_shards];
+	if (other == shard) return timed_out;
+
+	state_shard_lock(state, other);
+	timed_out += state_shard_expire(to_free, other, now);
+	state_shard_unlock(state, other);
+
+	return timed_out;
+}
+
+/** Free entries which have been unlinked from the state tree
+ *
+ * We do it outside of the critical region as freeing may involve
+ * significantly more work than just freeing the data.
+ *
+ * If there's request data that was persisted it will now be freed
+ * also, and it may have complex destructors associated with it.
+ */
+static void state_entry_list_free(fr_dlist_head_t *to_free)
+{
+	fr_state_entry_t *entry;
+
+	while ((entry = fr_dlist_head(to_free)) != NULL) {
+		fr_dlist_remove(to_free, entry);
 		talloc_free(entry);
 	}
+}
+
+/** Reserve a session against the tree's max_sessions limit
+ *
+ * @param[in] state	to reserve the session in.
+ * @param[in] force	reserve the session even if we're at the limit.
+ *			Used for ongoing sessions, which already held one.
+ * @return
+ *	- true if the session was reserved.
+ *	- false if we're at the limit.
+ */
+static bool state_session_reserve(fr_state_tree_t *state, bool force)
+{
+	uint_fast32_t used = atomic_load_explicit(&state->used_sessions, memory_order_relaxed);
+
+	do {
+		if (!force && (used >= state->max_sessions)) return false;
+	} while (!atomic_compare_exchange_weak_explicit(&state->used_sessions, &used, used + 1,
+							memory_order_relaxed, memory_order_relaxed));
+
+	return true;
+}
+
+/** Create a new state entry
+ *
+ * @note Called with no shards locked.  On success, returns with
+ *	the mutex of the new entry's shard held.
+ */
+static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *request,
+					    fr_pair_list_t *reply_list, fr_state_entry_t *old)
+{
+	size_t			i;
+	uint32_t		x;
+	fr_time_t		now = fr_time();
+	fr_pair_t		*vp, *state_vp = NULL;
+	fr_state_entry_t	*entry;
+	state_shard_t		*shard;
+
+	uint8_t			old_state[sizeof(old->state)];
+	int			old_tries = 0;
+	uint64_t		timed_out = 0;
+	bool			too_many = false;
+	fr_dlist_head_t		to_free;
 
 	/*
-	 *	Have to do this post-cleanup, else we end up returning with
-	 *	a list full of entries to free with none of them being
-	 *	freed which is bad...
+	 *	Shouldn't be in any lists if it's being reused
 	 */
-	if (too_many) {
-		RERROR("Failed inserting state entry - At maximum ongoing session limit (%u)",
-		       state->max_sessions);
-		PTHREAD_MUTEX_LOCK(&state->mutex);	/* Caller expects this to be locked */
-		return NULL;
-	}
+	fr_assert(!old ||
+		  (!fr_dlist_entry_in_list(&old->expire_entry) &&
+		   !fr_rb_node_inline_in_tree(&old->node)));
+
+	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
 
 	/*
 	 *	Allocation doesn't need to occur inside the critical region
@@ -425,13 +658,15 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	if (!old) {
 		MEM(entry = talloc_zero(NULL, fr_state_entry_t));
 		talloc_set_destructor(entry, _state_entry_free);
-		/* tree->used_sessions incremented above */
 	/*
 	 *	Reuse the old state entry cleaning up any memory associated
 	 *	with it.
 	 */
 	} else {
-		_state_entry_free(old);
+		old_tries = old->tries;
+		memcpy(old_state, old->state, sizeof(old_state));
+
+		_state_entry_free(old);		/* Releases its session */
 		talloc_free_children(old);
 		memset(old, 0, sizeof(*old));
 		entry = old;
@@ -441,7 +676,7 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 
 	request_data_list_init(&entry->data);
 
-	entry->id = state->id++;
+	entry->id = atomic_fetch_add_explicit(&state->id, 1, memory_order_relaxed);
 
 	/*
 	 *	Limit the lifetime of this entry based on how long the
@@ -522,17 +757,14 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 		 */
 		entry->state_comp.server_id = state->server_id;
 
-		MEM(vp = fr_pair_afrom_da(request->reply_ctx, state->da));
-		fr_pair_value_memdup(vp, entry->state, sizeof(entry->state), false);
-		fr_pair_append(reply_list, vp);
+		/*
+		 *	Only added to the reply once the entry
+		 *	has been inserted.
+		 */
+		MEM(state_vp = fr_pair_afrom_da(request->reply_ctx, state->da));
+		fr_pair_value_memdup(state_vp, entry->state, sizeof(entry->state), false);
 	}
 
-	DEBUG4("State ID %" PRIu64 " created, value 0x%pH, expires %pV",
-	       entry->id, fr_box_octets(entry->state, sizeof(entry->state)),
-	       fr_box_time_delta(fr_time_sub(entry->cleanup, now)));
-
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-
 	/*
 	 *	XOR the server hash with four bytes of random data.
 	 *	We XOR is again before resolving, to ensure state lookups
@@ -541,9 +773,60 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	 */
 	*((uint32_t *)(&entry->state_comp.context_id)) ^= state->context_id;
 
-	if (!fr_rb_insert(state->tree, entry)) {
+	/*
+	 *	Now we have the final state value, we know
+	 *	which shard the entry belongs in.
+	 */
+	shard = state_shard(state, entry);
+
+	/*
+	 *	Clean up expired entries
+	 */
+	timed_out = state_tree_expire(&to_free, state, shard, now, false);
+	state_entry_list_free(&to_free);
+
+	/*
+	 *	max_sessions applies to the whole tree, not to
+	 *	each shard.  Ongoing sessions always get a slot.
+	 *
+	 *	If we're at the limit, expired entries may be
+	 *	waiting in shards we didn't check, so check all
+	 *	of them before giving up.
+	 */
+	if (!state_session_reserve(state, (old != NULL))) {
+		timed_out += state_tree_expire(&to_free, state, shard, now, true);
+		state_entry_list_free(&to_free);
+
+		too_many = !state_session_reserve(state, false);
+	}
+
+	if (timed_out > 0) RWDEBUG("Cleaning up %"PRIu64" timed out state entries", timed_out);
+
+	if (too_many) {
+		RERROR("Failed inserting state entry - At maximum ongoing session limit (%u)",
+		       state->max_sessions);
+		talloc_free(state_vp);
+		talloc_free(entry);
+		return NULL;
+	}
+
+	atomic_fetch_add_explicit(&shard->used_sessions, 1, memory_order_relaxed);
+	entry->shard = shard;
+
+	DEBUG4("State ID %" PRIu64 " created, value 0x%pH, expires %pV",
+	       entry->id, fr_box_octets(entry->state, sizeof(entry->state)),
+	       fr_box_time_delta(fr_time_sub(entry->cleanup, now)));
+
+	state_shard_lock(state, shard);
+
+	if (!fr_rb_insert(shard->tree, entry)) {
+		state_shard_unlock(state, shard);
 		RERROR("Failed inserting state entry - Insertion into state tree failed");
-		fr_pair_delete_by_da(reply_list, state->da);
+		if (state_vp) {
+			talloc_free(state_vp);
+		} else {
+			fr_pair_delete_by_da(reply_list, state->da);
+		}
 		talloc_free(entry);
 		return NULL;
 	}
@@ -552,17 +835,21 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	 *	Link it to the end of the list, which is implicitly
 	 *	ordered by cleanup time.
 	 */
-	fr_dlist_insert_tail(&state->to_expire, entry);
+	fr_dlist_insert_tail(&shard->to_expire, entry);
+
+	if (state_vp) fr_pair_append(reply_list, state_vp);
 
 	return entry;
 }
 
 /** Find the entry based on the State attribute and remove it from the state tree
  *
+ * @note Called with no shards locked.
  */
 static fr_state_entry_t *state_entry_find_and_unlink(fr_state_tree_t *state, fr_value_box_t const *vb)
 {
-	fr_state_entry_t *entry, my_entry;
+	fr_state_entry_t	*entry, my_entry;
+	state_shard_t		*shard;
 
 	/*
 	 *	Assume our own State first.
@@ -591,11 +878,15 @@ static fr_state_entry_t *state_entry_find_and_unlink(fr_state_tree_t *state, fr_
 	 */
 	my_entry.state_comp.context_id ^= state->context_id;
 
-	entry = fr_rb_remove(state->tree, &my_entry);
+	shard = state_shard(state, &my_entry);
+
+	state_shard_lock(state, shard);
+	entry = fr_rb_remove(shard->tree, &my_entry);
 	if (entry) {
 		(void) talloc_get_type_abort(entry, fr_state_entry_t);
-		fr_dlist_remove(&state->to_expire, entry);
+		fr_dlist_remove(&shard->to_expire, entry);
 	}
+	state_shard_unlock(state, shard);
 
 	return entry;
 }
@@ -611,13 +902,8 @@ void fr_state_discard(fr_state_tree_t *state, request_t *request)
 	vp = fr_pair_find_by_da(&request->request_pairs, NULL, state->da);
 	if (!vp) return;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
 	entry = state_entry_find_and_unlink(state, &vp->data);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return;
-	}
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	if (!entry) return;
 
 	/*
 	 *	If fr_state_to_request was never called, this ensures
@@ -672,14 +958,11 @@ int fr_state_to_request(fr_state_tree_t *state, request_t *request)
 		return 1;
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
 	entry = state_entry_find_and_unlink(state, &vp->data);
 	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
 		RDEBUG2("No state entry matching &request.%pP found", vp);
 		return 2;
 	}
-   	PTHREAD_MUTEX_UNLOCK(&state->mutex);
 
 	/* Probably impossible in the current code */
 	if (unlikely(entry->thawed != NULL)) {
@@ -761,14 +1044,13 @@ int fr_request_to_state(fr_state_tree_t *state, request_t *request)
 	}
 
 	MEM(state_ctx = request_state_replace(request, NULL));
-	PTHREAD_MUTEX_LOCK(&state->mutex);
 
 	/*
-	 *	Reuses old if possible
+	 *	Reuses old if possible, and returns with
+	 *	the entry's shard locked.
 	 */
 	entry = state_entry_create(state, request, &request->reply_pairs, old);
 	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
 		RERROR("Creating state entry failed");
 
 		talloc_free(request_state_replace(request, state_ctx));
@@ -782,7 +1064,7 @@ int fr_request_to_state(fr_state_tree_t *state, request_t *request)
 	entry->seq_start = request->seq_start;
 	entry->ctx = state_ctx;
 	fr_dlist_move(&entry->data, &data);
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(state, entry->shard);
 
 	RDEBUG3("%s - saved", state->da->name);
 	REQUEST_VERIFY(request);
@@ -924,7 +1206,7 @@ void fr_state_discard_child(request_t *parent, void const *unique_ptr, int uniqu
  */
 uint64_t fr_state_entries_created(fr_state_tree_t *state)
 {
-	return state->id;
+	return atomic_load_explicit(&state->id, memory_order_relaxed);
 }
 
 /** Return number of entries that timed out
@@ -932,7 +1214,18 @@ uint64_t fr_state_entries_created(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
 {
-	return state->timed_out;
+	uint64_t	timed_out = 0;
+	uint32_t	i;
+
+	for (i = 0; i < state->num_shards; i++) {
+		state_shard_t *shard = &state->shards[i];
+
+		state_shard_lock(state, shard);
+		timed_out += shard->timed_out;
+		state_shard_unlock(state, shard);
+	}
+
+	return timed_out;
 }
 
 /** Return number of entries we're currently tracking
@@ -940,5 +1233,63 @@ uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_tracked(fr_state_tree_t *state)
 {
-	return fr_rb_num_elements(state->tree);
+	uint64_t	tracked = 0;
+	uint32_t	i;
+
+	for (i = 0; i < state->num_shards; i++) {
+		state_shard_t *shard = &state->shards[i];
+
+		state_shard_lock(state, shard);
+		tracked += fr_rb_num_elements(shard->tree);
+		state_shard_unlock(state, shard);
+	}
+
+	return tracked;
+}
+
+/** Return the number of shards the state tree is split into
+ *
+ */
+uint32_t fr_state_shards(fr_state_tree_t *state)
+{
+	return state->num_shards;
+}
+
+/** Return statistics for a single shard of the state tree
+ *
+ * The lock counters are only maintained for thread safe trees, and
+ * are intended to show whether the shards are sized correctly.
+ *
+ * @param[out] stats	to populate.
+ * @param[in] state	tree to get statistics for.
+ * @param[in] id	of the shard, 0 to fr_state_shards() - 1.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the shard doesn't exist.
+ */
+int fr_state_shard_stats(fr_state_shard_stats_t *stats, fr_state_tree_t *state, uint32_t id)
+{
+	state_shard_t *shard;
+
+	if (id >= state->num_shards) {
+		fr_strerror_printf("Invalid shard %u, state tree has %u shards", id, state->num_shards);
+		return -1;
+	}
+	shard = &state->shards[id];
+
+	/*
+	 *	Don't use state_shard_lock() here, we
+	 *	don't want to count our own accesses.
+	 */
+	if (state->thread_safe) pthread_mutex_lock(&shard->mutex);
+	*stats = (fr_state_shard_stats_t) {
+		.tracked = fr_rb_num_elements(shard->tree),
+		.used_sessions = atomic_load_explicit(&shard->used_sessions, memory_order_relaxed),
+		.timed_out = shard->timed_out,
+		.locked = shard->locked,
+		.contended = shard->contended
+	};
+	if (state->thread_safe) pthread_mutex_unlock(&shard->mutex);
+
+	return 0;
 }
@@ -35,9 +35,20 @@ extern "C" {
 
 typedef struct fr_state_tree_s fr_state_tree_t;
 
+/** Statistics for a single shard of a state tree
+ *
+ */
+typedef struct {
+	uint64_t	tracked;		//!< Entries currently in the shard.
+	uint32_t	used_sessions;		//!< Sessions in progress in the shard.
+	uint64_t	timed_out;		//!< Entries which expired before being resumed.
+	uint64_t	locked;			//!< How many times the shard's mutex was acquired.
+	uint64_t	contended;		//!< How many times we had to wait for the shard's mutex.
+} fr_state_shard_stats_t;
+
 fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, bool thread_safe,
 				    uint32_t max_sessions, fr_time_delta_t timeout,
-				    uint8_t server_id, uint32_t context_id);
+				    uint8_t server_id, uint32_t context_id, char const *name);
 
 void	fr_state_discard(fr_state_tree_t *state, request_t *request);
 
@@ -55,6 +66,9 @@ uint64_t fr_state_entries_created(fr_state_tree_t *state);
 uint64_t fr_state_entries_timeout(fr_state_tree_t *state);
 uint64_t fr_state_entries_tracked(fr_state_tree_t *state);
 
+uint32_t fr_state_shards(fr_state_tree_t *state);
+int	fr_state_shard_stats(fr_state_shard_stats_t *stats, fr_state_tree_t *state, uint32_t id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,271 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the sharded session state tree
+ *
+ * @file src/lib/server/state_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/util/dict_test.h>
+#include <freeradius-devel/util/time.h>
+
+#include <freeradius-devel/server/pair.h>
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/server/state.h>
+
+#include <unistd.h>
+
+#define TEST_MAX_SESSIONS	256
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("state_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	fr_time_start();
+}
+
+static request_t *request_fake_alloc(void)
+{
+	request_t	*request;
+
+	request = request_local_alloc_external(autofree, NULL);
+
+	request->packet = fr_packet_alloc(request, false);
+	TEST_CHECK(request->packet != NULL);
+
+	request->reply = fr_packet_alloc(request, false);
+	TEST_CHECK(request->reply != NULL);
+
+	return request;
+}
+
+static fr_state_tree_t *test_state_alloc(fr_time_delta_t timeout)
+{
+	fr_state_tree_t *state;
+
+	state = fr_state_tree_init(autofree, fr_dict_attr_test_octets, true, TEST_MAX_SESSIONS, timeout, 0, 0, NULL);
+	TEST_CHECK(state != NULL);
+
+	/*
+	 *	The tests need entries spread across
+	 *	several shards.
+	 */
+	TEST_CHECK(fr_state_shards(state) > 1);
+	TEST_MSG("shards %u", fr_state_shards(state));
+
+	return state;
+}
+
+/** Save a session, and return the State value sent in the reply
+ *
+ */
+static int test_session_save(fr_state_tree_t *state, request_t *request, fr_pair_t **state_vp)
+{
+	fr_pair_t	*vp;
+	int		ret;
+
+	TEST_CHECK(pair_append_session_state(&vp, fr_dict_attr_test_uint32) == 0);
+	vp->vp_uint32 = request->number;
+
+	ret = fr_request_to_state(state, request);
+	if (ret < 0) return ret;
+
+	*state_vp = fr_pair_find_by_da(&request->reply_pairs, NULL, fr_dict_attr_test_octets);
+	TEST_CHECK(*state_vp != NULL);
+
+	return ret;
+}
+
+/** Start TEST_MAX_SESSIONS sessions, keeping the requests so the sessions can be resumed
+ *
+ */
+static void test_sessions_fill(fr_state_tree_t *state, request_t **requests, fr_pair_t **state_vps)
+{
+	unsigned int i;
+
+	for (i = 0; i < TEST_MAX_SESSIONS; i++) {
+		requests[i] = request_fake_alloc();
+		TEST_CHECK(test_session_save(state, requests[i], &state_vps[i]) == 0);
+		TEST_MSG("Session %u of %u was refused", i, TEST_MAX_SESSIONS);
+	}
+}
+
+static void test_shard_totals(fr_state_tree_t *state, uint64_t tracked, uint64_t used)
+{
+	fr_state_shard_stats_t	stats;
+	uint64_t		total_tracked = 0, total_used = 0;
+	uint32_t		i;
+
+	for (i = 0; i < fr_state_shards(state); i++) {
+		TEST_CHECK(fr_state_shard_stats(&stats, state, i) == 0);
+		total_tracked += stats.tracked;
+		total_used += stats.used_sessions;
+	}
+	TEST_CHECK(fr_state_shard_stats(&stats, state, i) < 0);
+
+	TEST_CHECK(total_tracked == tracked);
+	TEST_MSG("Expected %" PRIu64 " tracked entries, shards have %" PRIu64, tracked, total_tracked);
+	TEST_CHECK(total_used == used);
+	TEST_MSG("Expected %" PRIu64 " used sessions, shards have %" PRIu64, used, total_used);
+}
+
+/** max_sessions is enforced across the whole tree, not per shard
+ *
+ */
+static void test_max_sessions(void)
+{
+	fr_state_tree_t	*state = test_state_alloc(fr_time_delta_from_sec(60));
+	request_t	*requests[TEST_MAX_SESSIONS], *request;
+	fr_pair_t	*state_vps[TEST_MAX_SESSIONS], *vp;
+
+	test_sessions_fill(state, requests, state_vps);
+
+	TEST_CHECK(fr_state_entries_tracked(state) == TEST_MAX_SESSIONS);
+	test_shard_totals(state, TEST_MAX_SESSIONS, TEST_MAX_SESSIONS);
+
+	request = request_fake_alloc();
+	TEST_CHECK(test_session_save(state, request, &vp) < 0);
+	TEST_CHECK(fr_state_entries_tracked(state) == TEST_MAX_SESSIONS);
+
+	talloc_free(state);
+}
+
+/** Ongoing sessions can continue when we're at max_sessions
+ *
+ */
+static void test_resume(void)
+{
+	fr_state_tree_t	*state = test_state_alloc(fr_time_delta_from_sec(60));
+	request_t	*requests[TEST_MAX_SESSIONS], *request;
+	fr_pair_t	*state_vps[TEST_MAX_SESSIONS], *vp;
+	unsigned int	i;
+
+	test_sessions_fill(state, requests, state_vps);
+
+	for (i = 0; i < TEST_MAX_SESSIONS; i += 7) {
+		request = request_fake_alloc();
+
+		TEST_CHECK(pair_append_request(&vp, fr_dict_attr_test_octets) == 0);
+		TEST_CHECK(fr_pair_value_copy(vp, state_vps[i]) == 0);
+
+		TEST_CHECK(fr_state_to_request(state, request) == 0);
+		TEST_MSG("Session %u wasn't found", i);
+
+		vp = fr_pair_find_by_da(&request->session_state_pairs, NULL, fr_dict_attr_test_uint32);
+		TEST_CHECK(vp != NULL);
+		TEST_CHECK(vp && (vp->vp_uint32 == requests[i]->number));
+
+		/*
+		 *	Still counted against max_sessions
+		 *	while the request has it.
+		 */
+		test_shard_totals(state, TEST_MAX_SESSIONS - 1, TEST_MAX_SESSIONS);
+
+		TEST_CHECK(test_session_save(state, request, &vp) == 0);
+		TEST_MSG("Session %u couldn't continue", i);
+
+		test_shard_totals(state, TEST_MAX_SESSIONS, TEST_MAX_SESSIONS);
+	}
+
+	talloc_free(state);
+}
+
+/** Expired entries are removed from every shard, not just the ones being inserted into
+ *
+ */
+static void test_expire(void)
+{
+	fr_state_tree_t	*state = test_state_alloc(fr_time_delta_from_msec(50));
+	request_t	*requests[TEST_MAX_SESSIONS], *request;
+	fr_pair_t	*state_vps[TEST_MAX_SESSIONS], *vp;
+	unsigned int	i;
+
+	test_sessions_fill(state, requests, state_vps);
+
+	usleep(100000);
+
+	/*
+	 *	Each new session checks its own shard and one
+	 *	other, so this many sessions check every shard.
+	 */
+	for (i = 0; i < fr_state_shards(state); i++) {
+		request = request_fake_alloc();
+		TEST_CHECK(test_session_save(state, request, &vp) == 0);
+		TEST_MSG("Session %u was refused, the expired sessions weren't cleaned up", i);
+	}
+
+	TEST_CHECK(fr_state_entries_timeout(state) == TEST_MAX_SESSIONS);
+	TEST_MSG("Expected %u timed out entries, got %" PRIu64, TEST_MAX_SESSIONS, fr_state_entries_timeout(state));
+	test_shard_totals(state, fr_state_shards(state), fr_state_shards(state));
+
+	talloc_free(state);
+}
+
+/** A full tree of expired entries accepts new sessions
+ *
+ */
+static void test_expire_full(void)
+{
+	fr_state_tree_t	*state = test_state_alloc(fr_time_delta_from_msec(50));
+	request_t	*requests[TEST_MAX_SESSIONS], *request;
+	fr_pair_t	*state_vps[TEST_MAX_SESSIONS], *vp;
+
+	test_sessions_fill(state, requests, state_vps);
+
+	usleep(100000);
+
+	request = request_fake_alloc();
+	TEST_CHECK(test_session_save(state, request, &vp) == 0);
+	TEST_CHECK(fr_state_entries_tracked(state) < TEST_MAX_SESSIONS);
+
+	talloc_free(state);
+}
+
+TEST_LIST = {
+	{ "max_sessions",	test_max_sessions },
+	{ "resume",		test_resume },
+	{ "expire",		test_expire },
+	{ "expire_full",	test_expire_full },
+
+	{ NULL }
+};
@@ -43,6 +43,8 @@ typedef struct trunk_s trunk_t;
 #include <freeradius-devel/util/table.h>
 #include <freeradius-devel/util/minmax_heap.h>
 
+#include <math.h>
+
 #ifdef HAVE_STDATOMIC_H
 #  include <stdatomic.h>
 #else
@@ -110,6 +112,9 @@ struct trunk_request_s {
 
 	fr_time_t		last_freed;		//!< Last time this request was freed.
 
+	fr_time_t		last_assigned;		//!< Last time this request was assigned to a connection.
+							///< Only set if the trunk is adaptive.
+
 	bool			bound_to_conn;		//!< Fail the request if there's an attempt to
 							///< re-enqueue it.
 
@@ -170,6 +175,18 @@ struct trunk_connection_s {
  							///< this connection.
  	/** @} */
 
+	/** @name Adaptive request limit
+	 * @{
+ 	 */
+	double			limit;			//!< Current request limit, before rounding.
+
+	double			latency_short;		//!< Short term average latency in nanoseconds.
+
+	double			latency_long;		//!< Long term average latency in nanoseconds.
+
+	uint64_t		latency_samples;	//!< How many latency samples we've seen.
+	/** @} */
+
 	/** @name Timers
 	 * @{
  	 */
@@ -290,12 +307,19 @@ struct trunk_s {
 							///< (open/close) connections.
 
 	uint64_t		last_req_per_conn;	//!< The last request to connection ratio we calculated.
+
+	uint32_t		target_req_per_conn;	//!< Target requests per connection.  Recalculated
+							///< from the connection limits if the trunk is adaptive.
 	/** @} */
 };
 
 static conf_parser_t const trunk_config_request[] = {
 	{ FR_CONF_OFFSET("per_connection_max", trunk_conf_t, max_req_per_conn), .dflt = "2000" },
 	{ FR_CONF_OFFSET("per_connection_target", trunk_conf_t, target_req_per_conn), .dflt = "1000" },
+	{ FR_CONF_OFFSET("per_connection_adaptive", trunk_conf_t, adaptive), .dflt = "no" },
+	{ FR_CONF_OFFSET("per_connection_start", trunk_conf_t, adaptive_start), .dflt = "20" },
+	{ FR_CONF_OFFSET("per_connection_min", trunk_conf_t, adaptive_min), .dflt = "1" },
+	{ FR_CONF_OFFSET("latency_tolerance", trunk_conf_t, adaptive_tolerance), .dflt = "1.5" },
 	{ FR_CONF_OFFSET("free_delay", trunk_conf_t, req_cleanup_delay), .dflt = "10.0" },
 
 	CONF_PARSER_TERMINATOR
@@ -919,6 +943,125 @@ static void trunk_manage(trunk_t *trunk, fr_time_t now);
 static void _trunk_timer(fr_event_list_t *el, fr_time_t now, void *uctx);
 static void trunk_backlog_drain(trunk_t *trunk);
 
+/*
+ *	Weights for the latency averages used by the adaptive
+ *	request limit.  Roughly the last 10 and the last 600
+ *	responses respectively.
+ */
+#define TRUNK_ADAPTIVE_SHORT_WEIGHT	(2.0 / 11.0)
+#define TRUNK_ADAPTIVE_LONG_WEIGHT	(2.0 / 601.0)
+#define TRUNK_ADAPTIVE_SMOOTHING	0.2		//!< How much of each new limit we apply.
+
+/** Return the maximum number of requests a connection can have
+ *
+ * @param[in] tconn	to return the limit for.
+ * @return
+ *	- 0 if there's no limit.
+ *	- The maximum number of requests.
+ */
+static inline uint32_t trunk_connection_req_limit(trunk_connection_t const *tconn)
+{
+	trunk_t *trunk = tconn->pub.trunk;
+
+	if (trunk->conf.adaptive) return tconn->pub.req_limit;
+
+	return trunk->conf.max_req_per_conn;
+}
+
+/** Feed the latency of a completed request into the connection's request limit
+ *
+ * This is a gradient controller along the lines of Netflix's concurrency-limits
+ * "Gradient2".  The short term average latency is compared with the long term
+ * average, which approximates the latency when the server isn't loaded.
+ *
+ * Whilst the short term average stays within `latency_tolerance` of the long term
+ * average, the limit grows by around its square root on each response.  Beyond that,
+ * the limit shrinks in proportion to how much latency has risen, down to half its
+ * current value.
+ *
+ * @param[in] tconn	the request completed on.
+ * @param[in] latency	between the request being assigned to the connection and completing.
+ */
+static void trunk_connection_adaptive_update(trunk_connection_t *tconn, fr_time_delta_t latency)
+{
+	trunk_t		*trunk = tconn->pub.trunk;
+	double		sample = fr_time_delta_unwrap(latency);
+	double		gradient, limit;
+	uint32_t	count;
+
+	if (sample < 1) sample = 1;
+
+	if (tconn->latency_samples++ == 0) {
+		tconn->latency_short = tconn->latency_long = sample;
+	} else {
+		tconn->latency_short += (sample - tconn->latency_short) * TRUNK_ADAPTIVE_SHORT_WEIGHT;
+		tconn->latency_long += (sample - tconn->latency_long) * TRUNK_ADAPTIVE_LONG_WEIGHT;
+
+		/*
+		 *	After a slow period the long term average
+		 *	lags behind.  Pull it down faster, so the
+		 *	slow period doesn't become the new normal.
+		 */
+		if (tconn->latency_long > (tconn->latency_short * 2)) tconn->latency_long *= 0.95;
+	}
+
+	gradient = (trunk->conf.adaptive_tolerance * tconn->latency_long) / tconn->latency_short;
+	if (gradient > 1.0) gradient = 1.0;
+	if (gradient < 0.5) gradient = 0.5;
+
+	limit = (tconn->limit * gradient) + sqrt(tconn->limit);
+
+	/*
+	 *	Don't grow the limit if we're not using it,
+	 *	or it grows without bound whilst we're idle.
+	 */
+	count = trunk_request_count_by_connection(tconn, TRUNK_REQUEST_STATE_ALL);
+	if ((limit > tconn->limit) && (count < (tconn->limit / 2))) limit = tconn->limit;
+
+	limit = (tconn->limit * (1.0 - TRUNK_ADAPTIVE_SMOOTHING)) + (limit * TRUNK_ADAPTIVE_SMOOTHING);
+
+	if (trunk->conf.max_req_per_conn && (limit > trunk->conf.max_req_per_conn)) {
+		limit = trunk->conf.max_req_per_conn;
+	}
+	if (limit < trunk->conf.adaptive_min) limit = trunk->conf.adaptive_min;
+
+	tconn->limit = limit;
+	tconn->pub.req_limit = (uint32_t)limit;
+	tconn->pub.latency = fr_time_delta_wrap((int64_t)tconn->latency_short);
+	tconn->pub.latency_baseline = fr_time_delta_wrap((int64_t)tconn->latency_long);
+}
+
+/** Return the number of requests we'd like each connection to have
+ *
+ * If the trunk is adaptive, this is recalculated from the connection
+ * limits by #trunk_manage.
+ */
+static inline uint32_t trunk_target_req_per_conn(trunk_t const *trunk)
+{
+	if (trunk->conf.adaptive) return trunk->target_req_per_conn;
+
+	return trunk->conf.target_req_per_conn;
+}
+
+/** Calculate the target requests per connection from an average adaptive limit
+ *
+ * The target keeps the same ratio to the limit as per_connection_target
+ * has to per_connection_max.  So when the server slows down and the limits
+ * shrink, we open more connections, and when it speeds up, we close them.
+ */
+static inline uint32_t trunk_adaptive_target(trunk_t const *trunk, uint64_t limit)
+{
+	uint64_t target;
+
+	if (trunk->conf.max_req_per_conn) {
+		target = (limit * trunk->conf.target_req_per_conn) / trunk->conf.max_req_per_conn;
+	} else {
+		target = limit / 2;
+	}
+
+	return target ? target : 1;
+}
+
 /** Compare two protocol requests
  *
  * Allows protocol requests to be prioritised with a function
@@ -1189,6 +1332,8 @@ static void trunk_request_enter_pending(trunk_request_t *treq, trunk_connection_
 	}
 	fr_heap_insert(&tconn->pending, treq);
 
+	if (trunk->conf.adaptive) treq->last_assigned = fr_time();
+
 	/*
 	 *	A new request has entered the trunk.
 	 *	Re-calculate request/connection ratios.
@@ -1536,6 +1681,14 @@ static void trunk_request_enter_complete(trunk_request_t *treq)
 	case TRUNK_REQUEST_STATE_SENT:
 	case TRUNK_REQUEST_STATE_PENDING:
 	case TRUNK_REQUEST_STATE_REAPABLE:
+		/*
+		 *	Update the limit first, so that the
+		 *	connection is re-evaluated against it
+		 *	as the request is removed.
+		 */
+		if (trunk->conf.adaptive && tconn) {
+			trunk_connection_adaptive_update(tconn, fr_time_sub(fr_time(), treq->last_assigned));
+		}
 		trunk_request_remove_from_conn(treq);
 		break;
 
@@ -2742,9 +2895,11 @@ trunk_enqueue_t trunk_request_enqueue_on_conn(trunk_request_t **treq_out, trunk_
 	 *	Limits check
 	 */
 	if (!ignore_limits) {
-		if (trunk->conf.max_req_per_conn &&
-		    (trunk_request_count_by_connection(tconn, TRUNK_REQUEST_STATE_ALL) >=
-		     trunk->conf.max_req_per_conn)) return TRUNK_ENQUEUE_NO_CAPACITY;
+		uint32_t limit = trunk_connection_req_limit(tconn);
+
+		if (limit && (trunk_request_count_by_connection(tconn, TRUNK_REQUEST_STATE_ALL) >= limit)) {
+			return TRUNK_ENQUEUE_NO_CAPACITY;
+		}
 
 		if (tconn->pub.state != TRUNK_CONN_ACTIVE) return TRUNK_ENQUEUE_NO_CAPACITY;
 	}
@@ -2885,17 +3040,17 @@ uint32_t trunk_request_count_by_connection(trunk_connection_t const *tconn, int
  */
 static inline void trunk_connection_auto_full(trunk_connection_t *tconn)
 {
-	trunk_t	*trunk = tconn->pub.trunk;
-	uint32_t	count;
+	uint32_t	count, limit;
 
 	if (tconn->pub.state != TRUNK_CONN_ACTIVE) return;
 
 	/*
-	 *	Enforces max_req_per_conn
+	 *	Enforces max_req_per_conn, or the adaptive limit
 	 */
-	if (trunk->conf.max_req_per_conn > 0) {
+	limit = trunk_connection_req_limit(tconn);
+	if (limit > 0) {
 		count = trunk_request_count_by_connection(tconn, TRUNK_REQUEST_STATE_ALL);
-		if (count >= trunk->conf.max_req_per_conn) trunk_connection_enter_full(tconn);
+		if (count >= limit) trunk_connection_enter_full(tconn);
 	}
 }
 
@@ -2908,14 +3063,14 @@ static inline void trunk_connection_auto_full(trunk_connection_t *tconn)
  */
 static inline bool trunk_connection_is_full(trunk_connection_t *tconn)
 {
-	trunk_t	*trunk = tconn->pub.trunk;
-	uint32_t	count;
+	uint32_t	count, limit;
 
 	/*
-	 *	Enforces max_req_per_conn
+	 *	Enforces max_req_per_conn, or the adaptive limit
 	 */
+	limit = trunk_connection_req_limit(tconn);
 	count = trunk_request_count_by_connection(tconn, TRUNK_REQUEST_STATE_ALL);
-	if ((trunk->conf.max_req_per_conn == 0) || (count < trunk->conf.max_req_per_conn)) return false;
+	if ((limit == 0) || (count < limit)) return false;
 
 	return true;
 }
@@ -3735,6 +3890,10 @@ static int trunk_connection_spawn(trunk_t *trunk, fr_time_t now)
 	MEM(tconn = talloc_zero(trunk, trunk_connection_t));
 	tconn->pub.trunk = trunk;
 	tconn->pub.state = TRUNK_CONN_HALTED;	/* All connections start in the halted state */
+	if (trunk->conf.adaptive) {
+		tconn->limit = trunk->conf.adaptive_start;
+		tconn->pub.req_limit = trunk->conf.adaptive_start;
+	}
 
 	/*
 	 *	Allocate a new connection_t or fail.
@@ -4099,6 +4258,53 @@ static void trunk_rebalance(trunk_t *trunk)
 	       					      TRUNK_REQUEST_STATE_PENDING, 1, false));
 }
 
+/** Update the trunk's averages, and the target requests per connection, from the connection limits
+ *
+ * @param[in] trunk	to update.
+ * @param[in] now	the current time.
+ */
+static void trunk_adaptive_recalculate(trunk_t *trunk, fr_time_t now)
+{
+	trunk_connection_t	*tconn;
+	fr_minmax_heap_iter_t	iter;
+	uint64_t		limit = 0;
+	int64_t			latency = 0, baseline = 0;
+	uint32_t		count = 0, target;
+
+#define ADAPTIVE_SUM(_tconn) \
+do { \
+	limit += (_tconn)->pub.req_limit; \
+	latency += fr_time_delta_unwrap((_tconn)->pub.latency); \
+	baseline += fr_time_delta_unwrap((_tconn)->pub.latency_baseline); \
+	count++; \
+} while (0)
+
+	for (tconn = fr_minmax_heap_iter_init(trunk->active, &iter);
+	     tconn;
+	     tconn = fr_minmax_heap_iter_next(trunk->active, &iter)) ADAPTIVE_SUM(tconn);
+
+	tconn = NULL;
+	while ((tconn = fr_dlist_next(&trunk->full, tconn))) ADAPTIVE_SUM(tconn);
+
+	if (count == 0) return;
+
+	trunk->pub.req_limit = limit / count;
+	trunk->pub.latency = fr_time_delta_wrap(latency / count);
+	trunk->pub.latency_baseline = fr_time_delta_wrap(baseline / count);
+
+	target = trunk_adaptive_target(trunk, trunk->pub.req_limit);
+	if (target == trunk->target_req_per_conn) return;
+
+	DEBUG4("Adaptive target requests per connection changed from %u to %u", trunk->target_req_per_conn, target);
+	trunk->target_req_per_conn = target;
+
+	/*
+	 *	The target has changed, so we may now be
+	 *	above or below it.
+	 */
+	(void)trunk_requests_per_connection(NULL, NULL, trunk, now, false);
+}
+
 /** Implements the algorithm we use to manage requests per connection levels
  *
  * This is executed periodically using a timer event, and opens/closes
@@ -4190,6 +4396,8 @@ static void trunk_manage(trunk_t *trunk, fr_time_t now)
 
 	if (new_state != trunk->pub.state) TRUNK_STATE_TRANSITION(new_state);
 
+	if (trunk->conf.adaptive) trunk_adaptive_recalculate(trunk, now);
+
 	/*
 	 *	A trunk can be signalled to not proactively
 	 *	manage connections if a destination is known
@@ -4267,7 +4475,7 @@ static void trunk_manage(trunk_t *trunk, fr_time_t now)
 		 */
 		if (conn_count > 0) {
 			average = ROUND_UP_DIV(req_count, (conn_count + 1));
-			if (average < trunk->conf.target_req_per_conn) {
+			if (average < trunk_target_req_per_conn(trunk)) {
 				DEBUG4("Not opening connection - Would leave us below our target requests "
 				       "per connection (now %u, after open %u)",
 				       ROUND_UP_DIV(req_count, conn_count), average);
@@ -4306,7 +4514,7 @@ static void trunk_manage(trunk_t *trunk, fr_time_t now)
 		}
 
 		DEBUG4("Opening connection - Above target requests per connection (now %u, target %u)",
-		       ROUND_UP_DIV(req_count, conn_count), trunk->conf.target_req_per_conn);
+		       ROUND_UP_DIV(req_count, conn_count), trunk_target_req_per_conn(trunk));
 		/* last_open set by trunk_connection_spawn */
 		(void)trunk_connection_spawn(trunk, now);
 	}
@@ -4360,14 +4568,14 @@ static void trunk_manage(trunk_t *trunk, fr_time_t now)
 		 *	will that take us above our target threshold.
 		 */
 		average = ROUND_UP_DIV(req_count, (conn_count - 1));
-		if (average > trunk->conf.target_req_per_conn) {
+		if (average > trunk_target_req_per_conn(trunk)) {
 			DEBUG4("Not closing connection - Would leave us above our target requests per connection "
 			       "(now %u, after close %u)", ROUND_UP_DIV(req_count, conn_count), average);
 			return;
 		}
 
 		DEBUG4("Closing connection - Below target requests per connection (now %u, target %u)",
-		       ROUND_UP_DIV(req_count, conn_count), trunk->conf.target_req_per_conn);
+		       ROUND_UP_DIV(req_count, conn_count), trunk_target_req_per_conn(trunk));
 
 	close:
 		if (fr_time_gt(fr_time_add(trunk->pub.last_closed, trunk->conf.close_delay), now)) {
@@ -4568,12 +4776,12 @@ static uint64_t trunk_requests_per_connection(uint16_t *conn_count_out, uint32_t
 	 *	No connections, but we do have requests
 	 */
 	if (conn_count == 0) {
-		if ((req_count > 0) && (trunk->conf.target_req_per_conn > 0)) goto above_target;
+		if ((req_count > 0) && (trunk_target_req_per_conn(trunk) > 0)) goto above_target;
 		goto done;
 	}
 
 	if (req_count == 0) {
-		if (trunk->conf.target_req_per_conn > 0) goto below_target;
+		if (trunk_target_req_per_conn(trunk) > 0) goto below_target;
 		goto done;
 	}
 
@@ -4581,7 +4789,7 @@ static uint64_t trunk_requests_per_connection(uint16_t *conn_count_out, uint32_t
 	 *	Calculate the req_per_conn
 	 */
 	req_per_conn = ROUND_UP_DIV(req_count, conn_count);
-	if (req_per_conn > trunk->conf.target_req_per_conn) {
+	if (req_per_conn > trunk_target_req_per_conn(trunk)) {
 	above_target:
 		/*
 		 *	Edge - Below target to above target (too many requests per conn - spawn more)
@@ -4589,7 +4797,7 @@ static uint64_t trunk_requests_per_connection(uint16_t *conn_count_out, uint32_t
 		 *	The equality check is correct here as both values start at 0.
 		 */
 		if (fr_time_lteq(trunk->pub.last_above_target, trunk->pub.last_below_target)) trunk->pub.last_above_target = now;
-	} else if (req_per_conn < trunk->conf.target_req_per_conn) {
+	} else if (req_per_conn < trunk_target_req_per_conn(trunk)) {
 	below_target:
 		/*
 		 *	Edge - Above target to below target (too few requests per conn - close some)
@@ -4906,6 +5114,29 @@ trunk_t *trunk_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
 
 	memcpy(&trunk->conf, conf, sizeof(trunk->conf));
 
+	/*
+	 *	Keep the adaptive limit between the minimum
+	 *	and max_req_per_conn.
+	 */
+	if (trunk->conf.adaptive) {
+		if (trunk->conf.adaptive_min == 0) trunk->conf.adaptive_min = 1;
+		if (trunk->conf.max_req_per_conn) {
+			if (trunk->conf.adaptive_min > trunk->conf.max_req_per_conn) {
+				trunk->conf.adaptive_min = trunk->conf.max_req_per_conn;
+			}
+			if (trunk->conf.adaptive_start > trunk->conf.max_req_per_conn) {
+				trunk->conf.adaptive_start = trunk->conf.max_req_per_conn;
+			}
+		}
+		if (trunk->conf.adaptive_start < trunk->conf.adaptive_min) {
+			trunk->conf.adaptive_start = trunk->conf.adaptive_min;
+		}
+		if (trunk->conf.adaptive_tolerance < 1.0) trunk->conf.adaptive_tolerance = 1.0;
+
+		trunk->pub.req_limit = trunk->conf.adaptive_start;
+		trunk->target_req_per_conn = trunk_adaptive_target(trunk, trunk->conf.adaptive_start);
+	}
+
 	memcpy(&trunk->uctx, &uctx, sizeof(trunk->uctx));
 	talloc_set_destructor(trunk, _trunk_free);
 
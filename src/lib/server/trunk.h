@@ -241,6 +241,19 @@ typedef struct {
 							///< Used to determine if we need to create new connections
 							///< and whether we can enqueue new requests.
 
+	bool			adaptive;		//!< Adjust the per-connection request limit based on
+							///< the latency of responses, instead of using
+							///< max_req_per_conn as a fixed limit.
+
+	uint32_t		adaptive_start;		//!< Per-connection request limit for new connections
+							///< when adaptive is true.
+
+	uint32_t		adaptive_min;		//!< Lowest the per-connection request limit can go
+							///< when adaptive is true.
+
+	double			adaptive_tolerance;	//!< How much the short term latency can exceed the
+							///< long term latency before the limit is reduced.
+
 	uint32_t		max_backlog;		//!< Maximum number of requests that can be in the backlog.
 
 	uint64_t		max_uses;		//!< The maximum time a connection can be used.
@@ -322,6 +335,15 @@ struct trunk_pub_s {
 	uint64_t _CONST		req_alloc_new;		//!< How many requests we've allocated.
 
 	uint64_t _CONST		req_alloc_reused;	//!< How many requests were reused.
+
+	uint32_t _CONST		req_limit;		//!< Average per-connection request limit.
+							///< Only updated if the trunk is adaptive.
+
+	fr_time_delta_t _CONST	latency;		//!< Average short term request latency.
+							///< Only updated if the trunk is adaptive.
+
+	fr_time_delta_t _CONST	latency_baseline;	//!< Average long term request latency.
+							///< Only updated if the trunk is adaptive.
 	/** @} */
 
 	bool _CONST		triggers;		//!< do we run the triggers?
@@ -365,6 +387,19 @@ struct trunk_connection_pub_s {
 	connection_t		* _CONST conn;		//!< The underlying connection.
 
 	trunk_t			* _CONST trunk;		//!< Trunk this connection belongs to.
+
+	/** @name Statistics
+	 * @{
+ 	 */
+	uint32_t _CONST		req_limit;		//!< Maximum requests this connection can have
+							///< outstanding.  Only updated if the trunk is adaptive.
+
+	fr_time_delta_t _CONST	latency;		//!< Short term average of the time between a request
+							///< being assigned to this connection and completing.
+
+	fr_time_delta_t _CONST	latency_baseline;	//!< Long term average of the same.  An estimate
+							///< of the latency when the server isn't loaded.
+	/** @} */
 };
 
 #ifndef TRUNK_TESTS
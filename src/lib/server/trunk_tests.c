@@ -1819,6 +1819,84 @@ static void test_connection_levels_alternating_edges(void)
 }
 
 #undef fr_time	/* Need to the real time */
+static void test_connection_adaptive_limit(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	trunk_t		*trunk;
+	fr_event_list_t		*el;
+	trunk_conf_t		conf = {
+					.start = 1,
+					.min = 1,
+					.max = 1,
+					.max_req_per_conn = 100,
+					.target_req_per_conn = 50,
+					.adaptive = true,
+					.adaptive_start = 20,
+					.adaptive_min = 2,
+					.adaptive_tolerance = 1.5,
+					.manage_interval = fr_time_delta_from_nsec(NSEC * 0.5)
+				};
+	test_proto_request_t	*preq = NULL;
+	trunk_request_t	*treq;
+	trunk_connection_t	*tconn;
+	uint32_t		limit;
+	size_t			i;
+
+	DEBUG_LVL_SET;
+
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	fr_event_list_set_time_func(el, test_time);
+
+	/* Need to provide a timer starting value above zero */
+	test_time_base = fr_time_add_time_delta(test_time_base, fr_time_delta_from_nsec(NSEC * 0.5));
+
+	trunk = test_setup_trunk(ctx, el, &conf, false, NULL);
+	TEST_CHECK(trunk_target_req_per_conn(trunk) == 10);
+
+	fr_event_corral(el, test_time_base, false);
+	fr_event_service(el);
+
+	TEST_CHECK(trunk_connection_count_by_state(trunk, TRUNK_CONN_ACTIVE) == 1);
+	tconn = fr_minmax_heap_min_peek(trunk->active);
+	TEST_CHECK(tconn != NULL);
+	if (!tconn) goto done;
+
+	TEST_CHECK(trunk_connection_req_limit(tconn) == 20);
+
+	/*
+	 *	Keep enough requests outstanding that
+	 *	the limit is allowed to grow.
+	 */
+	preq = talloc_zero(NULL, test_proto_request_t);
+	for (i = 0; i < 15; i++) {
+		treq = NULL;
+		TEST_CHECK(trunk_request_enqueue(&treq, trunk, NULL, preq, NULL) == TRUNK_ENQUEUE_OK);
+	}
+
+	TEST_CASE("Steady latency - Limit must grow");
+	for (i = 0; i < 50; i++) trunk_connection_adaptive_update(tconn, fr_time_delta_from_msec(10));
+	limit = trunk_connection_req_limit(tconn);
+	TEST_CHECK(limit > 20);
+	TEST_MSG("Expected limit > 20, got %u", limit);
+	TEST_CHECK(limit <= conf.max_req_per_conn);
+
+	TEST_CASE("Rising latency - Limit must shrink");
+	for (i = 0; i < 50; i++) trunk_connection_adaptive_update(tconn, fr_time_delta_from_msec(100));
+	TEST_CHECK(trunk_connection_req_limit(tconn) < limit);
+	TEST_MSG("Expected limit < %u, got %u", limit, trunk_connection_req_limit(tconn));
+	TEST_CHECK(trunk_connection_req_limit(tconn) >= conf.adaptive_min);
+	TEST_CHECK(fr_time_delta_gt(tconn->pub.latency, tconn->pub.latency_baseline));
+
+	TEST_CASE("Trunk stats reflect the connection limit");
+	trunk_adaptive_recalculate(trunk, test_time_base);
+	TEST_CHECK(trunk->pub.req_limit == trunk_connection_req_limit(tconn));
+	TEST_CHECK(trunk_target_req_per_conn(trunk) == trunk_adaptive_target(trunk, trunk->pub.req_limit));
+
+done:
+	talloc_free(ctx);
+	talloc_free(preq);
+}
+
 static void test_enqueue_and_io_speed(void)
 {
 	TALLOC_CTX		*ctx = talloc_init_const("test");
@@ -1965,6 +2043,11 @@ TEST_LIST = {
 	{ "Spawn - Connection levels max",		test_connection_levels_max },
 	{ "Spawn - Connection levels alternating edges",test_connection_levels_alternating_edges },
 
+	/*
+	 *	Adaptive request limits
+	 */
+	{ "Adaptive - Connection request limit",	test_connection_adaptive_limit },
+
 	/*
 	 *	Performance tests
 	 */
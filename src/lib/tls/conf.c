@@ -150,6 +150,11 @@ static conf_parser_t tls_verify_config[] = {
 	{ FR_CONF_OFFSET("check_crl", fr_tls_verify_conf_t, check_crl), .dflt = "no" },
 	{ FR_CONF_OFFSET("allow_expired_crl", fr_tls_verify_conf_t, allow_expired_crl) },
 	{ FR_CONF_OFFSET("allow_not_yet_valid_crl", fr_tls_verify_conf_t, allow_not_yet_valid_crl) },
+	{ FR_CONF_OFFSET_FLAGS("crl_file", CONF_FLAG_FILE_INPUT | CONF_FLAG_FILE_EXISTS, fr_tls_verify_conf_t, crl_file) },
+	{ FR_CONF_OFFSET("crl_reload_interval", fr_tls_verify_conf_t, crl_reload_interval), .dflt = "300" },
+	{ FR_CONF_OFFSET("cache", fr_tls_verify_conf_t, cache_enable), .dflt = "no" },
+	{ FR_CONF_OFFSET("cache_lifetime", fr_tls_verify_conf_t, cache_lifetime), .dflt = "3600" },
+	{ FR_CONF_OFFSET("cache_max_entries", fr_tls_verify_conf_t, cache_max_entries), .dflt = "65536" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -446,10 +451,57 @@ static X509_STORE *conf_ocsp_revocation_store(fr_tls_conf_t *conf)
  */
 static int _conf_server_free(fr_tls_conf_t *conf)
 {
+	if (conf->verify.crl) fr_tls_crl_release(conf->verify.crl);
+
 	memset(conf, 0, sizeof(*conf));
 	return 0;
 }
 
+/** Load and index the CRLs in crl_file
+ *
+ * CRLs are only indexed if check_crl is enabled.  Otherwise they're
+ * expected to be in ca_file or ca_path, and OpenSSL checks them.
+ */
+static int conf_crl_init(fr_tls_conf_t *conf)
+{
+	if (!conf->verify.crl_file) return 0;
+
+	if (!conf->verify.check_crl) {
+		WARN("Ignoring crl_file \"%s\" as check_crl is disabled", conf->verify.crl_file);
+		return 0;
+	}
+
+	conf->verify.crl = fr_tls_crl_alloc(conf->verify.crl_file, conf->ca_file, conf->ca_path,
+					    conf->verify.crl_reload_interval);
+	if (!conf->verify.crl) {
+		PERROR("Failed loading crl_file");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Allocate the cache of verified certificate chains
+ *
+ * Cached results are only invalidated when the indexed CRLs from crl_file
+ * are reloaded.  CRLs in ca_file or ca_path are checked by OpenSSL while
+ * building the chain, which a cache hit skips, so caching is refused.
+ */
+static void conf_verify_cache_init(fr_tls_conf_t *conf)
+{
+	if (!conf->verify.cache_enable) return;
+
+	if (conf->verify.check_crl && !conf->verify.crl) {
+		WARN("Disabling verify cache as check_crl is enabled without crl_file");
+		return;
+	}
+
+	FR_INTEGER_BOUND_CHECK("cache_max_entries", conf->verify.cache_max_entries, >=, 1);
+
+	conf->verify.cache = fr_tls_verify_cache_alloc(conf, conf->verify.cache_lifetime,
+						       conf->verify.cache_max_entries);
+}
+
 fr_tls_conf_t *fr_tls_conf_alloc(TALLOC_CTX *ctx)
 {
 	fr_tls_conf_t *conf;
@@ -498,6 +550,12 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 	if (conf_cert_admin_password(conf) < 0) goto error;
 #endif
 
+	if (conf_crl_init(conf) < 0) {
+		talloc_free(conf);
+		return NULL;
+	}
+	conf_verify_cache_init(conf);
+
 	/*
 	 *	Cache conf in cs in case we're asked to parse this again.
 	 */
@@ -541,6 +599,12 @@ fr_tls_conf_t *fr_tls_conf_parse_client(CONF_SECTION *cs)
 	if (conf_cert_admin_password(conf) < 0) goto error;
 #endif
 
+	if (conf_crl_init(conf) < 0) {
+		talloc_free(conf);
+		return NULL;
+	}
+	conf_verify_cache_init(conf);
+
 	cf_data_add(cs, conf, NULL, false);
 
 	return conf;
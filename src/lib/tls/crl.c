@@ -0,0 +1,829 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/crl.c
+ * @brief Indexed, reloadable certificate revocation lists.
+ *
+ * When CRLs are loaded into the X509_STORE of an SSL_CTX, refreshing them
+ * means building a new SSL_CTX, and OpenSSL's own revocation check gets
+ * expensive with very large CRLs.
+ *
+ * Instead, the CRLs in a `crl_file` are parsed once, their signatures checked
+ * against `ca_file` / `ca_path`, and the serial numbers they revoke indexed in
+ * an open addressing hash set per issuer.  Each set of indexes is immutable
+ * once built, so the verify callback can check a certificate with a single
+ * probe while holding a read lock.
+ *
+ * TLS configurations using the same files share one #fr_tls_crl_t.  A single
+ * thread polls each file at its `crl_reload_interval`, and when the file
+ * changes builds a new set of indexes and swaps it in, without disturbing
+ * handshakes in progress.  If the new file can't be loaded, the previous set
+ * is kept.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include "base.h"
+#include "crl.h"
+#include "log.h"
+#include "utils.h"
+
+#include <openssl/pem.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** A revoked serial number
+ *
+ */
+typedef struct {
+	uint32_t		hash;			//!< Of the serial number.
+	uint32_t		offset;			//!< Of the serial number in tls_crl_issuer_t->data.
+	size_t			len;			//!< Of the serial number.
+} tls_crl_serial_t;
+
+/** Serial numbers revoked by a single issuer
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the tree of issuers.
+
+	uint8_t const		*name;			//!< DER encoded issuer name.
+	size_t			name_len;
+
+	fr_time_t		this_update;		//!< Latest thisUpdate of the issuer's CRLs.
+	fr_time_t		next_update;		//!< Earliest nextUpdate of the issuer's CRLs.
+							///< fr_time_max() if none of them had one.
+
+	X509_CRL		**crls;			//!< Only used while building the index.
+	unsigned int		num_crls;
+
+	tls_crl_serial_t	*serials;		//!< Revoked serial numbers.
+	uint32_t		num_serials;
+	uint8_t			*data;			//!< Serial number octets.
+
+	uint32_t		*slots;			//!< Open addressing hash set of serials.  Each slot
+							///< holds an index into serials, plus one.
+							///< Zero means the slot is empty.
+	uint32_t		mask;			//!< Number of slots, minus one.
+} tls_crl_issuer_t;
+
+/** One version of the contents of a CRL file
+ *
+ * Immutable once built.
+ */
+typedef struct {
+	fr_rb_tree_t		*issuers;		//!< Indexes, by issuer name.
+
+	fr_time_t		loaded;			//!< When the file was loaded.
+	fr_time_delta_t		load_time;		//!< How long it took to load and index the file.
+	uint32_t		num_crls;		//!< How many CRLs the file contained.
+	uint64_t		num_serials;		//!< How many serials they revoked.
+} tls_crl_set_t;
+
+struct fr_tls_crl_s {
+	fr_dlist_t		entry;			//!< Entry in the list of CRL files.
+	unsigned int		refs;			//!< TLS configurations, and the reload thread, using us.
+							///< Protected by tls_crl_mutex.
+
+	char const		*file;			//!< Containing one or more CRLs.
+	char const		*ca_file;		//!< To find the issuers of the CRLs in.
+	char const		*ca_path;		//!< To find the issuers of the CRLs in.
+
+	fr_time_delta_t		reload_interval;	//!< How often to check if the file has changed.
+	fr_time_t		next_check;		//!< When the reload thread next checks the file.
+	struct stat		st;			//!< Of the file when it was last loaded.
+
+	pthread_rwlock_t	lock;			//!< Held for reading while checking certificates,
+							///< and for writing while swapping in a new set.
+	tls_crl_set_t		*set;			//!< The current version of the CRLs.
+
+	atomic_uint_fast64_t	lookups;		//!< Certificates checked.
+	atomic_uint_fast64_t	revoked;		//!< Certificates found to be revoked.
+	atomic_uint_fast64_t	missing;		//!< Certificates whose issuer had no CRL.
+	atomic_uint_fast64_t	loads;			//!< Times the file was loaded.
+	atomic_uint_fast64_t	load_failures;		//!< Times the file couldn't be loaded.
+};
+
+static fr_dlist_head_t		tls_crl_list;			//!< All CRL files.
+static pthread_mutex_t		tls_crl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		tls_crl_cond = PTHREAD_COND_INITIALIZER;
+static bool			tls_crl_init;			//!< tls_crl_list is initialised, and the
+								///< radmin commands are registered.
+static bool			tls_crl_running;		//!< The reload thread was started.
+static bool			tls_crl_stop;			//!< The reload thread should exit.
+static pthread_t		tls_crl_thread;
+
+/** Compare optional strings
+ *
+ */
+static inline bool tls_crl_str_eq(char const *a, char const *b)
+{
+	if (!a || !b) return a == b;
+
+	return strcmp(a, b) == 0;
+}
+
+static int8_t tls_crl_issuer_cmp(void const *one, void const *two)
+{
+	tls_crl_issuer_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, name, name_len);
+
+	return 0;
+}
+
+/** Add a CRL to the issuer it was signed by
+ *
+ */
+static int tls_crl_issuer_add(tls_crl_set_t *set, X509_CRL *crl)
+{
+	tls_crl_issuer_t	*issuer, find;
+	ASN1_TIME const		*asn1;
+	time_t			when;
+
+	if (!X509_NAME_get0_der(X509_CRL_get_issuer(crl), &find.name, &find.name_len)) {
+		fr_tls_strerror_printf("Failed encoding CRL issuer name");
+		return -1;
+	}
+
+	issuer = fr_rb_find(set->issuers, &find);
+	if (!issuer) {
+		MEM(issuer = talloc_zero(set, tls_crl_issuer_t));
+		MEM(issuer->name = talloc_memdup(issuer, find.name, find.name_len));
+		issuer->name_len = find.name_len;
+		issuer->this_update = fr_time_min();
+		issuer->next_update = fr_time_max();
+		if (!fr_rb_insert(set->issuers, issuer)) {
+			talloc_free(issuer);
+			fr_strerror_const("Failed adding CRL issuer");
+			return -1;
+		}
+	}
+
+	/*
+	 *	If the issuer splits its revocations over
+	 *	several CRLs, the merged set is only valid
+	 *	while all of them are.
+	 */
+	asn1 = X509_CRL_get0_lastUpdate(crl);
+	if (asn1 && (fr_tls_utils_asn1time_to_epoch(&when, asn1) == 0) &&
+	    fr_time_gt(fr_time_from_sec(when), issuer->this_update)) issuer->this_update = fr_time_from_sec(when);
+
+	asn1 = X509_CRL_get0_nextUpdate(crl);
+	if (asn1 && (fr_tls_utils_asn1time_to_epoch(&when, asn1) == 0) &&
+	    fr_time_lt(fr_time_from_sec(when), issuer->next_update)) issuer->next_update = fr_time_from_sec(when);
+
+	MEM(issuer->crls = talloc_realloc(issuer, issuer->crls, X509_CRL *, issuer->num_crls + 1));
+	issuer->crls[issuer->num_crls++] = crl;
+
+	return 0;
+}
+
+/** Build the hash set of serials revoked by an issuer
+ *
+ */
+static int tls_crl_issuer_index(tls_crl_issuer_t *issuer)
+{
+	uint64_t		num = 0, data_len = 0;
+	uint32_t		num_slots = 8, offset = 0;
+	unsigned int		i;
+
+	for (i = 0; i < issuer->num_crls; i++) {
+		STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(issuer->crls[i]);
+		int j;
+
+		for (j = 0; j < sk_X509_REVOKED_num(revoked); j++) {
+			num++;
+			data_len += ASN1_STRING_length(X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, j)));
+		}
+	}
+
+	if ((num >= (UINT32_MAX / 2)) || (data_len > UINT32_MAX)) {
+		fr_strerror_const("Too many revoked certificates");
+		return -1;
+	}
+
+	/*
+	 *	Keep the set at most half full, so
+	 *	probes are short.
+	 */
+	while (num_slots < (num * 2)) num_slots <<= 1;
+
+	MEM(issuer->serials = talloc_array(issuer, tls_crl_serial_t, num));
+	MEM(issuer->data = talloc_array(issuer, uint8_t, data_len));
+	MEM(issuer->slots = talloc_zero_array(issuer, uint32_t, num_slots));
+	issuer->mask = num_slots - 1;
+
+	for (i = 0; i < issuer->num_crls; i++) {
+		STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(issuer->crls[i]);
+		int j;
+
+		for (j = 0; j < sk_X509_REVOKED_num(revoked); j++) {
+			ASN1_INTEGER const	*serial = X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, j));
+			tls_crl_serial_t	*s = &issuer->serials[issuer->num_serials];
+			uint32_t		slot;
+
+			s->len = ASN1_STRING_length(serial);
+			s->offset = offset;
+			memcpy(issuer->data + offset, ASN1_STRING_get0_data(serial), s->len);
+			s->hash = fr_hash(issuer->data + offset, s->len);
+			offset += s->len;
+
+			for (slot = s->hash & issuer->mask; issuer->slots[slot]; slot = (slot + 1) & issuer->mask);
+			issuer->slots[slot] = ++issuer->num_serials;
+		}
+	}
+
+	/*
+	 *	The CRLs are freed with the stack
+	 *	they were read into.
+	 */
+	TALLOC_FREE(issuer->crls);
+	issuer->num_crls = 0;
+
+	return 0;
+}
+
+/** Check whether an issuer revoked a serial number
+ *
+ */
+static inline bool tls_crl_issuer_revoked(tls_crl_issuer_t const *issuer, uint8_t const *serial, size_t len)
+{
+	uint32_t hash = fr_hash(serial, len);
+	uint32_t slot, idx;
+
+	for (slot = hash & issuer->mask; (idx = issuer->slots[slot]) != 0; slot = (slot + 1) & issuer->mask) {
+		tls_crl_serial_t const *s = &issuer->serials[idx - 1];
+
+		if ((s->hash == hash) && (s->len == len) && (memcmp(issuer->data + s->offset, serial, len) == 0)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/** Check a CRL was signed by a CA we trust
+ *
+ */
+static int tls_crl_verify(X509_STORE_CTX *store_ctx, X509_CRL *crl)
+{
+	STACK_OF(X509)	*issuers;
+	int		i;
+	bool		found = false;
+
+	issuers = X509_STORE_CTX_get1_certs(store_ctx, X509_CRL_get_issuer(crl));
+	if (!issuers) {
+		fr_strerror_const("Issuer not found in ca_file or ca_path");
+		return -1;
+	}
+
+	/*
+	 *	The CA may have several certificates
+	 *	with the same name, after a re-key.
+	 */
+	for (i = 0; i < sk_X509_num(issuers); i++) {
+		EVP_PKEY *pkey = X509_get0_pubkey(sk_X509_value(issuers, i));
+
+		if (pkey && (X509_CRL_verify(crl, pkey) == 1)) {
+			found = true;
+			break;
+		}
+	}
+	sk_X509_pop_free(issuers, X509_free);
+	ERR_clear_error();
+
+	if (!found) {
+		fr_strerror_const("Signature doesn't match any issuer certificate in ca_file or ca_path");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Read all the CRLs in a file
+ *
+ * The file may contain any number of PEM encoded CRLs, or a single DER encoded CRL.
+ */
+static STACK_OF(X509_CRL) *tls_crl_file_read(char const *file)
+{
+	STACK_OF(X509_CRL)	*crls;
+	X509_CRL		*crl;
+	BIO			*bio;
+
+	bio = BIO_new_file(file, "r");
+	if (!bio) {
+		fr_tls_strerror_printf("Failed opening \"%s\"", file);
+		return NULL;
+	}
+
+	MEM(crls = sk_X509_CRL_new_null());
+	while ((crl = PEM_read_bio_X509_CRL(bio, NULL, NULL, NULL))) {
+		if (!sk_X509_CRL_push(crls, crl)) {
+			X509_CRL_free(crl);
+			goto error;
+		}
+	}
+
+	if ((sk_X509_CRL_num(crls) == 0) && (BIO_reset(bio) == 0)) {
+		crl = d2i_X509_CRL_bio(bio, NULL);
+		if (crl && !sk_X509_CRL_push(crls, crl)) {
+			X509_CRL_free(crl);
+			goto error;
+		}
+	}
+	BIO_free(bio);
+	ERR_clear_error();
+
+	if (sk_X509_CRL_num(crls) == 0) {
+		fr_strerror_printf("No CRLs found in \"%s\"", file);
+		sk_X509_CRL_free(crls);
+		return NULL;
+	}
+
+	return crls;
+
+error:
+	fr_strerror_printf("Failed reading CRLs from \"%s\"", file);
+	sk_X509_CRL_pop_free(crls, X509_CRL_free);
+	BIO_free(bio);
+	return NULL;
+}
+
+/** Load and index the CRLs in a file
+ *
+ * @param[in] crl	to load the file for.
+ * @return
+ *	- A new set of indexes.
+ *	- NULL on error.
+ */
+static tls_crl_set_t *tls_crl_set_load(fr_tls_crl_t const *crl)
+{
+	tls_crl_set_t		*set;
+	tls_crl_issuer_t	*issuer;
+	STACK_OF(X509_CRL)	*crls = NULL;
+	X509_STORE		*store = NULL;
+	X509_STORE_CTX		*store_ctx = NULL;
+	fr_rb_iter_inorder_t	iter;
+	fr_time_t		start = fr_time();
+	int			i;
+
+	MEM(set = talloc_zero(NULL, tls_crl_set_t));
+	MEM(set->issuers = fr_rb_inline_talloc_alloc(set, tls_crl_issuer_t, node, tls_crl_issuer_cmp, NULL));
+
+	crls = tls_crl_file_read(crl->file);
+	if (!crls) goto error;
+
+	MEM(store = X509_STORE_new());
+	if (!X509_STORE_load_locations(store, crl->ca_file, crl->ca_path)) {
+		fr_tls_strerror_printf("Failed reading CA certificates");
+		goto error;
+	}
+	MEM(store_ctx = X509_STORE_CTX_new());
+	if (!X509_STORE_CTX_init(store_ctx, store, NULL, NULL)) {
+		fr_tls_strerror_printf("Failed initialising certificate store");
+		goto error;
+	}
+
+	for (i = 0; i < sk_X509_CRL_num(crls); i++) {
+		X509_CRL *x509_crl = sk_X509_CRL_value(crls, i);
+
+		if (tls_crl_verify(store_ctx, x509_crl) < 0) {
+			char issuer_name[256];
+
+			X509_NAME_oneline(X509_CRL_get_issuer(x509_crl), issuer_name, sizeof(issuer_name));
+			fr_strerror_printf_push("Failed verifying CRL %i (issuer \"%s\") in \"%s\"",
+						i, issuer_name, crl->file);
+			goto error;
+		}
+
+		if (tls_crl_issuer_add(set, x509_crl) < 0) goto error;
+	}
+
+	for (issuer = fr_rb_iter_init_inorder(&iter, set->issuers);
+	     issuer;
+	     issuer = fr_rb_iter_next_inorder(&iter)) {
+		if (tls_crl_issuer_index(issuer) < 0) goto error;
+		set->num_serials += issuer->num_serials;
+	}
+
+	set->num_crls = sk_X509_CRL_num(crls);
+	set->loaded = fr_time();
+	set->load_time = fr_time_sub(set->loaded, start);
+
+	X509_STORE_CTX_free(store_ctx);
+	X509_STORE_free(store);
+	sk_X509_CRL_pop_free(crls, X509_CRL_free);
+
+	return set;
+
+error:
+	X509_STORE_CTX_free(store_ctx);
+	X509_STORE_free(store);
+	if (crls) sk_X509_CRL_pop_free(crls, X509_CRL_free);
+	talloc_free(set);
+
+	return NULL;
+}
+
+/** Check whether the CRL file has changed, and if so, load it and swap it in
+ *
+ * @note Called with no locks held.  The caller must hold a reference to crl.
+ */
+static void tls_crl_reload(fr_tls_crl_t *crl)
+{
+	tls_crl_set_t	*set, *old;
+	struct stat	st;
+
+	if (stat(crl->file, &st) < 0) {
+		ERROR("Failed checking CRL file \"%s\": %s", crl->file, fr_syserror(errno));
+		atomic_fetch_add_explicit(&crl->load_failures, 1, memory_order_relaxed);
+		return;
+	}
+
+	/*
+	 *	Files are usually replaced by renaming a new
+	 *	file over the old one, so check the inode too.
+	 */
+	if ((st.st_ino == crl->st.st_ino) && (st.st_size == crl->st.st_size) &&
+	    (st.st_mtime == crl->st.st_mtime)) return;
+
+	set = tls_crl_set_load(crl);
+	if (!set) {
+		PERROR("Failed reloading CRL file \"%s\", continuing with previous version", crl->file);
+		atomic_fetch_add_explicit(&crl->load_failures, 1, memory_order_relaxed);
+		return;
+	}
+	crl->st = st;
+
+	pthread_rwlock_wrlock(&crl->lock);
+	old = crl->set;
+	crl->set = set;
+	pthread_rwlock_unlock(&crl->lock);
+
+	atomic_fetch_add_explicit(&crl->loads, 1, memory_order_relaxed);
+
+	INFO("Reloaded CRL file \"%s\" - %u CRLs, %" PRIu64 " revoked certificates, in %" PRId64 " ms",
+	     crl->file, set->num_crls, set->num_serials, fr_time_delta_to_msec(set->load_time));
+
+	talloc_free(old);
+}
+
+/** Poll CRL files for changes until we're told to stop
+ *
+ */
+static void *tls_crl_reload_thread(UNUSED void *uctx)
+{
+	pthread_mutex_lock(&tls_crl_mutex);
+	while (!tls_crl_stop) {
+		fr_time_t	now = fr_time(), next = fr_time_max();
+		fr_tls_crl_t	*crl = NULL;
+
+		fr_dlist_foreach(&tls_crl_list, fr_tls_crl_t, this) {
+			if (!fr_time_delta_ispos(this->reload_interval)) continue;
+
+			if (fr_time_lt(now, this->next_check)) {
+				if (fr_time_lt(this->next_check, next)) next = this->next_check;
+				continue;
+			}
+
+			crl = this;
+			break;
+		}
+
+		if (!crl) {
+			struct timespec ts;
+
+			if (fr_time_eq(next, fr_time_max())) {
+				pthread_cond_wait(&tls_crl_cond, &tls_crl_mutex);
+			} else {
+				ts = fr_time_to_timespec(next);
+				pthread_cond_timedwait(&tls_crl_cond, &tls_crl_mutex, &ts);
+			}
+			continue;
+		}
+
+		/*
+		 *	Loading may take a while, so don't block
+		 *	configurations being added or removed.
+		 */
+		crl->next_check = fr_time_add(now, crl->reload_interval);
+		crl->refs++;
+		pthread_mutex_unlock(&tls_crl_mutex);
+
+		tls_crl_reload(crl);
+
+		pthread_mutex_lock(&tls_crl_mutex);
+		if (--crl->refs == 0) {
+			fr_dlist_remove(&tls_crl_list, crl);
+			talloc_free(crl);
+		}
+	}
+	pthread_mutex_unlock(&tls_crl_mutex);
+
+	OPENSSL_thread_stop();
+
+	return NULL;
+}
+
+/** Stop the reload thread
+ *
+ */
+static int _tls_crl_thread_free(UNUSED void *uctx)
+{
+	pthread_mutex_lock(&tls_crl_mutex);
+	if (!tls_crl_running) {
+		pthread_mutex_unlock(&tls_crl_mutex);
+		return 0;
+	}
+	tls_crl_stop = true;
+	pthread_cond_broadcast(&tls_crl_cond);
+	pthread_mutex_unlock(&tls_crl_mutex);
+
+	pthread_join(tls_crl_thread, NULL);
+
+	tls_crl_running = false;
+	tls_crl_stop = false;
+
+	return 0;
+}
+
+/** Start the reload thread if it's not already running
+ *
+ * @note Must be called with tls_crl_mutex held.
+ */
+static int tls_crl_thread_start(void)
+{
+	int ret;
+
+	if (tls_crl_running) return 0;
+
+	ret = pthread_create(&tls_crl_thread, NULL, tls_crl_reload_thread, NULL);
+	if (ret != 0) {
+		fr_strerror_printf("Failed creating CRL reload thread: %s", fr_syserror(ret));
+		return -1;
+	}
+	tls_crl_running = true;
+	fr_atexit_global(_tls_crl_thread_free, NULL);
+
+	return 0;
+}
+
+static int _tls_crl_free(fr_tls_crl_t *crl)
+{
+	pthread_rwlock_destroy(&crl->lock);
+
+	return 0;
+}
+
+static int cmd_stats_crl(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	pthread_mutex_lock(&tls_crl_mutex);
+	fr_dlist_foreach(&tls_crl_list, fr_tls_crl_t, crl) {
+		fprintf(fp, "%s\n", crl->file);
+
+		pthread_rwlock_rdlock(&crl->lock);
+		fprintf(fp, "\tcrls\t\t\t%u\n", crl->set->num_crls);
+		fprintf(fp, "\trevoked_serials\t\t%" PRIu64 "\n", crl->set->num_serials);
+		fprintf(fp, "\tlast_load_age\t\t%" PRId64 " s\n",
+			fr_time_delta_to_sec(fr_time_sub(fr_time(), crl->set->loaded)));
+		fprintf(fp, "\tlast_load_time\t\t%" PRId64 " ms\n", fr_time_delta_to_msec(crl->set->load_time));
+		pthread_rwlock_unlock(&crl->lock);
+
+		fprintf(fp, "\tloads\t\t\t%" PRIu64 "\n",
+			(uint64_t)atomic_load_explicit(&crl->loads, memory_order_relaxed));
+		fprintf(fp, "\tload_failures\t\t%" PRIu64 "\n",
+			(uint64_t)atomic_load_explicit(&crl->load_failures, memory_order_relaxed));
+		fprintf(fp, "\tlookups\t\t\t%" PRIu64 "\n",
+			(uint64_t)atomic_load_explicit(&crl->lookups, memory_order_relaxed));
+		fprintf(fp, "\trevoked\t\t\t%" PRIu64 "\n",
+			(uint64_t)atomic_load_explicit(&crl->revoked, memory_order_relaxed));
+		fprintf(fp, "\tmissing\t\t\t%" PRIu64 "\n",
+			(uint64_t)atomic_load_explicit(&crl->missing, memory_order_relaxed));
+	}
+	pthread_mutex_unlock(&tls_crl_mutex);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_crl_table[] = {
+	{
+		.parent = "stats",
+		.name = "crl",
+		.func = cmd_stats_crl,
+		.help = "Show load times and lookup counters for TLS certificate revocation lists.",
+		.read_only = true,
+	},
+
+	CMD_TABLE_END
+};
+
+/** Load and index a CRL file, or return the existing copy if another TLS configuration uses it
+ *
+ * The first load happens synchronously, so errors are reported at startup.
+ *
+ * @param[in] file		containing one or more CRLs.
+ * @param[in] ca_file		containing the CAs which signed the CRLs.
+ * @param[in] ca_path		containing the CAs which signed the CRLs.
+ * @param[in] reload_interval	How often to check the file for changes.
+ *				If zero, the file is never reloaded.
+ * @return
+ *	- The CRL store.  Must be released with #fr_tls_crl_release.
+ *	- NULL on error.
+ */
+fr_tls_crl_t *fr_tls_crl_alloc(char const *file, char const *ca_file, char const *ca_path,
+			       fr_time_delta_t reload_interval)
+{
+	fr_tls_crl_t	*crl;
+	struct stat	st;
+
+	pthread_mutex_lock(&tls_crl_mutex);
+	if (!tls_crl_init) {
+		fr_dlist_init(&tls_crl_list, fr_tls_crl_t, entry);
+
+		if (fr_command_register_hook(NULL, NULL, NULL, cmd_crl_table) < 0) {
+			pthread_mutex_unlock(&tls_crl_mutex);
+			fr_strerror_const_push("Failed registering radmin commands for CRLs");
+			return NULL;
+		}
+		tls_crl_init = true;
+	}
+
+	fr_dlist_foreach(&tls_crl_list, fr_tls_crl_t, this) {
+		if (!tls_crl_str_eq(this->file, file) ||
+		    !tls_crl_str_eq(this->ca_file, ca_file) ||
+		    !tls_crl_str_eq(this->ca_path, ca_path)) continue;
+
+		/*
+		 *	Check as often as the most demanding
+		 *	configuration wants.
+		 */
+		if (fr_time_delta_ispos(reload_interval) &&
+		    (!fr_time_delta_ispos(this->reload_interval) ||
+		     fr_time_delta_lt(reload_interval, this->reload_interval))) {
+			if (tls_crl_thread_start() < 0) {
+				pthread_mutex_unlock(&tls_crl_mutex);
+				return NULL;
+			}
+			this->reload_interval = reload_interval;
+			this->next_check = fr_time_add(fr_time(), reload_interval);
+			pthread_cond_signal(&tls_crl_cond);
+		}
+
+		this->refs++;
+		pthread_mutex_unlock(&tls_crl_mutex);
+		return this;
+	}
+	pthread_mutex_unlock(&tls_crl_mutex);
+
+	MEM(crl = talloc_zero(NULL, fr_tls_crl_t));
+	MEM(crl->file = talloc_typed_strdup(crl, file));
+	if (ca_file) MEM(crl->ca_file = talloc_typed_strdup(crl, ca_file));
+	if (ca_path) MEM(crl->ca_path = talloc_typed_strdup(crl, ca_path));
+	crl->reload_interval = reload_interval;
+	crl->refs = 1;
+	pthread_rwlock_init(&crl->lock, NULL);
+	talloc_set_destructor(crl, _tls_crl_free);
+
+	/*
+	 *	Stat first, so if the file changes while
+	 *	we're loading it, we'll load it again.
+	 */
+	if (stat(file, &st) < 0) {
+		fr_strerror_printf("Failed opening \"%s\": %s", file, fr_syserror(errno));
+	error:
+		talloc_free(crl);
+		return NULL;
+	}
+
+	crl->set = tls_crl_set_load(crl);
+	if (!crl->set) goto error;
+	crl->st = st;
+	atomic_fetch_add_explicit(&crl->loads, 1, memory_order_relaxed);
+
+	DEBUG2("Loaded CRL file \"%s\" - %u CRLs, %" PRIu64 " revoked certificates, in %" PRId64 " ms",
+	       file, crl->set->num_crls, crl->set->num_serials, fr_time_delta_to_msec(crl->set->load_time));
+
+	pthread_mutex_lock(&tls_crl_mutex);
+	crl->next_check = fr_time_add(fr_time(), reload_interval);
+	fr_dlist_insert_tail(&tls_crl_list, crl);
+
+	if (fr_time_delta_ispos(reload_interval)) {
+		if (tls_crl_thread_start() < 0) {
+			fr_dlist_remove(&tls_crl_list, crl);
+			pthread_mutex_unlock(&tls_crl_mutex);
+			goto error;
+		}
+		pthread_cond_signal(&tls_crl_cond);
+	}
+	pthread_mutex_unlock(&tls_crl_mutex);
+
+	return crl;
+}
+
+/** Release a reference to a CRL store, freeing it if no TLS configurations are using it
+ *
+ */
+void fr_tls_crl_release(fr_tls_crl_t *crl)
+{
+	pthread_mutex_lock(&tls_crl_mutex);
+	if (--crl->refs == 0) {
+		fr_dlist_remove(&tls_crl_list, crl);
+		talloc_free(crl);
+	}
+	pthread_mutex_unlock(&tls_crl_mutex);
+}
+
+/** Return a number which changes whenever a new version of the CRLs is swapped in
+ *
+ * @param[in] crl	to return the generation of.
+ * @return The generation.
+ */
+uint64_t fr_tls_crl_generation(fr_tls_crl_t *crl)
+{
+	return atomic_load_explicit(&crl->loads, memory_order_relaxed);
+}
+
+/** Check whether a certificate has been revoked
+ *
+ * Produces the same errors OpenSSL would with X509_V_FLAG_CRL_CHECK_ALL set.
+ *
+ * @param[in] crl	to check against.
+ * @param[in] cert	to check.
+ * @return
+ *	- X509_V_OK if the certificate hasn't been revoked.
+ *	- X509_V_ERR_CERT_REVOKED if the certificate has been revoked.
+ *	- X509_V_ERR_UNABLE_TO_GET_CRL if there's no CRL for the certificate's issuer.
+ *	- X509_V_ERR_CRL_NOT_YET_VALID or X509_V_ERR_CRL_HAS_EXPIRED if the issuer's
+ *	  CRLs aren't currently valid.
+ */
+int fr_tls_crl_check(fr_tls_crl_t *crl, X509 *cert)
+{
+	tls_crl_issuer_t const	*issuer;
+	tls_crl_issuer_t	find;
+	ASN1_INTEGER const	*serial;
+	fr_time_t		now;
+	int			ret;
+
+	atomic_fetch_add_explicit(&crl->lookups, 1, memory_order_relaxed);
+
+	if (!X509_NAME_get0_der(X509_get_issuer_name(cert), &find.name, &find.name_len)) return X509_V_ERR_UNSPECIFIED;
+	serial = X509_get0_serialNumber(cert);
+	now = fr_time();
+
+	pthread_rwlock_rdlock(&crl->lock);
+	issuer = fr_rb_find(crl->set->issuers, &find);
+	if (!issuer) {
+		ret = X509_V_ERR_UNABLE_TO_GET_CRL;
+		atomic_fetch_add_explicit(&crl->missing, 1, memory_order_relaxed);
+	} else if (tls_crl_issuer_revoked(issuer, ASN1_STRING_get0_data(serial), ASN1_STRING_length(serial))) {
+		ret = X509_V_ERR_CERT_REVOKED;
+		atomic_fetch_add_explicit(&crl->revoked, 1, memory_order_relaxed);
+	} else if (fr_time_lt(now, issuer->this_update)) {
+		ret = X509_V_ERR_CRL_NOT_YET_VALID;
+	} else if (fr_time_lt(issuer->next_update, now)) {
+		ret = X509_V_ERR_CRL_HAS_EXPIRED;
+	} else {
+		ret = X509_V_OK;
+	}
+	pthread_rwlock_unlock(&crl->lock);
+
+	return ret;
+}
+#endif /* WITH_TLS */
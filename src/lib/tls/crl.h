@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/crl.h
+ * @brief Indexed, reloadable certificate revocation lists.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(crl_h, "$Id$")
+
+#include "openssl_user_macros.h"
+
+#include <freeradius-devel/util/time.h>
+
+#include <openssl/x509.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fr_tls_crl_s fr_tls_crl_t;
+
+fr_tls_crl_t	*fr_tls_crl_alloc(char const *file, char const *ca_file, char const *ca_path,
+				  fr_time_delta_t reload_interval);
+
+void		fr_tls_crl_release(fr_tls_crl_t *crl);
+
+int		fr_tls_crl_check(fr_tls_crl_t *crl, X509 *cert);
+
+uint64_t	fr_tls_crl_generation(fr_tls_crl_t *crl);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
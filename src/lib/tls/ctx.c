@@ -697,6 +697,12 @@ SSL_CTX *fr_tls_ctx_alloc(fr_tls_conf_t const *conf, bool client)
 	/* This isn't accessible to use later, i.e. there's no SSL_CTX_get0_verify_cert_store */
 	SSL_CTX_set_ex_data(ctx, FR_TLS_EX_CTX_INDEX_VERIFY_STORE, verify_store);
 
+	/*
+	 *	Build and verify peer certificate chains in a
+	 *	crypto thread, if they're enabled.
+	 */
+	SSL_CTX_set_cert_verify_callback(ctx, fr_tls_verify_cert_offload_cb, NULL);
+
 	/*
 	 *	Load the CAs we trust
 	 */
@@ -882,9 +888,12 @@ post_ca:
 
 	/*
 	 *	Check the certificates for revocation.
+	 *
+	 *	If the CRLs have been indexed, the verify
+	 *	callback checks them, and OpenSSL doesn't.
 	 */
 #ifdef X509_V_FLAG_CRL_CHECK_ALL
-	if (conf->verify.check_crl) {
+	if (conf->verify.check_crl && !conf->verify.crl) {
 		cert_vpstore = SSL_CTX_get_cert_store(ctx);
 		if (cert_vpstore == NULL) {
 			fr_tls_log(NULL, "Error reading Certificate Store");
@@ -0,0 +1,376 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/offload.c
+ * @brief Run expensive handshake crypto operations in dedicated threads.
+ *
+ * The TLS handshake runs in the worker, so while OpenSSL is busy with public
+ * key operations nothing else on that worker makes progress.  During a
+ * reconnect storm that's enough to push the latency of every other request
+ * on the worker up by several milliseconds.
+ *
+ * Instead, when a handshake reaches one of these operations, the OpenSSL
+ * async job running the handshake submits it to a small pool of crypto threads
+ * shared by all workers, and pauses.  #tls_session_async_handshake_cont sees
+ * the job is outstanding and yields the request.  When the crypto thread is
+ * done, it wakes the worker with a pipe, the request is marked runnable, and
+ * the next call to SSL_read() resumes the async job where it left off.
+ *
+ * Jobs live on the stack of the paused async job, so they can't be freed
+ * until the crypto thread is done with them.  If the request is cancelled
+ * while its job is outstanding, the worker blocks until the job completes.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include "base.h"
+#include "offload.h"
+
+#include <openssl/async.h>
+#include <openssl/crypto.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+
+/** Crypto threads, shared by all workers
+ *
+ */
+typedef struct {
+	pthread_mutex_t		mutex;			//!< Protects queue and stop.
+	pthread_cond_t		cond;			//!< Signalled when there are jobs, or we're stopping.
+	fr_dlist_head_t		queue;			//!< Jobs waiting for a crypto thread.
+	bool			stop;			//!< The crypto threads should exit.
+
+	pthread_t		*threads;		//!< Crypto thread IDs.
+	uint32_t		num_threads;		//!< How many crypto threads were started.
+} tls_offload_pool_t;
+
+/** Per-worker state
+ *
+ */
+typedef struct {
+	fr_event_list_t		*el;			//!< The worker's event list.
+
+	pthread_mutex_t		mutex;			//!< Protects done, and the complete flag of our jobs.
+	pthread_cond_t		cond;			//!< Signalled as each of our jobs completes.
+	fr_dlist_head_t		done;			//!< Completed jobs whose requests haven't been resumed.
+	int			pipe[2];		//!< Wakes the worker when jobs complete.
+} tls_offload_thread_t;
+
+struct fr_tls_offload_job_s {
+	fr_dlist_t		entry;			//!< Entry in the pool queue, or the worker's done list.
+
+	fr_tls_offload_func_t	func;			//!< To run in the crypto thread.
+	void			*uctx;			//!< Passed to func.
+
+	tls_offload_thread_t	*tot;			//!< Worker which submitted the job.
+	request_t		*request;		//!< To mark runnable when the job completes.
+	bool			complete;		//!< Set by the crypto thread, with tot->mutex held.
+};
+
+static tls_offload_pool_t		*tls_offload_pool;
+static pthread_mutex_t			tls_offload_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local tls_offload_thread_t *tls_offload_thread;
+
+/** Run jobs until we're told to stop
+ *
+ */
+static void *tls_offload_crypto_thread(void *uctx)
+{
+	tls_offload_pool_t	*pool = uctx;
+	fr_tls_offload_job_t	*job;
+	tls_offload_thread_t	*tot;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->stop && !(job = fr_dlist_head(&pool->queue))) pthread_cond_wait(&pool->cond, &pool->mutex);
+		if (pool->stop) break;
+
+		fr_dlist_remove(&pool->queue, job);
+		pthread_mutex_unlock(&pool->mutex);
+
+		job->func(job->uctx);
+
+		/*
+		 *	The error stack is per thread, and nothing
+		 *	will ever look at ours.  The operation must
+		 *	record anything the worker needs in uctx.
+		 */
+		ERR_clear_error();
+
+		/*
+		 *	The worker may free the job as soon as it sees
+		 *	it's complete, and may exit as soon as it has
+		 *	no jobs outstanding, so the wakeup must be sent
+		 *	with the mutex held.
+		 */
+		tot = job->tot;
+		pthread_mutex_lock(&tot->mutex);
+		job->complete = true;
+		fr_dlist_insert_tail(&tot->done, job);
+		pthread_cond_signal(&tot->cond);
+		while ((write(tot->pipe[1], ".", 1) < 0) && (errno == EINTR));
+		pthread_mutex_unlock(&tot->mutex);
+
+		pthread_mutex_lock(&pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	OPENSSL_thread_stop();
+
+	return NULL;
+}
+
+/** Stop the crypto threads
+ *
+ * Workers have all exited by the time this is called, so there are no jobs.
+ */
+static int _tls_offload_pool_free(UNUSED void *uctx)
+{
+	tls_offload_pool_t	*pool = tls_offload_pool;
+	uint32_t		i;
+
+	if (!pool) return 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->num_threads; i++) pthread_join(pool->threads[i], NULL);
+
+	fr_assert(fr_dlist_empty(&pool->queue));
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+
+	tls_offload_pool = NULL;
+	return talloc_free(pool);
+}
+
+/** Start the crypto threads
+ *
+ * @note Must be called with tls_offload_pool_mutex held.
+ */
+static int tls_offload_pool_start(uint32_t num_threads)
+{
+	tls_offload_pool_t	*pool;
+	uint32_t		i;
+	int			ret;
+
+	MEM(pool = talloc_zero(NULL, tls_offload_pool_t));
+	MEM(pool->threads = talloc_array(pool, pthread_t, num_threads));
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	fr_dlist_init(&pool->queue, fr_tls_offload_job_t, entry);
+
+	tls_offload_pool = pool;
+
+	for (i = 0; i < num_threads; i++) {
+		ret = pthread_create(&pool->threads[i], NULL, tls_offload_crypto_thread, pool);
+		if (ret != 0) {
+			fr_strerror_printf("Failed creating TLS crypto thread: %s", fr_syserror(ret));
+			_tls_offload_pool_free(NULL);
+			return -1;
+		}
+		pool->num_threads++;
+	}
+
+	fr_atexit_global(_tls_offload_pool_free, NULL);
+
+	return 0;
+}
+
+/** Resume the requests whose jobs have completed
+ *
+ */
+static void _tls_offload_thread_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	tls_offload_thread_t	*tot = uctx;
+	fr_tls_offload_job_t	*job;
+	char			buffer[256];
+
+	while (read(fd, buffer, sizeof(buffer)) == sizeof(buffer));
+
+	pthread_mutex_lock(&tot->mutex);
+	while ((job = fr_dlist_pop_head(&tot->done))) unlang_interpret_mark_runnable(job->request);
+	pthread_mutex_unlock(&tot->mutex);
+}
+
+static int _tls_offload_thread_free(tls_offload_thread_t *tot)
+{
+	if (tot->el) (void) fr_event_fd_delete(tot->el, tot->pipe[0], FR_EVENT_FILTER_IO);
+
+	/*
+	 *	Wait for the crypto thread to finish
+	 *	with our pipe.
+	 */
+	pthread_mutex_lock(&tot->mutex);
+	fr_assert(fr_dlist_empty(&tot->done));
+	close(tot->pipe[0]);
+	close(tot->pipe[1]);
+	pthread_mutex_unlock(&tot->mutex);
+
+	pthread_cond_destroy(&tot->cond);
+	pthread_mutex_destroy(&tot->mutex);
+
+	tls_offload_thread = NULL;
+
+	return 0;
+}
+
+/** Attach a worker to the crypto threads, starting them if this is the first worker
+ *
+ * @param[in] ctx		to allocate the worker's state in.  Must not be freed
+ *				while the worker has TLS sessions.
+ * @param[in] el		the worker's event list.
+ * @param[in] num_threads	how many crypto threads to start.  If 0, handshake
+ *				crypto operations are performed in the worker.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_tls_offload_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el, uint32_t num_threads)
+{
+	tls_offload_thread_t	*tot;
+
+	if (num_threads == 0) return 0;
+
+	pthread_mutex_lock(&tls_offload_pool_mutex);
+	if (!tls_offload_pool && (tls_offload_pool_start(num_threads) < 0)) {
+		pthread_mutex_unlock(&tls_offload_pool_mutex);
+		return -1;
+	}
+	pthread_mutex_unlock(&tls_offload_pool_mutex);
+
+	MEM(tot = talloc_zero(ctx, tls_offload_thread_t));
+	if (pipe(tot->pipe) < 0) {
+		fr_strerror_printf("Failed opening TLS crypto thread wakeup pipe: %s", fr_syserror(errno));
+		talloc_free(tot);
+		return -1;
+	}
+	(void) fcntl(tot->pipe[0], F_SETFL, O_NONBLOCK | FD_CLOEXEC);
+	(void) fcntl(tot->pipe[1], F_SETFL, O_NONBLOCK | FD_CLOEXEC);
+	pthread_mutex_init(&tot->mutex, NULL);
+	pthread_cond_init(&tot->cond, NULL);
+	fr_dlist_init(&tot->done, fr_tls_offload_job_t, entry);
+	talloc_set_destructor(tot, _tls_offload_thread_free);
+
+	if (fr_event_fd_insert(tot, NULL, el, tot->pipe[0], _tls_offload_thread_read, NULL, NULL, tot) < 0) {
+		fr_strerror_const_push("Failed adding TLS crypto thread wakeup pipe to event list");
+		talloc_free(tot);
+		return -1;
+	}
+	tot->el = el;
+
+	tls_offload_thread = tot;
+
+	return 0;
+}
+
+/** Whether an operation in this handshake can be passed to a crypto thread
+ *
+ * @param[in] tls_session	the handshake is for.
+ * @return
+ *	- true if #fr_tls_offload_run will pass the operation to a crypto thread.
+ *	- false if it would be run in the worker.
+ */
+bool fr_tls_offload_enabled(fr_tls_session_t const *tls_session)
+{
+	return tls_offload_thread && tls_session->can_pause && ASYNC_get_current_job();
+}
+
+/** Run an operation in a crypto thread, pausing the handshake until it's complete
+ *
+ * Must be called from an OpenSSL callback, under #tls_session_async_handshake_cont.
+ * If the operation can't be passed to a crypto thread, it's run in the worker.
+ *
+ * @param[in] tls_session	the operation is for.
+ * @param[in] func		to run.
+ * @param[in] uctx		to pass to func.  Must not be freed until we return.
+ */
+void fr_tls_offload_run(fr_tls_session_t *tls_session, fr_tls_offload_func_t func, void *uctx)
+{
+	tls_offload_pool_t	*pool = tls_offload_pool;
+	tls_offload_thread_t	*tot = tls_offload_thread;
+	fr_tls_offload_job_t	job;
+
+	if (!fr_tls_offload_enabled(tls_session)) {
+		func(uctx);
+		return;
+	}
+
+	job = (fr_tls_offload_job_t) {
+		.func = func,
+		.uctx = uctx,
+		.tot = tot,
+		.request = fr_tls_session_request(tls_session->ssl)
+	};
+
+	pthread_mutex_lock(&pool->mutex);
+	fr_dlist_insert_tail(&pool->queue, &job);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	/*
+	 *	Jumps back to SSL_read() in session.c, which
+	 *	yields until the crypto thread is done.
+	 */
+	tls_session->offload = &job;
+	ASYNC_pause_job();
+
+	/*
+	 *	If the request was cancelled we may have been
+	 *	resumed early.  The job is on our stack, so we
+	 *	can't return until the crypto thread is done with
+	 *	it, and it must not be left in the done list.
+	 */
+	pthread_mutex_lock(&tot->mutex);
+	while (!job.complete) pthread_cond_wait(&tot->cond, &tot->mutex);
+	(void) fr_dlist_remove(&tot->done, &job);
+	pthread_mutex_unlock(&tot->mutex);
+
+	tls_session->offload = NULL;
+}
+
+/** Whether the handshake is paused waiting for a crypto thread
+ *
+ * @param[in] tls_session	to check.
+ * @return
+ *	- true if the request should yield.  It will be marked
+ *	  runnable when the crypto thread is done.
+ *	- false if there's no outstanding job.
+ */
+bool fr_tls_offload_pending(fr_tls_session_t const *tls_session)
+{
+	return tls_session->offload != NULL;
+}
+#endif /* WITH_TLS */
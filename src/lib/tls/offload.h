@@ -0,0 +1,68 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/offload.h
+ * @brief Run expensive handshake crypto operations in dedicated threads.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(offload_h, "$Id$")
+
+#include "openssl_user_macros.h"
+
+#include <freeradius-devel/util/event.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fr_tls_offload_job_s fr_tls_offload_job_t;
+
+/** Operation to run in a crypto thread
+ *
+ * Must not use the request, log, or touch anything belonging to the worker
+ * other than the memory pointed to by uctx.
+ *
+ * @param[in] uctx	passed to #fr_tls_offload_run.
+ */
+typedef void (*fr_tls_offload_func_t)(void *uctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int		fr_tls_offload_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el, uint32_t num_threads);
+
+bool		fr_tls_offload_enabled(fr_tls_session_t const *tls_session);
+
+void		fr_tls_offload_run(fr_tls_session_t *tls_session, fr_tls_offload_func_t func, void *uctx);
+
+bool		fr_tls_offload_pending(fr_tls_session_t const *tls_session);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -1424,7 +1424,7 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 	 *	asynchronously.
 	 */
 	switch (err = SSL_get_error(tls_session->ssl, tls_session->last_ret)) {
-	case SSL_ERROR_WANT_ASYNC:	/* Certification validation or cache loads */
+	case SSL_ERROR_WANT_ASYNC:	/* Certification validation, cache loads, or crypto offload */
 	{
 		unlang_action_t ua;
 
@@ -1466,9 +1466,21 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 			IGNORE(unlang_function_clear(request), int);
 			goto error;
 
-		default:
+		case UNLANG_ACTION_PUSHED_CHILD:
 			return ua;
+
+		default:
+			break;
 		}
+
+		/*
+		 *	Finally, wait for a crypto thread to finish
+		 *	a handshake operation.  We're marked runnable
+		 *	once it's done.
+		 */
+		if (fr_tls_offload_pending(tls_session)) return UNLANG_ACTION_YIELD;
+
+		return ua;
 	}
 
 	case SSL_ERROR_WANT_ASYNC_JOB:
@@ -38,6 +38,7 @@ typedef struct fr_tls_session_s fr_tls_session_t;
 #include "conf.h"
 #include "index.h"
 #include "verify.h"
+#include "offload.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -138,6 +139,10 @@ struct fr_tls_session_s {
 	bool			client_cert_ok;			//!< whether or not the client certificate was validated
 	bool			can_pause;			//!< If true, it's ok to pause the request
 								///< using the OpenSSL async API.
+	fr_tls_offload_job_t	*offload;			//!< Crypto thread job we're paused waiting for.
+	bool			verify_cached;			//!< Replaying a cached chain to the verify callback.
+	int			verify_cached_untrusted;	//!< How many certificates in the cached chain
+								///< the peer sent.
 
 	uint8_t			alerts_sent;
 	bool			pending_alert;
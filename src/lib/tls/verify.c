@@ -35,11 +35,21 @@
 #include <freeradius-devel/unlang/interpret.h>
 #include <freeradius-devel/unlang/subrequest.h>
 #include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/strerror.h>
 #include <freeradius-devel/util/syserror.h>
 
 #include "attrs.h"
 #include "base.h"
+#include "offload.h"
+#include "utils.h"
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <openssl/x509v3.h>
+
+#include <pthread.h>
 
 /** Check to see if a verification operation should apply to a certificate
  *
@@ -145,7 +155,6 @@ int fr_tls_verify_cert_cb(int ok, X509_STORE_CTX *x509_ctx)
 	cert = X509_STORE_CTX_get_current_cert(x509_ctx);
 	err = X509_STORE_CTX_get_error(x509_ctx);
 	depth = X509_STORE_CTX_get_error_depth(x509_ctx);
-	untrusted = X509_STORE_CTX_get_num_untrusted(x509_ctx);
 
 	/*
 	 *	Retrieve the pointer to the SSL of the connection currently treated
@@ -157,6 +166,14 @@ int fr_tls_verify_cert_cb(int ok, X509_STORE_CTX *x509_ctx)
 	tls_session = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_TLS_SESSION), fr_tls_session_t);
 	request = fr_tls_session_request(tls_session->ssl);
 
+	/*
+	 *	No chain was built for a cached result, so
+	 *	OpenSSL doesn't know how many certificates
+	 *	the peer sent.
+	 */
+	untrusted = tls_session->verify_cached ? tls_session->verify_cached_untrusted :
+						 X509_STORE_CTX_get_num_untrusted(x509_ctx);
+
 	/*
 	 *	If this error appears it suggests
 	 *	that OpenSSL is trying to perform post-handshake
@@ -194,6 +211,22 @@ int fr_tls_verify_cert_cb(int ok, X509_STORE_CTX *x509_ctx)
 		}
 	}
 
+	/*
+	 *	If the CRLs have been indexed, OpenSSL hasn't
+	 *	checked them, so do it here.  Trust anchors
+	 *	are skipped, as they'd have to revoke themselves.
+	 */
+	if (my_ok && conf->verify.crl && !(X509_get_extension_flags(cert) & EXFLAG_SS)) {
+		int crl_err;
+
+		crl_err = fr_tls_crl_check(conf->verify.crl, cert);
+		if (crl_err != X509_V_OK) {
+			my_ok = 0;
+			err = crl_err;
+			X509_STORE_CTX_set_error(x509_ctx, err);
+		}
+	}
+
 	/*
 	 *	See if the user has disabled verification for
 	 *      this certificate.  If they have, force verification
@@ -326,6 +359,487 @@ done:
 DIAG_ON(used-but-marked-unused)
 DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 
+/** A call OpenSSL made to the verify callback, while verifying the chain in a crypto thread
+ *
+ */
+typedef struct {
+	X509				*cert;		//!< Current certificate.  We hold a reference.
+	int				ok;		//!< Preverify result.
+	int				err;		//!< Error, if ok is 0.
+	int				depth;		//!< Depth of the current certificate.
+} tls_verify_offload_call_t;
+
+/** State for verifying a certificate chain in a crypto thread
+ *
+ */
+typedef struct {
+	X509_STORE_CTX			*x509_ctx;	//!< Being verified.
+	X509_STORE_CTX_verify_cb	verify_cb;	//!< The callback OpenSSL would have called.
+
+	tls_verify_offload_call_t	*calls;		//!< Recorded calls to the verify callback.
+	unsigned int			num_calls;	//!< How many calls were recorded.
+
+	int				ret;		//!< What X509_verify_cert() returned.
+} tls_verify_offload_t;
+
+/** The chain the current crypto thread is verifying
+ *
+ */
+static _Thread_local tls_verify_offload_t *tls_verify_offload_current;
+
+/** Record a call to the verify callback so that it can be replayed in the worker
+ *
+ * Always continues verification, so that we see every call OpenSSL would've
+ * made if the real callback had chosen to continue.  If the real callback
+ * stops verification, we stop replaying at the same point.
+ */
+static int tls_verify_offload_record(int ok, X509_STORE_CTX *x509_ctx)
+{
+	tls_verify_offload_t		*vo = tls_verify_offload_current;
+	tls_verify_offload_call_t	*call;
+
+	if ((vo->num_calls % 8) == 0) {
+		MEM(vo->calls = talloc_realloc(NULL, vo->calls, tls_verify_offload_call_t, vo->num_calls + 8));
+	}
+
+	call = &vo->calls[vo->num_calls++];
+	call->cert = X509_STORE_CTX_get_current_cert(x509_ctx);
+	if (call->cert) X509_up_ref(call->cert);
+	call->ok = ok;
+	call->err = X509_STORE_CTX_get_error(x509_ctx);
+	call->depth = X509_STORE_CTX_get_error_depth(x509_ctx);
+
+	return 1;
+}
+
+/** Build and verify the chain, running in a crypto thread
+ *
+ */
+static void tls_verify_offload_chain(void *uctx)
+{
+	tls_verify_offload_t *vo = uctx;
+
+	tls_verify_offload_current = vo;
+	X509_STORE_CTX_set_verify_cb(vo->x509_ctx, tls_verify_offload_record);
+	vo->ret = X509_verify_cert(vo->x509_ctx);
+	tls_verify_offload_current = NULL;
+}
+
+/** Verify the peer's certificate chain, in a crypto thread if possible
+ *
+ * Chain building and the signature checks are done in a crypto thread, with
+ * the calls to the verify callback recorded.  Once the worker resumes, the
+ * calls are replayed to the real callback (#fr_tls_verify_cert_cb), which
+ * needs the request, and may call the `verify certificate { ... }` section.
+ */
+static int tls_verify_chain(X509_STORE_CTX *x509_ctx, fr_tls_session_t *tls_session)
+{
+	tls_verify_offload_t	vo;
+	unsigned int		i;
+	int			ret;
+
+	if (!fr_tls_offload_enabled(tls_session)) return X509_verify_cert(x509_ctx);
+
+	vo = (tls_verify_offload_t) {
+		.x509_ctx = x509_ctx,
+		.verify_cb = X509_STORE_CTX_get_verify_cb(x509_ctx)
+	};
+
+	fr_tls_offload_run(tls_session, tls_verify_offload_chain, &vo);
+
+	X509_STORE_CTX_set_verify_cb(x509_ctx, vo.verify_cb);
+
+	ret = vo.ret;
+	for (i = 0; i < vo.num_calls; i++) {
+		tls_verify_offload_call_t *call = &vo.calls[i];
+
+		X509_STORE_CTX_set_current_cert(x509_ctx, call->cert);
+		X509_STORE_CTX_set_error_depth(x509_ctx, call->depth);
+
+		/*
+		 *	Only failed calls set the error.  For
+		 *	the others it's whatever the previous
+		 *	call to the real callback left it as.
+		 */
+		if (!call->ok) X509_STORE_CTX_set_error(x509_ctx, call->err);
+
+		/*
+		 *	Stopped where X509_verify_cert() would
+		 *	have, so set the error it would have.
+		 */
+		if (!vo.verify_cb(call->ok, x509_ctx)) {
+			if (X509_STORE_CTX_get_error(x509_ctx) == X509_V_OK) {
+				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_UNSPECIFIED);
+			}
+			ret = 0;
+			break;
+		}
+	}
+
+	for (i = 0; i < vo.num_calls; i++) X509_free(vo.calls[i].cert);
+	talloc_free(vo.calls);
+
+	return ret;
+}
+
+/** Chains which have been verified successfully
+ *
+ * Shared by all workers using a TLS configuration.
+ */
+struct fr_tls_verify_cache_s {
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	fr_hash_table_t		*ht;			//!< Entries, by key.
+	fr_dlist_head_t		lru;			//!< Entries, most recently used first.
+
+	fr_time_delta_t		lifetime;		//!< Maximum time to keep an entry.
+	uint32_t		max_entries;		//!< Maximum number of entries.
+};
+
+/** A chain which was verified successfully
+ *
+ */
+typedef struct {
+	uint8_t			key[SHA256_DIGEST_LENGTH];	//!< Hash of the peer's certificate, and any
+								///< intermediates it sent.
+	fr_dlist_t		entry;			//!< Entry in the LRU list.
+
+	fr_time_t		not_before;		//!< Latest notBefore of the certificates in the chain.
+	fr_time_t		expires;		//!< Earliest notAfter of the certificates in the chain,
+							///< or when the entry reaches its lifetime.
+	uint64_t		crl_generation;		//!< Of the indexed CRLs the chain was checked against.
+
+	STACK_OF(X509)		*chain;			//!< The verified chain, leaf first.  We hold references.
+	int			num_untrusted;		//!< How many certificates in the chain the peer sent.
+
+	fr_pair_list_t		pairs;			//!< TLS-Certificate attributes extracted from the chain.
+} tls_verify_cache_entry_t;
+
+static uint32_t tls_verify_cache_hash(void const *data)
+{
+	tls_verify_cache_entry_t const *entry = data;
+
+	return fr_hash(entry->key, sizeof(entry->key));
+}
+
+static int8_t tls_verify_cache_cmp(void const *one, void const *two)
+{
+	tls_verify_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = memcmp(a->key, b->key, sizeof(a->key));
+	return CMP(ret, 0);
+}
+
+static int _tls_verify_cache_entry_free(tls_verify_cache_entry_t *entry)
+{
+	if (entry->chain) sk_X509_pop_free(entry->chain, X509_free);
+
+	return 0;
+}
+
+static void tls_verify_cache_entry_free(void *data)
+{
+	talloc_free(data);
+}
+
+static int _tls_verify_cache_free(fr_tls_verify_cache_t *cache)
+{
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate a cache of verified certificate chains
+ *
+ * @param[in] ctx		to allocate the cache in.
+ * @param[in] lifetime		Maximum time to keep a result.
+ * @param[in] max_entries	Maximum number of results to keep.
+ * @return The new cache.
+ */
+fr_tls_verify_cache_t *fr_tls_verify_cache_alloc(TALLOC_CTX *ctx, fr_time_delta_t lifetime, uint32_t max_entries)
+{
+	fr_tls_verify_cache_t *cache;
+
+	MEM(cache = talloc_zero(ctx, fr_tls_verify_cache_t));
+	MEM(cache->ht = fr_hash_table_alloc(cache, tls_verify_cache_hash, tls_verify_cache_cmp,
+					    tls_verify_cache_entry_free));
+	fr_dlist_init(&cache->lru, tls_verify_cache_entry_t, entry);
+	pthread_mutex_init(&cache->mutex, NULL);
+	talloc_set_destructor(cache, _tls_verify_cache_free);
+
+	cache->lifetime = lifetime;
+	cache->max_entries = max_entries;
+
+	return cache;
+}
+
+/** Hash the certificates the peer sent
+ *
+ * The chain OpenSSL builds depends only on these, and on our configuration.
+ */
+static int tls_verify_cache_key(uint8_t out[SHA256_DIGEST_LENGTH], X509_STORE_CTX *x509_ctx)
+{
+	STACK_OF(X509)	*untrusted = X509_STORE_CTX_get0_untrusted(x509_ctx);
+	EVP_MD_CTX	*md_ctx;
+	uint8_t		digest[EVP_MAX_MD_SIZE];
+	unsigned int	len;
+	int		i;
+	int		ret = -1;
+
+	MEM(md_ctx = EVP_MD_CTX_new());
+	if (EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL) != 1) goto done;
+
+	if ((X509_digest(X509_STORE_CTX_get0_cert(x509_ctx), EVP_sha256(), digest, &len) != 1) ||
+	    (EVP_DigestUpdate(md_ctx, digest, len) != 1)) goto done;
+
+	for (i = 0; i < sk_X509_num(untrusted); i++) {
+		if ((X509_digest(sk_X509_value(untrusted, i), EVP_sha256(), digest, &len) != 1) ||
+		    (EVP_DigestUpdate(md_ctx, digest, len) != 1)) goto done;
+	}
+
+	if (EVP_DigestFinal_ex(md_ctx, out, NULL) != 1) goto done;
+	ret = 0;
+
+done:
+	EVP_MD_CTX_free(md_ctx);
+	if (ret < 0) ERR_clear_error();
+
+	return ret;
+}
+
+/** Free an entry, with the cache mutex held
+ *
+ */
+static void tls_verify_cache_entry_remove(fr_tls_verify_cache_t *cache, tls_verify_cache_entry_t *entry)
+{
+	fr_dlist_remove(&cache->lru, entry);
+	(void) fr_hash_table_delete(cache->ht, entry);
+}
+
+/** Restore the attributes for a chain we've verified before
+ *
+ * @param[in] cache		to search.
+ * @param[in] request		to restore the attributes to.
+ * @param[in] conf		the chain was verified with.
+ * @param[in] key		of the chain, from #tls_verify_cache_key.
+ * @param[out] untrusted	How many certificates in the chain the peer sent.
+ * @return
+ *	- The verified chain, if it was found and is still valid.
+ *	  Must be freed with sk_X509_pop_free().
+ *	- NULL if the chain must be verified.
+ */
+static STACK_OF(X509) *tls_verify_cache_find(fr_tls_verify_cache_t *cache, request_t *request,
+					     fr_tls_conf_t const *conf, uint8_t const key[SHA256_DIGEST_LENGTH],
+					     int *untrusted)
+{
+	tls_verify_cache_entry_t	*entry, find;
+	fr_time_t			now = fr_time();
+	STACK_OF(X509)			*found = NULL;
+
+	memcpy(find.key, key, sizeof(find.key));
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = fr_hash_table_find(cache->ht, &find);
+	if (!entry) goto done;
+
+	/*
+	 *	The CRLs have changed, or one of the
+	 *	certificates has expired.
+	 */
+	if ((conf->verify.crl && (entry->crl_generation != fr_tls_crl_generation(conf->verify.crl))) ||
+	    fr_time_lt(now, entry->not_before) || fr_time_lteq(entry->expires, now)) {
+		tls_verify_cache_entry_remove(cache, entry);
+		goto done;
+	}
+
+	/*
+	 *	Something already produced certificate
+	 *	attributes, so let the callback produce
+	 *	them again rather than mixing the two.
+	 */
+	if (!fr_pair_find_by_da(&request->session_state_pairs, NULL, attr_tls_certificate) &&
+	    (fr_pair_list_copy(request->session_state_ctx, &request->session_state_pairs, &entry->pairs) < 0)) {
+		fr_pair_delete_by_da(&request->session_state_pairs, attr_tls_certificate);
+		goto done;
+	}
+
+	found = X509_chain_up_ref(entry->chain);
+	if (!found) {
+		fr_pair_delete_by_da(&request->session_state_pairs, attr_tls_certificate);
+		goto done;
+	}
+	*untrusted = entry->num_untrusted;
+
+	fr_dlist_remove(&cache->lru, entry);
+	fr_dlist_insert_head(&cache->lru, entry);
+
+done:
+	pthread_mutex_unlock(&cache->mutex);
+
+	return found;
+}
+
+/** Record a chain which was verified successfully
+ *
+ */
+static void tls_verify_cache_insert(fr_tls_verify_cache_t *cache, request_t *request, fr_tls_conf_t const *conf,
+				    X509_STORE_CTX *x509_ctx, uint8_t const key[SHA256_DIGEST_LENGTH])
+{
+	STACK_OF(X509)			*chain = X509_STORE_CTX_get0_chain(x509_ctx);
+	tls_verify_cache_entry_t	*entry, *old;
+	int				i;
+
+	if (!chain) return;
+
+	/*
+	 *	Entries are shared between workers, so they
+	 *	can't be parented by anything a worker owns.
+	 */
+	MEM(entry = talloc_zero(NULL, tls_verify_cache_entry_t));
+	talloc_set_destructor(entry, _tls_verify_cache_entry_free);
+	memcpy(entry->key, key, sizeof(entry->key));
+	fr_pair_list_init(&entry->pairs);
+	entry->num_untrusted = X509_STORE_CTX_get_num_untrusted(x509_ctx);
+	entry->not_before = fr_time_min();
+	entry->expires = fr_time_add(fr_time(), cache->lifetime);
+	if (conf->verify.crl) entry->crl_generation = fr_tls_crl_generation(conf->verify.crl);
+
+	for (i = 0; i < sk_X509_num(chain); i++) {
+		X509	*cert = sk_X509_value(chain, i);
+		time_t	when;
+
+		if (fr_tls_utils_asn1time_to_epoch(&when, X509_get0_notBefore(cert)) < 0) goto error;
+		if (fr_time_gt(fr_time_from_sec(when), entry->not_before)) entry->not_before = fr_time_from_sec(when);
+
+		if (fr_tls_utils_asn1time_to_epoch(&when, X509_get0_notAfter(cert)) < 0) goto error;
+		if (fr_time_lt(fr_time_from_sec(when), entry->expires)) entry->expires = fr_time_from_sec(when);
+	}
+
+	entry->chain = X509_chain_up_ref(chain);
+	if (!entry->chain ||
+	    (fr_pair_list_copy_by_da(entry, &entry->pairs, &request->session_state_pairs, attr_tls_certificate, 0) < 0)) {
+	error:
+		talloc_free(entry);
+		return;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	old = fr_hash_table_find(cache->ht, entry);
+	if (old) tls_verify_cache_entry_remove(cache, old);
+
+	if ((fr_hash_table_num_elements(cache->ht) >= cache->max_entries) &&
+	    (old = fr_dlist_tail(&cache->lru))) tls_verify_cache_entry_remove(cache, old);
+
+	if (!fr_hash_table_insert(cache->ht, entry)) {
+		pthread_mutex_unlock(&cache->mutex);
+		talloc_free(entry);
+		return;
+	}
+	fr_dlist_insert_head(&cache->lru, entry);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Replay a cached chain to the verify callback
+ *
+ * Calls it for each certificate, deepest first, the same way OpenSSL does
+ * after building a chain.  That re-runs the checks which depend on the
+ * certificate and its depth, such as the indexed CRLs and the verify mode,
+ * and for the peer's certificate, the `verify certificate { ... }` section.
+ *
+ * @param[in] x509_ctx		being verified.
+ * @param[in] tls_session	the chain belongs to.
+ * @param[in] chain		which was verified previously, leaf first.
+ * @param[in] untrusted		How many certificates in the chain the peer sent.
+ * @return
+ *	- 1 if the chain is valid.
+ *	- 0 if the chain is invalid.
+ */
+static int tls_verify_cache_replay(X509_STORE_CTX *x509_ctx, fr_tls_session_t *tls_session,
+				   STACK_OF(X509) *chain, int untrusted)
+{
+	X509_STORE_CTX_verify_cb	verify_cb = X509_STORE_CTX_get_verify_cb(x509_ctx);
+	int				i;
+	int				ret = 1;
+
+	tls_session->verify_cached = true;
+	tls_session->verify_cached_untrusted = untrusted;
+
+	for (i = sk_X509_num(chain) - 1; i >= 0; i--) {
+		X509_STORE_CTX_set_current_cert(x509_ctx, sk_X509_value(chain, i));
+		X509_STORE_CTX_set_error_depth(x509_ctx, i);
+		X509_STORE_CTX_set_error(x509_ctx, X509_V_OK);
+
+		if (!verify_cb(1, x509_ctx)) {
+			if (X509_STORE_CTX_get_error(x509_ctx) == X509_V_OK) {
+				X509_STORE_CTX_set_error(x509_ctx, X509_V_ERR_UNSPECIFIED);
+			}
+			ret = 0;
+			break;
+		}
+	}
+
+	tls_session->verify_cached = false;
+
+	return ret;
+}
+
+/** Verify the peer's certificate chain, using the result of a previous verification if possible
+ *
+ * If the peer has presented exactly the same certificates before, and they
+ * were verified successfully, chain building and the signature checks are
+ * skipped.  The attributes extracted from the chain are restored, and the
+ * chain is replayed to the verify callback with #tls_verify_cache_replay.
+ *
+ * Results are discarded when any certificate in the chain expires, when new
+ * CRLs are loaded, or when they reach their configured lifetime.
+ *
+ * Installed with SSL_CTX_set_cert_verify_callback().
+ *
+ * @param[in] x509_ctx	containing certs to verify.
+ * @param[in] arg	UNUSED.
+ * @return
+ *	- 1 if the chain is valid.
+ *	- 0 if the chain is invalid.
+ *	- <0 on internal error.
+ */
+int fr_tls_verify_cert_offload_cb(X509_STORE_CTX *x509_ctx, UNUSED void *arg)
+{
+	SSL				*ssl;
+	fr_tls_session_t		*tls_session;
+	fr_tls_conf_t			*conf;
+	request_t			*request;
+	STACK_OF(X509)			*chain;
+	uint8_t				key[SHA256_DIGEST_LENGTH];
+	int				untrusted = 0;
+	int				ret;
+
+	ssl = X509_STORE_CTX_get_ex_data(x509_ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
+	tls_session = fr_tls_session(ssl);
+	conf = fr_tls_session_conf(ssl);
+
+	if (!conf->verify.cache || !tls_session->can_pause ||
+	    (tls_verify_cache_key(key, x509_ctx) < 0)) return tls_verify_chain(x509_ctx, tls_session);
+
+	request = fr_tls_session_request(ssl);
+
+	chain = tls_verify_cache_find(conf->verify.cache, request, conf, key, &untrusted);
+	if (chain) {
+		RDEBUG2("Certificate chain was verified previously, skipping chain verification");
+
+		ret = tls_verify_cache_replay(x509_ctx, tls_session, chain, untrusted);
+		sk_X509_pop_free(chain, X509_free);
+
+		return ret;
+	}
+
+	ret = tls_verify_chain(x509_ctx, tls_session);
+	if ((ret == 1) && tls_session->client_cert_ok && !unlang_request_is_cancelled(request)) {
+		tls_verify_cache_insert(conf->verify.cache, request, conf, x509_ctx, key);
+	}
+
+	return ret;
+}
+
 /** Revalidates the client's certificate chain
  *
  * Wraps the fr_tls_verify_cert_cb callback, allowing us to use the same
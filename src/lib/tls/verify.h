@@ -66,6 +66,8 @@ typedef struct {
 	bool				resumed;	//!< Whether we're validating a resumed session.
 } fr_tls_verify_t;
 
+typedef struct fr_tls_verify_cache_s fr_tls_verify_cache_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -78,8 +80,12 @@ extern "C" {
 
 int		fr_tls_verify_cert_cb(int ok, X509_STORE_CTX *ctx);
 
+int		fr_tls_verify_cert_offload_cb(X509_STORE_CTX *ctx, void *arg);
+
 int		fr_tls_verify_cert_chain(request_t *request, SSL *ssl);
 
+fr_tls_verify_cache_t *fr_tls_verify_cache_alloc(TALLOC_CTX *ctx, fr_time_delta_t lifetime, uint32_t max_entries);
+
 bool		fr_tls_verify_cert_result(fr_tls_session_t *tls_session);
 
 void		fr_tls_verify_cert_reset(fr_tls_session_t *tls_session);
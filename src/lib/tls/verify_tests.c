@@ -0,0 +1,416 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the cache of verified certificate chains
+ *
+ * @file src/lib/tls/verify_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void test_init(void);
+#define TEST_INIT test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/dict_test.h>
+#include <freeradius-devel/server/request.h>
+
+#include "verify.c"
+
+#include <openssl/pem.h>
+
+#include <unistd.h>
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+
+static char		test_dir[] = "/tmp/verify_tests.XXXXXX";
+static char		ca_file[PATH_MAX];
+static char		crl_file[PATH_MAX];
+
+/*
+ *	Certificates are generated on the fly, so the
+ *	tests don't depend on anything in raddb/certs.
+ */
+static EVP_PKEY		*ca_key;
+static X509		*ca_cert;
+static X509		*leaf_cert;
+
+static X509 *test_cert_alloc(char const *cn, long serial, EVP_PKEY *key, X509 *issuer, EVP_PKEY *issuer_key)
+{
+	X509		*cert;
+	X509_NAME	*name;
+
+	cert = X509_new();
+	if (!cert) return NULL;
+
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+	X509_set_pubkey(cert, key);
+
+	name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char const *)cn, -1, -1, 0);
+	X509_set_issuer_name(cert, issuer ? X509_get_subject_name(issuer) : name);
+
+	if (!issuer) {
+		X509V3_CTX	v3;
+		X509_EXTENSION	*ext;
+
+		X509V3_set_ctx(&v3, cert, cert, NULL, NULL, 0);
+		ext = X509V3_EXT_conf_nid(NULL, &v3, NID_basic_constraints, "critical,CA:TRUE");
+		X509_add_ext(cert, ext, -1);
+		X509_EXTENSION_free(ext);
+	}
+
+	if (!X509_sign(cert, issuer_key, EVP_sha256())) {
+		X509_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+/** Atomically replace a CRL file, revoking the given serial numbers
+ *
+ */
+static int test_crl_write(char const *file, long const *serials, size_t num)
+{
+	X509_CRL	*crl;
+	ASN1_TIME	*when;
+	FILE		*fp;
+	char		tmp[PATH_MAX];
+	size_t		i;
+	int		ret = -1;
+
+	crl = X509_CRL_new();
+	if (!crl) return -1;
+
+	X509_CRL_set_version(crl, 1);
+	X509_CRL_set_issuer_name(crl, X509_get_subject_name(ca_cert));
+
+	when = X509_gmtime_adj(NULL, -60);
+	X509_CRL_set1_lastUpdate(crl, when);
+
+	for (i = 0; i < num; i++) {
+		X509_REVOKED	*rev = X509_REVOKED_new();
+		ASN1_INTEGER	*serial = ASN1_INTEGER_new();
+
+		ASN1_INTEGER_set(serial, serials[i]);
+		X509_REVOKED_set_serialNumber(rev, serial);
+		X509_REVOKED_set_revocationDate(rev, when);
+		X509_CRL_add0_revoked(crl, rev);
+		ASN1_INTEGER_free(serial);
+	}
+
+	X509_gmtime_adj(when, 86400);
+	X509_CRL_set1_nextUpdate(crl, when);
+	ASN1_TIME_free(when);
+
+	X509_CRL_sort(crl);
+	if (!X509_CRL_sign(crl, ca_key, EVP_sha256())) goto done;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+	fp = fopen(tmp, "w");
+	if (!fp) goto done;
+	if (!PEM_write_X509_CRL(fp, crl)) {
+		fclose(fp);
+		goto done;
+	}
+	fclose(fp);
+
+	if (rename(tmp, file) < 0) goto done;
+	ret = 0;
+
+done:
+	X509_CRL_free(crl);
+	return ret;
+}
+
+static void test_init(void)
+{
+	EVP_PKEY	*leaf_key;
+	FILE		*fp;
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("verify_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	fr_time_start();
+
+	/*
+	 *	Normally resolved from the internal dictionary
+	 *	by fr_tls_dict_init().
+	 */
+	attr_tls_certificate = fr_dict_attr_test_tlv;
+
+	ca_key = EVP_EC_gen("P-256");
+	leaf_key = EVP_EC_gen("P-256");
+	if (!ca_key || !leaf_key) {
+		fr_tls_strerror_printf("Failed generating keys");
+		goto error;
+	}
+
+	ca_cert = test_cert_alloc("Test CA", 1, ca_key, NULL, ca_key);
+	leaf_cert = test_cert_alloc("Test client", 2, leaf_key, ca_cert, ca_key);
+	EVP_PKEY_free(leaf_key);
+	if (!ca_cert || !leaf_cert) {
+		fr_tls_strerror_printf("Failed generating certificates");
+		goto error;
+	}
+
+	if (!mkdtemp(test_dir)) {
+		fr_strerror_printf("Failed creating %s: %s", test_dir, fr_syserror(errno));
+		goto error;
+	}
+	snprintf(ca_file, sizeof(ca_file), "%s/ca.pem", test_dir);
+	snprintf(crl_file, sizeof(crl_file), "%s/crl.pem", test_dir);
+
+	fp = fopen(ca_file, "w");
+	if (!fp || !PEM_write_X509(fp, ca_cert)) {
+		fr_strerror_printf("Failed writing %s", ca_file);
+		goto error;
+	}
+	fclose(fp);
+
+	if (test_crl_write(crl_file, NULL, 0) < 0) {
+		fr_strerror_printf("Failed writing %s", crl_file);
+		goto error;
+	}
+}
+
+/** Build and verify the chain for the client certificate
+ *
+ */
+static X509_STORE_CTX *test_chain_verify(void)
+{
+	X509_STORE	*store;
+	X509_STORE_CTX	*x509_ctx;
+
+	store = X509_STORE_new();
+	X509_STORE_add_cert(store, ca_cert);
+
+	x509_ctx = X509_STORE_CTX_new();
+	X509_STORE_CTX_init(x509_ctx, store, leaf_cert, NULL);
+	X509_STORE_free(store);		/* The X509_STORE_CTX holds a reference */
+
+	TEST_CHECK(X509_verify_cert(x509_ctx) == 1);
+	TEST_MSG("Expected chain to verify, got %s", X509_verify_cert_error_string(X509_STORE_CTX_get_error(x509_ctx)));
+
+	return x509_ctx;
+}
+
+static request_t *test_request_alloc(bool with_cert)
+{
+	request_t	*request;
+	fr_pair_t	*vp;
+
+	request = request_local_alloc_external(autofree, NULL);
+
+	if (with_cert) {
+		MEM(vp = fr_pair_afrom_da(request->session_state_ctx, attr_tls_certificate));
+		fr_pair_append(&request->session_state_pairs, vp);
+	}
+
+	return request;
+}
+
+static fr_tls_conf_t *test_conf_alloc(fr_time_delta_t reload_interval)
+{
+	fr_tls_conf_t	*conf;
+
+	MEM(conf = talloc_zero(autofree, fr_tls_conf_t));
+	conf->verify.crl = fr_tls_crl_alloc(crl_file, ca_file, NULL, reload_interval);
+	TEST_CHECK(conf->verify.crl != NULL);
+	if (!conf->verify.crl) fr_perror("verify_tests");
+
+	return conf;
+}
+
+/** A verified chain is found again, with its attributes and untrusted count
+ *
+ */
+static void test_cache_hit(void)
+{
+	fr_tls_conf_t		*conf = test_conf_alloc(fr_time_delta_wrap(0));
+	fr_tls_verify_cache_t	*cache = fr_tls_verify_cache_alloc(autofree, fr_time_delta_from_sec(3600), 16);
+	X509_STORE_CTX		*x509_ctx = test_chain_verify();
+	request_t		*request;
+	STACK_OF(X509)		*chain;
+	uint8_t			key[SHA256_DIGEST_LENGTH];
+	int			untrusted = 0;
+
+	TEST_CHECK(tls_verify_cache_key(key, x509_ctx) == 0);
+
+	request = test_request_alloc(false);
+	TEST_CASE("Unknown chain is a miss");
+	TEST_CHECK(tls_verify_cache_find(cache, request, conf, key, &untrusted) == NULL);
+
+	tls_verify_cache_insert(cache, test_request_alloc(true), conf, x509_ctx, key);
+
+	TEST_CASE("Chain is found after it's inserted");
+	chain = tls_verify_cache_find(cache, request, conf, key, &untrusted);
+	TEST_CHECK(chain != NULL);
+	if (chain) {
+		TEST_CHECK(sk_X509_num(chain) == 2);
+		TEST_CHECK(X509_cmp(sk_X509_value(chain, 0), leaf_cert) == 0);
+		TEST_CHECK(X509_cmp(sk_X509_value(chain, 1), ca_cert) == 0);
+		sk_X509_pop_free(chain, X509_free);
+	}
+	TEST_CHECK(untrusted == 1);
+	TEST_MSG("Expected 1 untrusted certificate, got %i", untrusted);
+	TEST_CHECK(fr_pair_find_by_da(&request->session_state_pairs, NULL, attr_tls_certificate) != NULL);
+
+	X509_STORE_CTX_free(x509_ctx);
+	fr_tls_crl_release(conf->verify.crl);
+	talloc_free(cache);
+}
+
+/*
+ *	What the verify callback saw while a cached chain was replayed.
+ */
+static fr_tls_session_t	*test_session;
+static X509		*test_seen_cert[4];
+static int		test_seen_depth[4];
+static int		test_seen_untrusted[4];
+static int		test_seen;
+static int		test_fail_depth;
+
+static int test_verify_cb(int ok, X509_STORE_CTX *x509_ctx)
+{
+	int depth = X509_STORE_CTX_get_error_depth(x509_ctx);
+
+	TEST_CHECK(ok == 1);
+	TEST_CHECK(test_session->verify_cached);
+
+	if (test_seen < (int)NUM_ELEMENTS(test_seen_cert)) {
+		test_seen_cert[test_seen] = X509_STORE_CTX_get_current_cert(x509_ctx);
+		test_seen_depth[test_seen] = depth;
+		test_seen_untrusted[test_seen] = test_session->verify_cached_untrusted;
+	}
+	test_seen++;
+
+	return (depth == test_fail_depth) ? 0 : 1;
+}
+
+/** Every certificate in a cached chain is passed to the verify callback
+ *
+ * Deepest first, with its depth and the number of untrusted certificates,
+ * so that CRL checks and the verify mode apply the same way they did when
+ * the chain was built.
+ */
+static void test_cache_replay(void)
+{
+	X509_STORE_CTX		*x509_ctx = test_chain_verify();
+	STACK_OF(X509)		*chain = X509_chain_up_ref(X509_STORE_CTX_get0_chain(x509_ctx));
+
+	MEM(test_session = talloc_zero(autofree, fr_tls_session_t));
+	X509_STORE_CTX_set_verify_cb(x509_ctx, test_verify_cb);
+
+	TEST_CASE("Replay of a valid chain");
+	test_seen = 0;
+	test_fail_depth = -1;
+	TEST_CHECK(tls_verify_cache_replay(x509_ctx, test_session, chain, 1) == 1);
+	TEST_CHECK(test_seen == 2);
+	TEST_MSG("Expected 2 calls, got %i", test_seen);
+	TEST_CHECK((test_seen_depth[0] == 1) && (test_seen_cert[0] == ca_cert));
+	TEST_CHECK((test_seen_depth[1] == 0) && (test_seen_cert[1] == leaf_cert));
+	TEST_CHECK((test_seen_untrusted[0] == 1) && (test_seen_untrusted[1] == 1));
+	TEST_CHECK(!test_session->verify_cached);
+
+	TEST_CASE("Replay stops when the issuer is rejected");
+	test_seen = 0;
+	test_fail_depth = 1;
+	TEST_CHECK(tls_verify_cache_replay(x509_ctx, test_session, chain, 1) == 0);
+	TEST_CHECK(test_seen == 1);
+	TEST_CHECK(X509_STORE_CTX_get_error(x509_ctx) == X509_V_ERR_UNSPECIFIED);
+	TEST_CHECK(!test_session->verify_cached);
+
+	sk_X509_pop_free(chain, X509_free);
+	X509_STORE_CTX_free(x509_ctx);
+}
+
+/** Revoking a certificate after its chain was cached makes the next lookup miss
+ *
+ */
+static void test_cache_revoke(void)
+{
+	fr_tls_conf_t		*conf = test_conf_alloc(fr_time_delta_from_msec(10));
+	fr_tls_verify_cache_t	*cache = fr_tls_verify_cache_alloc(autofree, fr_time_delta_from_sec(3600), 16);
+	X509_STORE_CTX		*x509_ctx = test_chain_verify();
+	STACK_OF(X509)		*chain;
+	uint8_t			key[SHA256_DIGEST_LENGTH];
+	uint64_t		generation;
+	long			revoked = 2;
+	int			untrusted = 0;
+	int			i;
+
+	TEST_CHECK(tls_verify_cache_key(key, x509_ctx) == 0);
+	TEST_CHECK(fr_tls_crl_check(conf->verify.crl, leaf_cert) == X509_V_OK);
+
+	tls_verify_cache_insert(cache, test_request_alloc(true), conf, x509_ctx, key);
+
+	TEST_CASE("Chain is cached before the revocation");
+	chain = tls_verify_cache_find(cache, test_request_alloc(false), conf, key, &untrusted);
+	TEST_CHECK(chain != NULL);
+	if (chain) sk_X509_pop_free(chain, X509_free);
+
+	generation = fr_tls_crl_generation(conf->verify.crl);
+	TEST_CHECK(test_crl_write(crl_file, &revoked, 1) == 0);
+
+	/*
+	 *	Wait for the reload thread to notice.
+	 */
+	for (i = 0; (i < 500) && (fr_tls_crl_generation(conf->verify.crl) == generation); i++) usleep(10000);
+	TEST_CHECK(fr_tls_crl_generation(conf->verify.crl) != generation);
+	TEST_MSG("CRL file wasn't reloaded");
+
+	TEST_CASE("Chain isn't used after the revocation");
+	chain = tls_verify_cache_find(cache, test_request_alloc(false), conf, key, &untrusted);
+	TEST_CHECK(chain == NULL);
+	if (chain) sk_X509_pop_free(chain, X509_free);
+
+	TEST_CHECK(fr_tls_crl_check(conf->verify.crl, leaf_cert) == X509_V_ERR_CERT_REVOKED);
+
+	X509_STORE_CTX_free(x509_ctx);
+	fr_tls_crl_release(conf->verify.crl);
+	talloc_free(cache);
+
+	unlink(crl_file);
+	unlink(ca_file);
+	rmdir(test_dir);
+}
+
+TEST_LIST = {
+	{ "cache_hit",		test_cache_hit },
+	{ "cache_replay",	test_cache_replay },
+	{ "cache_revoke",	test_cache_revoke },
+
+	{ NULL }
+};
@@ -100,6 +100,11 @@ static int _unlang_global_init(UNUSED void *uctx)
 	 */
 	if (unlang_subrequest_op_init() < 0) goto fail;
 
+	/*
+	 *	Register the radmin commands for the profiler.
+	 */
+	if (unlang_perf_init() < 0) goto fail;
+
 	/*
 	 *	Register operations for the default keywords.  The
 	 *	operations listed below cannot fail, and do not
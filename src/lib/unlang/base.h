@@ -40,10 +40,6 @@ int			unlang_global_init(void);
 
 int			unlang_thread_instantiate(TALLOC_CTX *ctx) CC_HINT(nonnull);
 
-#ifdef WITH_PERF
-void			unlang_perf_virtual_server(fr_log_t *log, char const *name);
-#endif
-
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/virtual_servers.h>
 
 #include <freeradius-devel/server/cf_file.h>
+#include <freeradius-devel/server/command.h>
 #include <freeradius-devel/server/main_config.h>
 #include <freeradius-devel/server/map_proc.h>
 #include <freeradius-devel/server/modpriv.h>
@@ -57,6 +58,8 @@ RCSID("$Id$")
 #include "try_priv.h"
 #include "mod_action.h"
 
+#include <pthread.h>
+
 #define UNLANG_IGNORE ((unlang_t *) -1)
 
 extern bool tmpl_require_enum_prefix;
@@ -70,6 +73,8 @@ static unsigned int unlang_number = 1;
  */
 static _Thread_local unlang_thread_t *unlang_thread_array;
 
+static void unlang_perf_thread_add(unlang_thread_t *array);
+
 /*
  *	Until we know how many instructions there are, we can't
  *	allocate an array.  So we have to put the instructions into an
@@ -2043,6 +2048,109 @@ static bool compile_action_subsection(unlang_t *c, CONF_SECTION *cs, CONF_SECTIO
 }
 
 
+#ifdef HAVE_REGEX_PCRE2
+/*
+ *	Chains shorter than this aren't worth combining, as the
+ *	matching branch is evaluated again to get the captures.
+ */
+#define UNLANG_REGEX_SET_MIN	(3)
+
+/** See if an "if" or "elsif" is a simple regex match on a string attribute
+ *
+ */
+static bool regex_set_candidate(unlang_t *c, tmpl_t const **lhs, tmpl_t const **regex)
+{
+	unlang_cond_t	*gext;
+	tmpl_t const	*l, *r;
+
+	if ((c->type != UNLANG_TYPE_IF) && (c->type != UNLANG_TYPE_ELSIF)) return false;
+
+	gext = unlang_group_to_cond(unlang_generic_to_group(c));
+	if (gext->is_truthy || gext->set) return false;
+
+	if (!xlat_is_regex_match(gext->head, &l, &r)) return false;
+
+	if (!tmpl_is_attr(l) || (tmpl_attr_tail_da(l)->type != FR_TYPE_STRING) || !tmpl_is_regex(r)) return false;
+
+	*lhs = l;
+	*regex = r;
+
+	return true;
+}
+
+/** Combine chains of "if" / "elsif" regex matches on the same attribute
+ *
+ *	if (User-Name =~ /@a\.example\.com$/) {
+ *		...
+ *	} elsif (User-Name =~ /@b\.example\.com$/) {
+ *		...
+ *	} elsif ...
+ *
+ * The first condition in the chain gets all of the patterns compiled
+ * into one expression, which finds the first branch that matches with
+ * one scan of the attribute.  The interpreter then skips straight to
+ * that branch, and evaluates its condition as normal, so that the
+ * captures are set.
+ */
+static void compile_regex_sets(unlang_group_t *g)
+{
+	unlang_t *c, *next;
+
+	for (c = g->children; c != NULL; c = next) {
+		tmpl_t const		*lhs, *regex;
+		unlang_t		*last;
+		unlang_cond_t		*gext;
+		char const		**patterns;
+		fr_regex_flags_t const	**flags;
+		unsigned int		i, num = 1;
+
+		next = c->next;
+
+		if (!regex_set_candidate(c, &lhs, &regex)) continue;
+
+		for (last = c; last->next && (last->next->type == UNLANG_TYPE_ELSIF); last = last->next) {
+			tmpl_t const *next_lhs, *next_regex;
+
+			if (!regex_set_candidate(last->next, &next_lhs, &next_regex)) break;
+
+			if ((tmpl_attr_tail_da(next_lhs) != tmpl_attr_tail_da(lhs)) ||
+			    (strcmp(next_lhs->name, lhs->name) != 0)) break;
+
+			num++;
+		}
+		next = last->next;
+
+		if (num < UNLANG_REGEX_SET_MIN) continue;
+
+		gext = unlang_group_to_cond(unlang_generic_to_group(c));
+
+		MEM(patterns = talloc_array(gext, char const *, num));
+		MEM(flags = talloc_array(gext, fr_regex_flags_t const *, num));
+
+		for (i = 0, last = c; i < num; i++, last = last->next) {
+			(void) regex_set_candidate(last, &lhs, &regex);
+
+			patterns[i] = regex->name;
+			flags[i] = tmpl_regex_flags(regex);
+		}
+
+		if (regex_set_compile(gext, &gext->set, patterns, flags, num) < 0) {
+			cf_log_debug(g->cs, "Not combining %u regex conditions on %s - %s",
+				     num, lhs->name, fr_strerror());
+		} else {
+			cf_log_debug(g->cs, "Combined %u regex conditions on %s", num, lhs->name);
+
+			MEM(gext->set_lhs = tmpl_copy(gext, lhs));
+			gext->set_len = num;
+		}
+
+		talloc_free(patterns);
+		talloc_free(flags);
+	}
+}
+#endif
+
+
 static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ctx_in, bool set_action_defaults)
 {
 	CONF_ITEM	*ci = NULL;
@@ -2272,6 +2380,10 @@ static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ct
 		}
 	}
 
+#ifdef HAVE_REGEX_PCRE2
+	compile_regex_sets(g);
+#endif
+
 	/*
 	 *	Set the default actions, if they haven't already been
 	 *	set by an "actions" section above.
@@ -4826,8 +4938,6 @@ static unlang_t *compile_item(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
 
 		compile = (unlang_op_compile_t) fr_table_value_by_str(unlang_section_keywords, name, NULL);
 		if (compile) {
-			unlang_op_t *op;
-
 			c = compile(parent, unlang_ctx, ci);
 		allocate_number:
 			if (!c) return NULL;
@@ -4836,11 +4946,10 @@ static unlang_t *compile_item(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
 			c->number = unlang_number++;
 
 			/*
-			 *	Only insert the per-thread allocation && instantiation if it's used.
+			 *	Every instruction gets a per-thread entry
+			 *	for the profiler, even if it has no
+			 *	thread-specific instance data.
 			 */
-			op = &unlang_ops[c->type];
-			if (!op->thread_inst_size) return c;
-
 			if (!fr_rb_insert(unlang_instruction_tree, c)) {
 				cf_log_err(ci, "Instruction \"%s\" number %i has conflict with previous one.",
 					   c->debug_name, c->number);
@@ -5130,6 +5239,7 @@ int unlang_thread_instantiate(TALLOC_CTX *ctx)
 
 	MEM(unlang_thread_array = talloc_zero_array(ctx, unlang_thread_t, unlang_number + 1));
 //	talloc_set_destructor(unlang_thread_array, _unlang_thread_array_free);
+	unlang_perf_thread_add(unlang_thread_array);
 
 	/*
 	 *	Instantiate each instruction with thread-specific data.
@@ -5143,7 +5253,7 @@ int unlang_thread_instantiate(TALLOC_CTX *ctx)
 
 		op = &unlang_ops[instruction->type];
 
-		fr_assert(op->thread_inst_size);
+		if (!op->thread_inst_size) continue;
 
 		/*
 		 *	Allocate any thread-specific instance data.
@@ -5173,187 +5283,434 @@ void *unlang_thread_instance(unlang_t const *instruction)
 	return unlang_thread_array[instruction->number].thread_inst;
 }
 
-#ifdef WITH_PERF
-void unlang_frame_perf_init(unlang_stack_frame_t *frame)
-{
-	unlang_thread_t *t;
-	fr_time_t now;
-	unlang_t const *instruction = frame->instruction;
+/** Whether new stack frames are profiled
+ *
+ * Changed by radmin, and read by the workers each time they push a
+ * frame.  Frames which have already started carry on as they were.
+ */
+atomic_bool unlang_perf_enabled = false;
 
-	if (!instruction->number || !unlang_thread_array) return;
+/** Links a thread's instructions into the list of all threads
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< In the list of all threads.  Must be first.
+	unlang_thread_t		*array;		//!< The thread's instructions.
+} unlang_perf_thread_t;
 
-	fr_assert(instruction->number <= unlang_number);
+/*
+ *	So that radmin can sum the counters for all threads.
+ */
+static pthread_mutex_t	unlang_perf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t	unlang_perf_threads = FR_DLIST_HEAD_INITIALISER(unlang_perf_threads);
 
-	t = &unlang_thread_array[instruction->number];
+/** Counters for an instruction, summed across all threads
+ *
+ */
+typedef struct {
+	uint64_t		use_count;	//!< how many times the instruction was run
+	fr_time_delta_t		running;	//!< wall clock time spent running
+	fr_time_delta_t		cpu;		//!< CPU time spent running
+	fr_time_delta_t		yielded;	//!< time spent yielded, waiting for I/O
+} unlang_perf_total_t;
 
-	t->use_count++;
-	t->yielded++;			// everything starts off as yielded
-	now = fr_time();
+static unlang_perf_total_t	*unlang_perf_base;	//!< Totals when the counters were last reset.
 
-	fr_time_tracking_start(NULL, &frame->tracking, now);
-	fr_time_tracking_yield(&frame->tracking, fr_time());
+/*
+ *	There's a single writer for each set of counters, so a
+ *	relaxed load and store is enough, and avoids a locked
+ *	instruction every time a frame runs.
+ */
+#define UNLANG_PERF_ADD(_perf, _field, _num) \
+	atomic_store_explicit(&(_perf)->_field, \
+			      atomic_load_explicit(&(_perf)->_field, memory_order_relaxed) + (_num), \
+			      memory_order_relaxed)
+
+#define UNLANG_PERF_LOAD(_perf, _field) atomic_load_explicit(&(_perf)->_field, memory_order_relaxed)
+
+static int _unlang_perf_thread_free(unlang_perf_thread_t *pt)
+{
+	pthread_mutex_lock(&unlang_perf_mutex);
+	fr_dlist_remove(&unlang_perf_threads, pt);
+	pthread_mutex_unlock(&unlang_perf_mutex);
+
+	return 0;
 }
 
-void unlang_frame_perf_yield(unlang_stack_frame_t *frame)
+/** Add a thread's instructions to the list the radmin commands read
+ *
+ */
+static void unlang_perf_thread_add(unlang_thread_t *array)
 {
-	unlang_t const *instruction = frame->instruction;
-	unlang_thread_t *t;
+	unlang_perf_thread_t *pt;
 
-	if (!instruction->number || !unlang_thread_array) return;
+	MEM(pt = talloc(array, unlang_perf_thread_t));
+	pt->array = array;
 
-	t = &unlang_thread_array[instruction->number];
-	t->yielded++;
-	t->running--;
+	pthread_mutex_lock(&unlang_perf_mutex);
+	fr_dlist_insert_tail(&unlang_perf_threads, pt);
+	pthread_mutex_unlock(&unlang_perf_mutex);
 
-	fr_time_tracking_yield(&frame->tracking, fr_time());
+	talloc_set_destructor(pt, _unlang_perf_thread_free);
 }
 
-void unlang_frame_perf_resume(unlang_stack_frame_t *frame)
+static inline CC_HINT(always_inline) fr_time_delta_t unlang_perf_cpu_time(void)
 {
-	unlang_t const *instruction = frame->instruction;
-	unlang_thread_t *t;
-
-	if (!instruction->number || !unlang_thread_array) return;
-
-	if (frame->tracking.state != FR_TIME_TRACKING_YIELDED) return;
+	struct timespec ts;
 
-	t = &unlang_thread_array[instruction->number];
-	t->running++;
-	t->yielded--;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) return fr_time_delta_wrap(0);
 
-	fr_time_tracking_resume(&frame->tracking, fr_time());
+	return fr_time_delta_from_timespec(&ts);
 }
 
-void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
+void _unlang_frame_perf_init(unlang_stack_frame_t *frame)
 {
 	unlang_t const *instruction = frame->instruction;
-	unlang_thread_t *t;
 
-	if (!instruction || !instruction->number || !unlang_thread_array) return;
+	frame->perf = NULL;
+
+	if (!instruction->number || !unlang_thread_array) return;
 
 	fr_assert(instruction->number <= unlang_number);
 
-	t = &unlang_thread_array[instruction->number];
+	frame->perf = &unlang_thread_array[instruction->number].perf;
+	UNLANG_PERF_ADD(frame->perf, use_count, 1);
+	frame->perf_start = fr_time();
+	frame->perf_cpu_start = unlang_perf_cpu_time();
+	frame->perf_yielded = false;
+}
 
-	if (frame->tracking.state == FR_TIME_TRACKING_YIELDED) {
-		t->yielded--;
-		fr_time_tracking_resume(&frame->tracking, fr_time());
-	} else {
-		t->running--;
+/** The frame is about to run
+ *
+ */
+void _unlang_frame_perf_resume(unlang_stack_frame_t *frame)
+{
+	fr_time_t now = fr_time();
+
+	if (frame->perf_yielded) {
+		UNLANG_PERF_ADD(frame->perf, yielded, fr_time_delta_unwrap(fr_time_sub(now, frame->perf_start)));
+		frame->perf_yielded = false;
 	}
 
-	fr_time_tracking_end(NULL, &frame->tracking, fr_time());
-	t->tracking.running_total = fr_time_delta_add(t->tracking.running_total, frame->tracking.running_total);
-	t->tracking.waiting_total = fr_time_delta_add(t->tracking.waiting_total, frame->tracking.waiting_total);
+	frame->perf_start = now;
+	frame->perf_cpu_start = unlang_perf_cpu_time();
 }
 
-
-static void unlang_perf_dump(fr_log_t *log, unlang_t const *instruction, int depth)
+/** The frame has returned control to the interpreter
+ *
+ * Either it's done, or it's pushed a child, or it's about to yield.
+ */
+void _unlang_frame_perf_stop(unlang_stack_frame_t *frame)
 {
-	unlang_group_t const *g;
-	unlang_thread_t *t;
-	char const *file;
-	int line;
+	fr_time_t now = fr_time();
 
-	if (!instruction || !instruction->number) return;
+	UNLANG_PERF_ADD(frame->perf, running, fr_time_delta_unwrap(fr_time_sub(now, frame->perf_start)));
+	UNLANG_PERF_ADD(frame->perf, cpu,
+			fr_time_delta_unwrap(fr_time_delta_sub(unlang_perf_cpu_time(), frame->perf_cpu_start)));
+	frame->perf_start = now;
+}
+
+/** The frame is waiting for I/O
+ *
+ * Must be called after #_unlang_frame_perf_stop.
+ */
+void _unlang_frame_perf_yield(unlang_stack_frame_t *frame)
+{
+	frame->perf_yielded = true;
+}
 
+void _unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
+{
 	/*
-	 *	These are generally pushed onto the stack, and therefore ignored.
+	 *	Cancelled while waiting for I/O.
 	 */
-	if (instruction->type == UNLANG_TYPE_TMPL) return;
+	if (frame->perf_yielded) {
+		UNLANG_PERF_ADD(frame->perf, yielded, fr_time_delta_unwrap(fr_time_sub(fr_time(), frame->perf_start)));
+		frame->perf_yielded = false;
+	}
+
+	frame->perf = NULL;
+}
+
+/** Sum the counters for every instruction across all threads
+ *
+ * @param[in] ctx	to allocate the totals in.
+ * @return an array of totals, indexed by instruction number.
+ */
+static unlang_perf_total_t *unlang_perf_totals(TALLOC_CTX *ctx)
+{
+	unlang_perf_total_t	*totals;
+	unsigned int		i;
+
+	MEM(totals = talloc_zero_array(ctx, unlang_perf_total_t, unlang_number + 1));
+
+	pthread_mutex_lock(&unlang_perf_mutex);
+	fr_dlist_foreach(&unlang_perf_threads, unlang_perf_thread_t, pt) {
+		for (i = 1; i <= unlang_number; i++) {
+			unlang_perf_t *perf = &pt->array[i].perf;
+
+			totals[i].use_count += UNLANG_PERF_LOAD(perf, use_count);
+			totals[i].running = fr_time_delta_add(totals[i].running,
+							      fr_time_delta_wrap(UNLANG_PERF_LOAD(perf, running)));
+			totals[i].cpu = fr_time_delta_add(totals[i].cpu, fr_time_delta_wrap(UNLANG_PERF_LOAD(perf, cpu)));
+			totals[i].yielded = fr_time_delta_add(totals[i].yielded,
+							      fr_time_delta_wrap(UNLANG_PERF_LOAD(perf, yielded)));
+		}
+	}
+	pthread_mutex_unlock(&unlang_perf_mutex);
+
+	if (!unlang_perf_base) return totals;
 
 	/*
-	 *	Everything else is an unlang_group_t;
+	 *	Counters from threads which have exited are lost,
+	 *	so the totals may be smaller than the base.
 	 */
-	g = unlang_generic_to_group(instruction);
+#define PERF_SUB(_field) \
+	totals[i]._field = fr_time_delta_gt(totals[i]._field, unlang_perf_base[i]._field) ? \
+		fr_time_delta_sub(totals[i]._field, unlang_perf_base[i]._field) : fr_time_delta_wrap(0)
 
-	if (!g->cs) return;
+	for (i = 1; i <= unlang_number; i++) {
+		totals[i].use_count = (totals[i].use_count > unlang_perf_base[i].use_count) ?
+				      totals[i].use_count - unlang_perf_base[i].use_count : 0;
+		PERF_SUB(running);
+		PERF_SUB(cpu);
+		PERF_SUB(yielded);
+	}
+#undef PERF_SUB
 
-	file = cf_filename(g->cs);
-	line = cf_lineno(g->cs);
+	return totals;
+}
 
-	if (depth) {
-		fr_log(log, L_DBG, file, line, "%.*s", depth, unlang_spaces);
-	}
+/** Find the top of the tree an instruction is in
+ *
+ */
+static unlang_t const *unlang_perf_root(unlang_t const *instruction)
+{
+	while (instruction->parent) instruction = instruction->parent;
 
-	if (unlang_ops[instruction->type].debug_braces) {
-		fr_log(log, L_DBG, file, line, "%s { #", instruction->debug_name);
-	} else {
-		fr_log(log, L_DBG, file, line, "%s #", instruction->debug_name);
-	}
+	return instruction;
+}
 
-	t = &unlang_thread_array[instruction->number];
+/** Return the name of the virtual server an instruction was compiled in
+ *
+ */
+static char const *unlang_perf_server(unlang_t const *instruction)
+{
+	unlang_t const	*root = unlang_perf_root(instruction);
+	CONF_SECTION	*server_cs;
 
-	fr_log(log, L_DBG, file, line, "count=%" PRIu64 " cpu_time=%" PRIu64 " yielded_time=%" PRIu64 ,
-	       t->use_count, fr_time_delta_unwrap(t->tracking.running_total), fr_time_delta_unwrap(t->tracking.waiting_total));
+	if (!root->ci) return "<unknown>";
 
-	if (g->children) {
-		unlang_t *child;
+	server_cs = cf_section_find_parent(root->ci, "server", CF_IDENT_ANY);
+	if (!server_cs || !cf_section_name2(server_cs)) return "<unknown>";
 
-		for (child = g->children; child != NULL; child = child->next) {
-			unlang_perf_dump(log, child, depth + 1);
+	return cf_section_name2(server_cs);
+}
+
+/** Print a name and location for an instruction, which is safe to use as a stack frame
+ *
+ * ';' separates frames in the collapsed stack format, so it's replaced.
+ */
+static void unlang_perf_frame_print(FILE *fp, unlang_t const *instruction)
+{
+	char const *p;
+
+	for (p = instruction->debug_name; *p; p++) {
+		switch (*p) {
+		case ';':
+			fputc(',', fp);
+			break;
+
+		case '\n':
+		case '\r':
+			fputc(' ', fp);
+			break;
+
+		default:
+			fputc(*p, fp);
+			break;
 		}
 	}
 
-	if (unlang_ops[instruction->type].debug_braces) {
-		if (depth) {
-			fr_log(log, L_DBG, file, line, "%.*s", depth, unlang_spaces);
-		}
+	if (!instruction->ci) return;
 
-		fr_log(log, L_DBG, file, line, "}");
+	fprintf(fp, " (%s:%d)", cf_filename(instruction->ci), cf_lineno(instruction->ci));
+}
+
+static void unlang_perf_stack_print(FILE *fp, unlang_t const *instruction)
+{
+	if (instruction->parent) {
+		unlang_perf_stack_print(fp, instruction->parent);
+		fputc(';', fp);
 	}
+
+	unlang_perf_frame_print(fp, instruction);
 }
 
-void unlang_perf_virtual_server(fr_log_t *log, char const *name)
+static int cmd_set_unlang_profile(UNUSED FILE *fp, FILE *fp_err, UNUSED void *ctx, fr_cmd_info_t const *info)
 {
+	if (strcmp(info->argv[0], "on") == 0) {
+		atomic_store_explicit(&unlang_perf_enabled, true, memory_order_relaxed);
+		return 0;
+	}
 
-	virtual_server_t const	*vs = virtual_server_find(name);
-	CONF_SECTION		*cs;
-	CONF_ITEM		*ci;
-	char const		*file;
-	int			line;
+	if (strcmp(info->argv[0], "off") == 0) {
+		atomic_store_explicit(&unlang_perf_enabled, false, memory_order_relaxed);
+		return 0;
+	}
 
-	if (!vs) return;
+	if (strcmp(info->argv[0], "reset") == 0) {
+		unlang_perf_total_t *totals;
 
-	cs = virtual_server_cs(vs);
+		/*
+		 *	The workers update their counters without
+		 *	locking, so we can't zero them.  Instead,
+		 *	remember where they were.
+		 */
+		TALLOC_FREE(unlang_perf_base);
+		totals = unlang_perf_totals(unlang_instruction_tree);
+		unlang_perf_base = totals;
+		return 0;
+	}
 
-	file = cf_filename(cs);
-	line = cf_lineno(cs);
+	fprintf(fp_err, "Unknown profile action '%s'\n", info->argv[0]);
+	return -1;
+}
 
-	fr_log(log, L_DBG, file, line, " server %s {\n", name);
+static int cmd_show_unlang_profile(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, fr_cmd_info_t const *info)
+{
+	fr_rb_iter_inorder_t	iter;
+	unlang_t		*instruction;
+	unlang_perf_total_t	*totals;
 
-	/*
-	 *	Loop over the children of the virtual server, checking for unlang_t;
-	 */
-	for (ci = cf_item_next(cs, NULL);
-	     ci != NULL;
-	     ci = cf_item_next(cs, ci)) {
-		char const *name1, *name2;
-		unlang_t *instruction;
-		CONF_SECTION *subcs;
+	totals = unlang_perf_totals(NULL);
 
-		if (!cf_item_is_section(ci)) continue;
+	fprintf(fp, "profiling\t%s\n", atomic_load_explicit(&unlang_perf_enabled, memory_order_relaxed) ? "on" : "off");
 
-		instruction = (unlang_t *)cf_data_value(cf_data_find(ci, unlang_group_t, NULL));
-		if (!instruction) continue;
+	for (instruction = fr_rb_iter_init_inorder(&iter, unlang_instruction_tree);
+	     instruction;
+	     instruction = fr_rb_iter_next_inorder(&iter)) {
+		unlang_perf_total_t const	*perf = &totals[instruction->number];
+		char const			*server;
 
-		subcs = cf_item_to_section(ci);
-		name1 = cf_section_name1(subcs);
-		name2 = cf_section_name2(subcs);
-		file = cf_filename(ci);
-		line = cf_lineno(ci);
+		if (!perf->use_count) continue;
 
-		if (!name2) {
-			fr_log(log, L_DBG, file, line, " %s {\n", name1);
+		server = unlang_perf_server(instruction);
+		if ((info->argc > 0) && (strcmp(info->argv[0], server) != 0)) continue;
+
+		fprintf(fp, "%s\t%s\t", server, unlang_perf_root(instruction)->debug_name);
+		unlang_perf_frame_print(fp, instruction);
+		fprintf(fp, "\tcalls=%" PRIu64 "\twall=%.6f\tcpu=%.6f\tyielded=%.6f\n",
+			perf->use_count,
+			fr_time_delta_unwrap(perf->running) / (double)NSEC,
+			fr_time_delta_unwrap(perf->cpu) / (double)NSEC,
+			fr_time_delta_unwrap(perf->yielded) / (double)NSEC);
+	}
+
+	talloc_free(totals);
+
+	return 0;
+}
+
+/** Dump the counters in the collapsed stack format used by flamegraph.pl
+ *
+ * Times are in microseconds.  They're for the instruction itself, so
+ * each line is the "self" time for that stack.
+ */
+static int cmd_show_unlang_flamegraph(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, fr_cmd_info_t const *info)
+{
+	fr_rb_iter_inorder_t	iter;
+	unlang_t		*instruction;
+	unlang_perf_total_t	*totals;
+	char const		*metric = (info->argc > 0) ? info->argv[0] : "cpu";
+
+	totals = unlang_perf_totals(NULL);
+
+	for (instruction = fr_rb_iter_init_inorder(&iter, unlang_instruction_tree);
+	     instruction;
+	     instruction = fr_rb_iter_next_inorder(&iter)) {
+		unlang_perf_total_t const	*perf = &totals[instruction->number];
+		uint64_t			value;
+
+		if (strcmp(metric, "calls") == 0) {
+			value = perf->use_count;
+		} else if (strcmp(metric, "wall") == 0) {
+			value = (uint64_t) fr_time_delta_to_usec(perf->running);
+		} else if (strcmp(metric, "yielded") == 0) {
+			value = (uint64_t) fr_time_delta_to_usec(perf->yielded);
 		} else {
-			fr_log(log, L_DBG, file, line, " %s %s {\n", name1, name2);
+			value = (uint64_t) fr_time_delta_to_usec(perf->cpu);
 		}
 
-		unlang_perf_dump(log, instruction, 2);
+		if (!value) continue;
 
-		fr_log(log, L_DBG, file, line, " }\n");
+		fprintf(fp, "server %s;", unlang_perf_server(instruction));
+		unlang_perf_stack_print(fp, instruction);
+		fprintf(fp, " %" PRIu64 "\n", value);
 	}
 
-	fr_log(log, L_DBG, file, line, "}\n");
+	talloc_free(totals);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_unlang_table[] = {
+	{
+		.parent = "set",
+		.name = "unlang",
+		.help = "Change interpreter settings.",
+		.read_only = false
+	},
+
+	{
+		.parent = "set unlang",
+		.name = "profile",
+		.syntax = "(on|off|reset)",
+		.func = cmd_set_unlang_profile,
+		.help = "Turn the per-instruction profiler on or off, or reset its counters.",
+		.read_only = false
+	},
+
+	{
+		.parent = "show",
+		.name = "unlang",
+		.help = "Show interpreter information.",
+		.read_only = true
+	},
+
+	{
+		.parent = "show unlang",
+		.name = "profile",
+		.syntax = "[STRING]",
+		.func = cmd_show_unlang_profile,
+		.help = "Show per-instruction profiling counters, optionally for one virtual server.",
+		.read_only = true
+	},
+
+	{
+		.parent = "show unlang",
+		.name = "flamegraph",
+		.syntax = "[(cpu|wall|yielded|calls)]",
+		.func = cmd_show_unlang_flamegraph,
+		.help = "Dump profiling counters as collapsed stacks for flamegraph.pl.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+/** Register the radmin commands for the profiler
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int unlang_perf_init(void)
+{
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_unlang_table) < 0) {
+		PERROR("Failed registering radmin commands for the interpreter");
+		return -1;
+	}
+
+	return 0;
 }
-#endif
@@ -24,6 +24,9 @@
  */
 RCSID("$Id$")
 
+#include <freeradius-devel/server/regex.h>
+#include <freeradius-devel/server/tmpl_dcursor.h>
+
 #include "condition_priv.h"
 #include "group_priv.h"
 
@@ -71,6 +74,44 @@ static unlang_action_t unlang_if_resume(rlm_rcode_t *p_result, request_t *reques
 	return unlang_group(p_result, request, frame);
 }
 
+#ifdef HAVE_REGEX_PCRE2
+/** Find the first condition in an "if" / "elsif" chain which matches
+ *
+ * @return
+ *	- -1 if the set can't be used.  The conditions are evaluated as normal.
+ *	- 0 if none of the conditions match.
+ *	- >0 the position in the chain of the first condition which matches.
+ */
+static int unlang_if_regex_set(request_t *request, unlang_cond_t const *gext)
+{
+	fr_pair_t		*vp;
+	fr_dcursor_t		cursor;
+	tmpl_dcursor_ctx_t	cc;
+	int			ret, first = -1;
+
+	for (vp = tmpl_dcursor_init(NULL, NULL, &cc, &cursor, request, gext->set_lhs);
+	     vp != NULL;
+	     vp = fr_dcursor_next(&cursor)) {
+		ret = regex_set_exec(gext->set, vp->vp_strvalue, vp->vp_length);
+		if (ret < 0) {
+			RPWDEBUG("Failed evaluating regex set");
+			first = -1;
+			break;
+		}
+
+		/*
+		 *	The chain matches if any of the values match,
+		 *	so we want the lowest position of all of them.
+		 */
+		if ((first <= 0) || ((ret > 0) && (ret < first))) first = ret;
+		if (first == 1) break;
+	}
+	tmpl_dcursor_clear(&cc);
+
+	return first;
+}
+#endif
+
 static unlang_action_t unlang_if(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
 {
 	unlang_group_t			*g = unlang_generic_to_group(frame->instruction);
@@ -90,6 +131,37 @@ static unlang_action_t unlang_if(rlm_rcode_t *p_result, request_t *request, unla
 		return unlang_group(p_result, request, frame);
 	}
 
+#ifdef HAVE_REGEX_PCRE2
+	/*
+	 *	Skip over the "elsif" conditions which we know won't
+	 *	match.  The one that does is evaluated as normal, so
+	 *	that the captures are set.
+	 */
+	if (gext->set) {
+		int		match = unlang_if_regex_set(request, gext);
+		unsigned int	skip;
+
+		if ((match == 0) || (match > 1)) {
+			if (match == 0) {
+				RDEBUG3("None of the %u patterns in the chain match", gext->set_len);
+				regex_sub_to_request(request, NULL, NULL);	/* As a failed match would */
+				skip = gext->set_len - 1;
+			} else {
+				RDEBUG3("First match is pattern %d of %u in the chain", match, gext->set_len);
+				skip = match - 2;
+			}
+
+			while (skip--) {
+				fr_assert(frame->next && (frame->next->type == UNLANG_TYPE_ELSIF));
+				frame->next = frame->next->next;
+			}
+
+			RDEBUG2("...");
+			return UNLANG_ACTION_EXECUTE_NEXT;
+		}
+	}
+#endif
+
 	frame_repeat(frame, unlang_if_resume);
 
 	fr_value_box_list_init(&state->out);
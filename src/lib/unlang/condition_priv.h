@@ -33,6 +33,12 @@ typedef struct {
 	xlat_exp_head_t	*head;
 	bool		is_truthy;
 	bool		value;
+
+#ifdef HAVE_REGEX_PCRE2
+	regex_t		*set;		//!< All of the patterns in this "if" / "elsif" chain.
+	tmpl_t		*set_lhs;	//!< What the patterns in the chain match against.
+	unsigned int	set_len;	//!< Number of conditions in the chain, including this one.
+#endif
 } unlang_cond_t;
 
 /** Cast a group structure to the cond keyword extension
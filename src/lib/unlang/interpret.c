@@ -610,6 +610,7 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 		repeatable_clear(frame);
 		unlang_frame_perf_resume(frame);
 		ua = frame->process(result, request, frame);
+		unlang_frame_perf_stop(frame);
 
 		/*
 		 *	If this frame is breaking or returning
@@ -653,7 +654,6 @@ unlang_frame_action_t frame_eval(request_t *request, unlang_stack_frame_t *frame
 				      "Instruction %s returned UNLANG_ACTION_PUSHED_CHILD, "
 				      "but stack depth was not increased",
 				      instruction->name);
-			unlang_frame_perf_yield(frame);
 			*result = frame->result;
 			return UNLANG_FRAME_ACTION_NEXT;
 
@@ -0,0 +1,221 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the per-instruction profiler
+ *
+ * @file src/lib/unlang/perf_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void perf_test_init(void);
+#define TEST_INIT perf_test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "compile.c"
+
+#define NUM_INSTRUCTIONS	3
+
+static TALLOC_CTX	*autofree;
+static unlang_t		test_instruction[NUM_INSTRUCTIONS + 1];
+
+static void perf_test_init(void)
+{
+	unsigned int i;
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+		fr_perror("perf_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_time_start();
+
+	/*
+	 *	Fake up just enough of the compiler's state for the
+	 *	profiling hooks.  Instruction zero is never used.
+	 */
+	unlang_number = NUM_INSTRUCTIONS;
+
+	for (i = 1; i <= NUM_INSTRUCTIONS; i++) {
+		test_instruction[i].number = i;
+		test_instruction[i].debug_name = "test";
+	}
+
+	unlang_thread_array = talloc_zero_array(autofree, unlang_thread_t, unlang_number + 1);
+	unlang_perf_thread_add(unlang_thread_array);
+}
+
+static void test_set_profile(char const *action)
+{
+	char const	*argv[] = { action };
+	fr_cmd_info_t	info = { .argc = 1, .argv = argv };
+
+	TEST_CHECK(cmd_set_unlang_profile(NULL, stderr, NULL, &info) == 0);
+}
+
+/*
+ *	Burn some CPU, so the clocks are guaranteed to move.
+ */
+static void test_spin(void)
+{
+	fr_time_t		start = fr_time();
+	fr_time_delta_t		cpu_start = unlang_perf_cpu_time();
+
+	while (fr_time_delta_lt(fr_time_sub(fr_time(), start), fr_time_delta_from_usec(100)) ||
+	       fr_time_delta_lt(fr_time_delta_sub(unlang_perf_cpu_time(), cpu_start), fr_time_delta_from_usec(100)));
+}
+
+static void test_run(unlang_stack_frame_t *frame, unsigned int number)
+{
+	*frame = (unlang_stack_frame_t) { .instruction = &test_instruction[number] };
+
+	unlang_frame_perf_init(frame);
+	unlang_frame_perf_resume(frame);
+	test_spin();
+	unlang_frame_perf_stop(frame);
+	unlang_frame_perf_cleanup(frame);
+}
+
+/** No counters are updated while the profiler is off
+ *
+ */
+static void test_perf_disabled(void)
+{
+	unlang_stack_frame_t	frame;
+	unlang_perf_total_t	*totals;
+
+	test_set_profile("off");
+	test_set_profile("reset");
+
+	test_run(&frame, 1);
+	TEST_CHECK(frame.perf == NULL);
+
+	totals = unlang_perf_totals(autofree);
+	TEST_CHECK(totals[1].use_count == 0);
+	TEST_MSG("Expected 0 calls, got %" PRIu64, totals[1].use_count);
+	TEST_CHECK(fr_time_delta_unwrap(totals[1].running) == 0);
+	TEST_CHECK(fr_time_delta_unwrap(totals[1].cpu) == 0);
+	talloc_free(totals);
+}
+
+/** Each instruction gets its own call count and times
+ *
+ */
+static void test_perf_counters(void)
+{
+	unlang_stack_frame_t	frame;
+	unlang_perf_total_t	*totals;
+	int			i;
+
+	test_set_profile("reset");
+	test_set_profile("on");
+
+	for (i = 0; i < 5; i++) test_run(&frame, 1);
+	test_run(&frame, 2);
+
+	test_set_profile("off");
+
+	totals = unlang_perf_totals(autofree);
+
+	TEST_CHECK(totals[1].use_count == 5);
+	TEST_MSG("Expected 5 calls, got %" PRIu64, totals[1].use_count);
+	TEST_CHECK(fr_time_delta_ispos(totals[1].running));
+	TEST_CHECK(fr_time_delta_ispos(totals[1].cpu));
+	TEST_CHECK(fr_time_delta_unwrap(totals[1].yielded) == 0);
+
+	TEST_CHECK(totals[2].use_count == 1);
+	TEST_MSG("Expected 1 call, got %" PRIu64, totals[2].use_count);
+	TEST_CHECK(fr_time_delta_ispos(totals[2].running));
+
+	TEST_CHECK(totals[3].use_count == 0);
+	TEST_MSG("Expected 0 calls, got %" PRIu64, totals[3].use_count);
+	talloc_free(totals);
+}
+
+/** Time spent waiting for I/O is counted as yielded, not running
+ *
+ */
+static void test_perf_yield(void)
+{
+	unlang_stack_frame_t	frame = { .instruction = &test_instruction[3] };
+	unlang_perf_total_t	*totals;
+	fr_time_delta_t		running;
+
+	test_set_profile("reset");
+	test_set_profile("on");
+
+	unlang_frame_perf_init(&frame);
+	unlang_frame_perf_resume(&frame);
+	unlang_frame_perf_stop(&frame);
+	unlang_frame_perf_yield(&frame);
+
+	running = fr_time_delta_wrap(UNLANG_PERF_LOAD(&unlang_thread_array[3].perf, running));
+	usleep(2000);
+
+	unlang_frame_perf_resume(&frame);
+	unlang_frame_perf_stop(&frame);
+	unlang_frame_perf_cleanup(&frame);
+
+	test_set_profile("off");
+
+	totals = unlang_perf_totals(autofree);
+	TEST_CHECK(totals[3].use_count == 1);
+	TEST_CHECK(fr_time_delta_gteq(totals[3].yielded, fr_time_delta_from_msec(2)));
+	TEST_MSG("Expected at least 2ms yielded, got %" PRId64 "ns", fr_time_delta_unwrap(totals[3].yielded));
+	TEST_CHECK(fr_time_delta_lt(fr_time_delta_sub(fr_time_delta_wrap(UNLANG_PERF_LOAD(&unlang_thread_array[3].perf,
+											   running)), running),
+				    fr_time_delta_from_msec(2)));
+	talloc_free(totals);
+}
+
+/** A frame which is cancelled while yielded still has its wait counted
+ *
+ */
+static void test_perf_cancel(void)
+{
+	unlang_stack_frame_t	frame = { .instruction = &test_instruction[3] };
+	unlang_perf_total_t	*totals;
+
+	test_set_profile("reset");
+	test_set_profile("on");
+
+	unlang_frame_perf_init(&frame);
+	unlang_frame_perf_resume(&frame);
+	unlang_frame_perf_stop(&frame);
+	unlang_frame_perf_yield(&frame);
+	usleep(1000);
+	unlang_frame_perf_cleanup(&frame);
+
+	test_set_profile("off");
+
+	TEST_CHECK(frame.perf == NULL);
+
+	totals = unlang_perf_totals(autofree);
+	TEST_CHECK(totals[3].use_count == 1);
+	TEST_CHECK(fr_time_delta_gteq(totals[3].yielded, fr_time_delta_from_msec(1)));
+	talloc_free(totals);
+}
+
+TEST_LIST = {
+	{ "perf_disabled",	test_perf_disabled },
+	{ "perf_counters",	test_perf_counters },
+	{ "perf_yield",		test_perf_yield },
+	{ "perf_cancel",	test_perf_cancel },
+
+	{ NULL }
+};
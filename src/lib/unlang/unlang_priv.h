@@ -32,6 +32,12 @@
 #include <freeradius-devel/unlang/base.h>
 #include <freeradius-devel/io/listen.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -229,30 +235,43 @@ typedef struct {
 	size_t			frame_state_pool_size;		//!< The total size of the pool to alloc.
 } unlang_op_t;
 
+/** Profiling counters for an instruction
+ *
+ * Times are for the instruction itself, and don't include the time
+ * spent running its children.
+ *
+ * Only the thread which owns the counters updates them, but radmin
+ * reads them from another thread, so they're accessed with relaxed
+ * atomics.
+ */
+typedef struct {
+	atomic_uint_fast64_t	use_count;			//!< how many times the instruction was run
+	atomic_int_fast64_t	running;			//!< wall clock time spent running, in nanoseconds
+	atomic_int_fast64_t	cpu;				//!< CPU time spent running, in nanoseconds
+	atomic_int_fast64_t	yielded;			//!< time spent yielded, waiting for I/O, in nanoseconds
+} unlang_perf_t;
+
 typedef struct {
 	unlang_t const		*instruction;			//!< instruction which we're executing
 	void			*thread_inst;			//!< thread-specific instance data
-#ifdef WITH_PERF
-	uint64_t		use_count;			//!< how many packets it has processed
-	uint64_t		running;			//!< currently running this instruction
-	uint64_t		yielded;			//!< currently yielded
-	fr_time_tracking_t	tracking;			//!< tracking cpu time
-#endif
+	unlang_perf_t		perf;				//!< profiling counters for this thread
 } unlang_thread_t;
 
 void	*unlang_thread_instance(unlang_t const *instruction);
 
-#ifdef WITH_PERF
-void		unlang_frame_perf_init(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_yield(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_resume(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_cleanup(unlang_stack_frame_t *frame);
-#else
-#define		unlang_frame_perf_init(_x)
-#define		unlang_frame_perf_yield(_x)
-#define		unlang_frame_perf_resume(_x)
-#define		unlang_frame_perf_cleanup(_x)
-#endif
+/** Whether new stack frames are profiled
+ *
+ * Changed with "set unlang profile".
+ */
+extern atomic_bool	unlang_perf_enabled;
+
+void		_unlang_frame_perf_init(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_resume(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_stop(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_yield(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_cleanup(unlang_stack_frame_t *frame);
+
+int		unlang_perf_init(void);
 
 void	unlang_frame_signal(request_t *request, fr_signal_t action, int limit);
 
@@ -303,11 +322,51 @@ struct unlang_stack_frame_s {
 								///< frame lower in the stack to determine if the
 								///< result stored in the lower stack frame should
 	uint8_t			uflags;				//!< Unwind markers
-#ifdef WITH_PERF
-	fr_time_tracking_t	tracking;			//!< track this instance of this instruction
-#endif
+	unlang_perf_t		*perf;				//!< Counters to update, or NULL if the frame
+								///< isn't being profiled.
+	fr_time_t		perf_start;			//!< When the frame last started running, or yielded.
+	fr_time_delta_t		perf_cpu_start;			//!< Thread CPU time when the frame last started running.
+	bool			perf_yielded;			//!< Whether the frame is waiting for I/O.
 };
 
+/** @name Profiling hooks
+ *
+ * These are called for every instruction, so they only do a pointer
+ * check unless the frame is being profiled.
+ *
+ * @{
+ */
+static inline void unlang_frame_perf_init(unlang_stack_frame_t *frame)
+{
+	if (likely(!atomic_load_explicit(&unlang_perf_enabled, memory_order_relaxed))) {
+		frame->perf = NULL;
+		return;
+	}
+
+	_unlang_frame_perf_init(frame);
+}
+
+static inline void unlang_frame_perf_resume(unlang_stack_frame_t *frame)
+{
+	if (unlikely(frame->perf != NULL)) _unlang_frame_perf_resume(frame);
+}
+
+static inline void unlang_frame_perf_stop(unlang_stack_frame_t *frame)
+{
+	if (unlikely(frame->perf != NULL)) _unlang_frame_perf_stop(frame);
+}
+
+static inline void unlang_frame_perf_yield(unlang_stack_frame_t *frame)
+{
+	if (unlikely(frame->perf != NULL)) _unlang_frame_perf_yield(frame);
+}
+
+static inline void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
+{
+	if (unlikely(frame->perf != NULL)) _unlang_frame_perf_cleanup(frame);
+}
+/** @} */
+
 /** An unlang stack associated with a request
  *
  */
@@ -407,6 +407,8 @@ static inline fr_slen_t xlat_aprint(TALLOC_CTX *ctx, char **out, xlat_exp_head_t
 
 bool		xlat_is_truthy(xlat_exp_head_t const *head, bool *out);
 
+bool		xlat_is_regex_match(xlat_exp_head_t const *head, tmpl_t const **lhs, tmpl_t const **regex);
+
 fr_slen_t	xlat_validate_function_args(xlat_exp_t *node);
 
 void		xlat_debug(xlat_exp_t const *node);
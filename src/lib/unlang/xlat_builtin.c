@@ -3230,7 +3230,7 @@ static int xlat_func_subst_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 	fr_sbuff_marker_t	start_m, end_m;
 	char			*buff;
 	ssize_t			slen;
-	regex_t			*pattern, *our_pattern = NULL;
+	regex_t			*pattern;
 	fr_regex_flags_t const	*flags;
 	fr_regex_flags_t	our_flags = {};
 	fr_value_box_t		*vb;
@@ -3267,13 +3267,12 @@ static int xlat_func_subst_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		/*
 		*	Process the substitution
 		*/
-		if (regex_compile(NULL, &our_pattern,
-				  fr_sbuff_current(&start_m), fr_sbuff_current(&end_m) - fr_sbuff_current(&start_m),
-				  &our_flags, true, true) <= 0) {
+		if (regex_cache_compile(&pattern,
+					fr_sbuff_current(&start_m), fr_sbuff_current(&end_m) - fr_sbuff_current(&start_m),
+					&our_flags, true) <= 0) {
 			RPEDEBUG("Failed compiling regex");
 			return -1;
 		}
-		pattern = our_pattern;
 		flags = &our_flags;
 	} else {
 		pattern = inst->pattern;
@@ -3286,7 +3285,6 @@ static int xlat_func_subst_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 			     rep_vb->vb_strvalue, rep_vb->vb_length, NULL) < 0) {
 		RPEDEBUG("Failed performing substitution");
 		talloc_free(vb);
-		talloc_free(pattern);
 		return -1;
 	}
 	fr_value_box_bstrdup_buffer_shallow(NULL, vb, NULL, buff, subject_vb->tainted);
@@ -3294,8 +3292,6 @@ static int xlat_func_subst_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 
 	fr_dcursor_append(out, vb);
 
-	talloc_free(our_pattern);
-
 	return 0;
 }
 #endif
@@ -710,8 +710,13 @@ static xlat_action_t xlat_regex_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 
 	fr_assert(inst->regex == NULL);
 
-	slen = regex_compile(rctx, &preg, fr_sbuff_start(agg), fr_sbuff_used(agg),
-			     tmpl_regex_flags(inst->xlat->vpt), true, true); /* flags, allow subcaptures, at runtime */
+	/*
+	 *	The expanded pattern is usually the same for many
+	 *	requests, so use the per-thread cache instead of
+	 *	compiling it every time.
+	 */
+	slen = regex_cache_compile(&preg, fr_sbuff_start(agg), fr_sbuff_used(agg),
+				   tmpl_regex_flags(inst->xlat->vpt), true); /* flags, allow subcaptures */
 	if (slen <= 0) return XLAT_ACTION_FAIL;
 
 	return xlat_regex_match(ctx, request, in, &preg, out, inst->op);
@@ -3200,3 +3205,59 @@ bool xlat_is_truthy(xlat_exp_head_t const *head, bool *out)
 	*out = fr_value_box_is_truthy(box);
 	return true;
 }
+
+/** Unwrap groups which contain only one node
+ *
+ */
+static xlat_exp_t const *xlat_exp_single(xlat_exp_head_t const *head)
+{
+	xlat_exp_t const *node;
+
+	for (;;) {
+		node = xlat_exp_head(head);
+		if (!node || xlat_exp_next(head, node)) return NULL;
+
+		if (node->type != XLAT_GROUP) return node;
+
+		head = node->group;
+	}
+}
+
+/**  Allow callers to see if an xlat is a simple regular expression match
+ *
+ *  i.e. "foo =~ /bar/", so that the caller can combine multiple
+ *  patterns which match against the same thing.
+ *
+ *  This only works before the xlat has been instantiated, as
+ *  instantiation moves the regex out of the arguments.
+ *
+ *  @param[in] head	of the xlat to check
+ *  @param[out] lhs	tmpl which is matched.
+ *  @param[out] regex	tmpl containing the pattern.
+ *  @return
+ *	- false - xlat is not a simple regex match, the outputs are unchanged.
+ *	- true - xlat is a simple regex match.
+ */
+bool xlat_is_regex_match(xlat_exp_head_t const *head, tmpl_t const **lhs, tmpl_t const **regex)
+{
+	xlat_exp_t const *node, *arg;
+	xlat_exp_t const *l, *r;
+
+	node = xlat_exp_single(head);
+	if (!node || (node->type != XLAT_FUNC) || (node->call.func->token != T_OP_REG_EQ)) return false;
+
+	arg = xlat_exp_head(node->call.args);
+	if (!arg || (arg->type != XLAT_GROUP)) return false;
+	l = xlat_exp_single(arg->group);
+
+	arg = xlat_exp_next(node->call.args, arg);
+	if (!arg || (arg->type != XLAT_GROUP)) return false;
+	r = xlat_exp_single(arg->group);
+
+	if (!l || (l->type != XLAT_TMPL) || !r || (r->type != XLAT_TMPL) || !tmpl_contains_regex(r->vpt)) return false;
+
+	*lhs = l->vpt;
+	*regex = r->vpt;
+
+	return true;
+}
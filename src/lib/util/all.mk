@@ -5,10 +5,13 @@ SUBMAKEFILES := \
 	dcursor_typed_tests.mk \
 	dlist_tests.mk \
 	edit_tests.mk \
+	event_perf_test.mk \
+	event_tests.mk \
 	heap_tests.mk \
 	hmac_tests.mk \
 	libfreeradius-util.mk \
 	lst_tests.mk \
+	md5_mb_tests.mk \
 	minmax_heap_tests.mk \
 	pair_legacy_tests.mk \
 	pair_list_perf_test.mk \
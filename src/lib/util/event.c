@@ -33,6 +33,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/event.h>
 #include <freeradius-devel/util/lst.h>
 #include <freeradius-devel/util/log.h>
+#include <freeradius-devel/util/math.h>
 #include <freeradius-devel/util/rb.h>
 #include <freeradius-devel/util/strerror.h>
 #include <freeradius-devel/util/syserror.h>
@@ -96,6 +97,16 @@ static size_t kevent_filter_table_len = NUM_ELEMENTS(kevent_filter_table);
 static int log_conf_kq;
 #endif
 
+/*
+ *	The epoll backend keeps state for each kqueue, which
+ *	close() would leak.
+ */
+#ifdef WITH_EVENT_EPOLL
+#  define kqueue_close(_kq)	fr_epoll_close(_kq)
+#else
+#  define kqueue_close(_kq)	close(_kq)
+#endif
+
 /** A timer event
  *
  */
@@ -113,6 +124,10 @@ struct fr_event_timer {
 	fr_lst_index_t		lst_id;	     	  	//!< Where to store opaque lst data.
 	fr_dlist_t		entry;			//!< List of deferred timer events.
 
+	fr_dlist_t		wheel_entry;		//!< Entry in a timer wheel slot.
+	uint8_t			wheel_level;		//!< Level of the timer wheel this event is in.
+	uint8_t			wheel_slot;		//!< Slot within that level.
+
 	fr_event_list_t		*el;			//!< Event list containing this timer.
 
 #ifndef NDEBUG
@@ -405,11 +420,41 @@ typedef struct {
 	void			*uctx;			//!< Context for the callback.
 } fr_event_post_t;
 
+#define EVENT_WHEEL_LEVELS	4			//!< Number of levels in the timer wheel.
+#define EVENT_WHEEL_BITS	8			//!< log2 of the number of slots per level.
+#define EVENT_WHEEL_SLOTS	(1 << EVENT_WHEEL_BITS)
+#define EVENT_WHEEL_MASK	(EVENT_WHEEL_SLOTS - 1)
+
+/** Hierarchical timer wheel
+ *
+ * Holds timers which are due after the current tick.  Level 0 has one
+ * slot per tick, and each slot of level N covers all the slots of
+ * level N - 1.  Timers are placed in the lowest level where the tick
+ * they're due in differs from the current tick.
+ *
+ * As the current tick advances into a slot, the timers in the slot are
+ * "cascaded" down to a lower level.  Timers in level 0 are moved to
+ * the LST in the tick they're due in, so the LST still determines the
+ * exact order timers fire in.  Timers which are deleted before they're
+ * due, which is most of them, never touch the LST.
+ */
+typedef struct {
+	fr_time_delta_t		tick;			//!< Granularity of the wheel.
+	uint64_t		now;			//!< The current tick.  Timers due in or before this
+							///< tick are in the LST.
+	uint64_t		num;			//!< Number of timers in the wheel.
+
+	uint64_t		occupied[EVENT_WHEEL_LEVELS][EVENT_WHEEL_SLOTS / 64];	//!< Non-empty slots.
+	fr_dlist_head_t		slot[EVENT_WHEEL_LEVELS][EVENT_WHEEL_SLOTS];		//!< Timers in each slot.
+} fr_event_wheel_t;
+
 /** Stores all information relating to an event list
  *
  */
 struct fr_event_list {
 	fr_lst_t		*times;			//!< of timer events to be executed.
+	fr_event_wheel_t	*wheel;			//!< Timers which aren't due in the current tick.
+							///< NULL if the timer wheel isn't in use.
 	fr_rb_tree_t		*fds;			//!< Tree used to track FDs with filters in kqueue.
 
 	int			will_exit;		//!< Will exit on next call to fr_event_corral.
@@ -614,7 +659,7 @@ uint64_t fr_event_list_num_timers(fr_event_list_t *el)
 {
 	if (unlikely(!el)) return -1;
 
-	return fr_lst_num_elements(el->times);
+	return fr_lst_num_elements(el->times) + (el->wheel ? el->wheel->num : 0);
 }
 
 /** Return the kq associated with an event list.
@@ -1386,6 +1431,302 @@ int fr_event_fd_unarmour(fr_event_list_t *el, int fd, fr_event_filter_t filter,
 }
 #endif
 
+/** Return the tick a time falls in
+ *
+ */
+static inline CC_HINT(always_inline) uint64_t event_wheel_tick(fr_event_wheel_t const *wheel, fr_time_t when)
+{
+	if (fr_time_lteq(when, fr_time_wrap(0))) return 0;
+
+	return (uint64_t)fr_time_unwrap(when) / (uint64_t)fr_time_delta_unwrap(wheel->tick);
+}
+
+/** Insert a timer event into the LST, or the wheel if it's not due in the current tick
+ *
+ * @param[in] el	to insert the event into.
+ * @param[in] ev	to insert.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static inline CC_HINT(always_inline) int event_timer_insert(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	fr_event_wheel_t	*wheel = el->wheel;
+	uint64_t		tick, diff;
+	uint8_t			level, slot;
+
+	if (!wheel) return fr_lst_insert(el->times, ev);
+
+	tick = event_wheel_tick(wheel, ev->when);
+	if (tick <= wheel->now) return fr_lst_insert(el->times, ev);
+
+	/*
+	 *	The level is determined by the most significant
+	 *	digit where the tick differs from the current tick.
+	 *	Timers beyond the end of the wheel go in the LST.
+	 */
+	diff = tick ^ wheel->now;
+	if (diff >> (EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS)) return fr_lst_insert(el->times, ev);
+
+	level = (fr_high_bit_pos(diff) - 1) / EVENT_WHEEL_BITS;
+	slot = (tick >> (EVENT_WHEEL_BITS * level)) & EVENT_WHEEL_MASK;
+
+	ev->wheel_level = level;
+	ev->wheel_slot = slot;
+	fr_dlist_insert_tail(&wheel->slot[level][slot], ev);
+	wheel->occupied[level][slot / 64] |= ((uint64_t)1 << (slot % 64));
+	wheel->num++;
+
+	return 0;
+}
+
+/** Remove a timer event from the LST, or the wheel
+ *
+ * @param[in] el	the event is in.
+ * @param[in] ev	to remove.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static inline CC_HINT(always_inline) int event_timer_extract(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	fr_event_wheel_t	*wheel = el->wheel;
+	fr_dlist_head_t		*list;
+
+	if (!fr_dlist_entry_in_list(&ev->wheel_entry)) return fr_lst_extract(el->times, ev);
+
+	list = &wheel->slot[ev->wheel_level][ev->wheel_slot];
+	(void) fr_dlist_remove(list, ev);
+	if (fr_dlist_empty(list)) {
+		wheel->occupied[ev->wheel_level][ev->wheel_slot / 64] &= ~((uint64_t)1 << (ev->wheel_slot % 64));
+	}
+	wheel->num--;
+
+	return 0;
+}
+
+/** Find the first non-empty slot after a given slot
+ *
+ * @param[in] occupied	bitmap of non-empty slots.
+ * @param[in] from	slot to start searching at.
+ * @return
+ *	- The slot number.
+ *	- -1 if there are no more non-empty slots.
+ */
+static inline int event_wheel_next_slot(uint64_t const occupied[static EVENT_WHEEL_SLOTS / 64], unsigned int from)
+{
+	unsigned int	i;
+	uint64_t	word;
+
+	if (from >= EVENT_WHEEL_SLOTS) return -1;
+
+	i = from / 64;
+	word = occupied[i] & (~(uint64_t)0 << (from % 64));
+
+	for (;;) {
+		if (word) return (i * 64) + fr_low_bit_pos(word) - 1;
+		if (++i >= (EVENT_WHEEL_SLOTS / 64)) return -1;
+		word = occupied[i];
+	}
+}
+
+/** Return the next tick where the wheel has timers to process
+ *
+ * @return
+ *	- The tick.
+ *	- UINT64_MAX if the wheel is empty.
+ */
+static uint64_t event_wheel_next(fr_event_wheel_t const *wheel)
+{
+	unsigned int	level, shift;
+	int		slot;
+
+	if (!wheel->num) return UINT64_MAX;
+
+	/*
+	 *	Slots in lower levels are always processed
+	 *	before slots in higher levels.
+	 */
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		shift = EVENT_WHEEL_BITS * level;
+
+		slot = event_wheel_next_slot(wheel->occupied[level], ((wheel->now >> shift) & EVENT_WHEEL_MASK) + 1);
+		if (slot < 0) continue;
+
+		return ((wheel->now >> (shift + EVENT_WHEEL_BITS)) << (shift + EVENT_WHEEL_BITS)) |
+		       ((uint64_t)slot << shift);
+	}
+
+	return UINT64_MAX;
+}
+
+/** Move all the timers in a slot to their new location
+ *
+ */
+static void event_wheel_cascade(fr_event_list_t *el, unsigned int level, unsigned int slot)
+{
+	fr_event_wheel_t	*wheel = el->wheel;
+	fr_dlist_head_t		*list = &wheel->slot[level][slot];
+	fr_event_timer_t	*ev;
+
+	wheel->occupied[level][slot / 64] &= ~((uint64_t)1 << (slot % 64));
+
+	while ((ev = fr_dlist_pop_head(list))) {
+		wheel->num--;
+
+		if (unlikely(event_timer_insert(el, ev) < 0)) {
+			talloc_free(ev);
+			fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
+		}
+	}
+}
+
+/** Advance the timer wheel, moving any timers which are now due into the LST
+ *
+ * @param[in] el	containing the wheel.
+ * @param[in] now	the current time.
+ */
+static void event_wheel_advance(fr_event_list_t *el, fr_time_t now)
+{
+	fr_event_wheel_t	*wheel = el->wheel;
+	uint64_t		target = event_wheel_tick(wheel, now), next;
+	int			level;
+
+	while (wheel->now < target) {
+		/*
+		 *	Skip over ticks where there's nothing to do.
+		 */
+		next = event_wheel_next(wheel);
+		if (next > target) {
+			wheel->now = target;
+			return;
+		}
+		wheel->now = next;
+
+		/*
+		 *	Higher levels first, so that timers cascaded
+		 *	into this tick's level 0 slot get moved too.
+		 */
+		for (level = EVENT_WHEEL_LEVELS - 1; level >= 0; level--) {
+			unsigned int shift = EVENT_WHEEL_BITS * level;
+
+			if (level && (next & (((uint64_t)1 << shift) - 1))) continue;
+
+			event_wheel_cascade(el, level, (next >> shift) & EVENT_WHEEL_MASK);
+		}
+	}
+}
+
+/** Return when the next timer event should be serviced
+ *
+ * @param[in] el	to check.
+ * @param[in] now	the current time.
+ * @param[out] when	the next timer event is due.
+ * @return
+ *	- The next timer event, if it's in the LST, and it's due before
+ *	  the wheel next needs servicing.
+ *	- NULL if the LST is empty, or the wheel needs servicing first.
+ *	  when is set to the time the wheel next needs servicing, or 0 if
+ *	  there are no timers.
+ */
+static inline CC_HINT(always_inline) fr_event_timer_t *event_timer_peek(fr_event_list_t *el, fr_time_t now, fr_time_t *when)
+{
+	fr_event_timer_t	*ev;
+	uint64_t		next;
+	fr_time_t		wheel_when;
+
+	if (el->wheel) event_wheel_advance(el, now);
+
+	ev = fr_lst_peek(el->times);
+
+	if (!el->wheel || ((next = event_wheel_next(el->wheel)) == UINT64_MAX)) {
+		*when = ev ? ev->when : fr_time_wrap(0);
+		return ev;
+	}
+
+	/*
+	 *	The LST also holds timers beyond the end of the
+	 *	wheel, so its head may be due after the wheel's
+	 *	next tick.
+	 */
+	wheel_when = fr_time_wrap((int64_t)(next * (uint64_t)fr_time_delta_unwrap(el->wheel->tick)));
+	if (ev && fr_time_lt(ev->when, wheel_when)) {
+		*when = ev->when;
+		return ev;
+	}
+
+	*when = wheel_when;
+	return NULL;
+}
+
+/** Use a hierarchical timer wheel for timers which aren't due in the current tick
+ *
+ * The LST is O(log n) for insertions and deletions, and most timers
+ * are deleted before they fire.  With the wheel, timers only enter the
+ * LST during the tick they're due in, so inserting and deleting most
+ * timers is O(1).  The order timers fire in, and when they fire, is
+ * not affected.
+ *
+ * The tick should be small enough that relatively few timers are due
+ * in any single tick, but large enough that the wheel covers most
+ * timers.  Timers more than 2^32 ticks in the future are kept in the LST.
+ *
+ * @param[in] el	to enable the timer wheel for.
+ * @param[in] tick	granularity of the wheel.  Zero disables the wheel.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_event_list_timer_wheel(fr_event_list_t *el, fr_time_delta_t tick)
+{
+	fr_event_wheel_t	*wheel = el->wheel;
+	fr_event_timer_t	*ev;
+	unsigned int		level, slot;
+
+	if (unlikely(fr_time_delta_isneg(tick))) {
+		fr_strerror_const("Timer wheel tick must not be negative");
+		return -1;
+	}
+
+	/*
+	 *	Move any existing timers into the LST.  The
+	 *	wheel is rebuilt as timers are inserted.
+	 */
+	if (wheel) {
+		for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+			for (slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+				while ((ev = fr_dlist_pop_head(&wheel->slot[level][slot]))) {
+					if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+						fr_strerror_const_push("Failed moving timer wheel event to the lst");
+						return -1;
+					}
+				}
+			}
+		}
+		TALLOC_FREE(el->wheel);
+	}
+
+	if (!fr_time_delta_ispos(tick)) return 0;
+
+	wheel = talloc_zero(el, fr_event_wheel_t);
+	if (unlikely(!wheel)) {
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+	wheel->tick = tick;
+
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		for (slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+			fr_dlist_init(&wheel->slot[level][slot], fr_event_timer_t, wheel_entry);
+		}
+	}
+
+	el->wheel = wheel;
+	wheel->now = event_wheel_tick(wheel, el->time());
+
+	return 0;
+}
+
 /** Remove an event from the event loop
  *
  * @param[in] ev	to free.
@@ -1401,7 +1742,7 @@ static int _event_timer_free(fr_event_timer_t *ev)
 	if (fr_dlist_entry_in_list(&ev->entry)) {
 		(void) fr_dlist_remove(&el->ev_to_add, ev);
 	} else {
-		int		ret = fr_lst_extract(el->times, ev);
+		int		ret = event_timer_extract(el, ev);
 		char const	*err_file;
 		int		err_line;
 
@@ -1524,7 +1865,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 			char const	*err_file;
 			int		err_line;
 
-			ret = fr_lst_extract(el->times, ev);
+			ret = event_timer_extract(el, ev);
 
 #ifndef NDEBUG
 			err_file = ev->file;
@@ -1562,7 +1903,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 		 *	multiple times.
 		 */
 		if (!fr_dlist_entry_in_list(&ev->entry)) fr_dlist_insert_head(&el->ev_to_add, ev);
-	} else if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+	} else if (unlikely(event_timer_insert(el, ev) < 0)) {
 		fr_strerror_const_push("Failed inserting event");
 		talloc_set_destructor(ev, NULL);
 		*ev_p = NULL;
@@ -2067,13 +2408,13 @@ unsigned int fr_event_list_reap_signal(fr_event_list_t *el, fr_time_delta_t time
 			default:
 				EVENT_DEBUG("%p - %s - Reaper tmp loop error %s, forcing process reaping",
 					    el, __FUNCTION__, fr_syserror(errno));
-				close(kq);
+				kqueue_close(kq);
 				goto force;
 
 			case 0:
 				EVENT_DEBUG("%p - %s - Reaper timeout waiting for process exit, forcing process reaping",
 					    el, __FUNCTION__);
-				close(kq);
+				kqueue_close(kq);
 				goto force;
 
 			case 1:
@@ -2090,7 +2431,7 @@ unsigned int fr_event_list_reap_signal(fr_event_list_t *el, fr_time_delta_t time
 			waiting--;
 		}
 
-		close(kq);
+		kqueue_close(kq);
 	}
 
 force:
@@ -2366,16 +2707,13 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 	void			*uctx;
 	fr_event_timer_t	*ev;
 
-	if (unlikely(!el)) return 0;
+	fr_time_t		next;
 
-	if (fr_lst_num_elements(el->times) == 0) {
-		*when = fr_time_wrap(0);
-		return 0;
-	}
+	if (unlikely(!el)) return 0;
 
-	ev = fr_lst_peek(el->times);
+	ev = event_timer_peek(el, *when, &next);
 	if (!ev) {
-		*when = fr_time_wrap(0);
+		*when = next;
 		return 0;
 	}
 
@@ -2418,7 +2756,7 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	fr_event_pre_t		*pre;
 	int			num_fd_events;
 	bool			timer_event_ready = false;
-	fr_event_timer_t	*ev;
+	fr_time_t		next;
 
 	el->num_fd_events = 0;
 
@@ -2442,13 +2780,12 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	 *	events are in the past.  Or, we wait for a future
 	 *	timer event.
 	 */
-	ev = fr_lst_peek(el->times);
-	if (ev) {
-		if (fr_time_lteq(ev->when, el->now)) {
+	if (event_timer_peek(el, el->now, &next) || fr_time_ispos(next)) {
+		if (fr_time_lteq(next, el->now)) {
 			timer_event_ready = true;
 
 		} else if (wait) {
-			when = fr_time_sub(ev->when, el->now);
+			when = fr_time_sub(next, el->now);
 
 		} /* else we're not waiting, leave "when == 0" */
 
@@ -2691,7 +3028,7 @@ void fr_event_service(fr_event_list_t *el)
 	 *	Run all of the timer events.  Note that these can add
 	 *	new timers!
 	 */
-	if (fr_lst_num_elements(el->times) > 0) {
+	if (fr_event_list_num_timers(el) > 0) {
 		el->in_handler = true;
 
 		do {
@@ -2717,7 +3054,7 @@ void fr_event_service(fr_event_list_t *el)
 	 */
 	while ((ev = fr_dlist_head(&el->ev_to_add)) != NULL) {
 		(void)fr_dlist_remove(&el->ev_to_add, ev);
-		if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+		if (unlikely(event_timer_insert(el, ev) < 0)) {
 			talloc_free(ev);
 			fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
 		}
@@ -2795,13 +3132,14 @@ static int _event_list_free(fr_event_list_t *el)
 {
 	fr_event_timer_t const *ev;
 
+	(void) fr_event_list_timer_wheel(el, fr_time_delta_wrap(0));
 	while ((ev = fr_lst_peek(el->times)) != NULL) fr_event_timer_delete(&ev);
 
 	fr_event_list_reap_signal(el, fr_time_delta_wrap(0), SIGKILL);
 
 	talloc_free_children(el);
 
-	if (el->kq >= 0) close(el->kq);
+	if (el->kq >= 0) kqueue_close(el->kq);
 
 	return 0;
 }
@@ -2978,7 +3316,7 @@ void fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t fun
  */
 bool fr_event_list_empty(fr_event_list_t *el)
 {
-	return !fr_lst_num_elements(el->times) && !fr_rb_num_elements(el->fds);
+	return !fr_event_list_num_timers(el) && !fr_rb_num_elements(el->fds);
 }
 
 #ifdef WITH_EVENT_DEBUG
@@ -3018,6 +3356,40 @@ static int8_t event_timer_location_cmp(void const *one, void const *two)
 }
 
 
+/** Add a timer event to the report
+ *
+ */
+static int event_report_timer(fr_rb_tree_t *locations[static NUM_ELEMENTS(decades)], size_t array[static NUM_ELEMENTS(decades)],
+			      fr_event_timer_t const *ev, fr_time_t now)
+{
+	fr_time_delta_t diff = fr_time_sub(ev->when, now);
+	size_t		i;
+
+	for (i = 0; i < NUM_ELEMENTS(decades); i++) {
+		if ((fr_time_delta_cmp(diff, decades[i]) <= 0) || (i == NUM_ELEMENTS(decades) - 1)) {
+			fr_event_counter_t find = { .file = ev->file, .line = ev->line };
+			fr_event_counter_t *counter;
+
+			counter = fr_rb_find(locations[i], &find);
+			if (!counter) {
+				counter = talloc(locations[i], fr_event_counter_t);
+				if (!counter) return -1;
+				counter->file = ev->file;
+				counter->line = ev->line;
+				counter->count = 1;
+				fr_rb_insert(locations[i], counter);
+			} else {
+				counter->count++;
+			}
+
+			array[i]++;
+			break;
+		}
+	}
+
+	return 0;
+}
+
 /** Print out information about the number of events in the event loop
  *
  */
@@ -3052,27 +3424,19 @@ void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 	for (ev = fr_lst_iter_init(el->times, &iter);
 	     ev != NULL;
 	     ev = fr_lst_iter_next(el->times, &iter)) {
-		fr_time_delta_t diff = fr_time_sub(ev->when, now);
-
-		for (i = 0; i < NUM_ELEMENTS(decades); i++) {
-			if ((fr_time_delta_cmp(diff, decades[i]) <= 0) || (i == NUM_ELEMENTS(decades) - 1)) {
-				fr_event_counter_t find = { .file = ev->file, .line = ev->line };
-				fr_event_counter_t *counter;
-
-				counter = fr_rb_find(locations[i], &find);
-				if (!counter) {
-					counter = talloc(locations[i], fr_event_counter_t);
-					if (!counter) goto oom;
-					counter->file = ev->file;
-					counter->line = ev->line;
-					counter->count = 1;
-					fr_rb_insert(locations[i], counter);
-				} else {
-					counter->count++;
-				}
+		if (event_report_timer(locations, array, ev, now) < 0) goto oom;
+	}
 
-				array[i]++;
-				break;
+	if (el->wheel) {
+		unsigned int level, slot;
+
+		for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+			for (slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+				fr_dlist_head_t *list = &el->wheel->slot[level][slot];
+
+				for (ev = fr_dlist_head(list); ev; ev = fr_dlist_next(list, ev)) {
+					if (event_report_timer(locations, array, ev, now) < 0) goto oom;
+				}
 			}
 		}
 	}
@@ -3131,6 +3495,23 @@ void fr_event_timer_dump(fr_event_list_t *el)
 			    ev->file, ev->line, ev, fr_time_unwrap(ev->when),
 			    fr_time_gt(now, ev->when) ? '<' : '>', ev->callback);
 	}
+
+	if (el->wheel) {
+		unsigned int level, slot;
+
+		for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+			for (slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+				fr_dlist_head_t *list = &el->wheel->slot[level][slot];
+
+				for (ev = fr_dlist_head(list); ev; ev = fr_dlist_next(list, ev)) {
+					(void)talloc_get_type_abort(ev, fr_event_timer_t);
+					EVENT_DEBUG("%s[%u]: %p time=%" PRId64 " (%c), callback=%p, wheel=%u/%u",
+						    ev->file, ev->line, ev, fr_time_unwrap(ev->when),
+						    fr_time_gt(now, ev->when) ? '<' : '>', ev->callback, level, slot);
+				}
+			}
+		}
+	}
 }
 #endif
 #endif
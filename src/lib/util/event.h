@@ -15,7 +15,7 @@
  *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
-/** Wrapper around libkqueue to make managing events easier
+/** Wrapper around kqueue (or our native epoll backend) to make managing events easier
  *
  * @file src/lib/util/event.h
  *
@@ -34,7 +34,12 @@ extern "C" {
 #include <freeradius-devel/util/talloc.h>
 
 #include <stdbool.h>
-#include <sys/event.h>
+
+#ifdef WITH_EVENT_EPOLL
+#  include <freeradius-devel/util/event_epoll.h>
+#else
+#  include <sys/event.h>
+#endif
 
 /** An opaque file descriptor handle
  */
@@ -299,6 +304,7 @@ int		fr_event_loop(fr_event_list_t *el);
 
 fr_event_list_t	*fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t status, void *status_ctx);
 void		fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t func);
+int		fr_event_list_timer_wheel(fr_event_list_t *el, fr_time_delta_t tick) CC_HINT(nonnull);
 
 bool		fr_event_list_empty(fr_event_list_t *el);
 
@@ -0,0 +1,1186 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Native epoll backend for the event loop
+ *
+ * This implements the subset of the kqueue API which event.c uses,
+ * directly on top of epoll.  Unlike libkqueue, there is one epoll
+ * registration per file descriptor, with the read and write filters
+ * folded into the same set of epoll events.  Changing a filter is
+ * one epoll_ctl() call, and waiting for events is one epoll_wait()
+ * call.
+ *
+ * - EVFILT_READ / EVFILT_WRITE map to EPOLLIN / EPOLLOUT.  Regular
+ *   files can't be added to epoll, so they're always readable and
+ *   writable, as with kqueue.  EPOLLET applies to a whole registration,
+ *   so if only one of the two filters has EV_CLEAR, the write filter
+ *   gets its own registration on a dup() of the descriptor.
+ * - EVFILT_PROC uses a pidfd per process.
+ * - EVFILT_VNODE uses one inotify descriptor per kqueue.
+ * - EVFILT_USER events are only ever triggered by the thread which
+ *   owns the kqueue, so they're kept in a list, and don't need a
+ *   descriptor at all.
+ *
+ * As with fr_event_list_t, a kqueue must only be used by one thread
+ * at a time.
+ *
+ * @file src/lib/util/event_epoll.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/event_epoll.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define KQ_MAX_EVENTS	(256)
+
+#define KQ_TABLE_CHUNK	(1024)				//!< Descriptors per chunk of the kqueue table.
+#define KQ_TABLE_CHUNKS	(1024)				//!< Maximum number of chunks.
+
+typedef enum {
+	KQ_SOURCE_FD = 1,				//!< A file descriptor with read/write filters.
+	KQ_SOURCE_FD_WRITE,				//!< The write filter's own registration.
+	KQ_SOURCE_PROC,					//!< A pidfd.
+	KQ_SOURCE_INOTIFY				//!< The inotify descriptor for vnode filters.
+} kq_source_type_t;
+
+/** What epoll_event.data.ptr points to
+ *
+ */
+typedef struct {
+	kq_source_type_t	type;
+} kq_source_t;
+
+/** Filter state, as set by EV_ADD and friends
+ *
+ */
+typedef struct {
+	bool			active;			//!< Filter has been added.
+	bool			enabled;		//!< Filter hasn't been disabled.
+	uint16_t		flags;			//!< EV_CLEAR, EV_ONESHOT, EV_DISPATCH.
+	uint32_t		fflags;			//!< Filter flags, i.e. NOTE_*.
+	void			*udata;			//!< Returned in each event.
+} kq_knote_t;
+
+/** An epoll registration
+ *
+ */
+typedef struct {
+	int			fd;			//!< Descriptor registered with epoll, or -1.
+	uint32_t		events;			//!< What we've registered with epoll.
+	bool			registered;		//!< Whether the fd has been added to epoll.
+} kq_reg_t;
+
+/** EVFILT_READ and EVFILT_WRITE for a file descriptor
+ *
+ * Normally both filters share one registration.  When only one of
+ * them has EV_CLEAR, the write filter is registered separately on a
+ * dup() of the descriptor, so that each filter gets the right
+ * triggering mode.
+ */
+typedef struct {
+	kq_source_t		source;			//!< Must be first.
+	kq_source_t		write_source;		//!< For events from write_reg.
+
+	int			fd;			//!< File descriptor, also the index in kq->fds.
+	kq_knote_t		read;
+	kq_knote_t		write;
+
+	kq_reg_t		reg;			//!< Registration for fd.
+	kq_reg_t		write_reg;		//!< Registration for the write filter, if split.
+
+	bool			always_ready;		//!< Regular file, which epoll refuses.
+	fr_dlist_t		entry;			//!< Entry in the list of always ready fds.
+} kq_fd_t;
+
+/** EVFILT_PROC for a process
+ *
+ */
+typedef struct {
+	kq_source_t		source;			//!< Must be first.
+
+	pid_t			pid;			//!< Process we're watching.
+	int			pidfd;			//!< From pidfd_open().
+	kq_knote_t		knote;
+	fr_dlist_t		entry;			//!< Entry in the list of processes.
+} kq_proc_t;
+
+/** EVFILT_VNODE for a file or directory
+ *
+ */
+typedef struct {
+	int			fd;			//!< File or directory we're watching.
+	int			wd;			//!< inotify watch descriptor, or -1.
+	bool			is_dir;			//!< Whether the fd is a directory.
+	off_t			size;			//!< Last size we saw, for NOTE_EXTEND.
+	nlink_t			nlink;			//!< Last link count we saw, for NOTE_LINK.
+	uint32_t		pending;		//!< NOTE_* which haven't been returned yet.
+	kq_knote_t		knote;
+	fr_dlist_t		entry;			//!< Entry in the list of vnodes.
+} kq_vnode_t;
+
+/** EVFILT_USER
+ *
+ */
+typedef struct {
+	uintptr_t		ident;			//!< Identifier the caller gave us.
+	bool			triggered;		//!< NOTE_TRIGGER was set.
+	kq_knote_t		knote;
+	fr_dlist_t		entry;			//!< Entry in the list of user events.
+} kq_user_t;
+
+typedef struct {
+	int			epfd;			//!< The epoll instance, also the kqueue "fd".
+
+	kq_fd_t			**fds;			//!< Indexed by file descriptor.
+	unsigned int		num_fds;		//!< Size of the fds array.
+
+	fr_dlist_head_t		always_ready;		//!< Regular files.
+	fr_dlist_head_t		procs;			//!< EVFILT_PROC
+	fr_dlist_head_t		users;			//!< EVFILT_USER
+	fr_dlist_head_t		vnodes;			//!< EVFILT_VNODE
+
+	int			inotify_fd;		//!< For vnode filters, or -1.
+	kq_source_t		inotify_source;
+
+	struct epoll_event	events[KQ_MAX_EVENTS];	//!< so it doesn't go on the stack every time
+} kq_t;
+
+typedef _Atomic(kq_t *) kq_slot_t;
+typedef _Atomic(kq_slot_t *) kq_chunk_t;
+
+/** Map of epoll descriptors to kqueue state
+ *
+ * The kqueue API uses plain integers, so we need to find
+ * our state from the epoll descriptor.  That happens on every
+ * kevent() call, so lookups don't take a lock.  The table is
+ * allocated in chunks which are never freed or moved, and the
+ * mutex only serialises adding and removing kqueues.
+ */
+static pthread_mutex_t	kq_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static kq_chunk_t	kq_table[KQ_TABLE_CHUNKS];
+
+static kq_t *kq_find(int kq)
+{
+	kq_slot_t *chunk;
+
+	if ((kq < 0) || (kq >= (KQ_TABLE_CHUNK * KQ_TABLE_CHUNKS))) return NULL;
+
+	chunk = atomic_load_explicit(&kq_table[kq / KQ_TABLE_CHUNK], memory_order_acquire);
+	if (!chunk) return NULL;
+
+	return atomic_load_explicit(&chunk[kq % KQ_TABLE_CHUNK], memory_order_acquire);
+}
+
+static int _kq_free(kq_t *kq)
+{
+	kq_proc_t	*proc;
+	kq_vnode_t	*vnode;
+
+	while ((proc = fr_dlist_pop_head(&kq->procs))) close(proc->pidfd);
+	while ((vnode = fr_dlist_pop_head(&kq->vnodes))) {
+		if (vnode->wd >= 0) inotify_rm_watch(kq->inotify_fd, vnode->wd);
+	}
+
+	if (kq->inotify_fd >= 0) close(kq->inotify_fd);
+	if (kq->epfd >= 0) close(kq->epfd);
+
+	return 0;
+}
+
+/** Allocate a new kqueue
+ *
+ * @return
+ *	- >= 0 the descriptor for the new kqueue.
+ *	- -1 on error, with errno set.
+ */
+int fr_epoll_kqueue(void)
+{
+	kq_t		*kq;
+	kq_slot_t	*chunk;
+
+	kq = talloc_zero(NULL, kq_t);
+	if (!kq) {
+		errno = ENOMEM;
+		return -1;
+	}
+	kq->inotify_fd = -1;
+	kq->inotify_source.type = KQ_SOURCE_INOTIFY;
+	fr_dlist_init(&kq->always_ready, kq_fd_t, entry);
+	fr_dlist_talloc_init(&kq->procs, kq_proc_t, entry);
+	fr_dlist_talloc_init(&kq->users, kq_user_t, entry);
+	fr_dlist_talloc_init(&kq->vnodes, kq_vnode_t, entry);
+
+	kq->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (kq->epfd < 0) {
+		int err = errno;
+
+		talloc_free(kq);
+		errno = err;
+		return -1;
+	}
+	talloc_set_destructor(kq, _kq_free);
+
+	if (kq->epfd >= (KQ_TABLE_CHUNK * KQ_TABLE_CHUNKS)) {
+		talloc_free(kq);
+		errno = EMFILE;
+		return -1;
+	}
+
+	pthread_mutex_lock(&kq_table_mutex);
+	chunk = atomic_load_explicit(&kq_table[kq->epfd / KQ_TABLE_CHUNK], memory_order_relaxed);
+	if (!chunk) {
+		unsigned int i;
+
+		chunk = talloc_array(NULL, kq_slot_t, KQ_TABLE_CHUNK);
+		if (!chunk) {
+			pthread_mutex_unlock(&kq_table_mutex);
+			talloc_free(kq);
+			errno = ENOMEM;
+			return -1;
+		}
+		for (i = 0; i < KQ_TABLE_CHUNK; i++) atomic_init(&chunk[i], NULL);
+
+		/*
+		 *	Publish the chunk only once it's been initialised.
+		 */
+		atomic_store_explicit(&kq_table[kq->epfd / KQ_TABLE_CHUNK], chunk, memory_order_release);
+	}
+	atomic_store_explicit(&chunk[kq->epfd % KQ_TABLE_CHUNK], kq, memory_order_release);
+	pthread_mutex_unlock(&kq_table_mutex);
+
+	return kq->epfd;
+}
+
+/** Close a kqueue, and free all of its state
+ *
+ * @param[in] kq	to close.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the kqueue doesn't exist.
+ */
+int fr_epoll_close(int kq)
+{
+	kq_t		*our_kq;
+	kq_slot_t	*chunk = NULL;
+
+	pthread_mutex_lock(&kq_table_mutex);
+	if ((kq >= 0) && (kq < (KQ_TABLE_CHUNK * KQ_TABLE_CHUNKS))) {
+		chunk = atomic_load_explicit(&kq_table[kq / KQ_TABLE_CHUNK], memory_order_relaxed);
+	}
+	our_kq = chunk ? atomic_load_explicit(&chunk[kq % KQ_TABLE_CHUNK], memory_order_relaxed) : NULL;
+	if (!our_kq) {
+		pthread_mutex_unlock(&kq_table_mutex);
+		errno = EBADF;
+		return -1;
+	}
+	atomic_store_explicit(&chunk[kq % KQ_TABLE_CHUNK], NULL, memory_order_release);
+	pthread_mutex_unlock(&kq_table_mutex);
+
+	talloc_free(our_kq);
+
+	return 0;
+}
+
+/** Update a knote from a change
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the knote doesn't exist, and we weren't asked to add it.
+ */
+static int kq_knote_change(kq_knote_t *knote, struct kevent const *kev)
+{
+	if (kev->flags & EV_ADD) {
+		knote->active = true;
+		knote->enabled = true;
+		knote->flags = kev->flags & (EV_CLEAR | EV_ONESHOT | EV_DISPATCH);
+		knote->fflags = kev->fflags;
+		knote->udata = kev->udata;
+	} else if (!knote->active) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (kev->flags & EV_ENABLE) knote->enabled = true;
+	if (kev->flags & EV_DISABLE) knote->enabled = false;
+
+	return 0;
+}
+
+/** Add, modify or remove an epoll registration
+ *
+ */
+static int kq_reg_sync(kq_t *kq, kq_reg_t *reg, kq_source_t *source, uint32_t events)
+{
+	struct epoll_event ev = { .events = events, .data.ptr = source };
+
+	if (reg->registered && (events == reg->events)) return 0;
+
+	if (!reg->registered) {
+		if (!events) return 0;
+
+		if (epoll_ctl(kq->epfd, EPOLL_CTL_ADD, reg->fd, &ev) < 0) return -1;
+		reg->registered = true;
+		reg->events = events;
+		return 0;
+	}
+
+	if (!events) {
+		if (epoll_ctl(kq->epfd, EPOLL_CTL_DEL, reg->fd, &ev) < 0) return -1;
+		reg->registered = false;
+		reg->events = 0;
+		return 0;
+	}
+
+	if (epoll_ctl(kq->epfd, EPOLL_CTL_MOD, reg->fd, &ev) < 0) return -1;
+	reg->events = events;
+
+	return 0;
+}
+
+/** Mark a regular file as always ready, if epoll refused it
+ *
+ * @return true if the fd is a regular file.
+ */
+static bool kq_fd_always_ready(kq_t *kq, kq_fd_t *kfd)
+{
+	struct stat buf;
+
+	/*
+	 *	epoll doesn't do regular files.  They're
+	 *	always ready, as with kqueue.
+	 */
+	if ((errno != EPERM) || (fstat(kfd->fd, &buf) < 0) || !S_ISREG(buf.st_mode)) return false;
+
+	kfd->always_ready = true;
+	fr_dlist_insert_tail(&kq->always_ready, kfd);
+
+	return true;
+}
+
+/** Remove the separate registration for the write filter
+ *
+ * The registration has to be deleted before the dup() is closed, as
+ * epoll only forgets about it when the underlying file is released.
+ */
+static void kq_fd_unsplit(kq_t *kq, kq_fd_t *kfd)
+{
+	if (kfd->write_reg.registered) (void) epoll_ctl(kq->epfd, EPOLL_CTL_DEL, kfd->write_reg.fd, NULL);
+	close(kfd->write_reg.fd);
+	kfd->write_reg = (kq_reg_t){ .fd = -1 };
+}
+
+static int _kq_fd_free(kq_fd_t *kfd)
+{
+	if (kfd->write_reg.fd >= 0) close(kfd->write_reg.fd);
+
+	return 0;
+}
+
+/** Push the read/write filter state for an fd to epoll
+ *
+ * EV_CLEAR is tracked per filter.  If both filters are in use and only
+ * one of them is edge triggered, the write filter is moved to its own
+ * registration.
+ */
+static int kq_fd_sync(kq_t *kq, kq_fd_t *kfd)
+{
+	uint32_t	read_events = 0, write_events = 0;
+
+	if (kfd->always_ready) return 0;
+
+	if (kfd->read.active && kfd->read.enabled) {
+		read_events = EPOLLIN | EPOLLRDHUP;
+		if (kfd->read.flags & EV_CLEAR) read_events |= EPOLLET;
+	}
+	if (kfd->write.active && kfd->write.enabled) {
+		write_events = EPOLLOUT;
+		if (kfd->write.flags & EV_CLEAR) write_events |= EPOLLET;
+	}
+
+	/*
+	 *	Both filters agree on EV_CLEAR, or only one is in use,
+	 *	so they can share the registration.
+	 *
+	 *	Update the shared registration before removing the
+	 *	split one, so that write events aren't lost in between.
+	 */
+	if (!kfd->read.active || !kfd->write.active ||
+	    ((kfd->read.flags & EV_CLEAR) == (kfd->write.flags & EV_CLEAR))) {
+		if (kq_reg_sync(kq, &kfd->reg, &kfd->source, read_events | write_events) < 0) {
+			if (kfd->reg.registered || !kq_fd_always_ready(kq, kfd)) return -1;
+		}
+		if (kfd->write_reg.fd >= 0) kq_fd_unsplit(kq, kfd);
+
+		return 0;
+	}
+
+	if (kfd->write_reg.fd < 0) {
+		kfd->write_reg.fd = fcntl(kfd->fd, F_DUPFD_CLOEXEC, 0);
+		if (kfd->write_reg.fd < 0) return -1;
+	}
+
+	if (kq_reg_sync(kq, &kfd->write_reg, &kfd->write_source, write_events) < 0) {
+		if (kfd->write_reg.registered || !kq_fd_always_ready(kq, kfd)) return -1;
+		kq_fd_unsplit(kq, kfd);
+		return 0;
+	}
+
+	if (kq_reg_sync(kq, &kfd->reg, &kfd->source, read_events) < 0) {
+		if (kfd->reg.registered || !kq_fd_always_ready(kq, kfd)) return -1;
+		kq_fd_unsplit(kq, kfd);
+	}
+
+	return 0;
+}
+
+static int kq_fd_change(kq_t *kq, struct kevent const *kev)
+{
+	kq_fd_t		*kfd;
+	kq_knote_t	*knote;
+	int		fd = (int)kev->ident;
+
+	if (fd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if ((unsigned int)fd >= kq->num_fds) {
+		unsigned int	len;
+		kq_fd_t		**fds;
+
+		if (!(kev->flags & EV_ADD)) {
+			errno = ENOENT;
+			return -1;
+		}
+
+		len = fd + 64;
+		fds = talloc_realloc(kq, kq->fds, kq_fd_t *, len);
+		if (!fds) {
+			errno = ENOMEM;
+			return -1;
+		}
+		memset(fds + kq->num_fds, 0, sizeof(*fds) * (len - kq->num_fds));
+		kq->fds = fds;
+		kq->num_fds = len;
+	}
+
+	kfd = kq->fds[fd];
+	if (!kfd) {
+		if (!(kev->flags & EV_ADD)) {
+			errno = ENOENT;
+			return -1;
+		}
+
+		kfd = talloc_zero(kq, kq_fd_t);
+		if (!kfd) {
+			errno = ENOMEM;
+			return -1;
+		}
+		kfd->source.type = KQ_SOURCE_FD;
+		kfd->write_source.type = KQ_SOURCE_FD_WRITE;
+		kfd->fd = fd;
+		kfd->reg.fd = fd;
+		kfd->write_reg.fd = -1;
+		talloc_set_destructor(kfd, _kq_fd_free);
+		kq->fds[fd] = kfd;
+	}
+
+	knote = (kev->filter == EVFILT_READ) ? &kfd->read : &kfd->write;
+
+	if (kev->flags & EV_DELETE) {
+		if (!knote->active) {
+			errno = ENOENT;
+			return -1;
+		}
+		*knote = (kq_knote_t){};
+	} else if (kq_knote_change(knote, kev) < 0) {
+		return -1;
+	}
+
+	if (kq_fd_sync(kq, kfd) < 0) {
+		int err = errno;
+
+		/*
+		 *	Don't leave half-added filters lying around.
+		 */
+		if (kev->flags & EV_ADD) *knote = (kq_knote_t){};
+		if (!kfd->read.active && !kfd->write.active && !kfd->reg.registered) {
+			if (kfd->write_reg.fd >= 0) kq_fd_unsplit(kq, kfd);
+			kq->fds[fd] = NULL;
+			talloc_free(kfd);
+		}
+		errno = err;
+		return -1;
+	}
+
+	if (!kfd->read.active && !kfd->write.active) {
+		if (kfd->always_ready) fr_dlist_remove(&kq->always_ready, kfd);
+		kq->fds[fd] = NULL;
+		talloc_free(kfd);
+	}
+
+	return 0;
+}
+
+static kq_proc_t *kq_proc_find(kq_t *kq, pid_t pid)
+{
+	fr_dlist_foreach(&kq->procs, kq_proc_t, proc) {
+		if (proc->pid == pid) return proc;
+	}
+
+	return NULL;
+}
+
+static void kq_proc_free(kq_t *kq, kq_proc_t *proc)
+{
+	(void) epoll_ctl(kq->epfd, EPOLL_CTL_DEL, proc->pidfd, NULL);
+	close(proc->pidfd);
+	fr_dlist_remove(&kq->procs, proc);
+	talloc_free(proc);
+}
+
+static int kq_proc_change(kq_t *kq, struct kevent const *kev)
+{
+	kq_proc_t		*proc;
+	struct epoll_event	ev;
+	int			pidfd;
+
+	proc = kq_proc_find(kq, (pid_t)kev->ident);
+
+	if (kev->flags & EV_DELETE) {
+		if (!proc) {
+			errno = ENOENT;
+			return -1;
+		}
+		kq_proc_free(kq, proc);
+		return 0;
+	}
+
+	if (proc) return kq_knote_change(&proc->knote, kev);
+
+	if (!(kev->flags & EV_ADD)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+#ifdef SYS_pidfd_open
+	pidfd = syscall(SYS_pidfd_open, (pid_t)kev->ident, 0);
+	if (pidfd < 0) return -1;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+
+	proc = talloc_zero(kq, kq_proc_t);
+	if (!proc) {
+		close(pidfd);
+		errno = ENOMEM;
+		return -1;
+	}
+	proc->source.type = KQ_SOURCE_PROC;
+	proc->pid = (pid_t)kev->ident;
+	proc->pidfd = pidfd;
+	(void) kq_knote_change(&proc->knote, kev);
+
+	ev = (struct epoll_event){ .events = EPOLLIN, .data.ptr = proc };
+	if (epoll_ctl(kq->epfd, EPOLL_CTL_ADD, pidfd, &ev) < 0) {
+		int err = errno;
+
+		close(pidfd);
+		talloc_free(proc);
+		errno = err;
+		return -1;
+	}
+	fr_dlist_insert_tail(&kq->procs, proc);
+
+	return 0;
+}
+
+static kq_user_t *kq_user_find(kq_t *kq, uintptr_t ident)
+{
+	fr_dlist_foreach(&kq->users, kq_user_t, user) {
+		if (user->ident == ident) return user;
+	}
+
+	return NULL;
+}
+
+static int kq_user_change(kq_t *kq, struct kevent const *kev)
+{
+	kq_user_t *user;
+
+	user = kq_user_find(kq, kev->ident);
+
+	if (kev->flags & EV_DELETE) {
+		if (!user) {
+			errno = ENOENT;
+			return -1;
+		}
+		fr_dlist_remove(&kq->users, user);
+		talloc_free(user);
+		return 0;
+	}
+
+	if (!user) {
+		if (!(kev->flags & EV_ADD)) {
+			errno = ENOENT;
+			return -1;
+		}
+
+		user = talloc_zero(kq, kq_user_t);
+		if (!user) {
+			errno = ENOMEM;
+			return -1;
+		}
+		user->ident = kev->ident;
+		fr_dlist_insert_tail(&kq->users, user);
+	}
+
+	/*
+	 *	The trigger isn't part of the filter state.
+	 */
+	if (kq_knote_change(&user->knote, &(struct kevent){ .flags = kev->flags,
+							    .fflags = kev->fflags & ~NOTE_TRIGGER,
+							    .udata = kev->udata }) < 0) return -1;
+
+	if (kev->fflags & NOTE_TRIGGER) user->triggered = true;
+
+	return 0;
+}
+
+/** Convert kqueue vnode notes to inotify events
+ *
+ */
+static uint32_t kq_vnode_mask(uint32_t fflags, bool is_dir)
+{
+	uint32_t mask = 0;
+
+	if (fflags & NOTE_DELETE) mask |= IN_DELETE_SELF;
+	if (fflags & (NOTE_WRITE | NOTE_EXTEND)) {
+		mask |= is_dir ? (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) : IN_MODIFY;
+	}
+	if (fflags & (NOTE_ATTRIB | NOTE_LINK)) mask |= IN_ATTRIB;
+	if (fflags & NOTE_RENAME) mask |= IN_MOVE_SELF;
+	if (fflags & NOTE_REVOKE) mask |= IN_UNMOUNT;
+
+	return mask;
+}
+
+static int kq_vnode_change(kq_t *kq, struct kevent const *kev)
+{
+	kq_vnode_t	*vnode = NULL;
+	int		fd = (int)kev->ident;
+	char		proc_path[64];
+	char		path[PATH_MAX];
+	ssize_t		len;
+	struct stat	buf;
+
+	fr_dlist_foreach(&kq->vnodes, kq_vnode_t, v) {
+		if (v->fd == fd) {
+			vnode = v;
+			break;
+		}
+	}
+
+	if (kev->flags & EV_DELETE) {
+		if (!vnode) {
+			errno = ENOENT;
+			return -1;
+		}
+		if (vnode->wd >= 0) inotify_rm_watch(kq->inotify_fd, vnode->wd);
+		fr_dlist_remove(&kq->vnodes, vnode);
+		talloc_free(vnode);
+		return 0;
+	}
+
+	if (!vnode && !(kev->flags & EV_ADD)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (kq->inotify_fd < 0) {
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &kq->inotify_source };
+
+		kq->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (kq->inotify_fd < 0) return -1;
+
+		if (epoll_ctl(kq->epfd, EPOLL_CTL_ADD, kq->inotify_fd, &ev) < 0) {
+			int err = errno;
+
+			close(kq->inotify_fd);
+			kq->inotify_fd = -1;
+			errno = err;
+			return -1;
+		}
+	}
+
+	if (fstat(fd, &buf) < 0) return -1;
+
+	/*
+	 *	inotify wants a path, not a file descriptor.
+	 */
+	snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%i", fd);
+	len = readlink(proc_path, path, sizeof(path) - 1);
+	if (len < 0) return -1;
+	path[len] = '\0';
+
+	if (!vnode) {
+		vnode = talloc_zero(kq, kq_vnode_t);
+		if (!vnode) {
+			errno = ENOMEM;
+			return -1;
+		}
+		vnode->fd = fd;
+		vnode->wd = -1;
+		fr_dlist_insert_tail(&kq->vnodes, vnode);
+	}
+
+	(void) kq_knote_change(&vnode->knote, kev);
+	vnode->is_dir = S_ISDIR(buf.st_mode);
+	vnode->size = buf.st_size;
+	vnode->nlink = buf.st_nlink;
+
+	vnode->wd = inotify_add_watch(kq->inotify_fd, path, kq_vnode_mask(vnode->knote.fflags, vnode->is_dir));
+	if (vnode->wd < 0) {
+		int err = errno;
+
+		fr_dlist_remove(&kq->vnodes, vnode);
+		talloc_free(vnode);
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Read pending inotify events, and record them against the vnodes
+ *
+ */
+static void kq_vnode_read(kq_t *kq)
+{
+	char	buffer[4096] CC_HINT(aligned(__alignof__(struct inotify_event)));
+	ssize_t	len;
+
+	while ((len = read(kq->inotify_fd, buffer, sizeof(buffer))) > 0) {
+		char *p = buffer;
+
+		while (p < (buffer + len)) {
+			struct inotify_event	*in = (struct inotify_event *)p;
+			uint32_t		notes = 0;
+
+			p += sizeof(*in) + in->len;
+
+			fr_dlist_foreach(&kq->vnodes, kq_vnode_t, vnode) {
+				struct stat buf;
+
+				if (vnode->wd != in->wd) continue;
+
+				if (in->mask & IN_DELETE_SELF) notes |= NOTE_DELETE;
+				if (in->mask & IN_MOVE_SELF) notes |= NOTE_RENAME;
+				if (in->mask & IN_UNMOUNT) notes |= NOTE_REVOKE;
+				if (in->mask & (IN_CREATE | IN_MOVED_TO)) notes |= NOTE_WRITE | NOTE_EXTEND;
+				if (in->mask & (IN_DELETE | IN_MOVED_FROM | IN_MODIFY)) notes |= NOTE_WRITE;
+				if (in->mask & IN_ATTRIB) notes |= NOTE_ATTRIB;
+
+				if ((in->mask & (IN_MODIFY | IN_ATTRIB)) && (fstat(vnode->fd, &buf) == 0)) {
+					if (buf.st_size > vnode->size) notes |= NOTE_EXTEND;
+					if (buf.st_nlink != vnode->nlink) notes |= NOTE_LINK;
+					vnode->size = buf.st_size;
+					vnode->nlink = buf.st_nlink;
+				}
+
+				/*
+				 *	The watch is gone, either because the
+				 *	file was deleted, or the filesystem
+				 *	was unmounted.
+				 */
+				if (in->mask & IN_IGNORED) vnode->wd = -1;
+
+				vnode->pending |= notes;
+				break;
+			}
+		}
+	}
+}
+
+/** Whether any events are ready without asking epoll
+ *
+ */
+static bool kq_pending(kq_t *kq)
+{
+	fr_dlist_foreach(&kq->users, kq_user_t, user) {
+		if (user->triggered && user->knote.enabled) return true;
+	}
+
+	fr_dlist_foreach(&kq->vnodes, kq_vnode_t, vnode) {
+		if ((vnode->pending & vnode->knote.fflags) && vnode->knote.enabled) return true;
+	}
+
+	return (fr_dlist_num_elements(&kq->always_ready) > 0);
+}
+
+/** Apply EV_ONESHOT and EV_DISPATCH after an event has been returned
+ *
+ * @return true if the knote was deleted.
+ */
+static inline CC_HINT(always_inline) bool kq_knote_fired(kq_knote_t *knote)
+{
+	if (knote->flags & EV_ONESHOT) {
+		*knote = (kq_knote_t){};
+		return true;
+	}
+	if (knote->flags & EV_DISPATCH) knote->enabled = false;
+
+	return false;
+}
+
+/** Get the socket error and pending bytes for an EOF
+ *
+ */
+static void kq_fd_eof(int fd, struct kevent *kev)
+{
+	int		sock_errno = 0;
+	socklen_t	len = sizeof(sock_errno);
+	int		available = 0;
+
+	kev->flags |= EV_EOF;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sock_errno, &len) == 0) kev->fflags = sock_errno;
+	if ((kev->filter == EVFILT_READ) && (ioctl(fd, FIONREAD, &available) == 0)) kev->data = available;
+}
+
+/** Convert triggered user events to kevents
+ *
+ */
+static int kq_collect_users(kq_t *kq, struct kevent *out, int nevents)
+{
+	int n = 0;
+
+	fr_dlist_foreach_safe(&kq->users, kq_user_t, user) {
+		if (n >= nevents) break;
+		if (!user->triggered || !user->knote.enabled) continue;
+
+		out[n++] = (struct kevent){ .ident = user->ident, .filter = EVFILT_USER,
+					    .flags = user->knote.flags, .fflags = user->knote.fflags,
+					    .udata = user->knote.udata };
+
+		/*
+		 *	We only support triggering from the thread
+		 *	which owns the kqueue, so there's no point in
+		 *	leaving the trigger set.
+		 */
+		user->triggered = false;
+		if (kq_knote_fired(&user->knote)) {
+			fr_dlist_remove(&kq->users, user);
+			talloc_free(user);
+		}
+	}}
+
+	return n;
+}
+
+/** Convert pending vnode notes to kevents
+ *
+ */
+static int kq_collect_vnodes(kq_t *kq, struct kevent *out, int nevents)
+{
+	int n = 0;
+
+	fr_dlist_foreach(&kq->vnodes, kq_vnode_t, vnode) {
+		uint32_t notes;
+
+		if (n >= nevents) break;
+		if (!vnode->knote.enabled) continue;
+
+		notes = vnode->pending & vnode->knote.fflags;
+		if (!notes) continue;
+
+		out[n++] = (struct kevent){ .ident = vnode->fd, .filter = EVFILT_VNODE,
+					    .flags = vnode->knote.flags, .fflags = notes,
+					    .udata = vnode->knote.udata };
+		vnode->pending = 0;
+		(void) kq_knote_fired(&vnode->knote);
+	}
+
+	return n;
+}
+
+/** Convert regular files to kevents
+ *
+ */
+static int kq_collect_files(kq_t *kq, struct kevent *out, int nevents)
+{
+	int n = 0;
+
+	fr_dlist_foreach(&kq->always_ready, kq_fd_t, kfd) {
+		if (n >= nevents) break;
+
+		if (kfd->read.active && kfd->read.enabled) {
+			off_t		pos = lseek(kfd->fd, 0, SEEK_CUR);
+			struct stat	buf;
+
+			out[n] = (struct kevent){ .ident = kfd->fd, .filter = EVFILT_READ,
+						  .flags = kfd->read.flags, .udata = kfd->read.udata };
+			if ((pos >= 0) && (fstat(kfd->fd, &buf) == 0) && (buf.st_size > pos)) out[n].data = buf.st_size - pos;
+			n++;
+		}
+
+		if (kfd->write.active && kfd->write.enabled && (n < nevents)) {
+			out[n++] = (struct kevent){ .ident = kfd->fd, .filter = EVFILT_WRITE,
+						    .flags = kfd->write.flags, .udata = kfd->write.udata };
+		}
+	}
+
+	return n;
+}
+
+/** Wait for events, and convert them to kevents
+ *
+ */
+static int kq_wait(kq_t *kq, struct kevent *out, int nevents, struct timespec const *timeout)
+{
+	int	n, i, num, max, ms;
+
+	n = 0;
+	if (kq_pending(kq)) {
+		n += kq_collect_users(kq, out + n, nevents - n);
+		n += kq_collect_vnodes(kq, out + n, nevents - n);
+		n += kq_collect_files(kq, out + n, nevents - n);
+		if (n >= nevents) return n;
+	}
+
+	if (n > 0) {
+		ms = 0;
+	} else if (!timeout) {
+		ms = -1;
+	} else {
+		/*
+		 *	Round up, so that we don't spin waiting
+		 *	for a timer which is less than 1ms away.
+		 */
+		int64_t msec = ((int64_t)timeout->tv_sec * 1000) + ((timeout->tv_nsec + 999999) / 1000000);
+
+		ms = (msec > INT_MAX) ? INT_MAX : (int)msec;
+	}
+
+	/*
+	 *	Each epoll event can produce both a read and a write
+	 *	event.  Level triggered events we don't have room for
+	 *	will be returned on the next call.
+	 */
+	max = (nevents - n) / 2;
+	if (max < 1) max = 1;
+	if (max > KQ_MAX_EVENTS) max = KQ_MAX_EVENTS;
+
+	num = epoll_wait(kq->epfd, kq->events, max, ms);
+	if (num < 0) {
+		if (n > 0) return n;
+		return -1;
+	}
+
+	for (i = 0; (i < num) && (n < nevents); i++) {
+		kq_source_t	*source = kq->events[i].data.ptr;
+		uint32_t	events = kq->events[i].events;
+
+		switch (source->type) {
+		case KQ_SOURCE_FD:
+		case KQ_SOURCE_FD_WRITE:
+		{
+			kq_fd_t *kfd;
+			bool	do_read, do_write;
+			int	fd;
+
+			/*
+			 *	If the write filter has its own registration,
+			 *	only report it from there.
+			 */
+			if (source->type == KQ_SOURCE_FD) {
+				kfd = (kq_fd_t *)source;
+				do_read = true;
+				do_write = (kfd->write_reg.fd < 0);
+			} else {
+				kfd = (kq_fd_t *)((uint8_t *)source - offsetof(kq_fd_t, write_source));
+				do_read = false;
+				do_write = true;
+			}
+			fd = kfd->fd;
+
+			if (do_read && kfd->read.active && kfd->read.enabled &&
+			    (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+				out[n] = (struct kevent){ .ident = fd, .filter = EVFILT_READ,
+							  .flags = kfd->read.flags, .udata = kfd->read.udata };
+				if (events & (EPOLLRDHUP | EPOLLHUP)) kq_fd_eof(fd, &out[n]);
+				n++;
+				(void) kq_knote_fired(&kfd->read);
+			}
+
+			if (do_write && (n < nevents) && kfd->write.active && kfd->write.enabled &&
+			    (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+				out[n] = (struct kevent){ .ident = fd, .filter = EVFILT_WRITE,
+							  .flags = kfd->write.flags, .udata = kfd->write.udata };
+				if (events & EPOLLHUP) kq_fd_eof(fd, &out[n]);
+				n++;
+				(void) kq_knote_fired(&kfd->write);
+			}
+
+			if (!kfd->read.active && !kfd->write.active) {
+				(void) kq_fd_sync(kq, kfd);
+				kq->fds[fd] = NULL;
+				talloc_free(kfd);
+			} else if (!kfd->read.enabled || !kfd->write.enabled) {
+				(void) kq_fd_sync(kq, kfd);
+			}
+		}
+			break;
+
+		case KQ_SOURCE_PROC:
+		{
+			kq_proc_t	*proc = (kq_proc_t *)source;
+			siginfo_t	info = { .si_pid = 0 };
+			int		status = 0;
+
+			if (!proc->knote.enabled) break;
+
+			/*
+			 *	Get the exit status, but leave the process
+			 *	for the caller to reap, as kqueue does.
+			 */
+			if (waitid(P_PID, proc->pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+				switch (info.si_code) {
+				case CLD_EXITED:
+					status = (info.si_status & 0xff) << 8;
+					break;
+
+				case CLD_KILLED:
+					status = info.si_status & 0x7f;
+					break;
+
+				case CLD_DUMPED:
+					status = (info.si_status & 0x7f) | 0x80;
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			out[n++] = (struct kevent){ .ident = proc->pid, .filter = EVFILT_PROC,
+						    .flags = proc->knote.flags | EV_EOF, .fflags = NOTE_EXIT,
+						    .data = status, .udata = proc->knote.udata };
+
+			/*
+			 *	NOTE_EXIT is always oneshot.
+			 */
+			kq_proc_free(kq, proc);
+		}
+			break;
+
+		case KQ_SOURCE_INOTIFY:
+			kq_vnode_read(kq);
+			n += kq_collect_vnodes(kq, out + n, nevents - n);
+			break;
+		}
+	}
+
+	return n;
+}
+
+/** Apply changes to a kqueue, and optionally wait for events
+ *
+ * Mirrors kevent(2).  If a change fails and there's room in the
+ * eventlist, an EV_ERROR event is returned for it.  Otherwise we
+ * return -1 with errno set.
+ */
+int fr_epoll_kevent(int kq_fd, struct kevent const *changelist, int nchanges,
+		    struct kevent *eventlist, int nevents, struct timespec const *timeout)
+{
+	kq_t	*kq;
+	int	i, n = 0;
+
+	kq = kq_find(kq_fd);
+	if (!kq) {
+		errno = EBADF;
+		return -1;
+	}
+
+	for (i = 0; i < nchanges; i++) {
+		struct kevent const	*kev = &changelist[i];
+		int			ret;
+
+		switch (kev->filter) {
+		case EVFILT_READ:
+		case EVFILT_WRITE:
+			ret = kq_fd_change(kq, kev);
+			break;
+
+		case EVFILT_PROC:
+			ret = kq_proc_change(kq, kev);
+			break;
+
+		case EVFILT_USER:
+			ret = kq_user_change(kq, kev);
+			break;
+
+		case EVFILT_VNODE:
+			ret = kq_vnode_change(kq, kev);
+			break;
+
+		default:
+			errno = EINVAL;
+			ret = -1;
+			break;
+		}
+
+		if (ret < 0) {
+			if (n >= nevents) return -1;
+		} else if (!(kev->flags & EV_RECEIPT) || (n >= nevents)) {
+			continue;
+		}
+
+		eventlist[n] = *kev;
+		eventlist[n].flags = EV_ERROR;
+		eventlist[n].data = (ret < 0) ? errno : 0;
+		n++;
+	}
+
+	if (n > 0) return n;
+	if (nevents <= 0) return 0;
+
+	return kq_wait(kq, eventlist, nevents, timeout);
+}
@@ -0,0 +1,131 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Native epoll backend for the event loop
+ *
+ * Provides the subset of the kqueue API used by event.c, implemented
+ * directly on top of epoll, pidfd and inotify.  This removes the need
+ * for libkqueue on Linux.
+ *
+ * @file src/lib/util/event_epoll.h
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(event_epoll_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <time.h>
+
+/** Mirrors the kqueue kevent structure
+ *
+ */
+struct kevent {
+	uintptr_t	ident;			//!< Identifier for this event (fd, pid, or user value).
+	int16_t		filter;			//!< Filter for event.
+	uint16_t	flags;			//!< Action flags.
+	uint32_t	fflags;			//!< Filter flag value.
+	intptr_t	data;			//!< Filter data value.
+	void		*udata;			//!< Opaque user data identifier.
+};
+
+#define EV_SET(_kev, _ident, _filter, _flags, _fflags, _data, _udata) \
+do { \
+	struct kevent *_kev_p = (_kev); \
+	_kev_p->ident = (_ident); \
+	_kev_p->filter = (_filter); \
+	_kev_p->flags = (_flags); \
+	_kev_p->fflags = (_fflags); \
+	_kev_p->data = (_data); \
+	_kev_p->udata = (void *)(_udata); \
+} while (0)
+
+/*
+ *	Filters.  The values match FreeBSD.
+ */
+#define EVFILT_READ		(-1)
+#define EVFILT_WRITE		(-2)
+#define EVFILT_VNODE		(-4)
+#define EVFILT_PROC		(-5)
+#define EVFILT_SIGNAL		(-6)		//!< Not supported.
+#define EVFILT_TIMER		(-7)		//!< Not supported.
+#define EVFILT_USER		(-11)
+
+/*
+ *	Actions
+ */
+#define EV_ADD			0x0001
+#define EV_DELETE		0x0002
+#define EV_ENABLE		0x0004
+#define EV_DISABLE		0x0008
+
+/*
+ *	Flags
+ */
+#define EV_ONESHOT		0x0010
+#define EV_CLEAR		0x0020
+#define EV_RECEIPT		0x0040
+#define EV_DISPATCH		0x0080
+
+/*
+ *	Returned values
+ */
+#define EV_ERROR		0x4000
+#define EV_EOF			0x8000
+
+/*
+ *	EVFILT_USER
+ */
+#define NOTE_FFNOP		0x00000000
+#define NOTE_TRIGGER		0x01000000
+
+/*
+ *	EVFILT_VNODE
+ */
+#define NOTE_DELETE		0x0001
+#define NOTE_WRITE		0x0002
+#define NOTE_EXTEND		0x0004
+#define NOTE_ATTRIB		0x0008
+#define NOTE_LINK		0x0010
+#define NOTE_RENAME		0x0020
+#define NOTE_REVOKE		0x0040
+
+/*
+ *	EVFILT_PROC
+ */
+#define NOTE_EXIT		0x80000000
+
+int	fr_epoll_kqueue(void);
+
+int	fr_epoll_kevent(int kq, struct kevent const *changelist, int nchanges,
+			struct kevent *eventlist, int nevents, struct timespec const *timeout);
+
+int	fr_epoll_close(int kq);
+
+/*
+ *	So that callers can use the kqueue API unchanged.  These are
+ *	function-like macros, so "struct kevent" is unaffected.
+ */
+#define kqueue()					fr_epoll_kqueue()
+#define kevent(_kq, _cl, _nc, _el, _ne, _ts)	fr_epoll_kevent(_kq, _cl, _nc, _el, _ne, _ts)
+
+#ifdef __cplusplus
+}
+#endif
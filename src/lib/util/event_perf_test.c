@@ -0,0 +1,315 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Performance tests for the event loop
+ *
+ * Build once against libkqueue, and once with --with-epoll, to compare
+ * the two backends.  The timer tests compare the LST with the timer wheel.
+ *
+ * @file src/lib/util/event_perf_test.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void event_perf_init(void);
+#define TEST_INIT event_perf_init()
+
+#include <freeradius-devel/util/acutest.h>
+
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/time.h>
+
+#include <sys/socket.h>
+#include <fcntl.h>
+
+static TALLOC_CTX	*autofree;
+
+static void event_perf_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+		fr_perror("event_perf_test");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_time_start();
+}
+
+typedef struct {
+	int		fd[2];			//!< [0] is in the event list, [1] is written to.
+	unsigned int	*handled;		//!< Incremented for each read.
+} event_perf_pair_t;
+
+static void perf_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	event_perf_pair_t	*pair = uctx;
+	char			buffer[64];
+
+	while (read(fd, buffer, sizeof(buffer)) > 0);
+
+	(*pair->handled)++;
+}
+
+static void perf_write(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, UNUSED void *uctx)
+{
+}
+
+static event_perf_pair_t *perf_pairs_alloc(unsigned int num, unsigned int *handled)
+{
+	event_perf_pair_t	*pairs;
+	unsigned int		i;
+
+	pairs = talloc_zero_array(autofree, event_perf_pair_t, num);
+	TEST_CHECK(pairs != NULL);
+
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(socketpair(AF_UNIX, SOCK_DGRAM, 0, pairs[i].fd) == 0);
+		(void) fcntl(pairs[i].fd[0], F_SETFL, O_NONBLOCK);
+		pairs[i].handled = handled;
+	}
+
+	return pairs;
+}
+
+static void perf_pairs_free(event_perf_pair_t *pairs)
+{
+	size_t i;
+
+	for (i = 0; i < talloc_array_length(pairs); i++) {
+		close(pairs[i].fd[0]);
+		close(pairs[i].fd[1]);
+	}
+	talloc_free(pairs);
+}
+
+/** Make every socket readable, and time how long it takes to dispatch the events
+ *
+ */
+static void do_test_dispatch(unsigned int num, unsigned int reps)
+{
+	fr_event_list_t		*el;
+	event_perf_pair_t	*pairs;
+	unsigned int		i, j, handled = 0;
+	fr_time_t		start, end;
+	fr_time_delta_t		used = fr_time_delta_wrap(0);
+
+	el = fr_event_list_alloc(autofree, NULL, NULL);
+	TEST_CHECK(el != NULL);
+
+	pairs = perf_pairs_alloc(num, &handled);
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(fr_event_fd_insert(el, NULL, el, pairs[i].fd[0], perf_read, NULL, NULL, &pairs[i]) == 0);
+	}
+
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < num; j++) TEST_CHECK(write(pairs[j].fd[1], "x", 1) == 1);
+
+		handled = 0;
+		start = fr_time();
+		while (handled < num) {
+			if (fr_event_corral(el, fr_time(), true) < 0) break;
+			fr_event_service(el);
+		}
+		end = fr_time();
+		used = fr_time_delta_add(used, fr_time_sub(end, start));
+	}
+
+	talloc_free(el);
+	perf_pairs_free(pairs);
+
+	TEST_MSG_ALWAYS("repetitions=%u", reps);
+	TEST_MSG_ALWAYS("sockets=%u", num);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * num)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+/** Suspend and resume the write filter, as the network side does when a socket blocks
+ *
+ */
+static void do_test_filter_update(unsigned int num, unsigned int reps)
+{
+	fr_event_list_t		*el;
+	event_perf_pair_t	*pairs;
+	unsigned int		i, j, handled = 0;
+	fr_time_t		start, end;
+	fr_time_delta_t		used = fr_time_delta_wrap(0);
+	static fr_event_update_t const pause_write[] = {
+		FR_EVENT_SUSPEND(fr_event_io_func_t, write),
+		{ 0 }
+	};
+	static fr_event_update_t const resume_write[] = {
+		FR_EVENT_RESUME(fr_event_io_func_t, write),
+		{ 0 }
+	};
+
+	el = fr_event_list_alloc(autofree, NULL, NULL);
+	TEST_CHECK(el != NULL);
+
+	pairs = perf_pairs_alloc(num, &handled);
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(fr_event_fd_insert(el, NULL, el, pairs[i].fd[0], perf_read, perf_write, NULL, &pairs[i]) == 0);
+	}
+
+	start = fr_time();
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < num; j++) {
+			(void) fr_event_filter_update(el, pairs[j].fd[0], FR_EVENT_FILTER_IO, pause_write);
+			(void) fr_event_filter_update(el, pairs[j].fd[0], FR_EVENT_FILTER_IO, resume_write);
+		}
+	}
+	end = fr_time();
+	used = fr_time_sub(end, start);
+
+	talloc_free(el);
+	perf_pairs_free(pairs);
+
+	TEST_MSG_ALWAYS("repetitions=%u", reps);
+	TEST_MSG_ALWAYS("sockets=%u", num);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * num * 2)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+/** Add and remove sockets, as happens with connected sockets and outgoing connections
+ *
+ */
+static void do_test_insert_delete(unsigned int num, unsigned int reps)
+{
+	fr_event_list_t		*el;
+	event_perf_pair_t	*pairs;
+	unsigned int		i, j, handled = 0;
+	fr_time_t		start, end;
+	fr_time_delta_t		used = fr_time_delta_wrap(0);
+
+	el = fr_event_list_alloc(autofree, NULL, NULL);
+	TEST_CHECK(el != NULL);
+
+	pairs = perf_pairs_alloc(num, &handled);
+
+	start = fr_time();
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < num; j++) {
+			(void) fr_event_fd_insert(el, NULL, el, pairs[j].fd[0], perf_read, NULL, NULL, &pairs[j]);
+		}
+		for (j = 0; j < num; j++) {
+			(void) fr_event_fd_delete(el, pairs[j].fd[0], FR_EVENT_FILTER_IO);
+		}
+
+		/*
+		 *	Deleted fd events are freed on the next service.
+		 */
+		fr_event_service(el);
+	}
+	end = fr_time();
+	used = fr_time_sub(end, start);
+
+	talloc_free(el);
+	perf_pairs_free(pairs);
+
+	TEST_MSG_ALWAYS("repetitions=%u", reps);
+	TEST_MSG_ALWAYS("sockets=%u", num);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * num)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+static void perf_timer(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, UNUSED void *uctx)
+{
+}
+
+/** Arm and delete timers, as happens with request cleanup and max_request_time timers
+ *
+ * Most of the timers are re-armed or deleted before they fire.
+ */
+static void do_test_timer_churn(unsigned int num, unsigned int reps, fr_time_delta_t tick)
+{
+	fr_event_list_t		*el;
+	fr_event_timer_t const	**evs;
+	fr_fast_rand_t		rand_ctx = { .a = fr_rand(), .b = fr_rand() };
+	unsigned int		i, j;
+	fr_time_t		start, end;
+	fr_time_delta_t		used;
+
+	el = fr_event_list_alloc(autofree, NULL, NULL);
+	TEST_CHECK(el != NULL);
+	TEST_CHECK(fr_event_list_timer_wheel(el, tick) == 0);
+
+	evs = talloc_zero_array(autofree, fr_event_timer_t const *, num);
+
+	start = fr_time();
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < num; j++) {
+			(void) fr_event_timer_in(el, el, &evs[j],
+						 fr_time_delta_from_msec(1000 + (fr_fast_rand(&rand_ctx) % 30000)),
+						 perf_timer, NULL);
+		}
+		for (j = 0; j < num; j += 2) (void) fr_event_timer_delete(&evs[j]);
+	}
+	end = fr_time();
+	used = fr_time_sub(end, start);
+
+	talloc_free(el);
+	talloc_free(evs);
+
+	TEST_MSG_ALWAYS("repetitions=%u", reps);
+	TEST_MSG_ALWAYS("timers=%u", num);
+	TEST_MSG_ALWAYS("tick=%"PRId64, fr_time_delta_unwrap(tick));
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * num * 1.5)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+static void do_test_timer_lst(unsigned int num, unsigned int reps)
+{
+	do_test_timer_churn(num, reps, fr_time_delta_wrap(0));
+}
+
+static void do_test_timer_wheel(unsigned int num, unsigned int reps)
+{
+	do_test_timer_churn(num, reps, fr_time_delta_from_msec(1));
+}
+
+#define test_func(_func, _count) \
+static void test_ ## _func ## _ ## _count(void)\
+{\
+	do_test_ ## _func(_count, 200000 / _count);\
+}
+
+#define test_funcs(_func) \
+	test_func(_func, 1) \
+	test_func(_func, 16) \
+	test_func(_func, 128) \
+	test_func(_func, 1024)
+
+test_funcs(dispatch)
+test_funcs(filter_update)
+test_funcs(insert_delete)
+test_funcs(timer_lst)
+test_funcs(timer_wheel)
+
+#define count_tests(_func) \
+	{ #_func "_1", test_ ## _func ## _1},\
+	{ #_func "_16", test_ ## _func ## _16},\
+	{ #_func "_128", test_ ## _func ## _128},\
+	{ #_func "_1024", test_ ## _func ## _1024},\
+
+TEST_LIST = {
+	count_tests(dispatch)
+	count_tests(filter_update)
+	count_tests(insert_delete)
+	count_tests(timer_lst)
+	count_tests(timer_wheel)
+
+	{ NULL }
+};
@@ -0,0 +1,550 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for event loop timers and file descriptor events
+ *
+ * @file src/lib/util/event_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void event_test_init(void);
+#define TEST_INIT event_test_init()
+
+#include <freeradius-devel/util/acutest.h>
+
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+
+#include <sys/socket.h>
+
+#define NUM_TIMERS	10000
+
+static TALLOC_CTX	*autofree;
+
+/*
+ *	All the tests run against a fake clock, so that we can
+ *	skip over hours, or days.
+ */
+static fr_time_t	test_now;
+
+static void event_test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+		fr_perror("event_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_time_start();
+}
+
+static fr_time_t test_time(void)
+{
+	return test_now;
+}
+
+typedef struct {
+	fr_event_timer_t const	*ev;
+	fr_time_t		when;
+	bool			fired;
+	bool			deleted;
+} test_timer_t;
+
+typedef struct {
+	fr_time_t		last;		//!< When the last timer fired was due.
+	unsigned int		fired;		//!< How many timers have fired.
+	unsigned int		early;		//!< How many timers fired before they were due.
+	unsigned int		out_of_order;	//!< How many timers fired before an earlier one.
+} test_state_t;
+
+static test_state_t	state;
+
+static void test_timer_cb(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	test_timer_t *t = uctx;
+
+	if (fr_time_lt(now, t->when)) state.early++;
+	if (fr_time_lt(t->when, state.last)) state.out_of_order++;
+
+	state.last = t->when;
+	state.fired++;
+	t->fired = true;
+}
+
+static fr_event_list_t *test_el_alloc(fr_time_delta_t tick)
+{
+	fr_event_list_t *el;
+
+	test_now = fr_time_wrap(NSEC);		/* Not zero, which means "no timers" */
+	memset(&state, 0, sizeof(state));
+
+	el = fr_event_list_alloc(autofree, NULL, NULL);
+	TEST_CHECK(el != NULL);
+
+	fr_event_list_set_time_func(el, test_time);
+
+	TEST_CHECK(fr_event_list_timer_wheel(el, tick) == 0);
+
+	return el;
+}
+
+/** Arm timers at random times up to "range" in the future
+ *
+ */
+static test_timer_t *test_timers_alloc(fr_event_list_t *el, fr_time_delta_t range)
+{
+	test_timer_t	*timers;
+	fr_fast_rand_t	rand_ctx = { .a = fr_rand(), .b = fr_rand() };
+	unsigned int	i;
+
+	timers = talloc_zero_array(autofree, test_timer_t, NUM_TIMERS);
+	TEST_CHECK(timers != NULL);
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		uint64_t offset = (((uint64_t)fr_fast_rand(&rand_ctx) << 32) | fr_fast_rand(&rand_ctx)) %
+				  (uint64_t)fr_time_delta_unwrap(range);
+
+		timers[i].when = fr_time_add(test_now, fr_time_delta_wrap(offset));
+		TEST_CHECK(fr_event_timer_at(el, el, &timers[i].ev, timers[i].when, test_timer_cb, &timers[i]) == 0);
+	}
+
+	return timers;
+}
+
+/** Run all the timers, skipping the clock forward to the next one each time
+ *
+ */
+static void test_timers_run(fr_event_list_t *el)
+{
+	fr_time_t when;
+
+	for (;;) {
+		when = test_now;
+		if (fr_event_timer_run(el, &when) == 1) continue;
+
+		if (!fr_time_ispos(when)) break;
+
+		TEST_CHECK(fr_time_gt(when, test_now));
+		test_now = when;
+	}
+}
+
+static void test_timers_check(test_timer_t *timers)
+{
+	unsigned int i, expected = 0;
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		TEST_CHECK(timers[i].fired != timers[i].deleted);
+		if (!timers[i].deleted) expected++;
+	}
+
+	TEST_CHECK(state.fired == expected);
+	TEST_MSG("expected %u, fired %u", expected, state.fired);
+	TEST_CHECK(state.early == 0);
+	TEST_MSG("early %u", state.early);
+	TEST_CHECK(state.out_of_order == 0);
+	TEST_MSG("out of order %u", state.out_of_order);
+}
+
+/** Timers fire in order, and not before they're due
+ *
+ */
+static void do_test_order(fr_time_delta_t tick, fr_time_delta_t range)
+{
+	fr_event_list_t	*el = test_el_alloc(tick);
+	test_timer_t	*timers = test_timers_alloc(el, range);
+
+	TEST_CHECK(fr_event_list_num_timers(el) == NUM_TIMERS);
+
+	test_timers_run(el);
+	test_timers_check(timers);
+
+	TEST_CHECK(fr_event_list_num_timers(el) == 0);
+
+	talloc_free(el);
+	talloc_free(timers);
+}
+
+static void test_order_lst(void)
+{
+	do_test_order(fr_time_delta_wrap(0), fr_time_delta_from_sec(60));
+}
+
+static void test_order_wheel(void)
+{
+	do_test_order(fr_time_delta_from_msec(1), fr_time_delta_from_sec(60));
+}
+
+static void test_order_wheel_levels(void)
+{
+	/*
+	 *	1us ticks, up to ~1 hour, so timers are spread
+	 *	over every level.
+	 */
+	do_test_order(fr_time_delta_from_usec(1), fr_time_delta_from_sec(3600));
+}
+
+static void test_order_wheel_horizon(void)
+{
+	/*
+	 *	The wheel covers ~49 days with 1ms ticks, so some of
+	 *	these timers have to go into the LST.
+	 */
+	do_test_order(fr_time_delta_from_msec(1), fr_time_delta_from_sec(86400 * 100));
+}
+
+/** Wheel timers due before a distant LST timer aren't skipped
+ *
+ */
+static void test_order_mixed(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_from_msec(1));
+	test_timer_t	*timers;
+	fr_time_t	when;
+	unsigned int	i;
+
+	timers = talloc_zero_array(autofree, test_timer_t, NUM_TIMERS);
+	TEST_CHECK(timers != NULL);
+
+	/*
+	 *	The first timer is past the wheel's horizon (~49 days
+	 *	with 1ms ticks), so it goes into the LST.  The rest are
+	 *	due sooner, and go into the wheel.
+	 */
+	timers[0].when = fr_time_add(test_now, fr_time_delta_from_sec(86400 * 60));
+	TEST_CHECK(fr_event_timer_at(el, el, &timers[0].ev, timers[0].when, test_timer_cb, &timers[0]) == 0);
+
+	for (i = 1; i < NUM_TIMERS; i++) {
+		timers[i].when = fr_time_add(test_now, fr_time_delta_from_msec(i * 10));
+		TEST_CHECK(fr_event_timer_at(el, el, &timers[i].ev, timers[i].when, test_timer_cb, &timers[i]) == 0);
+	}
+
+	/*
+	 *	The next wakeup is for the first wheel timer, not the
+	 *	head of the LST.
+	 */
+	when = test_now;
+	TEST_CHECK(fr_event_timer_run(el, &when) == 0);
+	TEST_CHECK(fr_time_lteq(when, timers[1].when));
+	TEST_MSG("next wakeup %" PRId64 ", first timer due %" PRId64,
+		 fr_time_unwrap(when), fr_time_unwrap(timers[1].when));
+
+	test_timers_run(el);
+	test_timers_check(timers);
+
+	TEST_CHECK(timers[0].fired);
+	TEST_CHECK(fr_time_eq(state.last, timers[0].when));
+	TEST_CHECK(fr_event_list_num_timers(el) == 0);
+
+	talloc_free(el);
+	talloc_free(timers);
+}
+
+/** Deleted and re-armed timers don't fire at their old times
+ *
+ */
+static void test_delete_rearm(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_from_msec(1));
+	test_timer_t	*timers = test_timers_alloc(el, fr_time_delta_from_sec(60));
+	unsigned int	i;
+
+	for (i = 0; i < NUM_TIMERS; i += 2) {
+		TEST_CHECK(fr_event_timer_delete(&timers[i].ev) == 0);
+		TEST_CHECK(timers[i].ev == NULL);
+		timers[i].deleted = true;
+	}
+
+	TEST_CHECK(fr_event_list_num_timers(el) == NUM_TIMERS / 2);
+
+	for (i = 1; i < NUM_TIMERS; i += 4) {
+		timers[i].when = fr_time_add(timers[i].when, fr_time_delta_from_sec(3));
+		TEST_CHECK(fr_event_timer_at(el, el, &timers[i].ev, timers[i].when, test_timer_cb, &timers[i]) == 0);
+	}
+
+	TEST_CHECK(fr_event_list_num_timers(el) == NUM_TIMERS / 2);
+
+	test_timers_run(el);
+	test_timers_check(timers);
+
+	talloc_free(el);
+	talloc_free(timers);
+}
+
+/** Timers added before the wheel is enabled or disabled still fire
+ *
+ */
+static void test_toggle(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_wrap(0));
+	test_timer_t	*timers = test_timers_alloc(el, fr_time_delta_from_sec(60));
+	test_timer_t	*more;
+
+	TEST_CHECK(fr_event_list_timer_wheel(el, fr_time_delta_from_msec(1)) == 0);
+	more = test_timers_alloc(el, fr_time_delta_from_sec(60));
+	TEST_CHECK(fr_event_list_num_timers(el) == NUM_TIMERS * 2);
+
+	TEST_CHECK(fr_event_list_timer_wheel(el, fr_time_delta_wrap(0)) == 0);
+	TEST_CHECK(fr_event_list_num_timers(el) == NUM_TIMERS * 2);
+
+	test_timers_run(el);
+	TEST_CHECK(state.fired == NUM_TIMERS * 2);
+	TEST_CHECK(state.early == 0);
+	TEST_CHECK(state.out_of_order == 0);
+
+	talloc_free(el);
+	talloc_free(timers);
+	talloc_free(more);
+}
+
+/** Freeing the event list frees timers in the wheel
+ *
+ */
+static void test_free(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_from_msec(1));
+	test_timer_t	*timers = test_timers_alloc(el, fr_time_delta_from_sec(60));
+	unsigned int	i;
+
+	talloc_free(el);
+
+	for (i = 0; i < NUM_TIMERS; i++) TEST_CHECK(timers[i].ev == NULL);
+
+	talloc_free(timers);
+}
+
+typedef struct {
+	unsigned int		reads;
+	unsigned int		writes;
+	unsigned int		users;
+} test_io_t;
+
+static void test_fd_read(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	test_io_t *io = uctx;
+
+	io->reads++;
+}
+
+static void test_fd_write(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	test_io_t *io = uctx;
+
+	io->writes++;
+}
+
+static void test_user(UNUSED fr_event_list_t *el, void *uctx)
+{
+	test_io_t *io = uctx;
+
+	io->users++;
+}
+
+/** Check for events without waiting, and run their callbacks
+ *
+ */
+static void test_el_service(fr_event_list_t *el)
+{
+	TEST_CHECK(fr_event_corral(el, test_now, false) >= 0);
+	fr_event_service(el);
+}
+
+/** Read and write filters on the same fd are level triggered
+ *
+ */
+static void test_fd_level(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_wrap(0));
+	test_io_t	io = {};
+	int		sv[2];
+	char		c = 'x';
+
+	TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	TEST_CHECK(fr_event_fd_insert(el, NULL, el, sv[0], test_fd_read, test_fd_write, NULL, &io) == 0);
+
+	test_el_service(el);
+	TEST_CHECK(io.reads == 0);
+	TEST_CHECK(io.writes == 1);
+
+	/*
+	 *	Data which isn't read is reported again.
+	 */
+	TEST_CHECK(write(sv[1], &c, 1) == 1);
+	test_el_service(el);
+	test_el_service(el);
+	TEST_CHECK(io.reads == 2);
+	TEST_MSG("reads %u", io.reads);
+	TEST_CHECK(io.writes == 3);
+	TEST_MSG("writes %u", io.writes);
+
+	TEST_CHECK(read(sv[0], &c, 1) == 1);
+	test_el_service(el);
+	TEST_CHECK(io.reads == 2);
+	TEST_CHECK(io.writes == 4);
+
+	/*
+	 *	Nothing is reported once the filters are gone.
+	 */
+	TEST_CHECK(fr_event_fd_delete(el, sv[0], FR_EVENT_FILTER_IO) == 0);
+	test_el_service(el);
+	TEST_CHECK(io.reads == 2);
+	TEST_CHECK(io.writes == 4);
+	TEST_MSG("writes %u", io.writes);
+
+	close(sv[0]);
+	close(sv[1]);
+	talloc_free(el);
+}
+
+/** User events fire once per trigger
+ *
+ */
+static void test_user_trigger(void)
+{
+	fr_event_list_t	*el = test_el_alloc(fr_time_delta_wrap(0));
+	fr_event_user_t	*ev;
+	test_io_t	io = {};
+
+	TEST_CHECK(fr_event_user_insert(el, el, &ev, false, test_user, &io) == 0);
+
+	test_el_service(el);
+	TEST_CHECK(io.users == 0);
+
+	TEST_CHECK(fr_event_user_trigger(el, ev) == 0);
+	test_el_service(el);
+	test_el_service(el);
+	TEST_CHECK(io.users == 1);
+	TEST_MSG("users %u", io.users);
+
+	talloc_free(el);
+}
+
+#ifdef WITH_EVENT_EPOLL
+/** Count events for a filter, without waiting
+ *
+ */
+static int test_kevent_count(int kq, int16_t filter)
+{
+	struct kevent		events[8];
+	struct timespec		ts = {};
+	int			i, num, count = 0;
+
+	num = kevent(kq, NULL, 0, events, NUM_ELEMENTS(events), &ts);
+	TEST_CHECK(num >= 0);
+
+	for (i = 0; i < num; i++) if (events[i].filter == filter) count++;
+
+	return count;
+}
+
+/** EV_CLEAR only applies to the filter it was set for
+ *
+ */
+static void test_epoll_mixed_clear(void)
+{
+	struct kevent	changes[2];
+	int		kq, sv[2];
+	char		c = 'x';
+
+	kq = kqueue();
+	TEST_CHECK(kq >= 0);
+	TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	EV_SET(&changes[0], sv[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+	EV_SET(&changes[1], sv[0], EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, NULL);
+	TEST_CHECK(kevent(kq, changes, 2, NULL, 0, NULL) == 0);
+
+	/*
+	 *	The write filter is edge triggered, so it's reported
+	 *	once.  The read filter is level triggered, so it's
+	 *	reported until the data is read.
+	 */
+	TEST_CHECK(test_kevent_count(kq, EVFILT_WRITE) == 1);
+	TEST_CHECK(write(sv[1], &c, 1) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_READ) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_READ) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_WRITE) == 0);
+
+	TEST_CHECK(read(sv[0], &c, 1) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_READ) == 0);
+
+	/*
+	 *	Once the filters agree, they share a registration again.
+	 */
+	EV_SET(&changes[0], sv[0], EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, NULL);
+	TEST_CHECK(kevent(kq, changes, 1, NULL, 0, NULL) == 0);
+	TEST_CHECK(write(sv[1], &c, 1) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_READ) == 1);
+	TEST_CHECK(test_kevent_count(kq, EVFILT_READ) == 0);
+
+	EV_SET(&changes[0], sv[0], EVFILT_READ, EV_DELETE, 0, 0, NULL);
+	EV_SET(&changes[1], sv[0], EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+	TEST_CHECK(kevent(kq, changes, 2, NULL, 0, NULL) == 0);
+
+	close(sv[0]);
+	close(sv[1]);
+	TEST_CHECK(fr_epoll_close(kq) == 0);
+}
+
+/** Closed kqueues can't be found, open ones can
+ *
+ */
+static void test_epoll_kqueues(void)
+{
+	int		kqs[64];
+	unsigned int	i;
+
+	for (i = 0; i < NUM_ELEMENTS(kqs); i++) {
+		kqs[i] = kqueue();
+		TEST_CHECK(kqs[i] >= 0);
+	}
+
+	for (i = 0; i < NUM_ELEMENTS(kqs); i += 2) TEST_CHECK(fr_epoll_close(kqs[i]) == 0);
+
+	for (i = 0; i < NUM_ELEMENTS(kqs); i++) {
+		int ret = kevent(kqs[i], NULL, 0, NULL, 0, NULL);
+
+		if (i & 0x01) {
+			TEST_CHECK(ret == 0);
+			TEST_CHECK(fr_epoll_close(kqs[i]) == 0);
+			continue;
+		}
+
+		TEST_CHECK((ret < 0) && (errno == EBADF));
+		TEST_CHECK(fr_epoll_close(kqs[i]) < 0);
+	}
+}
+#endif
+
+TEST_LIST = {
+	{ "order_lst",			test_order_lst },
+	{ "order_wheel",		test_order_wheel },
+	{ "order_wheel_levels",		test_order_wheel_levels },
+	{ "order_wheel_horizon",	test_order_wheel_horizon },
+	{ "order_mixed",		test_order_mixed },
+	{ "delete_rearm",		test_delete_rearm },
+	{ "toggle",			test_toggle },
+	{ "free",			test_free },
+	{ "fd_level",			test_fd_level },
+	{ "user_trigger",		test_user_trigger },
+#ifdef WITH_EVENT_EPOLL
+	{ "epoll_mixed_clear",		test_epoll_mixed_clear },
+	{ "epoll_kqueues",		test_epoll_kqueues },
+#endif
+
+	{ NULL }
+};
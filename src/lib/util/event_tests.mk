@@ -0,0 +1,7 @@
+TARGET		:= event_tests$(E)
+SOURCES		:= event_tests.c
+
+TGT_LDLIBS	:= $(LIBS)
+TGT_PREREQS	:= libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
@@ -54,6 +54,7 @@ SOURCES		:= \
 		   machine.c \
 		   md4.c \
 		   md5.c \
+		   md5_mb.c \
 		   minmax_heap.c \
 		   misc.c \
 		   missing.c \
@@ -99,6 +100,13 @@ SOURCES		:= \
 		   value.c \
 		   version.c
 
+#
+#  Use the native epoll backend instead of libkqueue.
+#
+ifneq "$(WITH_EVENT_EPOLL)" ""
+SOURCES		+= event_epoll.c
+endif
+
 #
 #  Add the fuzzer only if everything was built with the fuzzing flags.
 #
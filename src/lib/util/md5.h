@@ -96,6 +96,37 @@ void		fr_md5_ctx_free_from_list(fr_md5_ctx_t **ctx);
 /* hmac.c */
 int		fr_hmac_md5(uint8_t digest[static MD5_DIGEST_LENGTH], uint8_t const *in, size_t inlen,
 			    uint8_t const *key, size_t key_len);
+
+/* md5_mb.c */
+#define FR_MD5_MB_MAX_LANES	16		//!< Most messages we hash in parallel.
+#define FR_MD5_MB_MAX_PARTS	2		//!< Most pieces a single message can be in.
+
+/** A message to hash with fr_md5_mb_calc()
+ *
+ * The message is the concatenation of its parts.  Unused parts must have a length of 0.
+ */
+typedef struct {
+	uint8_t const	*in[FR_MD5_MB_MAX_PARTS];	//!< Parts of the message.
+	size_t		inlen[FR_MD5_MB_MAX_PARTS];	//!< Length of each part.
+	uint8_t		*out;				//!< Where to write the digest.
+} fr_md5_mb_job_t;
+
+/** A message to HMAC with fr_hmac_md5_mb_calc()
+ *
+ */
+typedef struct {
+	uint8_t const	*in;				//!< Message.
+	size_t		inlen;				//!< Length of the message.
+	uint8_t const	*key;				//!< Key.
+	size_t		key_len;			//!< Length of the key.
+	uint8_t		*out;				//!< Where to write the HMAC.
+} fr_hmac_md5_mb_job_t;
+
+unsigned int	fr_md5_mb_lanes(void);
+
+void		fr_md5_mb_calc(fr_md5_mb_job_t const *jobs, size_t num);
+
+void		fr_hmac_md5_mb_calc(fr_hmac_md5_mb_job_t const *jobs, size_t num);
 #ifdef __cplusplus
 }
 #endif
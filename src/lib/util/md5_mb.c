@@ -0,0 +1,459 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Multi-buffer MD5 and HMAC-MD5
+ *
+ * MD5 can't be parallelised within a single message, as each block depends on the
+ * previous one.  It can be parallelised across messages, by running the compression
+ * function for several independent messages at once, one per SIMD lane.
+ *
+ * RADIUS needs one or two MD5 operations for each packet, on short messages, so when
+ * there are several packets to process at once, we can sign or verify all of them
+ * for roughly the cost of one.
+ *
+ * The lanes are written using the compiler's vector extensions.  On x86_64 we build
+ * 4, 8 and 16 lane versions (SSE2, AVX2 and AVX-512), and pick the widest one the CPU
+ * supports at runtime.  Elsewhere we build the 4 lane version, and let the compiler
+ * map it to whatever the platform has.
+ *
+ * @file src/lib/util/md5_mb.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/md5.h>
+
+#define MD5_MB_BLOCK_LENGTH	64
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#  define MD5_MB_X86 1
+#endif
+
+/** The state of every lane, in the layout the vector code loads from
+ *
+ */
+typedef struct {
+	uint32_t		state[4][FR_MD5_MB_MAX_LANES];	//!< a, b, c and d for each lane.
+	uint32_t		in[16][FR_MD5_MB_MAX_LANES];	//!< Message words for each lane.
+} md5_mb_lanes_t;
+
+/** Where a lane is up to in its message
+ *
+ */
+typedef struct {
+	fr_md5_mb_job_t const	*job;		//!< Message being hashed.  NULL if the lane is idle.
+	unsigned int		part;		//!< Part of the message being read.
+	size_t			offset;		//!< Offset into the part.
+	uint64_t		total;		//!< Length of the message in bytes.
+	bool			padded;		//!< Whether we've written the 0x80 padding byte.
+	bool			final;		//!< Whether the current block is the last one.
+} md5_mb_lane_t;
+
+typedef void (*md5_mb_transform_t)(md5_mb_lanes_t *lanes);
+
+typedef uint32_t md5_mb_v4_t __attribute__((vector_size(16)));
+#ifdef MD5_MB_X86
+typedef uint32_t md5_mb_v8_t __attribute__((vector_size(32)));
+typedef uint32_t md5_mb_v16_t __attribute__((vector_size(64)));
+#endif
+
+#define MD5_MB_F1(x, y, z) (z ^ (x & (y ^ z)))
+#define MD5_MB_F2(x, y, z) MD5_MB_F1(z, x, y)
+#define MD5_MB_F3(x, y, z) (x ^ y ^ z)
+#define MD5_MB_F4(x, y, z) (y ^ (x | ~z))
+
+#define MD5_MB_STEP(f, w, x, y, z, i, k, s) \
+	(w += f(x, y, z) + in[i] + (uint32_t)k, w = (w << s) | (w >> (32 - s)), w += x)
+
+/** Define an MD5 compression function operating on _vec sized lanes
+ *
+ * The steps are identical to fr_md5_local_transform(), with each variable
+ * holding one word from every lane.
+ */
+#define MD5_MB_TRANSFORM_DEFINE(_name, _vec, _attr) \
+static _attr void _name(md5_mb_lanes_t *lanes) \
+{ \
+	_vec	a, b, c, d, a0, b0, c0, d0, in[16]; \
+	int	i; \
+\
+	memcpy(&a, lanes->state[0], sizeof(a)); \
+	memcpy(&b, lanes->state[1], sizeof(b)); \
+	memcpy(&c, lanes->state[2], sizeof(c)); \
+	memcpy(&d, lanes->state[3], sizeof(d)); \
+	for (i = 0; i < 16; i++) memcpy(&in[i], lanes->in[i], sizeof(in[i])); \
+\
+	a0 = a; \
+	b0 = b; \
+	c0 = c; \
+	d0 = d; \
+\
+	MD5_MB_STEP(MD5_MB_F1, a, b, c, d,  0, 0xd76aa478,  7); \
+	MD5_MB_STEP(MD5_MB_F1, d, a, b, c,  1, 0xe8c7b756, 12); \
+	MD5_MB_STEP(MD5_MB_F1, c, d, a, b,  2, 0x242070db, 17); \
+	MD5_MB_STEP(MD5_MB_F1, b, c, d, a,  3, 0xc1bdceee, 22); \
+	MD5_MB_STEP(MD5_MB_F1, a, b, c, d,  4, 0xf57c0faf,  7); \
+	MD5_MB_STEP(MD5_MB_F1, d, a, b, c,  5, 0x4787c62a, 12); \
+	MD5_MB_STEP(MD5_MB_F1, c, d, a, b,  6, 0xa8304613, 17); \
+	MD5_MB_STEP(MD5_MB_F1, b, c, d, a,  7, 0xfd469501, 22); \
+	MD5_MB_STEP(MD5_MB_F1, a, b, c, d,  8, 0x698098d8,  7); \
+	MD5_MB_STEP(MD5_MB_F1, d, a, b, c,  9, 0x8b44f7af, 12); \
+	MD5_MB_STEP(MD5_MB_F1, c, d, a, b, 10, 0xffff5bb1, 17); \
+	MD5_MB_STEP(MD5_MB_F1, b, c, d, a, 11, 0x895cd7be, 22); \
+	MD5_MB_STEP(MD5_MB_F1, a, b, c, d, 12, 0x6b901122,  7); \
+	MD5_MB_STEP(MD5_MB_F1, d, a, b, c, 13, 0xfd987193, 12); \
+	MD5_MB_STEP(MD5_MB_F1, c, d, a, b, 14, 0xa679438e, 17); \
+	MD5_MB_STEP(MD5_MB_F1, b, c, d, a, 15, 0x49b40821, 22); \
+\
+	MD5_MB_STEP(MD5_MB_F2, a, b, c, d,  1, 0xf61e2562,  5); \
+	MD5_MB_STEP(MD5_MB_F2, d, a, b, c,  6, 0xc040b340,  9); \
+	MD5_MB_STEP(MD5_MB_F2, c, d, a, b, 11, 0x265e5a51, 14); \
+	MD5_MB_STEP(MD5_MB_F2, b, c, d, a,  0, 0xe9b6c7aa, 20); \
+	MD5_MB_STEP(MD5_MB_F2, a, b, c, d,  5, 0xd62f105d,  5); \
+	MD5_MB_STEP(MD5_MB_F2, d, a, b, c, 10, 0x02441453,  9); \
+	MD5_MB_STEP(MD5_MB_F2, c, d, a, b, 15, 0xd8a1e681, 14); \
+	MD5_MB_STEP(MD5_MB_F2, b, c, d, a,  4, 0xe7d3fbc8, 20); \
+	MD5_MB_STEP(MD5_MB_F2, a, b, c, d,  9, 0x21e1cde6,  5); \
+	MD5_MB_STEP(MD5_MB_F2, d, a, b, c, 14, 0xc33707d6,  9); \
+	MD5_MB_STEP(MD5_MB_F2, c, d, a, b,  3, 0xf4d50d87, 14); \
+	MD5_MB_STEP(MD5_MB_F2, b, c, d, a,  8, 0x455a14ed, 20); \
+	MD5_MB_STEP(MD5_MB_F2, a, b, c, d, 13, 0xa9e3e905,  5); \
+	MD5_MB_STEP(MD5_MB_F2, d, a, b, c,  2, 0xfcefa3f8,  9); \
+	MD5_MB_STEP(MD5_MB_F2, c, d, a, b,  7, 0x676f02d9, 14); \
+	MD5_MB_STEP(MD5_MB_F2, b, c, d, a, 12, 0x8d2a4c8a, 20); \
+\
+	MD5_MB_STEP(MD5_MB_F3, a, b, c, d,  5, 0xfffa3942,  4); \
+	MD5_MB_STEP(MD5_MB_F3, d, a, b, c,  8, 0x8771f681, 11); \
+	MD5_MB_STEP(MD5_MB_F3, c, d, a, b, 11, 0x6d9d6122, 16); \
+	MD5_MB_STEP(MD5_MB_F3, b, c, d, a, 14, 0xfde5380c, 23); \
+	MD5_MB_STEP(MD5_MB_F3, a, b, c, d,  1, 0xa4beea44,  4); \
+	MD5_MB_STEP(MD5_MB_F3, d, a, b, c,  4, 0x4bdecfa9, 11); \
+	MD5_MB_STEP(MD5_MB_F3, c, d, a, b,  7, 0xf6bb4b60, 16); \
+	MD5_MB_STEP(MD5_MB_F3, b, c, d, a, 10, 0xbebfbc70, 23); \
+	MD5_MB_STEP(MD5_MB_F3, a, b, c, d, 13, 0x289b7ec6,  4); \
+	MD5_MB_STEP(MD5_MB_F3, d, a, b, c,  0, 0xeaa127fa, 11); \
+	MD5_MB_STEP(MD5_MB_F3, c, d, a, b,  3, 0xd4ef3085, 16); \
+	MD5_MB_STEP(MD5_MB_F3, b, c, d, a,  6, 0x04881d05, 23); \
+	MD5_MB_STEP(MD5_MB_F3, a, b, c, d,  9, 0xd9d4d039,  4); \
+	MD5_MB_STEP(MD5_MB_F3, d, a, b, c, 12, 0xe6db99e5, 11); \
+	MD5_MB_STEP(MD5_MB_F3, c, d, a, b, 15, 0x1fa27cf8, 16); \
+	MD5_MB_STEP(MD5_MB_F3, b, c, d, a,  2, 0xc4ac5665, 23); \
+\
+	MD5_MB_STEP(MD5_MB_F4, a, b, c, d,  0, 0xf4292244,  6); \
+	MD5_MB_STEP(MD5_MB_F4, d, a, b, c,  7, 0x432aff97, 10); \
+	MD5_MB_STEP(MD5_MB_F4, c, d, a, b, 14, 0xab9423a7, 15); \
+	MD5_MB_STEP(MD5_MB_F4, b, c, d, a,  5, 0xfc93a039, 21); \
+	MD5_MB_STEP(MD5_MB_F4, a, b, c, d, 12, 0x655b59c3,  6); \
+	MD5_MB_STEP(MD5_MB_F4, d, a, b, c,  3, 0x8f0ccc92, 10); \
+	MD5_MB_STEP(MD5_MB_F4, c, d, a, b, 10, 0xffeff47d, 15); \
+	MD5_MB_STEP(MD5_MB_F4, b, c, d, a,  1, 0x85845dd1, 21); \
+	MD5_MB_STEP(MD5_MB_F4, a, b, c, d,  8, 0x6fa87e4f,  6); \
+	MD5_MB_STEP(MD5_MB_F4, d, a, b, c, 15, 0xfe2ce6e0, 10); \
+	MD5_MB_STEP(MD5_MB_F4, c, d, a, b,  6, 0xa3014314, 15); \
+	MD5_MB_STEP(MD5_MB_F4, b, c, d, a, 13, 0x4e0811a1, 21); \
+	MD5_MB_STEP(MD5_MB_F4, a, b, c, d,  4, 0xf7537e82,  6); \
+	MD5_MB_STEP(MD5_MB_F4, d, a, b, c, 11, 0xbd3af235, 10); \
+	MD5_MB_STEP(MD5_MB_F4, c, d, a, b,  2, 0x2ad7d2bb, 15); \
+	MD5_MB_STEP(MD5_MB_F4, b, c, d, a,  9, 0xeb86d391, 21); \
+\
+	a += a0; \
+	b += b0; \
+	c += c0; \
+	d += d0; \
+\
+	memcpy(lanes->state[0], &a, sizeof(a)); \
+	memcpy(lanes->state[1], &b, sizeof(b)); \
+	memcpy(lanes->state[2], &c, sizeof(c)); \
+	memcpy(lanes->state[3], &d, sizeof(d)); \
+}
+
+MD5_MB_TRANSFORM_DEFINE(md5_mb_transform_4, md5_mb_v4_t, )
+#ifdef MD5_MB_X86
+MD5_MB_TRANSFORM_DEFINE(md5_mb_transform_8, md5_mb_v8_t, __attribute__((target("avx2"))))
+MD5_MB_TRANSFORM_DEFINE(md5_mb_transform_16, md5_mb_v16_t, __attribute__((target("avx512f"))))
+#endif
+
+/** The widest transform the CPU supports
+ *
+ * Set on first use.  The CPU doesn't change, so it doesn't matter if two threads race.
+ */
+static unsigned int md5_mb_max_lanes;
+
+/** Return the maximum number of messages which are hashed in parallel
+ *
+ * Callers can use this to size their batches.  Batches smaller than 4
+ * are hashed one message at a time.
+ */
+unsigned int fr_md5_mb_lanes(void)
+{
+	if (likely(md5_mb_max_lanes)) return md5_mb_max_lanes;
+
+#ifdef MD5_MB_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		md5_mb_max_lanes = 16;
+	} else if (__builtin_cpu_supports("avx2")) {
+		md5_mb_max_lanes = 8;
+	} else
+#endif
+	{
+		md5_mb_max_lanes = 4;
+	}
+
+	return md5_mb_max_lanes;
+}
+
+/** Hash a single message with the normal MD5 functions
+ *
+ */
+static void md5_mb_calc_one(fr_md5_mb_job_t const *job)
+{
+	fr_md5_ctx_t	*ctx;
+	unsigned int	i;
+
+	ctx = fr_md5_ctx_alloc_from_list();
+	for (i = 0; i < FR_MD5_MB_MAX_PARTS; i++) {
+		if (job->inlen[i]) fr_md5_update(ctx, job->in[i], job->inlen[i]);
+	}
+	fr_md5_final(job->out, ctx);
+	fr_md5_ctx_free_from_list(&ctx);
+}
+
+/** Produce the next block of a lane's message, including any padding
+ *
+ * @param[in] lane	to produce the block for.
+ * @param[out] block	to write the data to.
+ */
+static void md5_mb_lane_block(md5_mb_lane_t *lane, uint8_t block[static MD5_MB_BLOCK_LENGTH])
+{
+	fr_md5_mb_job_t const	*job = lane->job;
+	size_t			used = 0, len;
+	uint64_t		bits;
+	int			i;
+
+	while ((used < MD5_MB_BLOCK_LENGTH) && (lane->part < FR_MD5_MB_MAX_PARTS)) {
+		len = job->inlen[lane->part] - lane->offset;
+		if (len > (MD5_MB_BLOCK_LENGTH - used)) len = MD5_MB_BLOCK_LENGTH - used;
+
+		if (len) memcpy(block + used, job->in[lane->part] + lane->offset, len);
+		used += len;
+		lane->offset += len;
+
+		if (lane->offset == job->inlen[lane->part]) {
+			lane->part++;
+			lane->offset = 0;
+		}
+	}
+
+	lane->final = false;
+	if (used == MD5_MB_BLOCK_LENGTH) return;
+
+	if (!lane->padded) {
+		block[used++] = 0x80;
+		lane->padded = true;
+	}
+
+	/*
+	 *	No room for the length, it goes in the next block.
+	 */
+	if (used > (MD5_MB_BLOCK_LENGTH - 8)) {
+		memset(block + used, 0, MD5_MB_BLOCK_LENGTH - used);
+		return;
+	}
+
+	memset(block + used, 0, (MD5_MB_BLOCK_LENGTH - 8) - used);
+	bits = lane->total << 3;
+	for (i = 0; i < 8; i++) block[(MD5_MB_BLOCK_LENGTH - 8) + i] = bits >> (i * 8);
+	lane->final = true;
+}
+
+/** Calculate the MD5 digests of several independent messages
+ *
+ * As each message finishes, the next one is started in its lane, so messages
+ * of different lengths are fine.  Digests are only written once all of a
+ * message's data has been read, so `out` may point into the message itself.
+ *
+ * @param[in] jobs	Messages to hash, and where to write their digests.
+ * @param[in] num	Number of jobs.
+ */
+void fr_md5_mb_calc(fr_md5_mb_job_t const *jobs, size_t num)
+{
+	md5_mb_lanes_t		lanes;
+	md5_mb_lane_t		lane[FR_MD5_MB_MAX_LANES];
+	md5_mb_transform_t	transform;
+	uint8_t			block[MD5_MB_BLOCK_LENGTH];
+	unsigned int		width, active, i, w;
+	size_t			next = 0;
+
+	width = fr_md5_mb_lanes();
+
+	/*
+	 *	Not enough messages to fill the lanes.
+	 *	Use the narrowest version that will
+	 *	keep them busy.
+	 */
+	while ((width > 4) && (num < width)) width /= 2;
+
+	switch (width) {
+#ifdef MD5_MB_X86
+	case 16:
+		transform = md5_mb_transform_16;
+		break;
+
+	case 8:
+		transform = md5_mb_transform_8;
+		break;
+#endif
+
+	default:
+		if (num < 4) {
+			for (i = 0; i < num; i++) md5_mb_calc_one(&jobs[i]);
+			return;
+		}
+		width = 4;
+		transform = md5_mb_transform_4;
+		break;
+	}
+
+	/*
+	 *	Idle lanes still go through the transform,
+	 *	so they must be initialised.
+	 */
+	memset(&lanes, 0, sizeof(lanes));
+	memset(lane, 0, sizeof(lane));
+
+	for (;;) {
+		active = 0;
+
+		for (i = 0; i < width; i++) {
+			if (!lane[i].job) {
+				if (next == num) continue;
+
+				lane[i] = (md5_mb_lane_t){ .job = &jobs[next++] };
+				for (w = 0; w < FR_MD5_MB_MAX_PARTS; w++) lane[i].total += lane[i].job->inlen[w];
+
+				lanes.state[0][i] = 0x67452301;
+				lanes.state[1][i] = 0xefcdab89;
+				lanes.state[2][i] = 0x98badcfe;
+				lanes.state[3][i] = 0x10325476;
+			}
+
+			md5_mb_lane_block(&lane[i], block);
+			for (w = 0; w < 16; w++) {
+				lanes.in[w][i] = (uint32_t)block[(w * 4) + 0] |
+						 (uint32_t)block[(w * 4) + 1] << 8 |
+						 (uint32_t)block[(w * 4) + 2] << 16 |
+						 (uint32_t)block[(w * 4) + 3] << 24;
+			}
+			active++;
+		}
+
+		if (!active) break;
+
+		transform(&lanes);
+
+		for (i = 0; i < width; i++) {
+			uint8_t *out;
+
+			if (!lane[i].job || !lane[i].final) continue;
+
+			out = lane[i].job->out;
+			for (w = 0; w < 4; w++) {
+				out[(w * 4) + 0] = lanes.state[w][i];
+				out[(w * 4) + 1] = lanes.state[w][i] >> 8;
+				out[(w * 4) + 2] = lanes.state[w][i] >> 16;
+				out[(w * 4) + 3] = lanes.state[w][i] >> 24;
+			}
+			lane[i].job = NULL;
+		}
+	}
+
+	memset(block, 0, sizeof(block));		/* in case it's sensitive */
+}
+
+/** Calculate the HMAC-MD5 of several independent messages
+ *
+ * @param[in] jobs	Messages, keys, and where to write the HMACs.
+ * @param[in] num	Number of jobs.
+ */
+void fr_hmac_md5_mb_calc(fr_hmac_md5_mb_job_t const *jobs, size_t num)
+{
+	fr_md5_mb_job_t		md5[FR_MD5_MB_MAX_LANES];
+	uint8_t			pad[FR_MD5_MB_MAX_LANES][2][MD5_MB_BLOCK_LENGTH];
+	uint8_t			inner[FR_MD5_MB_MAX_LANES][MD5_DIGEST_LENGTH];
+	uint8_t			tk[MD5_DIGEST_LENGTH];
+	size_t			i, j, chunk;
+
+	for (i = 0; i < num; i += chunk) {
+		chunk = num - i;
+		if (chunk > FR_MD5_MB_MAX_LANES) chunk = FR_MD5_MB_MAX_LANES;
+
+		for (j = 0; j < chunk; j++) {
+			fr_hmac_md5_mb_job_t const	*job = &jobs[i + j];
+			uint8_t const			*key = job->key;
+			size_t				key_len = job->key_len, k;
+
+			/*
+			 *	If the key is longer than 64 bytes,
+			 *	use MD5(key) instead.
+			 */
+			if (key_len > MD5_MB_BLOCK_LENGTH) {
+				fr_md5_calc(tk, key, key_len);
+				key = tk;
+				key_len = sizeof(tk);
+			}
+
+			memset(pad[j], 0, sizeof(pad[j]));
+			if (key_len) {
+				memcpy(pad[j][0], key, key_len);
+				memcpy(pad[j][1], key, key_len);
+			}
+
+			for (k = 0; k < MD5_MB_BLOCK_LENGTH; k++) {
+				pad[j][0][k] ^= 0x36;
+				pad[j][1][k] ^= 0x5c;
+			}
+
+			md5[j] = (fr_md5_mb_job_t){
+				.in = { pad[j][0], job->in },
+				.inlen = { MD5_MB_BLOCK_LENGTH, job->inlen },
+				.out = inner[j]
+			};
+		}
+
+		/*
+		 *	MD5(K XOR ipad, in)
+		 */
+		fr_md5_mb_calc(md5, chunk);
+
+		for (j = 0; j < chunk; j++) {
+			md5[j] = (fr_md5_mb_job_t){
+				.in = { pad[j][1], inner[j] },
+				.inlen = { MD5_MB_BLOCK_LENGTH, MD5_DIGEST_LENGTH },
+				.out = jobs[i + j].out
+			};
+		}
+
+		/*
+		 *	MD5(K XOR opad, MD5(K XOR ipad, in))
+		 */
+		fr_md5_mb_calc(md5, chunk);
+	}
+
+	memset(pad, 0, sizeof(pad));			/* in case it's sensitive */
+	memset(tk, 0, sizeof(tk));
+}
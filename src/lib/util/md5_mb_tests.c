@@ -0,0 +1,178 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the multi-buffer MD5 functions
+ *
+ * @file src/lib/util/md5_mb_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/md5.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+
+#define TEST_MAX_JOBS	40
+
+static uint8_t	test_data[2048];
+
+static void test_data_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(test_data); i++) test_data[i] = fr_rand();
+}
+
+/*
+ *	Every batch size up to TEST_MAX_JOBS, with messages of random
+ *	lengths split across both parts, including lengths which end
+ *	on and either side of a block boundary.
+ */
+static void test_md5_mb(void)
+{
+	fr_md5_mb_job_t	jobs[TEST_MAX_JOBS];
+	uint8_t		out[TEST_MAX_JOBS][MD5_DIGEST_LENGTH];
+	uint8_t		expected[MD5_DIGEST_LENGTH];
+	uint8_t		joined[512];
+	size_t		num, i;
+
+	test_data_init();
+
+	TEST_MSG_ALWAYS("lanes=%u", fr_md5_mb_lanes());
+
+	for (num = 1; num <= TEST_MAX_JOBS; num++) {
+		for (i = 0; i < num; i++) {
+			size_t a = fr_rand() % 300, b = fr_rand() % 100;
+
+			if ((i % 3) == 0) a = (64 * (1 + (i % 4))) + (i % 2) - ((i % 5) == 0);
+			if ((i % 4) == 0) b = 0;
+
+			jobs[i] = (fr_md5_mb_job_t){
+				.in = { test_data + i, test_data + 1024 + i },
+				.inlen = { a, b },
+				.out = out[i]
+			};
+		}
+
+		fr_md5_mb_calc(jobs, num);
+
+		for (i = 0; i < num; i++) {
+			memcpy(joined, jobs[i].in[0], jobs[i].inlen[0]);
+			memcpy(joined + jobs[i].inlen[0], jobs[i].in[1], jobs[i].inlen[1]);
+			fr_md5_calc(expected, joined, jobs[i].inlen[0] + jobs[i].inlen[1]);
+
+			TEST_CHECK(memcmp(out[i], expected, sizeof(expected)) == 0);
+			TEST_MSG("Digest %zu of %zu (length %zu) does not match", i, num,
+				 jobs[i].inlen[0] + jobs[i].inlen[1]);
+		}
+	}
+}
+
+/*
+ *	Keys shorter and longer than a block.
+ */
+static void test_hmac_md5_mb(void)
+{
+	fr_hmac_md5_mb_job_t	jobs[TEST_MAX_JOBS];
+	uint8_t			out[TEST_MAX_JOBS][MD5_DIGEST_LENGTH];
+	uint8_t			expected[MD5_DIGEST_LENGTH];
+	size_t			num, i;
+
+	test_data_init();
+
+	for (num = 1; num <= TEST_MAX_JOBS; num++) {
+		for (i = 0; i < num; i++) {
+			jobs[i] = (fr_hmac_md5_mb_job_t){
+				.in = test_data + i,
+				.inlen = fr_rand() % 400,
+				.key = test_data + 1024 + i,
+				.key_len = 1 + (fr_rand() % 100),
+				.out = out[i]
+			};
+		}
+
+		fr_hmac_md5_mb_calc(jobs, num);
+
+		for (i = 0; i < num; i++) {
+			fr_hmac_md5(expected, jobs[i].in, jobs[i].inlen, jobs[i].key, jobs[i].key_len);
+
+			TEST_CHECK(memcmp(out[i], expected, sizeof(expected)) == 0);
+			TEST_MSG("HMAC %zu of %zu (key length %zu) does not match", i, num, jobs[i].key_len);
+		}
+	}
+}
+
+/*
+ *	Request Authenticator sized messages, MD5(packet + secret),
+ *	one at a time and in batches of 64.
+ */
+static void test_md5_mb_speed(void)
+{
+	fr_md5_mb_job_t	jobs[64];
+	uint8_t		out[64][MD5_DIGEST_LENGTH];
+	uint8_t const	*secret = (uint8_t const *)"testing123";
+	size_t		i, r, reps = 20000;
+	fr_time_t	start;
+	fr_time_delta_t	single, batched;
+	fr_md5_ctx_t	*ctx;
+
+	test_data_init();
+	fr_time_start();
+
+	for (i = 0; i < NUM_ELEMENTS(jobs); i++) {
+		jobs[i] = (fr_md5_mb_job_t){
+			.in = { test_data + (i * 16), secret },
+			.inlen = { 100, 10 },
+			.out = out[i]
+		};
+	}
+
+	start = fr_time();
+	for (r = 0; r < reps; r++) {
+		for (i = 0; i < NUM_ELEMENTS(jobs); i++) {
+			ctx = fr_md5_ctx_alloc_from_list();
+			fr_md5_update(ctx, jobs[i].in[0], jobs[i].inlen[0]);
+			fr_md5_update(ctx, jobs[i].in[1], jobs[i].inlen[1]);
+			fr_md5_final(out[i], ctx);
+			fr_md5_ctx_free_from_list(&ctx);
+		}
+	}
+	single = fr_time_sub(fr_time(), start);
+
+	start = fr_time();
+	for (r = 0; r < reps; r++) fr_md5_mb_calc(jobs, NUM_ELEMENTS(jobs));
+	batched = fr_time_sub(fr_time(), start);
+
+	TEST_MSG_ALWAYS("lanes=%u", fr_md5_mb_lanes());
+	TEST_MSG_ALWAYS("single_per_sec=%0.0lf",
+			(reps * NUM_ELEMENTS(jobs)) / (fr_time_delta_unwrap(single) / (double)NSEC));
+	TEST_MSG_ALWAYS("batched_per_sec=%0.0lf",
+			(reps * NUM_ELEMENTS(jobs)) / (fr_time_delta_unwrap(batched) / (double)NSEC));
+}
+
+TEST_LIST = {
+	{ "md5-mb",			test_md5_mb },
+	{ "hmac-md5-mb",		test_hmac_md5_mb },
+
+	/*
+	 *	Performance tests
+	 */
+	{ "md5-mb-speed",		test_md5_mb_speed },
+
+	{ NULL }
+};
@@ -0,0 +1,8 @@
+TARGET		:= md5_mb_tests$(E)
+SOURCES		:= md5_mb_tests.c
+
+TGT_LDLIBS	:= $(LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
@@ -56,6 +56,7 @@ void fr_pair_list_init(fr_pair_list_t *list)
 #ifdef WITH_VERIFY_PTR
 	list->verified = true;
 #endif
+	list->index = NULL;
 	list->is_child = false;
 }
 
@@ -313,7 +314,8 @@ fr_pair_t *fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da)
  */
 int fr_pair_reinit_from_da(fr_pair_list_t *list, fr_pair_t *vp, fr_dict_attr_t const *da)
 {
-	fr_dict_attr_t const *to_free;
+	fr_dict_attr_t const	*to_free;
+	fr_pair_list_t		*parent;
 
 	/*
 	 *	vp may be created from fr_pair_alloc_null(), in which case it has no da.
@@ -330,9 +332,18 @@ int fr_pair_reinit_from_da(fr_pair_list_t *list, fr_pair_t *vp, fr_dict_attr_t c
 		fr_value_box_init(&vp->data, da->type, da, false);
 	}
 
+	/*
+	 *	The index is keyed by da, so the pair has
+	 *	to be re-added under the new one.
+	 */
+	parent = fr_pair_parent_list(vp);
+	if (parent && parent->index) fr_pair_list_index_remove(parent, vp);
+
 	to_free = vp->da;
 	vp->da = da;
 
+	if (parent && parent->index) fr_pair_list_index_add(parent, vp, PAIR_LIST_INDEX_UNKNOWN);
+
 	/*
 	 *	Only frees unknown fr_dict_attr_t's
 	 */
@@ -592,7 +603,8 @@ int fr_pair_steal_prepend(TALLOC_CTX *list_ctx, fr_pair_list_t *list, fr_pair_t
  */
 int fr_pair_raw_afrom_pair(fr_pair_t *vp, uint8_t const *data, size_t data_len)
 {
-	fr_dict_attr_t *unknown;
+	fr_dict_attr_t	*unknown;
+	fr_pair_list_t	*parent;
 
 	PAIR_VERIFY(vp);
 
@@ -603,7 +615,13 @@ int fr_pair_raw_afrom_pair(fr_pair_t *vp, uint8_t const *data, size_t data_len)
 	unknown = fr_dict_unknown_afrom_da(vp, vp->da);
 	if (!unknown) return -1;
 
+	parent = fr_pair_parent_list(vp);
+	if (parent && parent->index) fr_pair_list_index_remove(parent, vp);
+
 	vp->da = unknown;
+
+	if (parent && parent->index) fr_pair_list_index_add(parent, vp, PAIR_LIST_INDEX_UNKNOWN);
+
 	fr_assert(vp->da->type == FR_TYPE_OCTETS);
 
 	fr_value_box_init(&vp->data, FR_TYPE_OCTETS, NULL, true);
@@ -613,6 +631,235 @@ int fr_pair_raw_afrom_pair(fr_pair_t *vp, uint8_t const *data, size_t data_len)
 	return 0;
 }
 
+/** Entry in a pair list index
+ *
+ */
+typedef struct {
+	fr_dict_attr_t const	*da;			//!< The attribute this entry is for.
+	fr_pair_t		*first;			//!< First pair in the list with this da.  NULL
+							///< if it's moved, and must be found by walking
+							///< the list.
+	unsigned int		count;			//!< How many pairs in the list have this da.
+} pair_list_index_entry_t;
+
+/** Lists with fewer than this many pairs aren't indexed
+ *
+ */
+static unsigned int pair_list_index_min = FR_PAIR_LIST_INDEX_MIN;
+
+/** Set how many pairs a list must contain before it's indexed
+ *
+ * Lists which have already been indexed keep their index.
+ *
+ * @param[in] num	Minimum number of pairs.  0 disables indexing.
+ */
+void fr_pair_list_index_threshold(unsigned int num)
+{
+	pair_list_index_min = num;
+}
+
+static uint32_t pair_list_index_hash(void const *data)
+{
+	pair_list_index_entry_t const *entry = data;
+
+	return fr_hash(&entry->da, sizeof(entry->da));
+}
+
+static int8_t pair_list_index_cmp(void const *one, void const *two)
+{
+	pair_list_index_entry_t const *a = one, *b = two;
+
+	return CMP(a->da, b->da);
+}
+
+static inline CC_HINT(always_inline)
+pair_list_index_entry_t *pair_list_index_find(fr_pair_list_t const *list, fr_dict_attr_t const *da)
+{
+	return fr_hash_table_find(list->index, &(pair_list_index_entry_t){ .da = da });
+}
+
+/** Record a pair in the index of the list it's being inserted into
+ *
+ * @note Internal use by the pair list functions only.
+ *
+ * @param[in] list	the pair is being inserted into.
+ * @param[in] vp	being inserted.
+ * @param[in] pos	of vp relative to other pairs with the same da.
+ */
+void fr_pair_list_index_add(fr_pair_list_t *list, fr_pair_t *vp, fr_pair_list_index_pos_t pos)
+{
+	pair_list_index_entry_t *entry;
+
+	entry = pair_list_index_find(list, vp->da);
+	if (!entry) {
+		/*
+		 *	On failure, drop the index, it'll be
+		 *	rebuilt the next time a pair is inserted.
+		 */
+		entry = talloc(list->index, pair_list_index_entry_t);
+		if (unlikely(!entry)) {
+		error:
+			fr_pair_list_index_free(list);
+			return;
+		}
+		*entry = (pair_list_index_entry_t){ .da = vp->da, .first = vp, .count = 1 };
+
+		if (unlikely(!fr_hash_table_insert(list->index, entry))) {
+			talloc_free(entry);
+			goto error;
+		}
+		return;
+	}
+
+	entry->count++;
+
+	switch (pos) {
+	case PAIR_LIST_INDEX_HEAD:
+		entry->first = vp;
+		break;
+
+	case PAIR_LIST_INDEX_TAIL:
+		break;
+
+	case PAIR_LIST_INDEX_UNKNOWN:
+		entry->first = NULL;
+		break;
+	}
+}
+
+/** Update the index of a list before a pair is removed from it
+ *
+ * @note Internal use by the pair list functions only.
+ *
+ * @param[in] list	the pair is being removed from.
+ * @param[in] vp	being removed.  Must still be in the list.
+ */
+void fr_pair_list_index_remove(fr_pair_list_t *list, fr_pair_t *vp)
+{
+	pair_list_index_entry_t	*entry;
+	fr_pair_t		*next;
+
+	entry = pair_list_index_find(list, vp->da);
+	if (!entry) return;
+
+	/*
+	 *	The last pair with this da, so lookups
+	 *	for it don't need to walk the list.
+	 */
+	if (--entry->count == 0) {
+		fr_hash_table_delete(list->index, entry);
+		talloc_free(entry);
+		return;
+	}
+
+	if (entry->first != vp) return;
+
+	/*
+	 *	Repeated attributes are usually adjacent,
+	 *	otherwise lookups for this da walk the list
+	 *	until a pair is prepended.
+	 */
+	next = fr_pair_list_next(list, vp);
+	entry->first = (next && (next->da == vp->da)) ? next : NULL;
+}
+
+/** Free the index of a list
+ *
+ * @note Internal use by the pair list functions only.
+ *
+ * @param[in] list	to free the index of.
+ */
+void fr_pair_list_index_free(fr_pair_list_t *list)
+{
+	TALLOC_FREE(list->index);
+}
+
+/** Build an index of the first pair of each da in the list
+ *
+ * @param[in] list	to index.  Must be the child list of a pair, as
+ *			the index is parented by that pair.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int pair_list_index_build(fr_pair_list_t *list)
+{
+	fr_pair_t *vp;
+
+	fr_assert(list->is_child);
+
+	list->index = fr_hash_table_alloc(fr_pair_list_parent(list), pair_list_index_hash, pair_list_index_cmp, NULL);
+	if (unlikely(!list->index)) return -1;
+
+	for (vp = fr_pair_list_head(list); vp; vp = fr_pair_list_next(list, vp)) {
+		fr_pair_list_index_add(list, vp, PAIR_LIST_INDEX_TAIL);
+		if (unlikely(!list->index)) return -1;
+	}
+
+	return 0;
+}
+
+/** Index a list if it's grown large enough
+ *
+ * The index is only ever built here, after pairs are inserted, and never
+ * by lookups.  Lists are searched through const pointers, often from
+ * several threads at once, so lookups must not modify them.
+ *
+ * @note Internal use by the pair list functions only.
+ *
+ * @param[in] list	pairs were inserted into.
+ */
+void fr_pair_list_index_check(fr_pair_list_t *list)
+{
+	if (list->index || !list->is_child || !pair_list_index_min ||
+	    (fr_pair_list_num_elements(list) < pair_list_index_min)) return;
+
+	(void) pair_list_index_build(list);
+}
+
+/** Find the first pair with a matching da using the list's index
+ *
+ * @param[out] out	first matching pair, or NULL if there isn't one.
+ * @param[in] list	to search in.
+ * @param[in] da	to search for.
+ * @return
+ *	- 0 if the index was used.
+ *	- -1 if the list isn't indexed, and the caller must search it.
+ */
+static inline CC_HINT(always_inline)
+int pair_list_index_lookup(fr_pair_t **out, fr_pair_list_t const *list, fr_dict_attr_t const *da)
+{
+	pair_list_index_entry_t	*entry;
+	fr_pair_t		*vp;
+
+	if (!list->index) return -1;
+
+	entry = pair_list_index_find(list, da);
+	if (!entry) {
+		*out = NULL;
+		return 0;
+	}
+
+	/*
+	 *	The first pair moved, and the index can't be
+	 *	updated here, so walk the list.
+	 */
+	if (!entry->first) {
+		for (vp = fr_pair_list_head(list); vp; vp = fr_pair_list_next(list, vp)) {
+			if (vp->da == da) break;
+		}
+
+		*out = vp;
+		return 0;
+	}
+
+	fr_assert(entry->first->da == da);
+	fr_assert(fr_pair_parent_list(entry->first) == list);
+
+	*out = entry->first;
+	return 0;
+}
+
 /** Iterate over pairs with a specified da
  *
  * @param[in] list	to iterate over.
@@ -698,6 +945,8 @@ fr_pair_t *fr_pair_find_by_da(fr_pair_list_t const *list, fr_pair_t const *prev,
 
 	PAIR_LIST_VERIFY(list);
 
+	if (!prev && (pair_list_index_lookup(&vp, list, da) == 0)) return vp;
+
 	while ((vp = fr_pair_list_next(list, vp))) if (da == vp->da) return vp;
 
 	return NULL;
@@ -746,6 +995,14 @@ fr_pair_t *fr_pair_find_by_da_idx(fr_pair_list_t const *list, fr_dict_attr_t con
 
 	PAIR_LIST_VERIFY(list);
 
+	/*
+	 *	Skip straight to the first instance
+	 */
+	if (pair_list_index_lookup(&vp, list, da) == 0) {
+		if (!vp || (idx == 0)) return vp;
+		idx--;
+	}
+
 	while ((vp = fr_pair_list_next(list, vp))) {
 		if (da != vp->da) continue;
 
@@ -970,10 +1227,11 @@ fr_pair_t *fr_pair_list_parent(fr_pair_list_t const *list)
  * @return
  *	- 0 on success.
  */
-static int _pair_list_dcursor_insert(fr_dlist_head_t *list, void *to_insert, UNUSED void *uctx)
+static int _pair_list_dcursor_insert(fr_dlist_head_t *list, void *to_insert, void *uctx)
 {
 	fr_pair_t *vp = to_insert;
 	fr_tlist_head_t *tlist;
+	fr_pair_list_t *pair_list = uctx;
 
 	tlist = fr_tlist_head_from_dlist(list);
 
@@ -982,6 +1240,13 @@ static int _pair_list_dcursor_insert(fr_dlist_head_t *list, void *to_insert, UNU
 	 */
 	fr_pair_order_list_set_head(tlist, vp);
 
+	/*
+	 *	We're called before the pair is linked in,
+	 *	so we don't know where it'll end up.
+	 */
+	if (!pair_list->index) fr_pair_list_index_check(pair_list);
+	if (pair_list->index) fr_pair_list_index_add(pair_list, vp, PAIR_LIST_INDEX_UNKNOWN);
+
 	PAIR_VERIFY(vp);
 
 	return 0;
@@ -1021,7 +1286,10 @@ static int _pair_list_dcursor_remove(NDEBUG_UNUSED fr_dlist_head_t *list, void *
 
 	PAIR_VERIFY(vp);
 
-	if (&parent->order.head.dlist_head == list) return 0;
+	if (&parent->order.head.dlist_head == list) {
+		if (parent->index) fr_pair_list_index_remove(parent, vp);
+		return 0;
+	}
 
 	fr_pair_remove(parent, vp);
 	return 1;
@@ -1325,7 +1593,10 @@ int fr_pair_prepend(fr_pair_list_t *list, fr_pair_t *to_add)
 		return -1;
 	}
 
+	if (list->index) fr_pair_list_index_add(list, to_add, PAIR_LIST_INDEX_HEAD);
+
 	fr_pair_order_list_insert_head(&list->order, to_add);
+	if (!list->index) fr_pair_list_index_check(list);
 
 	return 0;
 }
@@ -1356,7 +1627,10 @@ int fr_pair_append(fr_pair_list_t *list, fr_pair_t *to_add)
 		return -1;
 	}
 
+	if (list->index) fr_pair_list_index_add(list, to_add, PAIR_LIST_INDEX_TAIL);
+
 	fr_pair_order_list_insert_tail(&list->order, to_add);
+	if (!list->index) fr_pair_list_index_check(list);
 
 	return 0;
 }
@@ -1389,7 +1663,21 @@ int fr_pair_insert_after(fr_pair_list_t *list, fr_pair_t *pos, fr_pair_t *to_add
 		return -1;
 	}
 
+	if (list->index) {
+		fr_pair_list_index_pos_t ipos;
+
+		if (!pos) {
+			ipos = PAIR_LIST_INDEX_HEAD;
+		} else if (pos->da == to_add->da) {
+			ipos = PAIR_LIST_INDEX_TAIL;
+		} else {
+			ipos = PAIR_LIST_INDEX_UNKNOWN;
+		}
+		fr_pair_list_index_add(list, to_add, ipos);
+	}
+
 	fr_pair_order_list_insert_after(&list->order, pos, to_add);
+	if (!list->index) fr_pair_list_index_check(list);
 
 	return 0;
 }
@@ -1423,7 +1711,10 @@ int fr_pair_insert_before(fr_pair_list_t *list, fr_pair_t *pos, fr_pair_t *to_ad
 		return -1;
 	}
 
+	if (list->index) fr_pair_list_index_add(list, to_add, pos ? PAIR_LIST_INDEX_UNKNOWN : PAIR_LIST_INDEX_TAIL);
+
 	fr_pair_order_list_insert_before(&list->order, pos, to_add);
+	if (!list->index) fr_pair_list_index_check(list);
 
 	return 0;
 }
@@ -1431,6 +1722,9 @@ int fr_pair_insert_before(fr_pair_list_t *list, fr_pair_t *pos, fr_pair_t *to_ad
 /** Replace a given VP
  *
  * @note Memory used by the VP being replaced will be freed.
+ * @note Use this rather than fr_dcursor_replace() on pair lists.  Cursors
+ *	only call their remove callback for replacements, so the list and
+ *	its index never see the new VP.
  *
  * @param[in,out] list		pair list
  * @param[in] to_replace	pair to replace and free, on list
@@ -2327,6 +2621,7 @@ int fr_pair_list_copy(TALLOC_CTX *ctx, fr_pair_list_t *to, fr_pair_list_t const
 
 		new_vp = fr_pair_copy(ctx, vp);
 		if (!new_vp) {
+			if (to->index) fr_pair_list_index_free(to);
 			fr_pair_order_list_talloc_free_to_tail(&to->order, first_added);
 			return -1;
 		}
@@ -2426,6 +2721,7 @@ int fr_pair_list_copy_by_da(TALLOC_CTX *ctx, fr_pair_list_t *to,
 		cnt++;
 		new_vp = fr_pair_copy(ctx, vp);
 		if (!new_vp) {
+			if (to->index) fr_pair_list_index_free(to);
 			fr_pair_order_list_talloc_free_to_tail(&to->order, first_added);
 			return -1;
 		}
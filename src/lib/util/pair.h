@@ -26,6 +26,7 @@ RCSIDH(dpair_h, "$Id$")
 #include <freeradius-devel/build.h>
 #include <freeradius-devel/missing.h>
 #include <freeradius-devel/util/dcursor.h>
+#include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/value.h>
 #include <freeradius-devel/util/tlist.h>
 
@@ -52,6 +53,10 @@ FR_TLIST_TYPES(fr_pair_order_list)
 typedef struct pair_list_s {
         FR_TLIST_HEAD(fr_pair_order_list)	order;			//!< Maintains the relative order of pairs in a list.
 
+	fr_hash_table_t			* _CONST index;			//!< Index of the first pair with a given da.
+									///< Built once the list is large enough.
+									///< Only child lists are indexed.
+
 	bool				 _CONST is_child;		//!< is a child of a VP
 
 #ifdef WITH_VERIFY_PTR
@@ -432,10 +437,17 @@ do { \
 	if (oldvp) fr_pair_delete(_list, oldvp); \
 } while (0)
 
+/** Default minimum number of pairs a list must contain before it's indexed
+ *
+ */
+#define FR_PAIR_LIST_INDEX_MIN	32
+
 /* Initialisation */
 /** @hidecallergraph */
 void fr_pair_list_init(fr_pair_list_t *head) CC_HINT(nonnull);
 
+void fr_pair_list_index_threshold(unsigned int num);
+
 void fr_pair_init_null(fr_pair_t *vp) CC_HINT(nonnull);
 
 /* Allocation and management */
@@ -881,6 +893,26 @@ void		fr_pair_ctx_reset(fr_pair_ctx_t *pair_ctx, fr_dict_t const *dict) CC_HINT(
 void		fr_fprintf_pair(FILE *fp, char const *msg, fr_pair_t const *vp);
 void		fr_fprintf_pair_list(FILE *fp, fr_pair_list_t const *list);
 
+#ifdef _PAIR_PRIVATE
+/** Where a pair was inserted relative to other pairs with the same da
+ *
+ * @note Internal use by the pair list functions only.
+ */
+typedef enum {
+	PAIR_LIST_INDEX_HEAD = 0,		//!< Before all other pairs with the same da.
+	PAIR_LIST_INDEX_TAIL,			//!< Not before any other pair with the same da.
+	PAIR_LIST_INDEX_UNKNOWN			//!< Somewhere in the list.
+} fr_pair_list_index_pos_t;
+
+void		fr_pair_list_index_add(fr_pair_list_t *list, fr_pair_t *vp, fr_pair_list_index_pos_t pos) CC_HINT(nonnull);
+
+void		fr_pair_list_index_remove(fr_pair_list_t *list, fr_pair_t *vp) CC_HINT(nonnull);
+
+void		fr_pair_list_index_free(fr_pair_list_t *list) CC_HINT(nonnull);
+
+void		fr_pair_list_index_check(fr_pair_list_t *list) CC_HINT(nonnull);
+#endif
+
 #undef _CONST
 #ifdef __cplusplus
 }
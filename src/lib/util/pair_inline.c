@@ -103,6 +103,8 @@ _INLINE fr_pair_t *fr_pair_remove(fr_pair_list_t *list, fr_pair_t *vp)
 	list->verified = false;
 #endif
 
+	if (list->index) fr_pair_list_index_remove(list, vp);
+
 	return fr_pair_order_list_remove(&list->order, vp);
 }
 
@@ -112,6 +114,8 @@ _INLINE fr_pair_t *fr_pair_remove(fr_pair_list_t *list, fr_pair_t *vp)
  */
 _INLINE void fr_pair_list_free(fr_pair_list_t *list)
 {
+	if (list->index) fr_pair_list_index_free(list);
+
 	fr_pair_order_list_talloc_free(&list->order);
 }
 
@@ -139,7 +143,14 @@ _INLINE bool fr_pair_list_empty(fr_pair_list_t const *list)
  */
 _INLINE void fr_pair_list_sort(fr_pair_list_t *list, fr_cmp_t cmp)
 {
+	/*
+	 *	Any of the first pairs may have moved,
+	 *	so the index is rebuilt.
+	 */
+	if (list->index) fr_pair_list_index_free(list);
+
 	fr_pair_order_list_sort(&list->order, cmp);
+	fr_pair_list_index_check(list);
 }
 
 /** Get the length of a list of fr_pair_t
@@ -184,7 +195,17 @@ _INLINE void fr_pair_list_append(fr_pair_list_t *dst, fr_pair_list_t *src)
 #ifdef WITH_VERIFY_POINTER
 	dst->verified = false;
 #endif
+	if (dst->index) {
+		fr_pair_t *vp;
+
+		for (vp = fr_pair_list_head(src); vp && dst->index; vp = fr_pair_list_next(src, vp)) {
+			fr_pair_list_index_add(dst, vp, PAIR_LIST_INDEX_TAIL);
+		}
+	}
+	if (src->index) fr_pair_list_index_free(src);
+
 	fr_pair_order_list_move(&dst->order, &src->order);
+	if (!dst->index) fr_pair_list_index_check(dst);
 }
 
 /** Move a list of fr_pair_t from a temporary list to the head of a destination list
@@ -194,5 +215,19 @@ _INLINE void fr_pair_list_append(fr_pair_list_t *dst, fr_pair_list_t *src)
  */
 _INLINE void fr_pair_list_prepend(fr_pair_list_t *dst, fr_pair_list_t *src)
 {
+	/*
+	 *	Walk backwards so the first pair of each
+	 *	da in src is the one left in the index.
+	 */
+	if (dst->index) {
+		fr_pair_t *vp;
+
+		for (vp = fr_pair_list_tail(src); vp && dst->index; vp = fr_pair_list_prev(src, vp)) {
+			fr_pair_list_index_add(dst, vp, PAIR_LIST_INDEX_HEAD);
+		}
+	}
+	if (src->index) fr_pair_list_index_free(src);
+
 	fr_pair_order_list_move_head(&dst->order, &src->order);
+	if (!dst->index) fr_pair_list_index_check(dst);
 }
@@ -449,6 +449,63 @@ static void do_test_find_nth(unsigned int len, unsigned int perc, unsigned int r
 	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * len)/(fr_time_delta_unwrap(used) / (double)NSEC));
 }
 
+static void do_test_fr_pair_find_by_da_indexed(unsigned int len, bool indexed, unsigned int reps, fr_pair_t *source_vps[])
+{
+	fr_pair_t		*group;
+	unsigned int		i, j;
+	fr_pair_t		*new_vp;
+	fr_time_t		start, end;
+	fr_time_delta_t		used = fr_time_delta_wrap(0);
+	fr_dict_attr_t const	*da;
+	size_t			input_count = talloc_array_length(source_vps);
+	fr_fast_rand_t		rand_ctx;
+
+	/*
+	 *  Only child lists are indexed, so the test list
+	 *  has to be the children of a group.
+	 */
+	group = fr_pair_afrom_da(autofree, fr_dict_attr_test_group);
+	TEST_ASSERT(group != NULL);
+
+	rand_ctx.a = fr_rand();
+	rand_ctx.b = fr_rand();
+
+	fr_pair_list_index_threshold(indexed ? 1 : 0);
+
+	/*
+	 *  Initialise the test list
+	 */
+	for (i = 0; i < len; i++) {
+		int idx = fr_fast_rand(&rand_ctx) % input_count;
+		new_vp = fr_pair_copy(group, source_vps[idx]);
+		fr_pair_append(&group->vp_group, new_vp);
+	}
+
+	/*
+	 *  Find first instance of specific DA, which may
+	 *  not be in the list.
+	 */
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < len; j++) {
+			int idx = fr_fast_rand(&rand_ctx) % input_count;
+			da = source_vps[idx]->da;
+			start = fr_time();
+			(void) fr_pair_find_by_da(&group->vp_group, NULL, da);
+			end = fr_time();
+			used = fr_time_delta_add(used, fr_time_sub(end, start));
+		}
+	}
+	talloc_free(group);
+
+	fr_pair_list_index_threshold(FR_PAIR_LIST_INDEX_MIN);
+
+	TEST_MSG_ALWAYS("repetitions=%d", reps);
+	TEST_MSG_ALWAYS("indexed=%s", indexed ? "yes" : "no");
+	TEST_MSG_ALWAYS("list_length=%d", len);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", (reps * len)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
 static void do_test_fr_pair_list_free(unsigned int len, unsigned int perc, unsigned int reps, fr_pair_t *source_vps[])
 {
 	fr_pair_list_t  test_vps;
@@ -508,6 +565,20 @@ all_test_funcs(fr_pair_find_by_da_idx)
 all_test_funcs(find_nth)
 all_test_funcs(fr_pair_list_free)
 
+#define index_test_func(_count, _name, _indexed) \
+static void test_fr_pair_find_by_da_ ## _count ## _ ## _name(void)\
+{\
+	do_test_fr_pair_find_by_da_indexed(_count, _indexed, 1000000 / _count, source_vps_0);\
+}
+
+#define index_test_funcs(_name, _indexed) \
+	index_test_func(10, _name, _indexed) \
+	index_test_func(100, _name, _indexed) \
+	index_test_func(1000, _name, _indexed)
+
+index_test_funcs(linear, false)
+index_test_funcs(indexed, true)
+
 #define repetition_tests(_func, _perc) \
 	{ #_func "_20_" #_perc, test_ ## _func ## _20_ ## _perc},\
 	{ #_func "_40_" #_perc, test_ ## _func ## _40_ ## _perc},\
@@ -522,11 +593,18 @@ all_test_funcs(fr_pair_list_free)
 	repetition_tests(_func, 75) \
 	repetition_tests(_func, 100)
 
+#define index_tests(_name) \
+	{ "fr_pair_find_by_da_10_" #_name, test_fr_pair_find_by_da_10_ ## _name},\
+	{ "fr_pair_find_by_da_100_" #_name, test_fr_pair_find_by_da_100_ ## _name},\
+	{ "fr_pair_find_by_da_1000_" #_name, test_fr_pair_find_by_da_1000_ ## _name},\
+
 TEST_LIST = {
 	all_repetition_tests(fr_pair_append)
 	all_repetition_tests(fr_pair_find_by_da_idx)
 	all_repetition_tests(find_nth)
 	all_repetition_tests(fr_pair_list_free)
+	index_tests(linear)
+	index_tests(indexed)
 
 	{ NULL }
 };
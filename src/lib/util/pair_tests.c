@@ -819,6 +819,210 @@ static void test_fr_pair_list_sort(void)
 	fr_pair_list_free(&local_pairs);
 }
 
+#define TEST_INDEX_MIN		8
+
+static fr_dict_attr_t const **test_index_das[] = {
+	&fr_dict_attr_test_uint8, &fr_dict_attr_test_uint16, &fr_dict_attr_test_uint32,
+	&fr_dict_attr_test_string, &fr_dict_attr_test_octets, &fr_dict_attr_test_date
+};
+
+/** Allocate a group, and append num pairs to it, cycling through the first num_das test_index_das
+ *
+ */
+static fr_pair_t *test_index_group_alloc(size_t num, size_t num_das)
+{
+	fr_pair_t	*group;
+	size_t		i;
+
+	fr_pair_list_index_threshold(TEST_INDEX_MIN);
+
+	group = fr_pair_afrom_da(autofree, fr_dict_attr_test_group);
+	TEST_CHECK(group != NULL);
+
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(fr_pair_append_by_da(group, NULL, &group->vp_group, *test_index_das[i % num_das]) == 0);
+	}
+
+	return group;
+}
+
+static void test_index_group_free(fr_pair_t *group)
+{
+	talloc_free(group);
+	fr_pair_list_index_threshold(FR_PAIR_LIST_INDEX_MIN);
+}
+
+/** Check lookups which may use the index return the same pairs as walking the list
+ *
+ */
+static void test_index_consistent(fr_pair_list_t const *list)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(test_index_das); i++) {
+		fr_dict_attr_t const	*da = *test_index_das[i];
+		fr_pair_t		*vp, *found;
+		unsigned int		idx = 0;
+
+		for (vp = fr_pair_list_head(list); vp; vp = fr_pair_list_next(list, vp)) {
+			if (vp->da == da) break;
+		}
+
+		found = fr_pair_find_by_da(list, NULL, da);
+		TEST_CHECK(found == vp);
+		TEST_MSG("First %s expected %p, got %p", da->name, vp, found);
+
+		for (vp = fr_pair_list_head(list); vp; vp = fr_pair_list_next(list, vp)) {
+			if (vp->da != da) continue;
+
+			found = fr_pair_find_by_da_idx(list, da, idx);
+			TEST_CHECK(found == vp);
+			TEST_MSG("%s[%u] expected %p, got %p", da->name, idx, vp, found);
+			idx++;
+		}
+		TEST_CHECK(fr_pair_find_by_da_idx(list, da, idx) == NULL);
+	}
+}
+
+static void test_fr_pair_list_index_append(void)
+{
+	fr_pair_t	*group = test_index_group_alloc(TEST_INDEX_MIN - 1, 4);
+
+	TEST_CASE("Lists smaller than the threshold aren't indexed");
+	TEST_CHECK(group->vp_group.index == NULL);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Lookups don't index a list");
+	fr_pair_list_index_threshold(TEST_INDEX_MIN - 2);
+	test_index_consistent(&group->vp_group);
+	TEST_CHECK(group->vp_group.index == NULL);
+	fr_pair_list_index_threshold(TEST_INDEX_MIN);
+
+	TEST_CASE("Appending past the threshold indexes the list");
+	TEST_CHECK(fr_pair_append_by_da(group, NULL, &group->vp_group, fr_dict_attr_test_date) == 0);
+	TEST_CHECK(group->vp_group.index != NULL);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Appending and prepending to an indexed list");
+	TEST_CHECK(fr_pair_append_by_da(group, NULL, &group->vp_group, fr_dict_attr_test_string) == 0);
+	TEST_CHECK(fr_pair_prepend_by_da(group, NULL, &group->vp_group, fr_dict_attr_test_uint32) == 0);
+	TEST_CHECK(fr_pair_prepend_by_da(group, NULL, &group->vp_group, fr_dict_attr_test_octets) == 0);
+	test_index_consistent(&group->vp_group);
+
+	test_index_group_free(group);
+}
+
+static void test_fr_pair_list_index_remove(void)
+{
+	fr_pair_t	*group = test_index_group_alloc(TEST_INDEX_MIN * 2, NUM_ELEMENTS(test_index_das));
+	fr_pair_t	*vp;
+	fr_dcursor_t	cursor;
+
+	TEST_CHECK(group->vp_group.index != NULL);
+
+	TEST_CASE("Remove the first pair with a da");
+	vp = fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint16);
+	TEST_CHECK(fr_pair_delete(&group->vp_group, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Remove a pair which isn't the first with its da");
+	vp = fr_pair_find_by_da_idx(&group->vp_group, fr_dict_attr_test_uint32, 1);
+	TEST_CHECK(fr_pair_delete(&group->vp_group, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Remove every pair with a da");
+	TEST_CHECK(fr_pair_delete_by_da(&group->vp_group, fr_dict_attr_test_string) > 0);
+	TEST_CHECK(fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_string) == NULL);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Remove the first pair with a da using a cursor");
+	TEST_CHECK(fr_pair_dcursor_by_da_init(&cursor, &group->vp_group, fr_dict_attr_test_octets) != NULL);
+	talloc_free(fr_dcursor_remove(&cursor));
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Insert a pair using a cursor");
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_string);
+	TEST_CHECK(vp != NULL);
+	TEST_CHECK(fr_dcursor_insert(&cursor, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	test_index_group_free(group);
+}
+
+static void test_fr_pair_list_index_insert_before(void)
+{
+	fr_pair_t	*group = test_index_group_alloc(TEST_INDEX_MIN * 2, 4);
+	fr_pair_t	*vp, *pos;
+
+	TEST_CHECK(group->vp_group.index != NULL);
+
+	TEST_CASE("Insert before the first pair with the same da");
+	pos = fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint32);
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_uint32);
+	TEST_CHECK(fr_pair_insert_before(&group->vp_group, pos, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Insert a new da before the head");
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_octets);
+	TEST_CHECK(fr_pair_insert_before(&group->vp_group, fr_pair_list_head(&group->vp_group), vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Insert before a later pair with the same da");
+	pos = fr_pair_find_by_da_idx(&group->vp_group, fr_dict_attr_test_uint8, 2);
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_uint8);
+	TEST_CHECK(fr_pair_insert_before(&group->vp_group, pos, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Insert after a pair with another da");
+	pos = fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint16);
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_string);
+	TEST_CHECK(fr_pair_insert_after(&group->vp_group, pos, vp) == 0);
+	test_index_consistent(&group->vp_group);
+
+	test_index_group_free(group);
+}
+
+static void test_fr_pair_list_index_sort(void)
+{
+	fr_pair_t	*group = test_index_group_alloc(TEST_INDEX_MIN * 2, NUM_ELEMENTS(test_index_das));
+
+	TEST_CHECK(group->vp_group.index != NULL);
+
+	fr_pair_list_sort(&group->vp_group, fr_pair_cmp_by_da);
+	TEST_CHECK(group->vp_group.index != NULL);
+	test_index_consistent(&group->vp_group);
+
+	test_index_group_free(group);
+}
+
+static void test_fr_pair_list_index_replace(void)
+{
+	fr_pair_t	*group = test_index_group_alloc(TEST_INDEX_MIN * 2, 4);
+	fr_pair_t	*vp;
+
+	TEST_CHECK(group->vp_group.index != NULL);
+
+	TEST_CASE("Replace the first pair with a da with another da");
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_string);
+	fr_pair_replace(&group->vp_group, fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint8), vp);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Replace a pair with one of the same da");
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_uint16);
+	fr_pair_replace(&group->vp_group, fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint16), vp);
+	TEST_CHECK(fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_uint16) == vp);
+	test_index_consistent(&group->vp_group);
+
+	TEST_CASE("Replace the only pair with a da");
+	TEST_CHECK(fr_pair_append_by_da(group, NULL, &group->vp_group, fr_dict_attr_test_date) == 0);
+	vp = fr_pair_afrom_da(group, fr_dict_attr_test_octets);
+	fr_pair_replace(&group->vp_group, fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_date), vp);
+	TEST_CHECK(fr_pair_find_by_da(&group->vp_group, NULL, fr_dict_attr_test_date) == NULL);
+	test_index_consistent(&group->vp_group);
+
+	test_index_group_free(group);
+}
+
 static void test_fr_pair_value_copy(void)
 {
 	fr_pair_t *vp1, *vp2;
@@ -1450,6 +1654,11 @@ TEST_LIST = {
 	{ "fr_pair_list_copy_by_da",              test_fr_pair_list_copy_by_da },
 	{ "fr_pair_list_copy_by_ancestor",        test_fr_pair_list_copy_by_ancestor },
 	{ "fr_pair_list_sort",                    test_fr_pair_list_sort },
+	{ "fr_pair_list_index_append",            test_fr_pair_list_index_append },
+	{ "fr_pair_list_index_remove",            test_fr_pair_list_index_remove },
+	{ "fr_pair_list_index_insert_before",     test_fr_pair_list_index_insert_before },
+	{ "fr_pair_list_index_sort",              test_fr_pair_list_index_sort },
+	{ "fr_pair_list_index_replace",           test_fr_pair_list_index_replace },
 
 	/* Copy */
 	{ "fr_pair_value_copy",                   test_fr_pair_value_copy },
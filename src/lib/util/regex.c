@@ -282,6 +282,31 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 	return len;
 }
 
+/** JIT an expression which was compiled for runtime evaluation
+ *
+ * For expressions which turn out to be evaluated repeatedly.  Failing
+ * to JIT isn't an error, the expression is still usable.
+ *
+ * @param[in] preg	to JIT.
+ * @return
+ *	- true if JIT data is available.
+ *	- false if it isn't.
+ */
+bool regex_jit(regex_t *preg)
+{
+#ifdef PCRE2_CONFIG_JIT
+	if (preg->jitd) return true;
+
+	if (unlikely(!fr_pcre2_tls) && (fr_pcre2_tls_init() < 0)) return false;
+
+	if (!fr_pcre2_tls->do_jit || (pcre2_jit_compile(preg->compiled, PCRE2_JIT_COMPLETE) < 0)) return false;
+
+	preg->jitd = true;
+#endif
+
+	return preg->jitd;
+}
+
 /** Wrapper around pcre2_exec
  *
  * @param[in] preg	The compiled expression.
@@ -562,6 +587,148 @@ again:
 }
 
 
+/** Compile several patterns into one expression, which finds the first of them to match
+ *
+ * Each pattern is put into a lookahead, anchored at the start of the
+ * subject, and tagged with a (*MARK).  The alternatives are tried in
+ * order, so the mark of the first pattern which matches anywhere in the
+ * subject is returned, with one call to pcre2_match().
+ *
+ * The per-pattern flags are set inline, so the patterns can have
+ * different flags, except for "u", which has to be the same for all of
+ * them.
+ *
+ * The combined expression has no auto captures.  Patterns which use
+ * numbered back references therefore fail to compile, as the group
+ * numbers in the combined expression would be different.
+ *
+ * @param[in] ctx		to allocate the compiled expression in.
+ * @param[out] out		Where to write the compiled expression.
+ * @param[in] patterns		to combine.
+ * @param[in] flags		for each pattern.  Entries may be NULL.
+ * @param[in] num		of patterns.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the patterns can't be combined.
+ */
+int regex_set_compile(TALLOC_CTX *ctx, regex_t **out, char const * const patterns[],
+		      fr_regex_flags_t const * const flags[], size_t num)
+{
+	char			*combined;
+	fr_regex_flags_t	set_flags = {};
+	size_t			i;
+	ssize_t			slen;
+
+	*out = NULL;
+
+	if (!num) {
+		fr_strerror_const("No patterns to combine");
+		return -1;
+	}
+
+	if (flags[0]) set_flags.unicode = flags[0]->unicode;
+
+	combined = talloc_typed_strdup(NULL, "\\A(?:");
+	if (!combined) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	for (i = 0; i < num; i++) {
+		fr_regex_flags_t const *f = flags[i];
+
+		if ((f ? f->unicode : 0) != set_flags.unicode) {
+			fr_strerror_const("Patterns have different unicode flags");
+			talloc_free(combined);
+			return -1;
+		}
+
+		/*
+		 *	The \E closes any unterminated \Q, and the LF
+		 *	terminates any trailing comment in extended mode.
+		 */
+		combined = talloc_asprintf_append_buffer(combined, "%s(?=[\\s\\S]*?(?:%s%s%s%s%s\\E%s))(*MARK:%zu)",
+							 (i > 0) ? "|" : "",
+							 (f && f->ignore_case) ? "(?i)" : "",
+							 (f && f->multiline) ? "(?m)" : "",
+							 (f && f->dot_all) ? "(?s)" : "",
+							 (f && f->extended) ? "(?x)" : "",
+							 patterns[i],
+							 (f && f->extended) ? "\n" : "",
+							 i + 1);
+		if (!combined) goto oom;
+	}
+
+	combined = talloc_strdup_append_buffer(combined, ")");
+	if (!combined) goto oom;
+
+	slen = regex_compile(ctx, out, combined, talloc_array_length(combined) - 1, &set_flags, false, false);
+	talloc_free(combined);
+	if (slen <= 0) return -1;
+
+	return 0;
+}
+
+/** Find the first pattern in a set which matches a subject
+ *
+ * @param[in] preg	The compiled expression from #regex_set_compile.
+ * @param[in] subject	to match.
+ * @param[in] len	Length of subject.
+ * @return
+ *	- -1 on failure.
+ *	- 0 if none of the patterns match.
+ *	- >0 the position (starting from 1) of the first pattern which matches.
+ */
+int regex_set_exec(regex_t *preg, char const *subject, size_t len)
+{
+	int			ret;
+	pcre2_match_data	*match_data;
+	PCRE2_SPTR		mark;
+
+	if (unlikely(!fr_pcre2_tls) && (fr_pcre2_tls_init() < 0)) return -1;
+
+	match_data = pcre2_match_data_create(1, fr_pcre2_tls->gcontext);
+	if (!match_data) {
+		fr_strerror_const("Failed allocating temporary match data");
+		return -1;
+	}
+
+#ifdef PCRE2_CONFIG_JIT
+	if (preg->jitd) {
+		ret = pcre2_jit_match(preg->compiled, (PCRE2_SPTR8)subject, len, 0, 0,
+				      match_data, fr_pcre2_tls->mcontext);
+	} else
+#endif
+	{
+		ret = pcre2_match(preg->compiled, (PCRE2_SPTR8)subject, len, 0, 0,
+				  match_data, fr_pcre2_tls->mcontext);
+	}
+	if (ret < 0) {
+		PCRE2_UCHAR	errbuff[128];
+
+		pcre2_match_data_free(match_data);
+
+		if (ret == PCRE2_ERROR_NOMATCH) return 0;
+
+		pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
+		fr_strerror_printf("regex evaluation failed with code (%i): %s", ret, errbuff);
+
+		return -1;
+	}
+
+	mark = pcre2_get_mark(match_data);
+	ret = mark ? atoi((char const *)mark) : -1;
+	pcre2_match_data_free(match_data);
+
+	if (ret <= 0) {
+		fr_strerror_const("Regex set matched without a mark");
+		return -1;
+	}
+
+	return ret;
+}
+
 /** Returns the number of subcapture groups
  *
  * @return
@@ -868,6 +1035,36 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 	return len;
 }
 
+/** JIT an expression which was compiled for runtime evaluation
+ *
+ * For expressions which turn out to be evaluated repeatedly.  Failing
+ * to JIT isn't an error, the expression is still usable.
+ *
+ * @param[in] preg	to JIT.
+ * @return
+ *	- true if JIT data is available.
+ *	- false if it isn't.
+ */
+bool regex_jit(regex_t *preg)
+{
+#ifdef PCRE_INFO_JIT
+	char const	*error = NULL;
+	int		jitd = 0;
+
+	if (preg->jitd || preg->extra) return preg->jitd;
+
+	if (!(fr_pcre_study_flags & PCRE_STUDY_JIT_COMPILE)) return false;
+
+	preg->extra = pcre_study(preg->compiled, fr_pcre_study_flags, &error);
+	if (error || !preg->extra) return false;
+
+	pcre_fullinfo(preg->compiled, preg->extra, PCRE_INFO_JIT, &jitd);
+	if (jitd) preg->jitd = true;
+#endif
+
+	return preg->jitd;
+}
+
 static fr_table_num_ordered_t const regex_pcre_error_str[] = {
 	{ L("PCRE_ERROR_NOMATCH"),		PCRE_ERROR_NOMATCH },
 	{ L("PCRE_ERROR_NULL"),			PCRE_ERROR_NULL },
@@ -1122,6 +1319,18 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 	return len;
 }
 
+/** JIT an expression which was compiled for runtime evaluation
+ *
+ * POSIX regex has no JIT, so this does nothing.
+ *
+ * @param[in] preg	to JIT.
+ * @return false.
+ */
+bool regex_jit(UNUSED regex_t *preg)
+{
+	return false;
+}
+
 /** Binary safe wrapper around regexec
  *
  * If we have the BSD extensions we don't need to do any special work
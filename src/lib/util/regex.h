@@ -68,6 +68,8 @@ typedef struct {
 
 	bool			precompiled;	//!< Whether this regex was precompiled,
 						///< or compiled for one off evaluation.
+	bool			cached;		//!< Owned by a thread's regex cache, and may
+						///< be evicted at any time.
 	bool			jitd;		//!< Whether JIT data is available.
 } regex_t;
 /*
@@ -113,6 +115,7 @@ typedef struct {
 	uint32_t		subcaptures;	//!< Number of subcaptures contained within the expression.
 
 	bool			precompiled;	//!< Whether this regex was precompiled, or compiled for one off evaluation.
+	bool			cached;		//!< Owned by a thread's regex cache, and may be evicted at any time.
 	bool			jitd;		//!< Whether JIT data is available.
 } regex_t;
 /*
@@ -176,12 +179,17 @@ ssize_t		regex_flags_print(fr_sbuff_t *sbuff, fr_regex_flags_t const *flags);
 
 	ssize_t		regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
 			      fr_regex_flags_t const *flags, bool subcaptures, bool runtime);
+bool		regex_jit(regex_t *preg) CC_HINT(nonnull);
 int		regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *regmatch) CC_HINT(nonnull(1,2));
 #ifdef HAVE_REGEX_PCRE2
 int		regex_substitute(TALLOC_CTX *ctx, char **out, size_t max_out, regex_t *preg, fr_regex_flags_t const *flags,
 		     		 char const *subject, size_t subject_len,
 		     		 char const *replacement, size_t replacement_len,
 				 fr_regmatch_t *regmatch);
+
+int		regex_set_compile(TALLOC_CTX *ctx, regex_t **out, char const * const patterns[],
+				  fr_regex_flags_t const * const flags[], size_t num);
+int		regex_set_exec(regex_t *preg, char const *subject, size_t len) CC_HINT(nonnull);
 #endif
 uint32_t	regex_subcapture_count(regex_t const *preg);
 fr_regmatch_t	*regex_match_data_alloc(TALLOC_CTX *ctx, uint32_t count);
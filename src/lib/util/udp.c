@@ -208,3 +208,248 @@ done:
 
 	return slen;
 }
+
+/** A set of datagrams read from a socket with one system call
+ *
+ */
+struct udp_batch_s {
+	unsigned int		num;			//!< Maximum number of datagrams to read at once.
+	unsigned int		count;			//!< Number of datagrams returned by the last read.
+	unsigned int		next;			//!< The next datagram to hand back to the caller.
+
+	size_t			max_packet_size;	//!< Size of each receive buffer.
+
+	struct sockaddr_storage	local;			//!< Local address of the socket.
+	socklen_t		local_len;		//!< Length of the local address.
+
+	struct mmsghdr		*msgvec;		//!< One header per datagram.
+	struct iovec		*iov;			//!< Pointing into the packet buffers.
+	struct sockaddr_storage	*src;			//!< Source addresses of the datagrams.
+	uint8_t			*cbuf;			//!< Control message buffers.
+	uint8_t			*buffers;		//!< Packet data.
+};
+
+#define UDP_BATCH_CBUF_SIZE	(256)
+
+/** Allocate a structure for reading multiple datagrams with a single system call
+ *
+ * @param[in] ctx		to allocate the batch in.
+ * @param[in] num		maximum number of datagrams to read at once.
+ * @param[in] max_packet_size	the largest datagram we expect to receive.
+ * @return
+ *	- NULL on error.
+ *	- A new batch structure.
+ */
+udp_batch_t *udp_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t max_packet_size)
+{
+	udp_batch_t	*batch;
+	unsigned int	i;
+
+	if (!num || !max_packet_size) {
+		fr_strerror_const("Invalid arguments");
+		return NULL;
+	}
+
+	batch = talloc_zero(ctx, udp_batch_t);
+	if (!batch) {
+	oom:
+		fr_strerror_const("Out of memory");
+		talloc_free(batch);
+		return NULL;
+	}
+
+	batch->num = num;
+	batch->max_packet_size = max_packet_size;
+
+	batch->msgvec = talloc_zero_array(batch, struct mmsghdr, num);
+	if (!batch->msgvec) goto oom;
+
+	batch->iov = talloc_zero_array(batch, struct iovec, num);
+	if (!batch->iov) goto oom;
+
+	batch->src = talloc_zero_array(batch, struct sockaddr_storage, num);
+	if (!batch->src) goto oom;
+
+	batch->cbuf = talloc_zero_array(batch, uint8_t, num * UDP_BATCH_CBUF_SIZE);
+	if (!batch->cbuf) goto oom;
+
+	batch->buffers = talloc_array(batch, uint8_t, num * max_packet_size);
+	if (!batch->buffers) goto oom;
+
+	for (i = 0; i < num; i++) {
+		batch->iov[i].iov_base = batch->buffers + (i * max_packet_size);
+		batch->iov[i].iov_len = max_packet_size;
+
+		batch->msgvec[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgvec[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return batch;
+}
+
+/** Return how many datagrams can be read from the batch without a system call
+ *
+ * @param[in] batch	to check.
+ * @return the number of datagrams buffered.
+ */
+unsigned int udp_batch_pending(udp_batch_t const *batch)
+{
+	return batch->count - batch->next;
+}
+
+#ifdef HAVE_RECVMMSG
+/** Refill the batch from the socket
+ *
+ * @return
+ *	- >0 the number of datagrams read.
+ *	- 0 if no datagrams were available.
+ *	- <0 on error.
+ */
+static int udp_batch_fill(udp_batch_t *batch, int sockfd, int flags)
+{
+	unsigned int	i;
+	int		ret;
+	bool		connected = ((flags & UDP_FLAGS_CONNECTED) != 0);
+
+	batch->count = batch->next = 0;
+
+	/*
+	 *	recvmsg doesn't provide the destination port, so we
+	 *	have to retrieve it using getsockname().  Do it once
+	 *	for the entire batch, instead of once per packet.
+	 */
+	if (!connected) {
+		batch->local_len = sizeof(batch->local);
+		if (getsockname(sockfd, (struct sockaddr *) &batch->local, &batch->local_len) < 0) return -1;
+	}
+
+	for (i = 0; i < batch->num; i++) {
+		struct msghdr *msgh = &batch->msgvec[i].msg_hdr;
+
+		batch->iov[i].iov_len = batch->max_packet_size;
+
+		if (connected) {
+			msgh->msg_name = NULL;
+			msgh->msg_namelen = 0;
+			msgh->msg_control = NULL;
+			msgh->msg_controllen = 0;
+		} else {
+			msgh->msg_name = &batch->src[i];
+			msgh->msg_namelen = sizeof(batch->src[i]);
+			msgh->msg_control = batch->cbuf + (i * UDP_BATCH_CBUF_SIZE);
+			msgh->msg_controllen = UDP_BATCH_CBUF_SIZE;
+		}
+		msgh->msg_flags = 0;
+		batch->msgvec[i].msg_len = 0;
+	}
+
+	ret = recvmmsg(sockfd, batch->msgvec, batch->num, MSG_DONTWAIT, NULL);
+	if (ret <= 0) return ret;
+
+	batch->count = ret;
+
+	return ret;
+}
+#endif
+
+/** Read a UDP packet, using a single system call to read multiple packets
+ *
+ * Behaves identically to udp_recv(), except that when the batch is empty,
+ * up to "num" packets are read from the socket with recvmmsg().  The
+ * remaining packets are then returned by subsequent calls without going
+ * back to the kernel.  Callers should use udp_batch_pending() to determine
+ * whether there are more packets to read, as the socket may no longer be
+ * readable.
+ *
+ * On systems without recvmmsg(), this function just calls udp_recv().
+ *
+ * @param[in] batch		for buffering packets.
+ * @param[in] sockfd		we're reading from.
+ * @param[in] flags		for things.  UDP_FLAGS_PEEK is not supported.
+ * @param[out] socket_out	Information about the src/dst address of the packet
+ *				and the interface it was received on.
+ * @param[out] data		pointer where data will be written
+ * @param[in] data_len		length of data to read
+ * @param[out] when		the packet was received.
+ * @return
+ *	- > 0 on success (number of bytes read).
+ *	- 0 if there's no data.
+ *	- < 0 on failure.
+ */
+ssize_t udp_recv_batch(udp_batch_t *batch, int sockfd, int flags,
+		       fr_socket_t *socket_out, void *data, size_t data_len, fr_time_t *when)
+{
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr		*mmsg;
+	struct sockaddr_storage	dst;
+	socklen_t		sizeof_dst;
+	size_t			slen;
+	unsigned int		i;
+
+	fr_assert((flags & UDP_FLAGS_PEEK) == 0);
+
+	if (when) *when = fr_time_wrap(0);
+
+	*socket_out = (fr_socket_t){
+		.fd = sockfd,
+		.type = SOCK_DGRAM,
+	};
+
+	if (batch->next == batch->count) {
+		int ret;
+
+		ret = udp_batch_fill(batch, sockfd, flags);
+		if (ret < 0) {
+			if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) return 0;
+
+			fr_strerror_printf("Failed reading socket: %s", fr_syserror(errno));
+			return -1;
+		}
+		if (ret == 0) return 0;
+	}
+
+	i = batch->next++;
+	mmsg = &batch->msgvec[i];
+
+	/*
+	 *	The kernel discards any data after max_packet_size
+	 *	bytes, and so should we.
+	 */
+	slen = mmsg->msg_len;
+	if (slen > data_len) slen = data_len;
+	memcpy(data, batch->iov[i].iov_base, slen);
+
+	if ((flags & UDP_FLAGS_CONNECTED) != 0) goto done;
+
+	/*
+	 *	Initialize the 'dst' address.  It may be INADDR_ANY
+	 *	here, with a more specific address in the control
+	 *	messages.
+	 */
+	memcpy(&dst, &batch->local, batch->local_len);
+	sizeof_dst = batch->local_len;
+
+	recvfromto_cmsg(&mmsg->msg_hdr, &socket_out->inet.ifindex,
+			(struct sockaddr *) &dst, &sizeof_dst, when);
+
+	if (fr_ipaddr_from_sockaddr(&socket_out->inet.src_ipaddr, &socket_out->inet.src_port,
+				    &batch->src[i], mmsg->msg_hdr.msg_namelen) < 0) {
+		fr_strerror_const_push("Failed converting src sockaddr to ipaddr");
+		return -1;
+	}
+	if (fr_ipaddr_from_sockaddr(&socket_out->inet.dst_ipaddr, &socket_out->inet.dst_port,
+				    &dst, sizeof_dst) < 0) {
+		fr_strerror_const_push("Failed converting dst sockaddr to ipaddr");
+		return -1;
+	}
+
+done:
+	if (when && fr_time_eq(*when, fr_time_wrap(0))) *when = fr_time();
+
+	return slen;
+#else
+	batch->count = batch->next = 0;
+
+	return udp_recv(sockfd, flags, socket_out, data, data_len, when);
+#endif
+}
@@ -31,6 +31,7 @@ extern "C" {
 #include <freeradius-devel/missing.h>
 #include <freeradius-devel/util/inet.h>
 #include <freeradius-devel/util/socket.h>
+#include <freeradius-devel/util/talloc.h>
 #include <freeradius-devel/util/time.h>
 #include <freeradius-devel/util/udpfromto.h>
 
@@ -38,6 +39,8 @@ extern "C" {
 #define UDP_FLAGS_CONNECTED	(1 << 0)
 #define UDP_FLAGS_PEEK		(1 << 1)
 
+typedef struct udp_batch_s udp_batch_t;
+
 int udp_send(fr_socket_t const *socket, int flags, void *data, size_t data_len);
 
 int udp_recv_discard(int sockfd);
@@ -47,6 +50,13 @@ ssize_t udp_recv_peek(int sockfd, void *data, size_t data_len, int flags, fr_ipa
 ssize_t udp_recv(int sockfd, int flags,
 		 fr_socket_t *socket_out, void *data, size_t data_len, fr_time_t *when);
 
+udp_batch_t *udp_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t max_packet_size);
+
+unsigned int udp_batch_pending(udp_batch_t const *batch);
+
+ssize_t udp_recv_batch(udp_batch_t *batch, int sockfd, int flags,
+		       fr_socket_t *socket_out, void *data, size_t data_len, fr_time_t *when);
+
 #ifdef __cplusplus
 }
 #endif
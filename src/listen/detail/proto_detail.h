@@ -93,6 +93,7 @@ struct proto_detail_work_s {
 	bool				track_progress;		//!< do we track progress by writing?
 	bool				retransmit;		//!< are we retransmitting on error?
 	bool				immediate;		//!< start reading the detail files immediately
+	bool				use_mmap;		//!< map the work file into memory instead of read()ing it
 
 	int				mode;			//!< O_RDWR or O_RDONLY
 
@@ -138,6 +139,13 @@ struct proto_detail_work_thread_s {
 	off_t				header_offset;		//!< offset of the current header we're reading
 	off_t				read_offset;		//!< where we're reading from in filename_work
 
+	uint8_t const			*map;			//!< the work file, when "mmap = yes"
+	size_t				map_size;		//!< size of the mapping
+	off_t				*index;			//!< end offsets of the next batch of records
+	size_t				index_used;		//!< number of offsets in the index
+	size_t				index_next;		//!< next offset in the index to hand out
+	off_t				index_offset;		//!< where the indexer stopped in the map
+
 	fr_event_timer_t const		*ev;			//!< for detail file timers.
 
 	pthread_mutex_t			worker_mutex;		//!< for the workers
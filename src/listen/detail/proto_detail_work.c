@@ -32,6 +32,7 @@
 #include "proto_detail.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #ifndef NDEBUG
@@ -49,6 +50,11 @@
 #define MPRINT(_x, ...)
 #endif
 
+/*
+ *	How many record boundaries we find in the mapped file at a time.
+ */
+#define DETAIL_MMAP_INDEX	(1024)
+
 typedef struct {
 	proto_detail_work_thread_t	*parent;		//!< talloc_parent is SLOW!
 	fr_time_t			timestamp;		//!< when we read the entry.
@@ -58,6 +64,7 @@ typedef struct {
 
 	uint8_t				*packet;		//!< for retransmissions
 	size_t				packet_len;		//!< for retransmissions
+	off_t				offset;			//!< where the entry starts in the mapped file
 
 	fr_retry_t			retry;			//!< our retry timers
 	fr_event_timer_t const		*ev;			//!< retransmission timer
@@ -88,6 +95,8 @@ static const conf_parser_t file_listen_config[] = {
 
 	{ FR_CONF_OFFSET("retransmit", proto_detail_work_t, retransmit ), .dflt = "yes" },
 
+	{ FR_CONF_OFFSET("mmap", proto_detail_work_t, use_mmap ) },
+
 	{ FR_CONF_POINTER("limit", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) limit_config },
 	CONF_PARSER_TERMINATOR
 };
@@ -141,6 +150,204 @@ static fr_event_update_t resume_read[] = {
 	{ 0 }
 };
 
+/** Find the end of the next batch of records in the mapped file
+ *
+ * Records are terminated by a blank line, so this is one memmem() per
+ * record over the map, with no copying.  At EOF, the last record
+ * doesn't need a terminator, and any trailing LFs are skipped.
+ *
+ * @return the number of records indexed.  0 means EOF.
+ */
+static size_t work_mmap_index(proto_detail_work_thread_t *thread)
+{
+	uint8_t const	*p = thread->map + thread->index_offset;
+	uint8_t const	*end = thread->map + thread->map_size;
+	uint8_t const	*next;
+	size_t		i;
+
+	for (i = 0; (i < DETAIL_MMAP_INDEX) && (p < end); i++) {
+		next = memmem(p, end - p, "\n\n", 2);
+		next = next ? next + 2 : end;
+
+		/*
+		 *	Stray LFs after the last record aren't a
+		 *	record.  The read() path doesn't return them,
+		 *	so we don't either.
+		 */
+		if (next == end) {
+			uint8_t const *q = p;
+
+			while ((q < end) && (*q == '\n')) q++;
+			if (q == end) {
+				p = end;
+				break;
+			}
+		}
+
+		thread->index[i] = next - thread->map;
+		p = next;
+	}
+
+	thread->index_offset = p - thread->map;
+	thread->index_used = i;
+	thread->index_next = 0;
+
+	return i;
+}
+
+/** Copy one record from the mapped file into the packet buffer
+ *
+ * The map is read-only, so the LFs are smashed to zero in the copy,
+ * which is what proto_detail expects to decode.  The lines are
+ * checked in the same pass.
+ *
+ * @param[in] thread		the reader.
+ * @param[out] done_offset	where the "Timestamp" attribute is, or 0.
+ *				May be NULL if the record has already been checked.
+ * @param[in] buffer		to copy the record to.
+ * @param[in] offset		of the record in the mapped file.
+ * @param[in] packet_len	length of the record.
+ * @return
+ *	- 1 if the record has already been marked "Done".
+ *	- 0 on success.
+ *	- -1 if the record is malformed.
+ */
+static int work_mmap_copy(proto_detail_work_thread_t *thread, off_t *done_offset,
+			  uint8_t *buffer, off_t offset, size_t packet_len)
+{
+	uint8_t *p, *end = buffer + packet_len;
+
+	memcpy(buffer, thread->map + offset, packet_len);
+
+	if (done_offset) *done_offset = 0;
+
+	for (p = memchr(buffer, '\n', packet_len); p; p = memchr(p, '\n', end - p)) {
+		*(p++) = '\0';
+		if (p == end) break;
+
+		/*
+		 *	End of record marker.
+		 */
+		if (*p == '\n') {
+			*p = '\0';
+			break;
+		}
+
+		if (!done_offset) continue;
+
+		if (*p != '\t') {
+			ERROR("proto_detail (%s): Missing tab indent in %s, offset from start of file %zu",
+			      thread->name, thread->filename_work, (size_t) (offset + (p - buffer)));
+			return -1;
+		}
+		p++;
+
+		if (((end - p) >= 4) && (memcmp(p, "Done", 4) == 0)) return 1;
+
+		if (((end - p) > 9) && (memcmp(p, "Timestamp", 9) == 0)) *done_offset = offset + (p - buffer);
+
+		/*
+		 *	Skip the attribute name, and check for " = ".
+		 *	A truncated last line at EOF is allowed, as
+		 *	with the read() path.
+		 */
+		while ((p < end) && !isspace((uint8_t) *p)) p++;
+
+		if (((end - p) >= 3) && (memcmp(p, " = ", 3) != 0)) {
+			ERROR("proto_detail (%s): Missing pair assignment operator in %s, offset from start of file %zu",
+			      thread->name, thread->filename_work, (size_t) (offset + (p - buffer)));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Hand out the next record from the mapped file
+ *
+ * The records are already complete in memory, so there's no partial
+ * data to track.  The FD offset is only used to tell the event loop
+ * whether or not there's more to read.
+ */
+static ssize_t work_mmap_read(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread,
+			      void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len)
+{
+	fr_detail_entry_t	*track;
+	off_t			offset, done_offset;
+	size_t			packet_len;
+	int			ret;
+
+redo:
+	if ((thread->index_next == thread->index_used) && (work_mmap_index(thread) == 0)) {
+		MPRINT("MMAP at EOF, outstanding %u", thread->outstanding);
+
+		/*
+		 *	Move the FD to EOF so that it's no longer
+		 *	readable.  mod_write() closes the file when
+		 *	the last reply comes back.
+		 */
+		thread->eof = true;
+		thread->closing = true;
+		(void) lseek(thread->fd, 0, SEEK_END);
+
+		/*
+		 *	Nothing is outstanding, so there won't be a
+		 *	reply to close the file.  Do it now.
+		 */
+		if (!thread->outstanding) return -1;
+
+		return 0;
+	}
+
+	offset = thread->read_offset;
+	thread->read_offset = thread->index[thread->index_next++];
+	packet_len = thread->read_offset - offset;
+	thread->last_line++;
+
+	if ((packet_len > inst->parent->max_packet_size) || (packet_len > buffer_len)) {
+		DEBUG("Ignoring 'too large' entry at offset %zu of %s",
+		      (size_t) offset, thread->filename_work);
+		DEBUG("Entry size %zu is greater than allowed maximum %u",
+		      packet_len, inst->parent->max_packet_size);
+		goto redo;
+	}
+
+	ret = work_mmap_copy(thread, &done_offset, buffer, offset, packet_len);
+	if (ret < 0) return -1;
+	if (ret > 0) {
+		MPRINT("Skipping record");
+		goto redo;
+	}
+
+	MEM(track = talloc_zero(thread, fr_detail_entry_t));
+	track->parent = thread;
+	track->timestamp = fr_time();
+	track->id = thread->count++;
+	track->done_offset = done_offset;
+
+	/*
+	 *	Retransmissions are copied from the map again, so
+	 *	there's no need to keep a copy of the packet.
+	 */
+	track->offset = offset;
+	track->packet_len = packet_len;
+
+	thread->header_offset = thread->read_offset;
+
+	*packet_ctx = track;
+	*recv_time_p = track->timestamp;
+
+	thread->outstanding++;
+
+	if (!thread->paused && (thread->outstanding >= inst->max_outstanding)) {
+		(void) fr_event_filter_update(thread->el, thread->fd, FR_EVENT_FILTER_IO, pause_read);
+		thread->paused = true;
+	}
+
+	MPRINT("Returning NUM %u - %.*s", thread->outstanding, (int) packet_len, buffer);
+	return packet_len;
+}
+
 static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
 {
 	proto_detail_work_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_detail_work_t);
@@ -180,7 +387,11 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		}
 
 		fr_assert(buffer_len >= track->packet_len);
-		memcpy(buffer, track->packet, track->packet_len);
+		if (thread->map) {
+			(void) work_mmap_copy(thread, NULL, buffer, track->offset, track->packet_len);
+		} else {
+			memcpy(buffer, track->packet, track->packet_len);
+		}
 
 		DEBUG("Retrying packet %d (retransmission %u)", track->id, track->retry.count);
 		*packet_ctx = track;
@@ -194,7 +405,7 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	 *	without locking it first.  So too bad for them.
 	 */
 	if (thread->closing) {
-		if (inst->track_progress) thread->read_offset = lseek(thread->fd, 0, SEEK_END);
+		if (inst->track_progress || thread->map) thread->read_offset = lseek(thread->fd, 0, SEEK_END);
 		return 0;
 	}
 
@@ -208,6 +419,8 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		return 0;
 	}
 
+	if (thread->map) return work_mmap_read(inst, thread, packet_ctx, recv_time_p, buffer, buffer_len);
+
 	/*
 	 *	If we've cached leftover data from the ring buffer,
 	 *	copy it back.
@@ -629,11 +842,21 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 		 *	Seek to the entry, mark it as done, and then seek to
 		 *	the point in the file where we were reading from.
 		 */
-		(void) lseek(thread->fd, track->done_offset, SEEK_SET);
-		if (write(thread->fd, "Done", 4) < 0) {
-			ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
+		if (thread->map) {
+			/*
+			 *	The FD offset is only used to signal
+			 *	readability, so don't touch it.
+			 */
+			if (pwrite(thread->fd, "Done", 4, track->done_offset) < 0) {
+				ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
+			}
+		} else {
+			(void) lseek(thread->fd, track->done_offset, SEEK_SET);
+			if (write(thread->fd, "Done", 4) < 0) {
+				ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
+			}
+			(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
 		}
-		(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
 	}
 
 free_track:
@@ -714,6 +937,37 @@ static int mod_open(fr_listen_t *li)
 		thread->file_size = 1;
 	}
 
+	/*
+	 *	Map the whole file, and hand out records directly from
+	 *	the page cache.  Empty files, or files we can't map, are
+	 *	read the normal way.
+	 */
+	if (inst->use_mmap && !thread->map) {
+		struct stat buf;
+
+		if (fstat(thread->fd, &buf) < 0) {
+			cf_log_err(inst->cs, "Failed examining %s: %s", thread->filename_work, fr_syserror(errno));
+			return -1;
+		}
+
+		if ((buf.st_size > 0) && ((uint64_t) buf.st_size <= SIZE_MAX)) {
+			void *map;
+
+			map = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, thread->fd, 0);
+			if (map == MAP_FAILED) {
+				cf_log_warn(inst->cs, "Failed mapping %s, falling back to read(): %s",
+					    thread->filename_work, fr_syserror(errno));
+			} else {
+#ifdef MADV_SEQUENTIAL
+				(void) madvise(map, buf.st_size, MADV_SEQUENTIAL);
+#endif
+				thread->map = map;
+				thread->map_size = buf.st_size;
+				MEM(thread->index = talloc_array(thread, off_t, DETAIL_MMAP_INDEX));
+			}
+		}
+	}
+
 	fr_assert(thread->name == NULL);
 	fr_assert(thread->filename_work != NULL);
 	thread->name = talloc_typed_asprintf(thread, "detail_work reading file %s", thread->filename_work);
@@ -758,6 +1012,11 @@ static int mod_close_internal(proto_detail_work_thread_t *thread)
 
 	if (thread->outstanding == 0) unlink(thread->filename_work);
 
+	if (thread->map) {
+		(void) munmap(UNCONST(uint8_t *, thread->map), thread->map_size);
+		thread->map = NULL;
+	}
+
 	close(thread->fd);
 	thread->fd = -1;
 
@@ -41,6 +41,7 @@ typedef struct {
 	int				sockfd;
 
 	fr_io_address_t			*connection;		//!< for connected sockets.
+	udp_batch_t			*batch;			//!< for reading multiple packets at once.
 
 	fr_stats_t			stats;			//!< statistics for this socket
 }  proto_dns_udp_thread_t;
@@ -53,6 +54,7 @@ typedef struct {
 	char const			*interface;		//!< Interface to bind to.
 
 	uint32_t			recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t			recv_batch;		//!< How many packets to read with one system call.
 
 	uint32_t			max_packet_size;	//!< for message ring buffer.
 	uint32_t			max_attributes;		//!< Limit maximum decodable attributes.
@@ -88,6 +90,7 @@ static const conf_parser_t udp_listen_config[] = {
 
 	{ FR_CONF_OFFSET("port", proto_dns_udp_t, port), .dflt = "547"  },
 	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_dns_udp_t, recv_buff) },
+	{ FR_CONF_OFFSET("recv_batch", proto_dns_udp_t, recv_batch), .dflt = "1" },
 
 	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
 
@@ -142,7 +145,12 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	 */
 	flags = UDP_FLAGS_CONNECTED * (thread->connection != NULL);
 
-	data_size = udp_recv(thread->sockfd, flags, &address->socket, buffer, buffer_len, recv_time_p);
+	if (thread->batch && !thread->connection) {
+		data_size = udp_recv_batch(thread->batch, thread->sockfd, flags, &address->socket,
+					   buffer, buffer_len, recv_time_p);
+	} else {
+		data_size = udp_recv(thread->sockfd, flags, &address->socket, buffer, buffer_len, recv_time_p);
+	}
 	if (data_size < 0) {
 		RATE_LIMIT_GLOBAL(PERROR, "Read error (%zd)", data_size);
 		return data_size;
@@ -186,6 +194,15 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	return packet_len;
 }
 
+static unsigned int mod_read_pending(fr_listen_t *li)
+{
+	proto_dns_udp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_dns_udp_thread_t);
+
+	if (!thread->batch || thread->connection) return 0;
+
+	return udp_batch_pending(thread->batch);
+}
+
 static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
 {
@@ -301,6 +318,20 @@ static int mod_open(fr_listen_t *li)
 
 	thread->sockfd = sockfd;
 
+	/*
+	 *	Read multiple packets with one system call.  This is
+	 *	only done for the main socket, connected sockets have
+	 *	much lower packet rates.
+	 */
+	if ((inst->recv_batch > 1) && !thread->connection) {
+		thread->batch = udp_batch_alloc(thread, inst->recv_batch, inst->max_packet_size);
+		if (!thread->batch) {
+			PERROR("Failed allocating receive batch");
+			close(sockfd);
+			return -1;
+		}
+	}
+
 	fr_assert((cf_parent(inst->cs) != NULL) && (cf_parent(cf_parent(inst->cs)) != NULL));	/* listen { ... } */
 
 	thread->name = fr_app_io_socket_name(thread, &proto_dns_udp,
@@ -378,6 +409,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
 
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, >=, 1);
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, <=, 64);
+
 	/*
 	 *	Parse and create the trie for dynamic clients, even if
 	 *	there's no dynamic clients.
@@ -457,6 +491,7 @@ fr_app_io_t proto_dns_udp = {
 
 	.open			= mod_open,
 	.read			= mod_read,
+	.read_pending		= mod_read_pending,
 	.write			= mod_write,
 	.fd_set			= mod_fd_set,
 	.connection_set		= mod_connection_set,
@@ -42,6 +42,7 @@ static conf_parser_t const limit_config[] = {
 	{ FR_CONF_OFFSET("max_connections", proto_radius_t, io.max_connections), .dflt = "1024" } ,
 	{ FR_CONF_OFFSET("max_clients", proto_radius_t, io.max_clients), .dflt = "256" } ,
 	{ FR_CONF_OFFSET("max_pending_packets", proto_radius_t, io.max_pending_packets), .dflt = "256" } ,
+	{ FR_CONF_OFFSET("num_shards", proto_radius_t, io.num_shards), .dflt = "1" } ,
 
 	/*
 	 *	For performance tweaking.  NOT for normal humans.
@@ -610,6 +611,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 1024);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65535);
 
+	FR_INTEGER_BOUND_CHECK("num_shards", inst->io.num_shards, >=, 1);
+	FR_INTEGER_BOUND_CHECK("num_shards", inst->io.num_shards, <=, 64);
+
 	/*
 	 *	Tell the master handler about the main protocol instance.
 	 */
@@ -40,6 +40,7 @@ typedef struct {
 	int				sockfd;
 
 	fr_io_address_t			*connection;		//!< for connected sockets.
+	udp_batch_t			*batch;			//!< for reading multiple packets at once.
 
 	fr_stats_t			stats;			//!< statistics for this socket
 
@@ -58,6 +59,7 @@ typedef struct {
 	char const			*port_name;		//!< Name of the port for getservent().
 
 	uint32_t			recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t			recv_batch;		//!< How many packets to read with one system call.
 	uint32_t			send_buff;		//!< How big the kernel's send buffer should be.
 
 	uint32_t			max_packet_size;	//!< for message ring buffer.
@@ -99,6 +101,7 @@ static const conf_parser_t udp_listen_config[] = {
 	{ FR_CONF_OFFSET("port", proto_radius_udp_t, port) },
 
 	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_radius_udp_t, recv_buff) },
+	{ FR_CONF_OFFSET("recv_batch", proto_radius_udp_t, recv_batch), .dflt = "1" },
 	{ FR_CONF_OFFSET_IS_SET("send_buff", FR_TYPE_UINT32, 0, proto_radius_udp_t, send_buff) },
 
 	{ FR_CONF_OFFSET("accept_conflicting_packets", proto_radius_udp_t, dedup_authenticator) } ,
@@ -138,7 +141,12 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	 */
 	flags = UDP_FLAGS_CONNECTED * (thread->connection != NULL);
 
-	data_size = udp_recv(thread->sockfd, flags, &address->socket, buffer, buffer_len, recv_time_p);
+	if (thread->batch && !thread->connection) {
+		data_size = udp_recv_batch(thread->batch, thread->sockfd, flags, &address->socket,
+					   buffer, buffer_len, recv_time_p);
+	} else {
+		data_size = udp_recv(thread->sockfd, flags, &address->socket, buffer, buffer_len, recv_time_p);
+	}
 	if (data_size < 0) {
 		PDEBUG2("proto_radius_udp got read error");
 		return data_size;
@@ -196,6 +204,15 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	return packet_len;
 }
 
+static unsigned int mod_read_pending(fr_listen_t *li)
+{
+	proto_radius_udp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_udp_thread_t);
+
+	if (!thread->batch || thread->connection) return 0;
+
+	return udp_batch_pending(thread->batch);
+}
+
 static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
 {
@@ -361,6 +378,20 @@ static int mod_open(fr_listen_t *li)
 
 	thread->sockfd = sockfd;
 
+	/*
+	 *	Read multiple packets with one system call.  This is
+	 *	only done for the main socket, connected sockets have
+	 *	much lower packet rates.
+	 */
+	if ((inst->recv_batch > 1) && !thread->connection) {
+		thread->batch = udp_batch_alloc(thread, inst->recv_batch, inst->max_packet_size);
+		if (!thread->batch) {
+			PERROR("Failed allocating receive batch");
+			close(sockfd);
+			return -1;
+		}
+	}
+
 	fr_assert((cf_parent(inst->cs) != NULL) && (cf_parent(cf_parent(inst->cs)) != NULL));	/* listen { ... } */
 
 	thread->name = fr_app_io_socket_name(thread, &proto_radius_udp,
@@ -425,6 +456,25 @@ static int mod_track_compare(void const *instance, UNUSED void *thread_instance,
 	return (a[0] < b[0]) - (a[0] > b[0]);
 }
 
+static uint32_t mod_track_hash(void const *instance, UNUSED void *thread_instance, fr_client_t *client,
+			       void const *packet)
+{
+	proto_radius_udp_t const *inst = talloc_get_type_abort_const(instance, proto_radius_udp_t);
+	uint8_t const *p = packet;
+	uint32_t hash;
+
+	/*
+	 *	Code and ID.
+	 */
+	hash = fr_hash(p, 2);
+
+	if (inst->dedup_authenticator || client->dedup_authenticator) {
+		hash = fr_hash_update(p + 4, RADIUS_AUTH_VECTOR_LENGTH, hash);
+	}
+
+	return hash;
+}
+
 
 static char const *mod_name(fr_listen_t *li)
 {
@@ -465,6 +515,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 20);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
 
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, >=, 1);
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, <=, 64);
+
 	if (!inst->port) {
 		struct servent *s;
 
@@ -554,10 +607,12 @@ fr_app_io_t proto_radius_udp = {
 
 	.open			= mod_open,
 	.read			= mod_read,
+	.read_pending		= mod_read_pending,
 	.write			= mod_write,
 	.fd_set			= mod_fd_set,
 	.track_create  		= mod_track_create,
 	.track_compare		= mod_track_compare,
+	.track_hash		= mod_track_hash,
 	.connection_set		= mod_connection_set,
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
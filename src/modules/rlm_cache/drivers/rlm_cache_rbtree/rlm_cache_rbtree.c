@@ -139,7 +139,7 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
  */
 static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, void *instance,
 					 request_t *request, UNUSED void *handle,
-					 fr_value_box_t const *key)
+					 fr_value_box_t const *key, UNUSED rlm_cache_entry_t const *stale)
 {
 	rlm_cache_rbtree_t *driver = talloc_get_type_abort(instance, rlm_cache_rbtree_t);
 	rlm_cache_entry_t find = {};
@@ -209,7 +209,7 @@ static cache_status_t cache_entry_insert(rlm_cache_config_t const *config, void
  */
 static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, void *instance,
 					  request_t *request, UNUSED void *handle,
-					  rlm_cache_entry_t *c)
+					  rlm_cache_entry_t *c, fr_unix_time_t expires)
 {
 	rlm_cache_rbtree_t *driver = talloc_get_type_abort(instance, rlm_cache_rbtree_t);
 
@@ -221,6 +221,7 @@ static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *confi
 		RERROR("Entry not in heap");
 		return CACHE_ERROR;
 	}
+	c->expires = expires;
 
 	if (fr_heap_insert(&driver->mutable->heap, c) < 0) {
 		fr_rb_delete(driver->mutable->cache, c);	/* make sure we don't leak entries... */
@@ -430,7 +430,8 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
  * @copydetails cache_entry_expire_t
  */
 static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, void *instance,
-					 request_t *request, UNUSED void *handle, fr_value_box_t const *key)
+					 request_t *request, UNUSED void *handle, fr_value_box_t const *key,
+					 UNUSED rlm_cache_entry_t const *stale)
 {
 	rlm_cache_redis_t		*driver = instance;
 	fr_redis_cluster_state_t	state;
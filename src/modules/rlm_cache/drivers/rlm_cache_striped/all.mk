@@ -0,0 +1,4 @@
+TARGETNAME	:= rlm_cache_striped
+
+TARGET		:= $(TARGETNAME)$(L)
+SOURCES		:= $(TARGETNAME).c
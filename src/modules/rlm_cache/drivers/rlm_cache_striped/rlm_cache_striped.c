@@ -0,0 +1,471 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_cache_striped.c
+ * @brief Lock striped in memory cache, for read mostly workloads.
+ *
+ * Entries are spread over a fixed number of stripes by a hash of their key.
+ * Each stripe has its own rbtree, expiry heap, and read/write lock, so
+ * lookups only ever take a shared lock on a single stripe, and writers
+ * only block readers of the same stripe.
+ *
+ * Entries are reference counted.  The stripe holds one reference, and
+ * every successful lookup takes another, which is dropped when rlm_cache
+ * calls our free callback.  This lets us release the stripe lock as soon
+ * as the lookup is complete, as an entry which is expired or replaced
+ * whilst a request is merging it stays valid until that request is done
+ * with it.
+ *
+ * As entries are shared, rlm_cache only changes them through us.  The hit
+ * counter is atomic, and the expiry time is only written by our set_ttl
+ * callback, with the stripe locked exclusively.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/heap.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/value.h>
+#include "../../rlm_cache.h"
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** Number of stripes, must be a power of two
+ *
+ */
+#define CACHE_STRIPES		64
+
+typedef struct {
+	pthread_rwlock_t		lock;		//!< Shared for lookups, exclusive for modifications.
+
+	fr_rb_tree_t			*cache;		//!< Tree for looking up cache keys.
+	fr_heap_t			*heap;		//!< For managing entry expiry.
+} rlm_cache_stripe_t;
+
+typedef struct {
+	rlm_cache_stripe_t		stripe[CACHE_STRIPES];	//!< Independently locked portions of the cache.
+
+	atomic_uint_fast64_t		num_entries;	//!< Total entries across all stripes.
+} rlm_cache_striped_mutable_t;
+
+typedef struct {
+	rlm_cache_striped_mutable_t	*mutable;	//!< Mutable instance data.
+} rlm_cache_striped_t;
+
+typedef struct {
+	rlm_cache_entry_t		fields;		//!< Entry data.
+
+	fr_rb_node_t			node;		//!< Entry used for lookups.
+	fr_heap_index_t			heap_id;	//!< Offset used for expiry heap.
+
+	atomic_uint_fast32_t		refs;		//!< One for the stripe, and one for each user.
+} rlm_cache_striped_entry_t;
+
+/** Compare two entries by key
+ *
+ * There may only be one entry with the same key.
+ */
+static int8_t cache_entry_cmp(void const *one, void const *two)
+{
+	rlm_cache_entry_t const *a = one, *b = two;
+
+	MEMCMP_RETURN(a, b, key.vb_strvalue, key.vb_length);
+	return 0;
+}
+
+/** Compare two entries by expiry time
+ *
+ * There may be multiple entries with the same expiry time.
+ */
+static int8_t cache_heap_cmp(void const *one, void const *two)
+{
+	rlm_cache_striped_entry_t const *a = one, *b = two;
+
+	return fr_unix_time_cmp(a->fields.expires, b->fields.expires);
+}
+
+/** Return the stripe responsible for a key
+ *
+ */
+static inline CC_HINT(always_inline) rlm_cache_stripe_t *cache_stripe(rlm_cache_striped_t const *driver,
+								      fr_value_box_t const *key)
+{
+	return &driver->mutable->stripe[fr_hash(key->vb_strvalue, key->vb_length) & (CACHE_STRIPES - 1)];
+}
+
+/** Drop a reference to an entry, freeing it if it was the last one
+ *
+ */
+static inline CC_HINT(always_inline) void cache_entry_unref(rlm_cache_striped_entry_t *c)
+{
+	if (atomic_fetch_sub_explicit(&c->refs, 1, memory_order_acq_rel) == 1) talloc_free(c);
+}
+
+/** Remove an entry from its stripe
+ *
+ * @note Must be called with the stripe locked exclusively.  The caller inherits
+ *	the stripe's reference.
+ */
+static inline CC_HINT(always_inline) void cache_entry_unlink(rlm_cache_striped_t const *driver,
+							     rlm_cache_stripe_t *stripe,
+							     rlm_cache_striped_entry_t *c)
+{
+	fr_heap_extract(&stripe->heap, c);
+	fr_rb_delete(stripe->cache, c);
+	atomic_fetch_sub_explicit(&driver->mutable->num_entries, 1, memory_order_relaxed);
+}
+
+/** Custom allocation function for the driver
+ *
+ * Allows allocation of cache entry structures with additional fields.
+ *
+ * @copydetails cache_entry_alloc_t
+ */
+static rlm_cache_entry_t *cache_entry_alloc(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					    request_t *request)
+{
+	rlm_cache_striped_entry_t *c;
+
+	c = talloc_zero(NULL, rlm_cache_striped_entry_t);
+	if (!c) {
+		RERROR("Failed allocating cache entry");
+		return NULL;
+	}
+	atomic_init(&c->refs, 1);		/* Owned by the caller */
+
+	return (rlm_cache_entry_t *)c;
+}
+
+/** Release a reference to an entry we previously returned
+ *
+ * @copydetails cache_entry_free_t
+ */
+static void cache_entry_free(rlm_cache_entry_t *c)
+{
+	cache_entry_unref((rlm_cache_striped_entry_t *)c);
+}
+
+/** Locate a cache entry
+ *
+ * Only takes a shared lock on the stripe the key hashes to.  Expired
+ * entries are returned as normal, and removed by rlm_cache calling
+ * our expire callback, or when the stripe is next written to.
+ *
+ * @copydetails cache_entry_find_t
+ */
+static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
+				       UNUSED rlm_cache_config_t const *config, void *instance,
+				       UNUSED request_t *request, UNUSED void *handle, fr_value_box_t const *key)
+{
+	rlm_cache_striped_t		*driver = talloc_get_type_abort(instance, rlm_cache_striped_t);
+	rlm_cache_stripe_t		*stripe = cache_stripe(driver, key);
+	rlm_cache_entry_t		find = {};
+	rlm_cache_striped_entry_t	*c;
+
+	fr_value_box_copy_shallow(NULL, &find.key, key);
+
+	pthread_rwlock_rdlock(&stripe->lock);
+	c = fr_rb_find(stripe->cache, &find);
+	if (!c) {
+		pthread_rwlock_unlock(&stripe->lock);
+		*out = NULL;
+		return CACHE_MISS;
+	}
+	atomic_fetch_add_explicit(&c->refs, 1, memory_order_relaxed);
+	pthread_rwlock_unlock(&stripe->lock);
+
+	*out = (rlm_cache_entry_t *)c;
+
+	return CACHE_OK;
+}
+
+/** Remove an entry from the data store
+ *
+ * The entry is only freed once all requests using it have released it.
+ *
+ * If we're given the stale entry a request found, and another request
+ * has since replaced it, the new entry is left alone.
+ *
+ * @copydetails cache_entry_expire_t
+ */
+static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, void *instance,
+					 request_t *request, UNUSED void *handle,
+					 fr_value_box_t const *key, rlm_cache_entry_t const *stale)
+{
+	rlm_cache_striped_t		*driver = talloc_get_type_abort(instance, rlm_cache_striped_t);
+	rlm_cache_stripe_t		*stripe = cache_stripe(driver, key);
+	rlm_cache_entry_t		find = {};
+	rlm_cache_striped_entry_t	*c;
+
+	if (!request) return CACHE_ERROR;
+
+	fr_value_box_copy_shallow(NULL, &find.key, key);
+
+	pthread_rwlock_wrlock(&stripe->lock);
+	c = fr_rb_find(stripe->cache, &find);
+	if (!c || (stale && (&c->fields != stale))) {
+		pthread_rwlock_unlock(&stripe->lock);
+		return CACHE_MISS;
+	}
+	cache_entry_unlink(driver, stripe, c);
+	pthread_rwlock_unlock(&stripe->lock);
+
+	cache_entry_unref(c);
+
+	return CACHE_OK;
+}
+
+/** Insert a new entry into the data store
+ *
+ * Replaces any existing entry with the same key, and removes any
+ * entries in the same stripe which have expired.
+ *
+ * @copydetails cache_entry_insert_t
+ */
+static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, void *instance,
+					 request_t *request, UNUSED void *handle,
+					 rlm_cache_entry_t const *c)
+{
+	rlm_cache_striped_t		*driver = talloc_get_type_abort(instance, rlm_cache_striped_t);
+	rlm_cache_stripe_t		*stripe = cache_stripe(driver, &c->key);
+	rlm_cache_striped_entry_t	*new = UNCONST(rlm_cache_striped_entry_t *, c), *old;
+	fr_unix_time_t			now;
+
+	if (!request) return CACHE_ERROR;
+
+	now = fr_time_to_unix_time(request->packet->timestamp);
+
+	pthread_rwlock_wrlock(&stripe->lock);
+
+	/*
+	 *	Clear out old entries
+	 */
+	while ((old = fr_heap_peek(stripe->heap)) && fr_unix_time_lt(old->fields.expires, now)) {
+		cache_entry_unlink(driver, stripe, old);
+		cache_entry_unref(old);
+	}
+
+	/*
+	 *	Allow overwriting
+	 */
+	old = fr_rb_find(stripe->cache, new);
+	if (old) {
+		cache_entry_unlink(driver, stripe, old);
+		cache_entry_unref(old);
+	}
+
+	if (!fr_rb_insert(stripe->cache, new)) {
+		pthread_rwlock_unlock(&stripe->lock);
+		RERROR("Failed adding entry");
+		return CACHE_ERROR;
+	}
+
+	if (fr_heap_insert(&stripe->heap, new) < 0) {
+		fr_rb_delete(stripe->cache, new);
+		pthread_rwlock_unlock(&stripe->lock);
+		RERROR("Failed adding entry to expiry heap");
+		return CACHE_ERROR;
+	}
+
+	atomic_fetch_add_explicit(&new->refs, 1, memory_order_relaxed);		/* The stripe's reference */
+	atomic_fetch_add_explicit(&driver->mutable->num_entries, 1, memory_order_relaxed);
+
+	pthread_rwlock_unlock(&stripe->lock);
+
+	return CACHE_OK;
+}
+
+/** Update the TTL of an entry
+ *
+ * @copydetails cache_entry_set_ttl_t
+ */
+static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, void *instance,
+					  request_t *request, UNUSED void *handle,
+					  rlm_cache_entry_t *c, fr_unix_time_t expires)
+{
+	rlm_cache_striped_t		*driver = talloc_get_type_abort(instance, rlm_cache_striped_t);
+	rlm_cache_stripe_t		*stripe = cache_stripe(driver, &c->key);
+	rlm_cache_striped_entry_t	*entry = (rlm_cache_striped_entry_t *)c;
+
+#ifdef NDEBUG
+	if (!request) return CACHE_ERROR;
+#endif
+
+	pthread_rwlock_wrlock(&stripe->lock);
+
+	/*
+	 *	Another request removed or replaced the entry
+	 *	after we looked it up.  Equivalent to that
+	 *	happening after the TTL was updated.
+	 */
+	if (!fr_heap_entry_inserted(entry->heap_id)) {
+		pthread_rwlock_unlock(&stripe->lock);
+		RDEBUG2("Entry was removed before its TTL could be updated");
+		return CACHE_OK;
+	}
+
+	fr_heap_extract(&stripe->heap, entry);
+	c->expires = expires;
+
+	if (fr_heap_insert(&stripe->heap, entry) < 0) {
+		fr_rb_delete(stripe->cache, entry);	/* make sure we don't leak entries... */
+		atomic_fetch_sub_explicit(&driver->mutable->num_entries, 1, memory_order_relaxed);
+		pthread_rwlock_unlock(&stripe->lock);
+
+		cache_entry_unref(entry);
+		RERROR("Failed updating entry TTL.  Entry was forcefully expired");
+		return CACHE_ERROR;
+	}
+
+	pthread_rwlock_unlock(&stripe->lock);
+
+	return CACHE_OK;
+}
+
+/** Return the number of entries in the cache
+ *
+ * @copydetails cache_entry_count_t
+ */
+static uint64_t cache_entry_count(UNUSED rlm_cache_config_t const *config, void *instance,
+				  request_t *request, UNUSED void *handle)
+{
+	rlm_cache_striped_t *driver = talloc_get_type_abort(instance, rlm_cache_striped_t);
+
+	if (!request) return CACHE_ERROR;
+
+	return atomic_load_explicit(&driver->mutable->num_entries, memory_order_relaxed);
+}
+
+/** Free all stripes and their entries
+ *
+ */
+static int _cache_striped_mutable_free(rlm_cache_striped_mutable_t *mutable)
+{
+	size_t i;
+
+	for (i = 0; i < CACHE_STRIPES; i++) {
+		rlm_cache_stripe_t	*stripe = &mutable->stripe[i];
+		fr_rb_iter_inorder_t	iter;
+		void			*data;
+
+		if (!stripe->cache) break;	/* Partially initialised */
+
+		for (data = fr_rb_iter_init_inorder(&iter, stripe->cache);
+		     data;
+		     data = fr_rb_iter_next_inorder(&iter)) {
+			fr_rb_iter_delete_inorder(&iter);
+			talloc_free(data);
+		}
+
+		pthread_rwlock_destroy(&stripe->lock);
+	}
+
+	return 0;
+}
+
+/** Cleanup a cache_striped instance
+ *
+ */
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_cache_striped_t *driver = talloc_get_type_abort(mctx->mi->data, rlm_cache_striped_t);
+
+	TALLOC_FREE(driver->mutable);
+
+	return 0;
+}
+
+/** Create a new cache_striped instance
+ *
+ * @param[in] mctx		Data required for instantiation.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_cache_striped_t		*driver = talloc_get_type_abort(mctx->mi->data, rlm_cache_striped_t);
+	rlm_cache_striped_mutable_t	*mutable;
+	size_t				i;
+	int				ret;
+
+	MEM(mutable = talloc_zero(NULL, rlm_cache_striped_mutable_t));
+	talloc_set_destructor(mutable, _cache_striped_mutable_free);
+	atomic_init(&mutable->num_entries, 0);
+
+	for (i = 0; i < CACHE_STRIPES; i++) {
+		rlm_cache_stripe_t *stripe = &mutable->stripe[i];
+
+		if ((ret = pthread_rwlock_init(&stripe->lock, NULL)) != 0) {
+			ERROR("Failed initializing lock: %s", fr_syserror(ret));
+		error:
+			talloc_free(mutable);
+			return -1;
+		}
+
+		/*
+		 *	The heap of entries to expire.
+		 */
+		stripe->heap = fr_heap_talloc_alloc(mutable, cache_heap_cmp, rlm_cache_striped_entry_t, heap_id, 0);
+		if (!stripe->heap) {
+			ERROR("Failed to create heap for the cache");
+			pthread_rwlock_destroy(&stripe->lock);
+			goto error;
+		}
+
+		/*
+		 *	The cache.
+		 */
+		stripe->cache = fr_rb_inline_talloc_alloc(mutable, rlm_cache_striped_entry_t, node,
+							  cache_entry_cmp, NULL);
+		if (!stripe->cache) {
+			ERROR("Failed to create cache");
+			pthread_rwlock_destroy(&stripe->lock);
+			goto error;
+		}
+	}
+
+	driver->mutable = mutable;
+
+	return 0;
+}
+
+extern rlm_cache_driver_t rlm_cache_striped;
+rlm_cache_driver_t rlm_cache_striped = {
+	.common = {
+		.magic		= MODULE_MAGIC_INIT,
+		.name		= "cache_striped",
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach,
+		.inst_size	= sizeof(rlm_cache_striped_t),
+		.inst_type	= "rlm_cache_striped_t",
+	},
+	.alloc		= cache_entry_alloc,
+	.free		= cache_entry_free,
+
+	.find		= cache_entry_find,
+	.insert		= cache_entry_insert,
+	.expire		= cache_entry_expire,
+	.set_ttl	= cache_entry_set_ttl,
+	.count		= cache_entry_count,
+};
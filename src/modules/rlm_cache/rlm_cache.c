@@ -271,7 +271,7 @@ static rlm_rcode_t cache_merge(rlm_cache_t const *inst, request_t *request, rlm_
 	if (inst->config.stats) {
 		fr_assert(request->packet != NULL);
 		MEM(pair_update_request(&vp, attr_cache_entry_hits) >= 0);
-		vp->vp_uint32 = c->hits;
+		vp->vp_uint32 = atomic_load_explicit(&c->hits, memory_order_relaxed);
 	}
 
 	return merged > 0 ?
@@ -331,7 +331,7 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
 			fr_box_time(request->packet->timestamp));
 
 	expired:
-		inst->driver->expire(&inst->config, inst->driver_submodule->data, request, handle, key);
+		inst->driver->expire(&inst->config, inst->driver_submodule->data, request, *handle, key, c);
 		cache_free(inst, &c);
 		RETURN_MODULE_NOTFOUND;	/* Couldn't find a non-expired entry */
 	}
@@ -343,7 +343,7 @@ static unlang_action_t cache_find(rlm_rcode_t *p_result, rlm_cache_entry_t **out
 	}
 	RDEBUG2("Found entry for \"%pV\"", key);
 
-	c->hits++;
+	atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
 	*out = c;
 
 	RETURN_MODULE_OK;
@@ -361,7 +361,7 @@ static unlang_action_t cache_expire(rlm_rcode_t *p_result,
 				    rlm_cache_handle_t **handle, fr_value_box_t const *key)
 {
 	RDEBUG2("Expiring cache entry");
-	for (;;) switch (inst->driver->expire(&inst->config, inst->driver_submodule->data, request, *handle, key)) {
+	for (;;) switch (inst->driver->expire(&inst->config, inst->driver_submodule->data, request, *handle, key, NULL)) {
 	case CACHE_RECONNECT:
 		if (cache_reconnect(handle, inst, request) == 0) continue;
 		FALL_THROUGH;
@@ -563,14 +563,18 @@ skip_maps:
  */
 static unlang_action_t cache_set_ttl(rlm_rcode_t *p_result,
 				     rlm_cache_t const *inst, request_t *request,
-				     rlm_cache_handle_t **handle, rlm_cache_entry_t *c)
+				     rlm_cache_handle_t **handle, rlm_cache_entry_t *c, fr_unix_time_t expires)
 {
 	/*
-	 *	Call the driver's insert method to overwrite the old entry
+	 *	Call the driver's insert method to overwrite the old entry.
+	 *	Drivers without set_ttl don't share entries between
+	 *	requests, so we can update the expiry ourselves.
 	 */
 	if (!inst->driver->set_ttl) for (;;) {
 		cache_status_t ret;
 
+		c->expires = expires;
+
 		ret = inst->driver->insert(&inst->config, inst->driver_submodule->data, request, *handle, c);
 		switch (ret) {
 		case CACHE_RECONNECT:
@@ -593,7 +597,7 @@ static unlang_action_t cache_set_ttl(rlm_rcode_t *p_result,
 	for (;;) {
 		cache_status_t ret;
 
-		ret = inst->driver->set_ttl(&inst->config, inst->driver_submodule->data, request, *handle, c);
+		ret = inst->driver->set_ttl(&inst->config, inst->driver_submodule->data, request, *handle, c, expires);
 		switch (ret) {
 		case CACHE_RECONNECT:
 			if (cache_reconnect(handle, inst, request) == 0) continue;
@@ -795,9 +799,8 @@ static unlang_action_t CC_HINT(nonnull) mod_cache_it(rlm_rcode_t *p_result, modu
 
 		fr_assert(c);
 
-		c->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
-
-		cache_set_ttl(&tmp, inst, request, &handle, c);
+		cache_set_ttl(&tmp, inst, request, &handle, c,
+			      fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl));
 		switch (tmp) {
 		case RLM_MODULE_FAIL:
 			rcode = RLM_MODULE_FAIL;
@@ -1169,9 +1172,8 @@ static unlang_action_t CC_HINT(nonnull) mod_method_update(rlm_rcode_t *p_result,
 
 		DEBUG3("Updating the TTL -> %pV", fr_box_time_delta(ttl));
 
-		entry->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
-
-		cache_set_ttl(&rcode, inst, request, &handle, entry);
+		cache_set_ttl(&rcode, inst, request, &handle, entry,
+			      fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl));
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 	}
 
@@ -1367,9 +1369,8 @@ static unlang_action_t CC_HINT(nonnull) mod_method_ttl(rlm_rcode_t *p_result, mo
 
 		DEBUG3("Updating the TTL -> %pV", fr_box_time_delta(ttl));
 
-		entry->expires = fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl);
-
-		cache_set_ttl(&rcode, inst, request, &handle, entry);
+		cache_set_ttl(&rcode, inst, request, &handle, entry,
+			      fr_unix_time_add(fr_time_to_unix_time(request->packet->timestamp), ttl));
 		if (rcode == RLM_MODULE_FAIL) goto finish;
 
 		rcode = RLM_MODULE_UPDATED;
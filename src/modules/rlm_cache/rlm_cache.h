@@ -30,6 +30,12 @@ RCSIDH(cache_h, "$Id$")
 #include <freeradius-devel/server/map.h>
 #include <freeradius-devel/protocol/freeradius/freeradius.internal.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 typedef struct rlm_cache_driver_s rlm_cache_driver_t;
 
 typedef void rlm_cache_handle_t;
@@ -71,7 +77,9 @@ typedef struct {
 
 typedef struct {
 	fr_value_box_t		key;			//!< Key used to identify entry.
-	long long int		hits;			//!< How many times the entry has been retrieved.
+	atomic_int_fast64_t	hits;			//!< How many times the entry has been retrieved.
+							///< Atomic, as drivers may share entries between
+							///< requests.
 	fr_unix_time_t		created;		//!< When the entry was created.
 	fr_unix_time_t		expires;		//!< When the entry expires.
 
@@ -163,6 +171,9 @@ typedef cache_status_t	(*cache_entry_insert_t)(rlm_cache_config_t const *config,
  * @param[in] handle the driver gave us when we called #cache_acquire_t, or NULL if no
  *	#cache_acquire_t callback was provided.
  * @param[in] key of entry to expire.
+ * @param[in] c the stale entry #cache_entry_find_t returned, or NULL to expire whatever
+ *	entry is stored under key.  Drivers which share entries between requests must only
+ *	remove the stored entry if it's still c, as another request may have replaced it.
  * @return
  *	- #CACHE_RECONNECT - If handle needs to be reinitialised/reconnected.
  *	- #CACHE_ERROR - If the entry couldn't be expired.
@@ -171,7 +182,7 @@ typedef cache_status_t	(*cache_entry_insert_t)(rlm_cache_config_t const *config,
  */
 typedef cache_status_t	(*cache_entry_expire_t)(rlm_cache_config_t const *config, void *instance,
 						request_t *request, void *handle,
-						fr_value_box_t const *key);
+						fr_value_box_t const *key, rlm_cache_entry_t const *c);
 
 /** Update the ttl of an entry in the cache
  *
@@ -186,7 +197,9 @@ typedef cache_status_t	(*cache_entry_expire_t)(rlm_cache_config_t const *config,
  * @param[in] request The current request.
  * @param[in] handle the driver gave us when we called #cache_acquire_t, or NULL if no
  *	#cache_acquire_t callback was provided.
- * @param[in] c to update the TTL of. c->ttl will have been set to the new value.
+ * @param[in] c to update the TTL of.
+ * @param[in] expires the new expiry time.  The driver must set c->expires, with whatever
+ *	locking it needs if entries are shared between requests.
  * @return
  *	- #CACHE_RECONNECT - If handle needs to be reinitialised/reconnected.
  *	- #CACHE_ERROR - If the entry TTL couldn't be updated.
@@ -194,7 +207,7 @@ typedef cache_status_t	(*cache_entry_expire_t)(rlm_cache_config_t const *config,
  */
 typedef cache_status_t	(*cache_entry_set_ttl_t)(rlm_cache_config_t const *config, void *instance,
 						 request_t *request, void *handle,
-						 rlm_cache_entry_t *c);
+						 rlm_cache_entry_t *c, fr_unix_time_t expires);
 
 /** Get the number of entries in the cache
  *
@@ -0,0 +1,262 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Multi-threaded performance tests for the in memory cache drivers
+ *
+ * Calls the driver API the same way rlm_cache does, from several threads at
+ * once, with a read mostly mix of lookups and inserts.
+ *
+ * @file src/modules/rlm_cache/rlm_cache_perf_test.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void cache_perf_init(void);
+#define TEST_INIT cache_perf_init()
+
+#include <freeradius-devel/util/acutest.h>
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/util/dict_test.h>
+#include <freeradius-devel/util/time.h>
+
+#include "rlm_cache.h"
+
+/*
+ *	Exported by the driver libraries we link against.
+ */
+extern rlm_cache_driver_t rlm_cache_rbtree;
+extern rlm_cache_driver_t rlm_cache_striped;
+
+#define CACHE_PERF_KEYS		1024		//!< Number of distinct keys.
+#define CACHE_PERF_OPS		200000		//!< Operations per thread.
+#define CACHE_PERF_WRITE_EVERY	100		//!< One insert for every N operations.
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+static fr_value_box_t	keys[CACHE_PERF_KEYS];
+
+static void cache_perf_init(void)
+{
+	size_t i;
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("rlm_cache_perf_test");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_time_start();
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	for (i = 0; i < CACHE_PERF_KEYS; i++) {
+		char *key;
+
+		MEM(key = talloc_asprintf(autofree, "perf-key-%zu", i));
+		fr_value_box_bstrndup_shallow(&keys[i], NULL, key, talloc_array_length(key) - 1, false);
+	}
+}
+
+typedef struct {
+	rlm_cache_driver_t const	*driver;
+	rlm_cache_config_t		config;
+	void				*inst;
+
+	pthread_barrier_t		start;
+} cache_perf_ctx_t;
+
+static request_t *cache_perf_request_alloc(TALLOC_CTX *ctx)
+{
+	request_t *request;
+
+	request = request_local_alloc_external(ctx, NULL);
+	request->packet = fr_packet_alloc(request, false);
+	TEST_CHECK(request->packet != NULL);
+	request->packet->timestamp = fr_time();
+
+	return request;
+}
+
+/** Insert an entry, the same way rlm_cache does
+ *
+ */
+static void cache_perf_insert(cache_perf_ctx_t *pctx, request_t *request, fr_value_box_t const *key)
+{
+	rlm_cache_driver_t const	*driver = pctx->driver;
+	rlm_cache_handle_t		*handle = NULL;
+	rlm_cache_entry_t		*c;
+
+	c = driver->alloc(&pctx->config, pctx->inst, request);
+	map_list_init(&c->maps);
+	fr_value_box_copy(c, &c->key, key);
+	c->created = fr_time_to_unix_time(request->packet->timestamp);
+	c->expires = fr_unix_time_add(c->created, pctx->config.ttl);
+
+	if (driver->acquire) driver->acquire(&handle, &pctx->config, pctx->inst, request);
+
+	if (driver->insert(&pctx->config, pctx->inst, request, handle, c) != CACHE_OK) {
+		talloc_free(c);
+	} else if (driver->free) {
+		driver->free(c);
+	}
+
+	if (driver->release) driver->release(&pctx->config, pctx->inst, request, handle);
+}
+
+/** Lookup an entry, the same way rlm_cache does
+ *
+ */
+static bool cache_perf_find(cache_perf_ctx_t *pctx, request_t *request, fr_value_box_t const *key)
+{
+	rlm_cache_driver_t const	*driver = pctx->driver;
+	rlm_cache_handle_t		*handle = NULL;
+	rlm_cache_entry_t		*c = NULL;
+	bool				found;
+
+	if (driver->acquire) driver->acquire(&handle, &pctx->config, pctx->inst, request);
+
+	found = (driver->find(&c, &pctx->config, pctx->inst, request, handle, key) == CACHE_OK);
+	if (found && driver->free) driver->free(c);
+
+	if (driver->release) driver->release(&pctx->config, pctx->inst, request, handle);
+
+	return found;
+}
+
+static void *cache_perf_thread(void *uctx)
+{
+	cache_perf_ctx_t	*pctx = uctx;
+	TALLOC_CTX		*ctx;
+	request_t		*request;
+	unsigned int		i, seed = (unsigned int)(uintptr_t)&ctx, misses = 0;
+
+	MEM(ctx = talloc_new(NULL));
+	request = cache_perf_request_alloc(ctx);
+
+	pthread_barrier_wait(&pctx->start);
+
+	for (i = 0; i < CACHE_PERF_OPS; i++) {
+		fr_value_box_t const *key = &keys[rand_r(&seed) % CACHE_PERF_KEYS];
+
+		if ((i % CACHE_PERF_WRITE_EVERY) == 0) {
+			cache_perf_insert(pctx, request, key);
+			continue;
+		}
+
+		if (!cache_perf_find(pctx, request, key)) misses++;
+	}
+
+	talloc_free(ctx);
+
+	return (void *)(uintptr_t)misses;
+}
+
+static void do_test_cache(rlm_cache_driver_t const *driver, unsigned int num_threads)
+{
+	cache_perf_ctx_t	pctx = {
+					.driver = driver,
+					.config = {
+						.ttl = fr_time_delta_from_sec(3600),
+						.max_entries = CACHE_PERF_KEYS * 2
+					}
+				};
+	module_instance_t	mi = {};
+	pthread_t		*threads;
+	request_t		*request;
+	fr_time_t		start;
+	fr_time_delta_t		used;
+	uintptr_t		misses = 0;
+	size_t			i;
+
+	MEM(pctx.inst = talloc_zero_size(autofree, driver->common.inst_size));
+	talloc_set_name_const(pctx.inst, driver->common.inst_type);
+	mi.data = pctx.inst;
+
+	TEST_CHECK(driver->common.instantiate(&(module_inst_ctx_t){ .mi = &mi }) == 0);
+
+	/*
+	 *	Pre-populate the cache, so lookups hit
+	 */
+	request = cache_perf_request_alloc(autofree);
+	for (i = 0; i < CACHE_PERF_KEYS; i++) cache_perf_insert(&pctx, request, &keys[i]);
+
+	threads = talloc_array(autofree, pthread_t, num_threads);
+	pthread_barrier_init(&pctx.start, NULL, num_threads + 1);
+
+	for (i = 0; i < num_threads; i++) {
+		TEST_CHECK(pthread_create(&threads[i], NULL, cache_perf_thread, &pctx) == 0);
+	}
+
+	pthread_barrier_wait(&pctx.start);
+	start = fr_time();
+
+	for (i = 0; i < num_threads; i++) {
+		void *ret;
+
+		pthread_join(threads[i], &ret);
+		misses += (uintptr_t)ret;
+	}
+	used = fr_time_sub(fr_time(), start);
+
+	pthread_barrier_destroy(&pctx.start);
+	talloc_free(threads);
+	talloc_free(request);
+
+	TEST_CHECK(driver->common.detach(&(module_detach_ctx_t){ .mi = &mi }) == 0);
+	talloc_free(pctx.inst);
+
+	/*
+	 *	Every key is in the cache, so every lookup should hit
+	 */
+	TEST_CHECK(misses == 0);
+	TEST_MSG("misses=%"PRIuPTR, misses);
+
+	TEST_MSG_ALWAYS("driver=%s", driver->common.name);
+	TEST_MSG_ALWAYS("threads=%u", num_threads);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", ((double)CACHE_PERF_OPS * num_threads)/(fr_time_delta_unwrap(used) / (double)NSEC));
+}
+
+#define test_func(_driver, _threads) \
+static void test_ ## _driver ## _ ## _threads(void)\
+{\
+	do_test_cache(&rlm_cache_ ## _driver, _threads);\
+}
+
+#define test_funcs(_driver) \
+	test_func(_driver, 1) \
+	test_func(_driver, 2) \
+	test_func(_driver, 4) \
+	test_func(_driver, 8)
+
+test_funcs(rbtree)
+test_funcs(striped)
+
+#define thread_tests(_driver) \
+	{ #_driver "_1", test_ ## _driver ## _1},\
+	{ #_driver "_2", test_ ## _driver ## _2},\
+	{ #_driver "_4", test_ ## _driver ## _4},\
+	{ #_driver "_8", test_ ## _driver ## _8},\
+
+TEST_LIST = {
+	thread_tests(rbtree)
+	thread_tests(striped)
+
+	{ NULL }
+};
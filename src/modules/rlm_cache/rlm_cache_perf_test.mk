@@ -0,0 +1,7 @@
+TARGET		:= rlm_cache_perf_test$(E)
+SOURCES		:= rlm_cache_perf_test.c
+
+TGT_INSTALLDIR	:=
+TGT_LDLIBS	:= $(LIBS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-unlang$(L) \
+		   rlm_cache_rbtree$(L) rlm_cache_striped$(L)
@@ -57,9 +57,17 @@ typedef struct {
 
 	bool		escape;		//!< do filename escaping, yes / no
 
+	bool		buffered;	//!< Queue entries for a writer thread.
+	exfile_writer_config_t	buffer;	//!< Writer thread configuration.
+
 	exfile_t    	*ef;		//!< Log file handler
+	exfile_writer_t	*writer;	//!< Writes entries queued by workers.
 } rlm_detail_t;
 
+typedef struct {
+	exfile_writer_thread_t	*writer;	//!< Our queue for the writer thread.
+} rlm_detail_thread_t;
+
 typedef struct {
 	fr_value_box_t	filename;	//!< File / path to write to.
 	tmpl_t		*filename_tmpl;	//!< tmpl used to expand filename (for debug output)
@@ -76,6 +84,8 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("locking", rlm_detail_t, locking), .dflt = "no" },
 	{ FR_CONF_OFFSET("escape_filenames", rlm_detail_t, escape), .dflt = "no" },
 	{ FR_CONF_OFFSET("log_packet_header", rlm_detail_t, log_srcdst), .dflt = "no" },
+	{ FR_CONF_OFFSET("buffered", rlm_detail_t, buffered), .dflt = "no" },
+	{ FR_CONF_OFFSET_SUBSECTION("buffer", 0, rlm_detail_t, buffer, exfile_writer_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -189,6 +199,48 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	if (inst->buffered) {
+		char prefix[100];
+
+		FR_INTEGER_BOUND_CHECK("buffer.entries", inst->buffer.num_entries, >=, 16);
+		FR_TIME_DELTA_BOUND_CHECK("buffer.flush_interval", inst->buffer.flush_interval,
+					  >=, fr_time_delta_from_msec(1));
+
+		snprintf(prefix, sizeof(prefix), "rlm_detail (%s)", mctx->mi->name);
+
+		inst->writer = exfile_writer_alloc(inst, &inst->buffer, prefix, inst->locking, inst->perm,
+						   inst->group_is_set ? inst->group : (gid_t)-1, false);
+		if (!inst->writer) {
+			cf_log_perr(conf, "Failed creating detail writer");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_detail_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_detail_t);
+	rlm_detail_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_detail_thread_t);
+
+	if (!inst->writer) return 0;
+
+	t->writer = exfile_writer_thread_alloc(inst->writer);
+	if (!t->writer) {
+		PERROR("Failed allocating detail writer queue");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_detail_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_detail_thread_t);
+
+	if (t->writer) exfile_writer_thread_free(t->writer);
+
 	return 0;
 }
 
@@ -325,6 +377,7 @@ static unlang_action_t CC_HINT(nonnull) detail_do(rlm_rcode_t *p_result, module_
 						  bool compat)
 {
 	rlm_detail_env_t	*env = talloc_get_type_abort(mctx->env_data, rlm_detail_env_t);
+	rlm_detail_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_detail_thread_t);
 	int			outfd, dupfd;
 	FILE			*outfp = NULL;
 
@@ -332,6 +385,41 @@ static unlang_action_t CC_HINT(nonnull) detail_do(rlm_rcode_t *p_result, module_
 
 	RDEBUG2("%s expands to %pV", env->filename_tmpl->name, &env->filename);
 
+	/*
+	 *	Format the entry in memory, and let the writer
+	 *	thread open the file and write it out.
+	 */
+	if (t->writer) {
+		char		*buff = NULL;
+		size_t		len = 0;
+		struct iovec	vector;
+		int		ret;
+
+		outfp = open_memstream(&buff, &len);
+		if (!outfp) {
+			RERROR("Failed allocating detail buffer: %s", fr_syserror(errno));
+			RETURN_MODULE_FAIL;
+		}
+
+		ret = detail_write(outfp, inst, request, &env->header, packet, list, compat, env->ht);
+		fclose(outfp);
+
+		/*
+		 *	Empty packets are skipped, and don't write anything.
+		 */
+		if ((ret == 0) && (len > 0)) {
+			vector.iov_base = buff;
+			vector.iov_len = len;
+
+			ret = exfile_writer_write(t->writer, env->filename.vb_strvalue, NULL, 0, &vector, 1);
+			if (ret < 0) RPERROR("Failed queueing write to %pV", &env->filename);
+		}
+		free(buff);
+
+		if (ret < 0) RETURN_MODULE_FAIL;
+		RETURN_MODULE_OK;
+	}
+
 	outfd = exfile_open(inst->ef, env->filename.vb_strvalue, inst->perm, NULL);
 	if (outfd < 0) {
 		RPERROR("Couldn't open file %pV", &env->filename);
@@ -506,7 +594,11 @@ module_rlm_t rlm_detail = {
 		.name		= "detail",
 		.inst_size	= sizeof(rlm_detail_t),
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_detail_thread_t),
+		.thread_inst_type	= "rlm_detail_thread_t",
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
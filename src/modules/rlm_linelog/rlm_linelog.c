@@ -122,6 +122,9 @@ typedef struct {
 		exfile_t		*ef;			//!< Exclusive file access handle.
 		bool			escape;			//!< Do filename escaping, yes / no.
 		bool			fsync;			//!< fsync after each write.
+		bool			buffered;		//!< Queue lines for a writer thread.
+		exfile_writer_config_t	buffer;			//!< Writer thread configuration.
+		exfile_writer_t		*writer;		//!< Writes lines queued by workers.
 	} file;
 
 	struct {
@@ -135,6 +138,10 @@ typedef struct {
 	CONF_SECTION		*cs;			//!< #CONF_SECTION to use as the root for #log_ref lookups.
 } rlm_linelog_t;
 
+typedef struct {
+	exfile_writer_thread_t	*writer;		//!< Our queue for the writer thread.
+} rlm_linelog_thread_t;
+
 typedef struct {
 	int			sockfd;			//!< File descriptor associated with socket
 } linelog_conn_t;
@@ -145,6 +152,8 @@ static const conf_parser_t file_config[] = {
 	{ FR_CONF_OFFSET("group", rlm_linelog_t, file.group_str) },
 	{ FR_CONF_OFFSET("escape_filenames", rlm_linelog_t, file.escape), .dflt = "no" },
 	{ FR_CONF_OFFSET("fsync", rlm_linelog_t, file.fsync), .dflt = "no" },
+	{ FR_CONF_OFFSET("buffered", rlm_linelog_t, file.buffered), .dflt = "no" },
+	{ FR_CONF_OFFSET_SUBSECTION("buffer", 0, rlm_linelog_t, file.buffer, exfile_writer_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -360,7 +369,7 @@ static void linelog_hexdump(request_t *request, struct iovec *vector_p, size_t v
 	RHEXDUMP3(fr_dbuff_start(agg), fr_dbuff_used(agg), "%s", msg);
 }
 
-static int linelog_write(rlm_linelog_t const *inst, linelog_call_env_t const *call_env, request_t *request, struct iovec *vector_p, size_t vector_len, bool with_delim)
+static int linelog_write(rlm_linelog_t const *inst, rlm_linelog_thread_t *t, linelog_call_env_t const *call_env, request_t *request, struct iovec *vector_p, size_t vector_len, bool with_delim)
 {
 	int 			ret = 0;
 	linelog_conn_t		*conn;
@@ -384,6 +393,37 @@ static int linelog_write(rlm_linelog_t const *inst, linelog_call_env_t const *ca
 
 		path = call_env->filename->vb_strvalue;
 
+		/*
+		 *	Copy the line into our queue, the writer
+		 *	thread opens the file and writes it out.
+		 */
+		if (t->writer) {
+			struct iovec	head_vector_s[2];
+			size_t		head_vector_len = 0;
+
+			if (call_env->log_head) {
+				memcpy(&head_vector_s[0].iov_base, &call_env->log_head->vb_strvalue, sizeof(head_vector_s[0].iov_base));
+				head_vector_s[0].iov_len = call_env->log_head->vb_length;
+				head_vector_len++;
+
+				if (with_delim) {
+					memcpy(&head_vector_s[1].iov_base, &(inst->delimiter),
+					       sizeof(head_vector_s[1].iov_base));
+					head_vector_s[1].iov_len = inst->delimiter_len;
+					head_vector_len++;
+				}
+			}
+
+			if (RDEBUG_ENABLED3) linelog_hexdump(request, vector_p, vector_len, "linelog data");
+
+			ret = exfile_writer_write(t->writer, path, head_vector_s, head_vector_len, vector_p, vector_len);
+			if (ret < 0) {
+				RPERROR("Failed queueing write to \"%pV\"", call_env->filename);
+				return -1;
+			}
+			break;
+		}
+
 		/* check path and eventually create subdirs */
 		p = strrchr(path, '/');
 		if (p) {
@@ -598,7 +638,7 @@ static xlat_action_t linelog_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		vector[i].iov_len = inst->delimiter_len;
 		i++;
 	}
-	slen = linelog_write(inst, call_env, request, vector, i, with_delim);
+	slen = linelog_write(inst, xctx->mctx->thread, call_env, request, vector, i, with_delim);
 	if (slen < 0) return XLAT_ACTION_FAIL;
 
 	MEM(wrote = fr_value_box_alloc(ctx, FR_TYPE_SIZE, NULL));
@@ -667,7 +707,7 @@ static unlang_action_t CC_HINT(nonnull) mod_do_linelog_resume(rlm_rcode_t *p_res
 		}
 	}
 
-	RETURN_MODULE_RCODE(linelog_write(inst, call_env, request, vector, vector_len, rctx->with_delim) < 0 ? RLM_MODULE_FAIL : RLM_MODULE_OK);
+	RETURN_MODULE_RCODE(linelog_write(inst, mctx->thread, call_env, request, vector, vector_len, rctx->with_delim) < 0 ? RLM_MODULE_FAIL : RLM_MODULE_OK);
 }
 
 /** Write a linelog message
@@ -853,7 +893,7 @@ build_vector:
 			RDEBUG2("No data to write");
 			rcode = RLM_MODULE_NOOP;
 		} else {
-			rcode = linelog_write(inst, call_env, request, vector_p, vector_len, with_delim) < 0 ? RLM_MODULE_FAIL : RLM_MODULE_OK;
+			rcode = linelog_write(inst, mctx->thread, call_env, request, vector_p, vector_len, with_delim) < 0 ? RLM_MODULE_FAIL : RLM_MODULE_OK;
 		}
 
 		talloc_free(vpt);
@@ -967,6 +1007,21 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 				}
 			}
 		}
+
+		if (inst->file.buffered) {
+			FR_INTEGER_BOUND_CHECK("file.buffer.entries", inst->file.buffer.num_entries, >=, 16);
+			FR_TIME_DELTA_BOUND_CHECK("file.buffer.flush_interval", inst->file.buffer.flush_interval,
+						  >=, fr_time_delta_from_msec(1));
+
+			inst->file.writer = exfile_writer_alloc(inst, &inst->file.buffer, prefix, true,
+								inst->file.permissions,
+								inst->file.group_str ? inst->file.group : (gid_t)-1,
+								inst->file.fsync);
+			if (!inst->file.writer) {
+				cf_log_perr(conf, "Failed creating log writer");
+				return -1;
+			}
+		}
 	}
 		break;
 
@@ -1036,6 +1091,31 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	return 0;
 }
 
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_linelog_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_linelog_t);
+	rlm_linelog_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_linelog_thread_t);
+
+	if (!inst->file.writer) return 0;
+
+	t->writer = exfile_writer_thread_alloc(inst->file.writer);
+	if (!t->writer) {
+		PERROR("Failed allocating log writer queue");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_linelog_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_linelog_thread_t);
+
+	if (t->writer) exfile_writer_thread_free(t->writer);
+
+	return 0;
+}
+
 static int mod_bootstrap(module_inst_ctx_t const *mctx)
 {
 	xlat_t *xlat;
@@ -1064,7 +1144,11 @@ module_rlm_t rlm_linelog = {
 		.config		= module_config,
 		.bootstrap	= mod_bootstrap,
 		.instantiate	= mod_instantiate,
-		.detach		= mod_detach
+		.detach		= mod_detach,
+		.thread_inst_size	= sizeof(rlm_linelog_thread_t),
+		.thread_inst_type	= "rlm_linelog_thread_t",
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
@@ -409,7 +409,7 @@ static int _lua_pair_set(lua_State *L)
 	 *	else we add a new VP to the list.
 	 */
 	if (vp) {
-		fr_dcursor_replace(&cursor, new);
+		fr_pair_replace(&request->request_pairs, vp, new);
 	} else {
 		fr_dcursor_append(&cursor, new);
 	}
@@ -92,6 +92,8 @@ typedef struct udp_request_s udp_request_t;
 typedef struct {
 	struct iovec		out;			//!< Describes buffer to send.
 	trunk_request_t	*treq;				//!< Used for signalling.
+	bool			sign;			//!< Packet was encoded for this batch, and still
+							///< needs signing.
 } udp_coalesced_t;
 
 /** Track the handle, which is tightly correlated with the FD
@@ -105,6 +107,7 @@ typedef struct {
 
 	struct mmsghdr		*mmsgvec;		//!< Vector of inbound/outbound packets.
 	udp_coalesced_t		*coalesced;		//!< Outbound coalesced requests.
+	fr_radius_batch_t	*sign;			//!< Outbound coalesced requests to sign.
 
 	size_t			send_buff_actual;	//!< What we believe the maximum SO_SNDBUF size to be.
 							///< We don't try and encode more packet data than this
@@ -251,7 +254,7 @@ static rlm_rcode_t radius_code_to_rcode[FR_RADIUS_CODE_MAX] = {
 static void		conn_writable_status_check(UNUSED fr_event_list_t *el, UNUSED int fd,
 						   UNUSED int flags, void *uctx);
 
-static int 		encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_t *u, uint8_t id);
+static int 		encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_t *u, uint8_t id, bool sign);
 
 static decode_fail_t	decode(TALLOC_CTX *ctx, fr_pair_list_t *reply, uint8_t *response_code,
 			       udp_handle_t *h, request_t *request, udp_request_t *u,
@@ -640,7 +643,7 @@ static void conn_writable_status_check(fr_event_list_t *el, UNUSED int fd, UNUSE
 	DEBUG("%s - Sending %s ID %d over connection %s",
 	      h->module_name, fr_radius_packet_name[u->code], u->id, h->name);
 
-	if (encode(h->inst, h->status_request, u, u->id) < 0) {
+	if (encode(h->inst, h->status_request, u, u->id, true) < 0) {
 	fail:
 		connection_signal_reconnect(conn, CONNECTION_FAILED);
 		return;
@@ -734,6 +737,7 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 	 */
 	h->mmsgvec = talloc_zero_array(h, struct mmsghdr, h->inst->max_send_coalesce);
 	h->coalesced = talloc_zero_array(h, udp_coalesced_t, h->inst->max_send_coalesce);
+	h->sign = talloc_zero_array(h, fr_radius_batch_t, h->inst->max_send_coalesce);
 	for (i = 0; i < h->inst->max_send_coalesce; i++) {
 		h->mmsgvec[i].msg_hdr.msg_iov = &h->coalesced[i].out;
 		h->mmsgvec[i].msg_hdr.msg_iovlen = 1;
@@ -1206,7 +1210,7 @@ static decode_fail_t decode(TALLOC_CTX *ctx, fr_pair_list_t *reply, uint8_t *res
 	return DECODE_FAIL_NONE;
 }
 
-static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_t *u, uint8_t id)
+static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_t *u, uint8_t id, bool sign)
 {
 	ssize_t			packet_len;
 	fr_radius_encode_ctx_t	encode_ctx;
@@ -1309,8 +1313,10 @@ static int encode(rlm_radius_udp_t const *inst, request_t *request, udp_request_
 
 	/*
 	 *	Now that we're done mangling the packet, sign it.
+	 *	Unless the caller is going to sign it along with
+	 *	other packets.
 	 */
-	if (fr_radius_sign(u->packet, NULL, (uint8_t const *) inst->secret,
+	if (sign && fr_radius_sign(u->packet, NULL, (uint8_t const *) inst->secret,
 			   talloc_array_length(inst->secret) - 1) < 0) {
 		RERROR("Failed signing packet");
 		goto error;
@@ -1580,7 +1586,7 @@ static void request_mux(fr_event_list_t *el,
 	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
 	rlm_radius_udp_t const	*inst = h->inst;
 	int			sent;
-	uint16_t		i, queued;
+	uint16_t		i, j, queued, to_sign;
 	size_t			total_len = 0;
 
 	/*
@@ -1641,7 +1647,7 @@ static void request_mux(fr_event_list_t *el,
 			RDEBUG("Sending %s ID %d length %ld over connection %s",
 			       fr_radius_packet_name[u->code], u->id, u->packet_len, h->name);
 
-			if (encode(h->inst, request, u, u->id) < 0) {
+			if (encode(h->inst, request, u, u->id, false) < 0) {
 				/*
 				 *	Need to do this because request_conn_release
 				 *	may not be called.
@@ -1651,14 +1657,10 @@ static void request_mux(fr_event_list_t *el,
 				trunk_request_signal_fail(treq);
 				continue;
 			}
-			RHEXDUMP3(u->packet, u->packet_len, "Encoded packet");
-
-			/*
-			 *	Remember the authentication vector, which now has the
-			 *	packet signature.
-			 */
-			(void) radius_track_entry_update(u->rr, u->packet + RADIUS_AUTH_VECTOR_OFFSET);
+			h->coalesced[queued].sign = true;
 		} else {
+			h->coalesced[queued].sign = false;
+
 			RDEBUG("Retransmitting %s ID %d length %ld over connection %s",
 			       fr_radius_packet_name[u->code], u->id, u->packet_len, h->name);
 		}
@@ -1696,6 +1698,56 @@ static void request_mux(fr_event_list_t *el,
 	}
 	if (queued == 0) return;	/* No work */
 
+	/*
+	 *	Sign the newly encoded packets together, so their
+	 *	digests can be calculated in parallel.
+	 */
+	for (i = 0, to_sign = 0; i < queued; i++) {
+		udp_request_t		*u;
+
+		if (!h->coalesced[i].sign) continue;
+
+		u = talloc_get_type_abort(h->coalesced[i].treq->preq, udp_request_t);
+		h->sign[to_sign++] = (fr_radius_batch_t) {
+			.packet = u->packet,
+			.secret = (uint8_t const *) inst->secret,
+			.secret_len = talloc_array_length(inst->secret) - 1
+		};
+	}
+	if (to_sign > 0) (void) fr_radius_sign_batch(h->sign, to_sign);
+
+	/*
+	 *	Fail any packets we couldn't sign, and close up
+	 *	the gaps they leave in the coalesced array.
+	 */
+	for (i = 0, j = 0, to_sign = 0; i < queued; i++) {
+		trunk_request_t		*treq = h->coalesced[i].treq;
+		udp_request_t		*u = talloc_get_type_abort(treq->preq, udp_request_t);
+		request_t		*request = treq->request;
+
+		if (h->coalesced[i].sign) {
+			if (h->sign[to_sign++].rcode < 0) {
+				RERROR("Failed signing packet");
+				udp_request_reset(u);
+				if (u->ev) (void) fr_event_timer_delete(&u->ev);
+				trunk_request_signal_fail(treq);
+				continue;
+			}
+			RHEXDUMP3(u->packet, u->packet_len, "Encoded packet");
+
+			/*
+			 *	Remember the authentication vector, which now has the
+			 *	packet signature.
+			 */
+			(void) radius_track_entry_update(u->rr, u->packet + RADIUS_AUTH_VECTOR_OFFSET);
+		}
+
+		if (i != j) h->coalesced[j] = h->coalesced[i];
+		j++;
+	}
+	queued = j;
+	if (queued == 0) return;
+
 	/*
 	 *	Verify nothing accidentally freed the connection handle
 	 */
@@ -1862,7 +1914,7 @@ static void request_mux_replicate(UNUSED fr_event_list_t *el,
 		if (!u->packet) {
 			u->id = h->last_id++;
 
-			if (encode(h->inst, request, u, u->id) < 0) {
+			if (encode(h->inst, request, u, u->id, true) < 0) {
 				trunk_request_signal_fail(treq);
 				continue;
 			}
@@ -669,6 +669,7 @@ static void sql_trunk_request_mux(UNUSED fr_event_list_t *el, trunk_connection_t
 	}
 
 	trunk_request_signal_reapable(treq);
+	if (request) unlang_interpret_mark_runnable(request);
 }
 
 static unlang_action_t sql_query_resume(rlm_rcode_t *p_result, UNUSED int *priority, UNUSED request_t *request, void *uctx)
@@ -679,13 +680,15 @@ static unlang_action_t sql_query_resume(rlm_rcode_t *p_result, UNUSED int *prior
 	RETURN_MODULE_FAIL;
 }
 
-static void sql_request_fail(UNUSED request_t *request, void *preq, UNUSED void *rctx,
+static void sql_request_fail(request_t *request, void *preq, UNUSED void *rctx,
 			     UNUSED trunk_request_state_t state, UNUSED void *uctx)
 {
 	fr_sql_query_t		*query_ctx = talloc_get_type_abort(preq, fr_sql_query_t);
 
 	query_ctx->treq = NULL;
 	query_ctx->rcode = RLM_SQL_ERROR;
+
+	if (request) unlang_interpret_mark_runnable(request);
 }
 
 static void sql_request_complete(UNUSED request_t *request, void *preq, UNUSED void *rctx, UNUSED void *uctx)
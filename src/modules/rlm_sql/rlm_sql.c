@@ -53,6 +53,16 @@ typedef struct {
 	fr_dict_attr_t const *group_da;
 } rlm_sql_boot_t;
 
+static const conf_parser_t batch_config[] = {
+	{ FR_CONF_OFFSET("size", rlm_sql_config_t, batch_size), .dflt = "0" },
+	{ FR_CONF_OFFSET("window", rlm_sql_config_t, batch_window), .dflt = "0.01" },
+	{ FR_CONF_OFFSET("begin", rlm_sql_config_t, batch_begin), .dflt = "BEGIN" },
+	{ FR_CONF_OFFSET("commit", rlm_sql_config_t, batch_commit), .dflt = "COMMIT" },
+	{ FR_CONF_OFFSET("rollback", rlm_sql_config_t, batch_rollback), .dflt = "ROLLBACK" },
+
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_TYPE_FLAGS("driver", FR_TYPE_VOID, 0, rlm_sql_t, driver_submodule), .dflt = "null",
 			 .func = submodule_parse },
@@ -74,6 +84,10 @@ static const conf_parser_t module_config[] = {
 	 */
 	{ FR_CONF_OFFSET("query_timeout", rlm_sql_config_t, query_timeout) },
 
+	{ FR_CONF_POINTER("batch", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) batch_config },
+
+	{ FR_CONF_OFFSET("coalesce_selects", rlm_sql_config_t, coalesce_selects), .dflt = "no" },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -236,6 +250,7 @@ typedef struct {
 	fr_value_box_list_t		query;		//!< Where expanded query tmpl will be written.
 	fr_value_box_t			*query_vb;	//!< Current query string.
 	fr_sql_query_t			*query_ctx;	//!< Query context for current query.
+	unlang_function_t		query_func;	//!< Function used to run each query.
 } sql_redundant_ctx_t;
 
 typedef struct {
@@ -692,8 +707,8 @@ static unlang_action_t mod_map_resume(rlm_rcode_t *p_result, UNUSED int *priorit
 	/*
 	 *	Not every driver provides an sql_num_rows function
 	 */
-	if (inst->driver->sql_num_rows) {
-		ret = inst->driver->sql_num_rows(query_ctx, &inst->config);
+	if (query_ctx->shared || inst->driver->sql_num_rows) {
+		ret = rlm_sql_num_rows(query_ctx);
 		if (ret == 0) {
 			RDEBUG2("Server returned an empty result");
 			rcode = RLM_MODULE_NOTFOUND;
@@ -713,7 +728,7 @@ static unlang_action_t mod_map_resume(rlm_rcode_t *p_result, UNUSED int *priorit
 	/*
 	 *	Map proc only registered if driver provides an sql_fields function
 	 */
-	ret = (inst->driver->sql_fields)(&fields, query_ctx, &inst->config);
+	ret = rlm_sql_fields(&fields, query_ctx);
 	if (ret != RLM_SQL_OK) {
 		RERROR("Failed retrieving field names: %s", fr_table_str_by_value(sql_rcode_description_table, ret, "<INVALID>"));
 		goto error;
@@ -1785,7 +1800,7 @@ static unlang_action_t mod_sql_redundant_query_resume(rlm_rcode_t *p_result, UNU
 	 *	We need to have updated something for the query to have been
 	 *	counted as successful.
 	 */
-	numaffected = (inst->driver->sql_affected_rows)(query_ctx, &inst->config);
+	numaffected = rlm_sql_affected_rows(query_ctx);
 	TALLOC_FREE(query_ctx);
 	RDEBUG2("%i record(s) updated", numaffected);
 
@@ -1834,15 +1849,18 @@ static unlang_action_t mod_sql_redundant_resume(rlm_rcode_t *p_result, UNUSED in
 
 	if (unlang_function_repeat_set(request, mod_sql_redundant_query_resume) < 0) RETURN_MODULE_FAIL;
 
-	return unlang_function_push(request, inst->query, NULL, NULL, 0, UNLANG_SUB_FRAME, redundant_ctx->query_ctx);
+	return unlang_function_push(request, redundant_ctx->query_func, NULL, NULL, 0, UNLANG_SUB_FRAME, redundant_ctx->query_ctx);
 }
 
 /**  Generic module call for failing between a bunch of queries.
  *
- * Used for `accounting` and `send` module calls
- *
+ * @param[out] p_result		Result of the module call.
+ * @param[in] mctx		Module calling context.
+ * @param[in] request		Current request.
+ * @param[in] query_func	Function used to run each query.
  */
-static unlang_action_t CC_HINT(nonnull) mod_sql_redundant(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+static unlang_action_t sql_redundant(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request,
+				     unlang_function_t query_func)
 {
 	rlm_sql_t const			*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_sql_t);
 	rlm_sql_thread_t		*thread = talloc_get_type_abort(mctx->thread, rlm_sql_thread_t);
@@ -1863,7 +1881,8 @@ static unlang_action_t CC_HINT(nonnull) mod_sql_redundant(rlm_rcode_t *p_result,
 		.request = request,
 		.trunk = thread->trunk,
 		.call_env = call_env,
-		.query_no = 0
+		.query_no = 0,
+		.query_func = query_func
 	};
 	talloc_set_destructor(redundant_ctx, sql_redundant_ctx_free);
 
@@ -1886,6 +1905,28 @@ static unlang_action_t CC_HINT(nonnull) mod_sql_redundant(rlm_rcode_t *p_result,
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
 
+/** Run `send` queries, failing over between them
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_sql_redundant(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_sql_t const *inst = talloc_get_type_abort_const(mctx->mi->data, rlm_sql_t);
+
+	return sql_redundant(p_result, mctx, request, inst->query);
+}
+
+/** Run `accounting` queries, failing over between them
+ *
+ * If batching is enabled, the queries are run in transactions containing
+ * queries from multiple requests.
+ */
+static unlang_action_t CC_HINT(nonnull) mod_accounting(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_sql_t const *inst = talloc_get_type_abort_const(mctx->mi->data, rlm_sql_t);
+
+	return sql_redundant(p_result, mctx, request, (inst->config.batch_size > 1) ? rlm_sql_batch_query : inst->query);
+}
+
 static int logfile_call_env_parse(TALLOC_CTX *ctx, call_env_parsed_head_t *out, tmpl_rules_t const *t_rules,
 				  CONF_ITEM *ci,
 				  call_env_ctx_t const *cec, UNUSED call_env_parser_t const *rule)
@@ -2103,12 +2144,33 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	 */
 	inst->sql_user = attr_sql_user_name;
 
+	/*
+	 *	Batches are run on a single trunk connection.
+	 */
+	if ((inst->config.batch_size > 1) && !inst->driver->uses_trunks) {
+		cf_log_warn(conf, "Ignoring batch.size, as driver \"%s\" does not support trunks",
+			    inst->driver_submodule->name);
+		inst->config.batch_size = 0;
+	}
+	FR_INTEGER_BOUND_CHECK("batch.size", inst->config.batch_size, <=, 10000);
+	FR_TIME_DELTA_BOUND_CHECK("batch.window", inst->config.batch_window, <=, fr_time_delta_from_sec(1));
+
+	/*
+	 *	Selects are only shared between requests using
+	 *	the same trunk.
+	 */
+	if (inst->config.coalesce_selects && !inst->driver->uses_trunks) {
+		cf_log_warn(conf, "Ignoring coalesce_selects, as driver \"%s\" does not support trunks",
+			    inst->driver_submodule->name);
+		inst->config.coalesce_selects = false;
+	}
+
 	/*
 	 *	Export these methods, too.  This avoids RTDL_GLOBAL.
 	 */
 	if (inst->driver->uses_trunks) {
 		inst->query		= rlm_sql_trunk_query;
-		inst->select		= rlm_sql_trunk_query;
+		inst->select		= inst->config.coalesce_selects ? rlm_sql_shared_select : rlm_sql_trunk_query;
 	} else {
 		inst->query		= rlm_sql_query;
 		inst->select		= rlm_sql_select_query;
@@ -2417,7 +2479,7 @@ module_rlm_t rlm_sql = {
 			/*
 			 *	Hack to support old configurations
 			 */
-			{ .section = SECTION_NAME("accounting", CF_IDENT_ANY), .method = mod_sql_redundant, .method_env = &accounting_method_env },
+			{ .section = SECTION_NAME("accounting", CF_IDENT_ANY), .method = mod_accounting, .method_env = &accounting_method_env },
 			{ .section = SECTION_NAME("authorize", CF_IDENT_ANY), .method = mod_authorize, .method_env = &authorize_method_env },
 
 			{ .section = SECTION_NAME("recv", CF_IDENT_ANY), .method = mod_authorize, .method_env = &authorize_method_env },
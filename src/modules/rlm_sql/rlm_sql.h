@@ -97,10 +97,25 @@ typedef struct {
 								//!< new connection.
 
 	trunk_conf_t		trunk_conf;			//!< Configuration for trunk connections.
+
+	uint32_t		batch_size;			//!< Maximum number of accounting queries to run
+								///< in a single transaction.  0 or 1 disables batching.
+	fr_time_delta_t		batch_window;			//!< How long to wait for a batch to fill.
+	char const		*batch_begin;			//!< Query used to start a batch transaction.
+	char const		*batch_commit;			//!< Query used to commit a batch transaction.
+	char const		*batch_rollback;		//!< Query used to abandon a batch transaction.
+
+	bool			coalesce_selects;		//!< If an identical select is already in progress on
+								///< the same thread, wait for its results instead of
+								///< running another.
 } rlm_sql_config_t;
 
 typedef struct sql_inst rlm_sql_t;
 
+typedef struct fr_sql_batch_s fr_sql_batch_t;
+typedef struct fr_sql_batch_entry_s fr_sql_batch_entry_t;
+typedef struct fr_sql_shared_select_s fr_sql_shared_select_t;
+
 /*
  *	Per-thread instance data structure
  */
@@ -108,6 +123,9 @@ typedef struct {
 	trunk_t		*trunk;				//!< Trunk connection for this thread.
 	rlm_sql_t const		*inst;				//!< Module instance data.
 	void			*sql_escape_arg;		//!< Thread specific argument to be passed to escape function.
+	fr_sql_batch_t		*batch;				//!< Batch currently accepting accounting queries.
+	fr_rb_tree_t		*selects;			//!< Selects in progress which other requests can
+								///< wait on.  Only used if coalesce_selects is set.
 } rlm_sql_thread_t;
 
 typedef struct {
@@ -145,6 +163,15 @@ typedef struct {
 	fr_sql_query_status_t	status;				//!< Status of the query.
 	sql_rcode_t		rcode;				//!< Result code.
 	rlm_sql_row_t		row;				//!< Row data from the last query.
+	fr_sql_batch_entry_t	*batch_entry;			//!< Batch entry, if the query is waiting on a batch.
+	bool			in_transaction;			//!< A transaction is open on the query's connection.
+								///< If the query is abandoned, the connection is closed
+								///< so the transaction isn't left open.
+	int			affected_rows;			//!< Rows affected, if the query was run as part of
+								///< a batch.  -1 otherwise.
+	fr_sql_shared_select_t	*shared;			//!< Identical select this query is sharing rows with.
+	fr_dlist_t		shared_entry;			//!< Entry in the list of queries sharing rows.
+	size_t			shared_row;			//!< Next shared row to return.
 } fr_sql_query_t;
 
 /** Context used when fetching attribute value pairs as a map list
@@ -262,7 +289,12 @@ void 		rlm_sql_query_log(rlm_sql_t const *inst, char const *filename, char const
 unlang_action_t rlm_sql_select_query(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx);
 unlang_action_t	rlm_sql_query(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx);
 unlang_action_t rlm_sql_trunk_query(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx);
+unlang_action_t rlm_sql_batch_query(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx);
+unlang_action_t rlm_sql_shared_select(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx);
 unlang_action_t rlm_sql_fetch_row(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx);
+int		rlm_sql_affected_rows(fr_sql_query_t *query_ctx);
+int		rlm_sql_num_rows(fr_sql_query_t *query_ctx);
+sql_rcode_t	rlm_sql_fields(char const **out[], fr_sql_query_t *query_ctx);
 void		rlm_sql_print_error(rlm_sql_t const *inst, request_t *request, fr_sql_query_t *query_ctx, bool force_debug);
 fr_sql_query_t *fr_sql_query_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, request_t *request, rlm_sql_handle_t *handle, trunk_t *trunk, char const *query_str, fr_sql_query_type_t type);
 
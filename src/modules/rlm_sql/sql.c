@@ -290,6 +290,26 @@ static int sql_pair_afrom_row(TALLOC_CTX *ctx, request_t *request, fr_pair_list_
 }
 #endif
 
+/** A select which is in progress, and the identical selects waiting on its rows
+ *
+ * Only the leader's query is run.  Once it completes, all the rows are copied
+ * out of the driver, so each query sharing them can fetch them in its own time,
+ * without needing a connection.
+ */
+struct fr_sql_shared_select_s {
+	fr_rb_node_t		node;				//!< Entry in the thread's tree of selects in progress.
+	rlm_sql_thread_t	*thread;			//!< Thread the select is being run on.
+	char const		*query_str;			//!< Copy of the query, so it outlives the leader.
+	fr_sql_query_t		*leader;			//!< Query which is run on the trunk.
+								///< NULL once the rows have been copied.
+	bool			submitted;			//!< The leader's query has been submitted.
+	fr_dlist_head_t		queries;			//!< All queries sharing the rows, including the leader.
+	sql_rcode_t		rcode;				//!< Result of the select.
+	char const		**fields;			//!< Field names of the result.
+	rlm_sql_row_t		*rows;				//!< Rows copied from the driver.
+	size_t			num_rows;			//!< How many rows were copied.
+};
+
 /** Call the driver's sql_fetch_row function
  *
  * Calls the driver's sql_fetch_row logging any errors. On success, will
@@ -310,6 +330,24 @@ unlang_action_t rlm_sql_fetch_row(rlm_rcode_t *p_result, UNUSED int *priority, r
 	fr_sql_query_t	*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
 	rlm_sql_t const	*inst = query_ctx->inst;
 
+	/*
+	 *	The rows were copied out of the driver when
+	 *	the select completed.
+	 */
+	if (query_ctx->shared) {
+		fr_sql_shared_select_t const *shared = query_ctx->shared;
+
+		if (query_ctx->shared_row >= shared->num_rows) {
+			query_ctx->row = NULL;
+			query_ctx->rcode = RLM_SQL_NO_MORE_ROWS;
+			RETURN_MODULE_OK;
+		}
+
+		query_ctx->row = shared->rows[query_ctx->shared_row++];
+		query_ctx->rcode = RLM_SQL_OK;
+		RETURN_MODULE_OK;
+	}
+
 	if ((inst->driver->uses_trunks && !query_ctx->tconn) ||
 	    (!inst->driver->uses_trunks && (!query_ctx->handle || !query_ctx->handle->conn))) {
 		ROPTIONAL(RERROR, ERROR, "Invalid connection");
@@ -356,7 +394,15 @@ void rlm_sql_print_error(rlm_sql_t const *inst, request_t *request, fr_sql_query
 	size_t		num, i;
 	TALLOC_CTX	*log_ctx = talloc_new(NULL);
 
-	num = (inst->driver->sql_error)(log_ctx, log, (NUM_ELEMENTS(log)), query_ctx, &inst->config);
+	/*
+	 *	Queries which waited on the results of an
+	 *	identical select have no connection to ask.
+	 */
+	if (inst->driver->uses_trunks && !query_ctx->tconn) {
+		num = 0;
+	} else {
+		num = (inst->driver->sql_error)(log_ctx, log, (NUM_ELEMENTS(log)), query_ctx, &inst->config);
+	}
 	if (num == 0) {
 		ROPTIONAL(RERROR, ERROR, "Unknown error");
 		talloc_free(log_ctx);
@@ -390,12 +436,20 @@ void rlm_sql_print_error(rlm_sql_t const *inst, request_t *request, fr_sql_query
 	talloc_free(log_ctx);
 }
 
+static void sql_batch_entry_detach(fr_sql_query_t *query_ctx);
+static void sql_shared_select_leave(fr_sql_query_t *query_ctx);
+
 /** Automatically run the correct `finish` function when freeing an SQL query
  *
  * And mark any associated trunk request as complete.
  */
 static int fr_sql_query_free(fr_sql_query_t *to_free)
 {
+	trunk_connection_t *tconn = NULL;
+
+	if (to_free->batch_entry) sql_batch_entry_detach(to_free);
+	if (to_free->shared) sql_shared_select_leave(to_free);
+	if (to_free->in_transaction && to_free->treq) tconn = to_free->treq->pub.tconn;
 	if (to_free->status > 0) {
 		if (to_free->type == SQL_QUERY_SELECT) {
 			(to_free->inst->driver->sql_finish_select_query)(to_free, &to_free->inst->config);
@@ -404,6 +458,13 @@ static int fr_sql_query_free(fr_sql_query_t *to_free)
 		}
 	}
 	if (to_free->treq) trunk_request_signal_complete(to_free->treq);
+
+	/*
+	 *	Nothing is going to commit or roll back the
+	 *	transaction, so close the connection rather
+	 *	than leave it open for the next query.
+	 */
+	if (tconn) trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
 	return 0;
 }
 
@@ -421,7 +482,8 @@ fr_sql_query_t *fr_sql_query_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, reque
 		.request = request,
 		.trunk = trunk,
 		.query_str = query_str,
-		.type = type
+		.type = type,
+		.affected_rows = -1
 	};
 	talloc_set_destructor(query, fr_sql_query_free);
 	return query;
@@ -546,10 +608,13 @@ static unlang_action_t sql_trunk_query_start(UNUSED rlm_rcode_t *p_result, UNUSE
  */
 static void sql_trunk_query_cancel(UNUSED request_t *request, UNUSED fr_signal_t action, void *uctx)
 {
-	fr_sql_query_t	*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	fr_sql_query_t		*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	trunk_connection_t	*tconn;
 
 	if (!query_ctx->treq) return;
 
+	tconn = query_ctx->treq->pub.tconn;
+
 	/*
 	 *	The query_ctx needs to be parented by the treq so that it still exists
 	 *	when the cancel_mux callback is run.
@@ -559,6 +624,15 @@ static void sql_trunk_query_cancel(UNUSED request_t *request, UNUSED fr_signal_t
 	trunk_request_signal_cancel(query_ctx->treq);
 
 	query_ctx->treq = NULL;
+
+	/*
+	 *	The transaction can't be rolled back without
+	 *	the request, so close the connection instead.
+	 */
+	if (query_ctx->in_transaction) {
+		query_ctx->in_transaction = false;
+		if (tconn) trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
+	}
 }
 
 /** Submit an SQL query using a trunk connection.
@@ -576,6 +650,13 @@ unlang_action_t rlm_sql_trunk_query(rlm_rcode_t *p_result, UNUSED int *priority,
 
 	fr_assert(query_ctx->trunk);
 
+	/*
+	 *	The query context is being reused for a
+	 *	different query, so it no longer needs the
+	 *	shared rows.
+	 */
+	if (query_ctx->shared && (query_ctx->shared->leader != query_ctx)) sql_shared_select_leave(query_ctx);
+
 	/* There's no query to run, return an error */
 	if (query_ctx->query_str[0] == '\0') {
 		if (request) REDEBUG("Zero length query");
@@ -626,6 +707,612 @@ unlang_action_t rlm_sql_trunk_query(rlm_rcode_t *p_result, UNUSED int *priority,
 	}
 }
 
+/** State of a batch of accounting queries
+ */
+typedef enum {
+	SQL_BATCH_COLLECTING = 0,				//!< Accepting new queries.
+	SQL_BATCH_READY,					//!< Full, or the window expired, waiting for
+								///< the leader to run it.
+	SQL_BATCH_BEGIN,					//!< Starting the transaction.
+	SQL_BATCH_QUERY,					//!< Running the queries.
+	SQL_BATCH_COMMIT,					//!< Committing the transaction.
+	SQL_BATCH_ROLLBACK					//!< Abandoning the transaction.
+} fr_sql_batch_state_t;
+
+/** A query waiting on, or run as part of, a batch
+ */
+struct fr_sql_batch_entry_s {
+	fr_dlist_t		entry;				//!< Entry in the batch's list of queries.
+	fr_sql_batch_t		*batch;				//!< Batch this query is part of.
+	fr_sql_query_t		*query_ctx;			//!< Query context of the request.  NULL if the request
+								///< has gone away.
+	char const		*query_str;			//!< Copy of the query, so it outlives the request.
+	int			affected_rows;			//!< Rows affected by this query.
+};
+
+/** Accounting queries from multiple requests, run in a single transaction
+ *
+ * The first request to add a query to the batch is the leader.  Every
+ * request yields until the batch is complete, with the leader being
+ * resumed once the batch is full, or the batch window expires, to run
+ * all the queries in the batch on a single connection, between the
+ * configured begin and commit queries.
+ *
+ * If any query fails, the transaction is rolled back, and every request
+ * runs its own query individually, so errors, and alternative queries,
+ * are handled the same as if batching were disabled.
+ */
+struct fr_sql_batch_s {
+	rlm_sql_t const		*inst;				//!< Module instance for this batch.
+	rlm_sql_thread_t	*thread;			//!< Thread this batch belongs to.
+	fr_sql_batch_state_t	state;				//!< What the batch is doing.
+	fr_dlist_head_t		entries;			//!< Queries in the batch, in the order they were added.
+	fr_sql_batch_entry_t	*leader;			//!< Entry whose request runs the batch.
+	fr_sql_batch_entry_t	*current;			//!< Entry whose query is being run.
+	fr_sql_query_t		*query_ctx;			//!< Used to run every query in the batch, so they're
+								///< all run on the same connection.
+	fr_event_timer_t const	*ev;				//!< Fires when the batch window expires.
+};
+
+/** Stop accepting queries, and resume the leader to run the batch
+ */
+static void sql_batch_ready(fr_sql_batch_t *batch)
+{
+	if (batch->state != SQL_BATCH_COLLECTING) return;
+
+	if (batch->thread->batch == batch) batch->thread->batch = NULL;
+	if (batch->ev) fr_event_timer_delete(&batch->ev);
+
+	batch->state = SQL_BATCH_READY;
+	unlang_interpret_mark_runnable(batch->leader->query_ctx->request);
+}
+
+/** The batch window expired before the batch was full
+ */
+static void _sql_batch_window_expired(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	sql_batch_ready(talloc_get_type_abort(uctx, fr_sql_batch_t));
+}
+
+/** Resume all the requests waiting on a batch, and free it
+ *
+ * @param[in] batch		to release.
+ * @param[in] committed		If true, every query in the batch succeeded, and the
+ *				requests are given their results.  If false, each request
+ *				runs its query individually.
+ */
+static void sql_batch_release(fr_sql_batch_t *batch, bool committed)
+{
+	fr_sql_batch_entry_t	*entry = NULL;
+
+	if (batch->thread->batch == batch) batch->thread->batch = NULL;
+
+	while ((entry = fr_dlist_next(&batch->entries, entry))) {
+		fr_sql_query_t *query_ctx = entry->query_ctx;
+
+		if (!query_ctx) continue;
+
+		query_ctx->batch_entry = NULL;
+		if (committed) {
+			query_ctx->rcode = RLM_SQL_OK;
+			query_ctx->affected_rows = entry->affected_rows;
+		}
+
+		/*
+		 *	The leader is already running.
+		 */
+		if (entry != batch->leader) unlang_interpret_mark_runnable(query_ctx->request);
+	}
+
+	talloc_free(batch);
+}
+
+/** Remove a query from a batch, as its request has gone away
+ *
+ * If the request was the leader, another request takes over running
+ * the batch, unless the batch was already being run, in which case the
+ * remaining requests run their queries individually.
+ */
+static void sql_batch_entry_detach(fr_sql_query_t *query_ctx)
+{
+	fr_sql_batch_entry_t	*entry = query_ctx->batch_entry;
+	fr_sql_batch_t		*batch = entry->batch;
+
+	entry->query_ctx = NULL;
+	query_ctx->batch_entry = NULL;
+
+	if (entry != batch->leader) return;
+
+	if (batch->state > SQL_BATCH_READY) {
+		sql_batch_release(batch, false);
+		return;
+	}
+
+	batch->leader = NULL;
+	while ((entry = fr_dlist_next(&batch->entries, entry))) {
+		if (entry->query_ctx) {
+			batch->leader = entry;
+			break;
+		}
+	}
+
+	if (!batch->leader) {
+		if (batch->thread->batch == batch) batch->thread->batch = NULL;
+		talloc_free(batch);
+		return;
+	}
+
+	if (batch->state == SQL_BATCH_READY) unlang_interpret_mark_runnable(batch->leader->query_ctx->request);
+}
+
+/** Find the next query in the batch whose request is still waiting for it
+ */
+static fr_sql_batch_entry_t *sql_batch_next(fr_sql_batch_t *batch, fr_sql_batch_entry_t *entry)
+{
+	while ((entry = fr_dlist_next(&batch->entries, entry))) {
+		if (entry->query_ctx) return entry;
+	}
+
+	return NULL;
+}
+
+/** Resume a request which added a query to a batch
+ *
+ * For the leader this is called once the batch is ready, and again after
+ * each query in the batch has been run.
+ *
+ * @param p_result	Result of current module call.
+ * @param priority	Unused.
+ * @param request	Current request.
+ * @param uctx		query context which was added to the batch.
+ * @return an unlang_action_t.
+ */
+static unlang_action_t sql_batch_query_resume(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx)
+{
+	fr_sql_query_t		*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	rlm_sql_t const		*inst = query_ctx->inst;
+	fr_sql_batch_entry_t	*entry = query_ctx->batch_entry;
+	fr_sql_batch_t		*batch;
+	fr_sql_query_t		*batch_query;
+
+	/*
+	 *	No longer part of a batch, either it was
+	 *	committed, or our query needs running on
+	 *	its own.
+	 */
+	if (!entry) {
+		if (query_ctx->affected_rows >= 0) RETURN_MODULE_OK;
+
+		RDEBUG2("Running query individually");
+		return rlm_sql_trunk_query(p_result, priority, request, query_ctx);
+	}
+
+	batch = entry->batch;
+	fr_assert(entry == batch->leader);
+
+	switch (batch->state) {
+	case SQL_BATCH_READY:
+		/*
+		 *	Not worth a transaction.
+		 */
+		if (!sql_batch_next(batch, sql_batch_next(batch, NULL))) {
+			sql_batch_release(batch, false);
+			return sql_batch_query_resume(p_result, priority, request, uctx);
+		}
+
+		RDEBUG2("Running batch of %u queries", fr_dlist_num_elements(&batch->entries));
+		MEM(batch->query_ctx = fr_sql_query_alloc(batch, inst, request, NULL, batch->thread->trunk,
+							  inst->config.batch_begin, SQL_QUERY_OTHER));
+		batch->state = SQL_BATCH_BEGIN;
+		goto submit;
+
+	case SQL_BATCH_BEGIN:
+		if (batch->query_ctx->rcode != RLM_SQL_OK) goto failed;
+		batch->query_ctx->in_transaction = true;
+		break;
+
+	case SQL_BATCH_QUERY:
+		if (batch->query_ctx->rcode != RLM_SQL_OK) goto failed;
+		batch->current->affected_rows = (inst->driver->sql_affected_rows)(batch->query_ctx, &inst->config);
+		if (batch->current->affected_rows < 0) batch->current->affected_rows = 0;
+		break;
+
+	case SQL_BATCH_COMMIT:
+		if (batch->query_ctx->rcode != RLM_SQL_OK) goto failed;
+		RDEBUG2("Batch committed");
+		batch->query_ctx->in_transaction = false;
+		sql_batch_release(batch, true);
+		return sql_batch_query_resume(p_result, priority, request, uctx);
+
+	case SQL_BATCH_ROLLBACK:
+		/*
+		 *	If the rollback failed, in_transaction is
+		 *	left set, and the connection is closed when
+		 *	the batch is freed.
+		 */
+		if (batch->query_ctx->rcode == RLM_SQL_OK) {
+			batch->query_ctx->in_transaction = false;
+		} else {
+			RWDEBUG("Batch rollback failed, closing connection");
+		}
+		sql_batch_release(batch, false);
+		return sql_batch_query_resume(p_result, priority, request, uctx);
+
+	default:
+		fr_assert(0);
+		RETURN_MODULE_FAIL;
+	}
+
+	batch_query = batch->query_ctx;
+	(inst->driver->sql_finish_query)(batch_query, &inst->config);
+	batch_query->status = SQL_QUERY_PREPARED;
+
+	entry = sql_batch_next(batch, batch->current);
+	batch->current = entry;
+	if (entry) {
+		batch->state = SQL_BATCH_QUERY;
+		batch_query->query_str = entry->query_str;
+	} else {
+		batch->state = SQL_BATCH_COMMIT;
+		batch_query->query_str = inst->config.batch_commit;
+	}
+
+submit:
+	if (unlang_function_repeat_set(request, sql_batch_query_resume) < 0) RETURN_MODULE_FAIL;
+	return unlang_function_push(request, rlm_sql_trunk_query, NULL, NULL, 0, UNLANG_SUB_FRAME, batch->query_ctx);
+
+failed:
+	batch_query = batch->query_ctx;
+	RWDEBUG("Batch query failed, running queries individually");
+
+	/*
+	 *	If the connection failed, the transaction
+	 *	went with it.
+	 */
+	if ((batch->state == SQL_BATCH_BEGIN) || !batch_query->treq) {
+		batch_query->in_transaction = false;
+		sql_batch_release(batch, false);
+		return sql_batch_query_resume(p_result, priority, request, uctx);
+	}
+
+	(inst->driver->sql_finish_query)(batch_query, &inst->config);
+	batch_query->status = SQL_QUERY_PREPARED;
+	batch_query->query_str = inst->config.batch_rollback;
+	batch->current = NULL;
+	batch->state = SQL_BATCH_ROLLBACK;
+	goto submit;
+}
+
+/** Add a query to the current batch, and yield until the batch has been run
+ *
+ * Used in place of #rlm_sql_trunk_query for accounting queries, when
+ * batching is enabled.  Once this returns, the query context can be used
+ * the same way as if the query had been run by #rlm_sql_trunk_query,
+ * except that #rlm_sql_affected_rows must be used to find out how many
+ * rows the query affected.
+ *
+ * @param p_result	Result of current module call.
+ * @param priority	Unused.
+ * @param request	Current request.
+ * @param uctx		query context containing query to execute.
+ * @return an unlang_action_t.
+ */
+unlang_action_t rlm_sql_batch_query(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx)
+{
+	fr_sql_query_t		*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	rlm_sql_t const		*inst = query_ctx->inst;
+	rlm_sql_thread_t	*thread = talloc_get_type_abort(module_thread(inst->mi)->data, rlm_sql_thread_t);
+	fr_sql_batch_t		*batch = thread->batch;
+	fr_sql_batch_entry_t	*entry;
+
+	if ((inst->config.batch_size < 2) || (query_ctx->query_str[0] == '\0')) {
+		return rlm_sql_trunk_query(p_result, priority, request, uctx);
+	}
+
+	if (!batch) {
+		MEM(batch = talloc_zero(thread, fr_sql_batch_t));
+		batch->inst = inst;
+		batch->thread = thread;
+		fr_dlist_talloc_init(&batch->entries, fr_sql_batch_entry_t, entry);
+
+		if (fr_event_timer_in(batch, unlang_interpret_event_list(request), &batch->ev,
+				      inst->config.batch_window, _sql_batch_window_expired, batch) < 0) {
+			RPERROR("Failed inserting batch timer");
+			talloc_free(batch);
+			return rlm_sql_trunk_query(p_result, priority, request, uctx);
+		}
+		thread->batch = batch;
+	}
+
+	MEM(entry = talloc(batch, fr_sql_batch_entry_t));
+	*entry = (fr_sql_batch_entry_t) {
+		.batch = batch,
+		.query_ctx = query_ctx
+	};
+	MEM(entry->query_str = talloc_strdup(entry, query_ctx->query_str));
+	fr_dlist_insert_tail(&batch->entries, entry);
+	query_ctx->batch_entry = entry;
+
+	if (!batch->leader) batch->leader = entry;
+
+	RDEBUG2("Added query to batch (%u/%u)", fr_dlist_num_elements(&batch->entries), inst->config.batch_size);
+
+	if (fr_dlist_num_elements(&batch->entries) >= inst->config.batch_size) sql_batch_ready(batch);
+
+	if (unlang_function_push(request, sql_trunk_query_start, sql_batch_query_resume, NULL, 0,
+				 UNLANG_SUB_FRAME, query_ctx) < 0) {
+		sql_batch_entry_detach(query_ctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	*p_result = RLM_MODULE_OK;
+	return UNLANG_ACTION_PUSHED_CHILD;
+}
+
+/** Return the number of rows affected by a query
+ *
+ * @param query_ctx	query context of a query which has been run.
+ * @return the number of rows affected, or -1 on error.
+ */
+int rlm_sql_affected_rows(fr_sql_query_t *query_ctx)
+{
+	if (query_ctx->affected_rows >= 0) return query_ctx->affected_rows;
+
+	return (query_ctx->inst->driver->sql_affected_rows)(query_ctx, &query_ctx->inst->config);
+}
+
+/** Return the number of rows returned by a select
+ *
+ * Must only be called if the driver provides sql_num_rows, or the query was shared.
+ *
+ * @param query_ctx	query context of a select which has been run.
+ * @return the number of rows, or -1 on error.
+ */
+int rlm_sql_num_rows(fr_sql_query_t *query_ctx)
+{
+	if (query_ctx->shared) return query_ctx->shared->num_rows;
+
+	return (query_ctx->inst->driver->sql_num_rows)(query_ctx, &query_ctx->inst->config);
+}
+
+/** Return the field names of the result of a select
+ *
+ * @param[out] out	talloc array of field names, parented by the query context.
+ * @param[in] query_ctx	query context of a select which has been run.
+ * @return an sql_rcode_t.
+ */
+sql_rcode_t rlm_sql_fields(char const **out[], fr_sql_query_t *query_ctx)
+{
+	fr_sql_shared_select_t const	*shared = query_ctx->shared;
+
+	if (!shared) return (query_ctx->inst->driver->sql_fields)(out, query_ctx, &query_ctx->inst->config);
+
+	if (!shared->fields) return RLM_SQL_ERROR;
+
+	MEM(*out = talloc_array(query_ctx, char const *, talloc_array_length(shared->fields)));
+	memcpy(*out, shared->fields, talloc_get_size(shared->fields));
+
+	return RLM_SQL_OK;
+}
+
+/** Compare two shared selects by their query
+ *
+ */
+static int8_t sql_shared_select_cmp(void const *one, void const *two)
+{
+	fr_sql_shared_select_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->query_str, b->query_str), 0);
+}
+
+/** Stop a query sharing the rows of a select
+ *
+ * If the query was the one being run, and the select hasn't completed,
+ * the next query in the list is run in its place.
+ */
+static void sql_shared_select_leave(fr_sql_query_t *query_ctx)
+{
+	fr_sql_shared_select_t	*shared = query_ctx->shared;
+	fr_sql_query_t		*next;
+
+	fr_dlist_remove(&shared->queries, query_ctx);
+	query_ctx->shared = NULL;
+	query_ctx->shared_row = 0;
+
+	/*
+	 *	The row belongs to the shared select, and
+	 *	mustn't be freed by the driver.
+	 */
+	query_ctx->row = NULL;
+
+	if (fr_dlist_num_elements(&shared->queries) == 0) {
+		if (fr_rb_node_inline_in_tree(&shared->node)) fr_rb_remove(shared->thread->selects, shared);
+		talloc_free(shared);
+		return;
+	}
+
+	if (shared->leader != query_ctx) return;
+
+	/*
+	 *	The select is still in progress, but the
+	 *	request that ran it no longer wants the
+	 *	rows.  Run it for one of the waiting
+	 *	requests instead.
+	 */
+	next = fr_dlist_head(&shared->queries);
+	shared->leader = next;
+	shared->submitted = false;
+	unlang_interpret_mark_runnable(next->request);
+}
+
+/** Copy all the rows of the leader's result out of the driver
+ *
+ */
+static void sql_shared_select_copy(request_t *request, fr_sql_shared_select_t *shared, fr_sql_query_t *query_ctx)
+{
+	rlm_sql_t const	*inst = query_ctx->inst;
+	rlm_rcode_t	p_result;
+	char const	**fields;
+	size_t		num_fields = 0, i, alloced = 0;
+	rlm_sql_row_t	row;
+
+	if ((inst->driver->sql_fields)(&fields, query_ctx, &inst->config) == RLM_SQL_OK) {
+		num_fields = talloc_array_length(fields);
+		MEM(shared->fields = talloc_array(shared, char const *, num_fields));
+		for (i = 0; i < num_fields; i++) MEM(shared->fields[i] = talloc_strdup(shared->fields, fields[i]));
+		talloc_free(fields);
+	}
+
+	for (;;) {
+		(inst->driver->sql_fetch_row)(&p_result, NULL, request, query_ctx);
+		if (query_ctx->rcode == RLM_SQL_NO_MORE_ROWS) break;
+
+		if ((query_ctx->rcode != RLM_SQL_OK) || !shared->fields) {
+			ROPTIONAL(RERROR, ERROR, "Error fetching row");
+			rlm_sql_print_error(inst, request, query_ctx, false);
+			if (query_ctx->rcode == RLM_SQL_OK) query_ctx->rcode = RLM_SQL_ERROR;
+			shared->rcode = query_ctx->rcode;
+			return;
+		}
+
+		if (shared->num_rows == alloced) {
+			alloced = alloced ? alloced * 2 : 8;
+			MEM(shared->rows = talloc_realloc(shared, shared->rows, rlm_sql_row_t, alloced));
+		}
+
+		MEM(row = talloc_zero_array(shared, char *, num_fields + 1));
+		for (i = 0; i < num_fields; i++) {
+			if (query_ctx->row[i]) MEM(row[i] = talloc_strdup(row, query_ctx->row[i]));
+		}
+		shared->rows[shared->num_rows++] = row;
+	}
+
+	query_ctx->row = NULL;
+	query_ctx->rcode = RLM_SQL_OK;
+	shared->rcode = RLM_SQL_OK;
+}
+
+/** Resume a request sharing the rows of a select
+ *
+ * For the leader this is called first to run the select, and again once it
+ * has completed, to copy the rows and resume the waiting requests.
+ *
+ * @param p_result	Result of current module call.
+ * @param priority	Unused.
+ * @param request	Current request.
+ * @param uctx		query context sharing the select.
+ * @return an unlang_action_t.
+ */
+static unlang_action_t sql_shared_select_resume(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx)
+{
+	fr_sql_query_t		*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	fr_sql_shared_select_t	*shared = query_ctx->shared;
+	fr_sql_query_t		*waiting = NULL;
+
+	if (!shared) RETURN_MODULE_FAIL;
+
+	if (shared->leader != query_ctx) {
+		query_ctx->rcode = shared->rcode;
+		if (query_ctx->rcode != RLM_SQL_OK) RETURN_MODULE_FAIL;
+		RETURN_MODULE_OK;
+	}
+
+	if (!shared->submitted) {
+		shared->submitted = true;
+		if (unlang_function_repeat_set(request, sql_shared_select_resume) < 0) RETURN_MODULE_FAIL;
+		return unlang_function_push(request, rlm_sql_trunk_query, NULL, NULL, 0, UNLANG_SUB_FRAME, query_ctx);
+	}
+
+	/*
+	 *	Identical selects are run again from now on.
+	 */
+	fr_rb_remove(shared->thread->selects, shared);
+	shared->leader = NULL;
+
+	if ((query_ctx->rcode == RLM_SQL_OK) && !query_ctx->tconn) query_ctx->rcode = RLM_SQL_ERROR;
+	if (query_ctx->rcode == RLM_SQL_OK) {
+		sql_shared_select_copy(request, shared, query_ctx);
+	} else {
+		shared->rcode = query_ctx->rcode;
+	}
+
+	while ((waiting = fr_dlist_next(&shared->queries, waiting))) {
+		if ((waiting != query_ctx) && waiting->request) unlang_interpret_mark_runnable(waiting->request);
+	}
+
+	if (query_ctx->rcode != RLM_SQL_OK) RETURN_MODULE_FAIL;
+	RETURN_MODULE_OK;
+}
+
+/** Stop sharing the rows of a select, as the request has been cancelled
+ */
+static void sql_shared_select_cancel(UNUSED request_t *request, UNUSED fr_signal_t action, void *uctx)
+{
+	fr_sql_query_t	*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+
+	if (query_ctx->shared) sql_shared_select_leave(query_ctx);
+}
+
+/** Run a select, or wait on the results of an identical select which is in progress
+ *
+ * Used in place of #rlm_sql_trunk_query for selects, when coalesce_selects
+ * is enabled.  Once this returns, rows are fetched with #rlm_sql_fetch_row,
+ * and #rlm_sql_num_rows and #rlm_sql_fields must be used instead of calling
+ * the driver.
+ *
+ * Selects which are part of a transaction are always run, as they may
+ * depend on changes made earlier in the transaction.
+ *
+ * @param p_result	Result of current module call.
+ * @param priority	Unused.
+ * @param request	Current request.
+ * @param uctx		query context containing query to execute.
+ * @return an unlang_action_t.
+ */
+unlang_action_t rlm_sql_shared_select(rlm_rcode_t *p_result, int *priority, request_t *request, void *uctx)
+{
+	fr_sql_query_t		*query_ctx = talloc_get_type_abort(uctx, fr_sql_query_t);
+	rlm_sql_t const		*inst = query_ctx->inst;
+	rlm_sql_thread_t	*thread = talloc_get_type_abort(module_thread(inst->mi)->data, rlm_sql_thread_t);
+	fr_sql_shared_select_t	*shared, find = { .query_str = query_ctx->query_str };
+
+	if (query_ctx->shared) sql_shared_select_leave(query_ctx);
+
+	if (!request || query_ctx->treq || query_ctx->in_transaction || (query_ctx->query_str[0] == '\0')) {
+		return rlm_sql_trunk_query(p_result, priority, request, uctx);
+	}
+
+	if (!thread->selects) {
+		MEM(thread->selects = fr_rb_inline_talloc_alloc(thread, fr_sql_shared_select_t, node,
+								 sql_shared_select_cmp, NULL));
+	}
+
+	shared = fr_rb_find(thread->selects, &find);
+	if (shared) {
+		RDEBUG2("Waiting on identical SQL query already in progress");
+	} else {
+		MEM(shared = talloc_zero(thread, fr_sql_shared_select_t));
+		shared->thread = thread;
+		shared->leader = query_ctx;
+		MEM(shared->query_str = talloc_strdup(shared, query_ctx->query_str));
+		fr_dlist_talloc_init(&shared->queries, fr_sql_query_t, shared_entry);
+		fr_rb_insert(thread->selects, shared);
+	}
+
+	fr_dlist_insert_tail(&shared->queries, query_ctx);
+	query_ctx->shared = shared;
+
+	if (unlang_function_push(request, (shared->leader == query_ctx) ? NULL : sql_trunk_query_start,
+				 sql_shared_select_resume, sql_shared_select_cancel, ~FR_SIGNAL_CANCEL,
+				 UNLANG_SUB_FRAME, query_ctx) < 0) {
+		sql_shared_select_leave(query_ctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	*p_result = RLM_MODULE_OK;
+	return UNLANG_ACTION_PUSHED_CHILD;
+}
+
 /** Call the driver's sql_select_query method, reconnecting if necessary.
  *
  * @note Caller must call ``(inst->driver->sql_finish_select_query)(handle, &inst->config);``
@@ -41,9 +41,23 @@ RCSID("$Id$")
 
 #include <pthread.h>
 
+/** A table of statistics, keyed by IP address
+ *
+ */
+typedef struct {
+	fr_rb_tree_t		*tree;				//!< Entries by IP address.
+	fr_dlist_head_t		lru;				//!< Least recently updated entry first.
+} rlm_stats_table_t;
+
+/** Statistics aggregated from all threads
+ *
+ * Only accessed when a thread flushes its local statistics, or when
+ * statistics are queried.
+ */
 typedef struct {
 	pthread_mutex_t		mutex;
-	fr_dlist_head_t		list;				//!< for threads to know about each other
+	rlm_stats_table_t	src;				//!< stats by source
+	rlm_stats_table_t	dst;				//!< stats by destination
 	uint64_t		stats[FR_RADIUS_CODE_MAX];
 } rlm_stats_mutable_t;
 
@@ -58,35 +72,41 @@ typedef struct {
 	fr_dict_attr_t const	*ipv4_da;			//!< FreeRADIUS-Stats4-IPv4-Address
 	fr_dict_attr_t const	*ipv6_da;			//!< FreeRADIUS-Stats4-IPv6-Address
 
-
+	uint32_t		max_entries;			//!< Maximum number of addresses per table.
+	fr_time_delta_t		interval;			//!< How often threads flush their statistics.
 } rlm_stats_t;
 
 typedef struct {
-	fr_rb_node_t		src_node;
-	fr_rb_node_t		dst_node;
+	fr_rb_node_t		node;				//!< Entry in the table's tree.
+	fr_dlist_t		entry;				//!< Entry in the table's LRU list.
 	fr_ipaddr_t		ipaddr;				//!< IP address of this thing
 	fr_time_t		created;			//!< when it was created
 	fr_time_t		last_packet;			//!< when we last saw a packet
 	uint64_t		stats[FR_RADIUS_CODE_MAX];	//!< actual statistic
 } rlm_stats_data_t;
 
+/** Per-thread statistics
+ *
+ * Only ever accessed by the thread which owns them, so updating them
+ * requires no locking.  They're periodically added to the global
+ * statistics, and reset.
+ */
 typedef struct {
-	rlm_stats_t		*inst;
+	rlm_stats_t const	*inst;
 
-	fr_time_t		last_global_update;
-	fr_dlist_t		entry;				//!< for threads to know about each other
+	fr_event_list_t		*el;				//!< To run the flush timer in.
+	fr_event_timer_t const	*ev;				//!< When we next flush our statistics.
 
-	fr_time_t		last_manage;			//!< when we deleted old things
+	rlm_stats_table_t	src;				//!< stats by source since the last flush
+	rlm_stats_table_t	dst;				//!< stats by destination since the last flush
 
-	fr_rb_tree_t		*src;				//!< stats by source
-	fr_rb_tree_t		*dst;				//!< stats by destination
-
-	uint64_t		stats[FR_RADIUS_CODE_MAX];
-
-	pthread_mutex_t		mutex;
+	uint64_t		stats[FR_RADIUS_CODE_MAX];	//!< global stats since the last flush
+	bool			dirty;				//!< Whether there's anything to flush.
 } rlm_stats_thread_t;
 
 static const conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET("max_entries", rlm_stats_t, max_entries), .dflt = "4096" },
+	{ FR_CONF_OFFSET("interval", rlm_stats_t, interval), .dflt = "1.0" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -110,154 +130,215 @@ fr_dict_attr_autoload_t rlm_stats_dict_attr[] = {
 	{ NULL }
 };
 
-static void coalesce(uint64_t final_stats[FR_RADIUS_CODE_MAX], rlm_stats_thread_t *t,
-		     size_t tree_offset, rlm_stats_data_t *mydata)
+static int8_t data_cmp(const void *one, const void *two)
 {
-	rlm_stats_data_t *stats;
-	rlm_stats_thread_t *other;
-	fr_rb_tree_t **tree;
-	uint64_t local_stats[FR_RADIUS_CODE_MAX];
+	rlm_stats_data_t const *a = one;
+	rlm_stats_data_t const *b = two;
 
-	tree = (fr_rb_tree_t **) (((uint8_t *) t) + tree_offset);
+	return fr_ipaddr_cmp(&a->ipaddr, &b->ipaddr);
+}
 
-	/*
-	 *	Bootstrap with my statistics, where we don't need a
-	 *	lock.
-	 */
-	stats = fr_rb_find(*tree, mydata);
-	if (!stats) {
-		memset(final_stats, 0, sizeof(uint64_t) * FR_RADIUS_CODE_MAX);
-	} else {
-		memcpy(final_stats, stats->stats, sizeof(stats->stats));
+static int stats_table_init(TALLOC_CTX *ctx, rlm_stats_table_t *table)
+{
+	table->tree = fr_rb_inline_talloc_alloc(ctx, rlm_stats_data_t, node, data_cmp, NULL);
+	if (unlikely(!table->tree)) return -1;
+
+	fr_dlist_init(&table->lru, rlm_stats_data_t, entry);
+
+	return 0;
+}
+
+/** Find the entry for an address, creating it if it doesn't exist
+ *
+ * The entry is moved to the tail of the LRU list.  If the table is full,
+ * the least recently updated entry is discarded to make room.
+ *
+ * @param[in] ctx		to allocate new entries in.
+ * @param[in] table		to search.
+ * @param[in] ipaddr		to find.
+ * @param[in] now		creation time for new entries.
+ * @param[in] max_entries	maximum size of the table, 0 for no limit.
+ */
+static rlm_stats_data_t *stats_table_find_or_alloc(TALLOC_CTX *ctx, rlm_stats_table_t *table,
+						   fr_ipaddr_t const *ipaddr, fr_time_t now, uint32_t max_entries)
+{
+	rlm_stats_data_t	*stats, mydata;
+
+	mydata.ipaddr = *ipaddr;
+	stats = fr_rb_find(table->tree, &mydata);
+	if (stats) {
+		fr_dlist_remove(&table->lru, stats);
+		fr_dlist_insert_tail(&table->lru, stats);
+		return stats;
 	}
 
-	/*
-	 *	Loop over all of the other thread instances, locking
-	 *	them, and adding their statistics in.
-	 */
-	pthread_mutex_lock(&t->inst->mutable->mutex);
-	for (other = fr_dlist_head(&t->inst->mutable->list);
-	     other != NULL;
-	     other = fr_dlist_next(&t->inst->mutable->list, other)) {
-		int i;
+	if (max_entries && (fr_rb_num_elements(table->tree) >= max_entries)) {
+		stats = fr_dlist_pop_head(&table->lru);
+		fr_rb_remove(table->tree, stats);
+		talloc_free(stats);
+	}
 
-		if (other == t) continue;
+	MEM(stats = talloc_zero(ctx, rlm_stats_data_t));
+	stats->ipaddr = *ipaddr;
+	stats->created = now;
 
-		tree = (fr_rb_tree_t **) (((uint8_t *) other) + tree_offset);
-		pthread_mutex_lock(&other->mutex);
-		stats = fr_rb_find(*tree, mydata);
+	(void) fr_rb_insert(table->tree, stats);
+	fr_dlist_insert_tail(&table->lru, stats);
 
-		if (!stats) {
-			pthread_mutex_unlock(&other->mutex);
-			continue;
-		}
-		memcpy(&local_stats, stats->stats, sizeof(stats->stats));
+	return stats;
+}
 
-		for (i = 0; i < FR_RADIUS_CODE_MAX; i++) {
-			final_stats[i] += local_stats[i];
-		}
+/** Add all the entries in a thread's table to a global one
+ *
+ */
+static void stats_table_merge(TALLOC_CTX *ctx, rlm_stats_table_t *out, rlm_stats_table_t *in, uint32_t max_entries)
+{
+	rlm_stats_data_t	*stats, *mine;
+	int			i;
+
+	for (mine = fr_dlist_head(&in->lru);
+	     mine != NULL;
+	     mine = fr_dlist_next(&in->lru, mine)) {
+		stats = stats_table_find_or_alloc(ctx, out, &mine->ipaddr, mine->created, max_entries);
+
+		if (fr_time_gt(mine->last_packet, stats->last_packet)) stats->last_packet = mine->last_packet;
 
-		pthread_mutex_unlock(&other->mutex);
+		for (i = 0; i < FR_RADIUS_CODE_MAX; i++) stats->stats[i] += mine->stats[i];
 	}
-	pthread_mutex_unlock(&t->inst->mutable->mutex);
 }
 
+static void stats_table_empty(rlm_stats_table_t *table)
+{
+	rlm_stats_data_t *stats;
 
-/*
- *	Do the statistics
+	while ((stats = fr_dlist_pop_head(&table->lru))) {
+		fr_rb_remove(table->tree, stats);
+		talloc_free(stats);
+	}
+}
+
+/** Add our statistics to the global statistics, and reset them
+ *
+ * This is the only time a thread takes the global mutex, so the
+ * mutex is held at most once per interval, per thread.
  */
-static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+static void stats_flush(rlm_stats_thread_t *t)
 {
-	rlm_stats_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_stats_t);
-	rlm_stats_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_stats_thread_t);
+	rlm_stats_mutable_t	*mutable = t->inst->mutable;
 	int			i;
-	uint32_t		stats_type;
 
+	if (!t->dirty) return;
 
-	fr_pair_t *vp;
-	rlm_stats_data_t mydata;
-	char buffer[64];
-	uint64_t local_stats[NUM_ELEMENTS(inst->mutable->stats)];
+	pthread_mutex_lock(&mutable->mutex);
+	for (i = 0; i < FR_RADIUS_CODE_MAX; i++) mutable->stats[i] += t->stats[i];
+	stats_table_merge(mutable, &mutable->src, &t->src, t->inst->max_entries);
+	stats_table_merge(mutable, &mutable->dst, &t->dst, t->inst->max_entries);
+	pthread_mutex_unlock(&mutable->mutex);
 
 	/*
-	 *	Increment counters only in "send foo" sections.
-	 *
-	 *	i.e. only when we have a reply to send.
-	 *
-	 *	FIXME - Nothing sets request_state anymore
+	 *	Free our entries outside of the critical region
 	 */
-#if 0
-	if (request->request_state == REQUEST_SEND) {
-		int src_code, dst_code;
-		rlm_stats_data_t *stats;
+	stats_table_empty(&t->src);
+	stats_table_empty(&t->dst);
+	memset(t->stats, 0, sizeof(t->stats));
+	t->dirty = false;
+}
 
-		src_code = request->packet->code;
-		if (src_code >= FR_RADIUS_CODE_MAX) src_code = 0;
+static void stats_flush_timer(fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	rlm_stats_thread_t *t = talloc_get_type_abort(uctx, rlm_stats_thread_t);
 
-		dst_code = request->reply->code;
-		if (dst_code >= FR_RADIUS_CODE_MAX) dst_code = 0;
+	stats_flush(t);
 
-		pthread_mutex_lock(&t->mutex);
-		t->stats[src_code]++;
-		t->stats[dst_code]++;
+	if (fr_event_timer_in(t, el, &t->ev, t->inst->interval, stats_flush_timer, t) < 0) {
+		PERROR("Failed re-arming stats timer");
+	}
+}
 
-		/*
-		 *	Update source statistics
-		 */
-		mydata.ipaddr = request->packet->socket.inet.src_ipaddr;
-		stats = fr_rb_find(t->src, &mydata);
-		if (!stats) {
-			MEM(stats = talloc_zero(t, rlm_stats_data_t));
+/** Copy the global statistics for an address
+ *
+ */
+static void stats_table_copy(uint64_t final_stats[FR_RADIUS_CODE_MAX], rlm_stats_mutable_t *mutable,
+			     rlm_stats_table_t *table, fr_ipaddr_t const *ipaddr)
+{
+	rlm_stats_data_t	*stats, mydata;
 
-			stats->ipaddr = request->packet->socket.inet.src_ipaddr;
-			stats->created = request->async->recv_time;
+	mydata.ipaddr = *ipaddr;
 
-			(void) fr_rb_insert(t->src, stats);
-		}
+	pthread_mutex_lock(&mutable->mutex);
+	stats = fr_rb_find(table->tree, &mydata);
+	if (!stats) {
+		memset(final_stats, 0, sizeof(uint64_t) * FR_RADIUS_CODE_MAX);
+	} else {
+		memcpy(final_stats, stats->stats, sizeof(stats->stats));
+	}
+	pthread_mutex_unlock(&mutable->mutex);
+}
 
-		stats->last_packet = request->async->recv_time;
-		stats->stats[src_code]++;
-		stats->stats[dst_code]++;
+/*
+ *	Increment counters only in "send foo" sections.
+ *
+ *	i.e. only when we have a reply to send.
+ */
+static unlang_action_t CC_HINT(nonnull) mod_stats_send(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_stats_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_stats_t);
+	rlm_stats_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_stats_thread_t);
+	rlm_stats_data_t	*stats;
+	int			src_code, dst_code;
+	fr_time_t		now = request->packet->timestamp;
 
-		/*
-		 *	Update destination statistics
-		 */
-		mydata.ipaddr = request->packet->socket.inet.dst_ipaddr;
-		stats = fr_rb_find(t->dst, &mydata);
-		if (!stats) {
-			MEM(stats = talloc_zero(t, rlm_stats_data_t));
+	src_code = request->packet->code;
+	if (src_code >= FR_RADIUS_CODE_MAX) src_code = 0;
 
-			stats->ipaddr = request->packet->socket.inet.dst_ipaddr;
-			stats->created = request->async->recv_time;
+	dst_code = request->reply->code;
+	if (dst_code >= FR_RADIUS_CODE_MAX) dst_code = 0;
 
-			(void) fr_rb_insert(t->dst, stats);
-		}
+	/*
+	 *	Don't let our tables grow past the limit, push
+	 *	everything we have to the global tables instead.
+	 */
+	if (inst->max_entries &&
+	    ((fr_rb_num_elements(t->src.tree) >= inst->max_entries) ||
+	     (fr_rb_num_elements(t->dst.tree) >= inst->max_entries))) stats_flush(t);
 
-		stats->last_packet = request->async->recv_time;
-		stats->stats[src_code]++;
-		stats->stats[dst_code]++;
-		pthread_mutex_unlock(&t->mutex);
+	t->stats[src_code]++;
+	t->stats[dst_code]++;
+	t->dirty = true;
 
-		/*
-		 *	@todo - periodically clean up old entries.
-		 */
+	/*
+	 *	Update source statistics
+	 */
+	stats = stats_table_find_or_alloc(t, &t->src, &request->packet->socket.inet.src_ipaddr, now, 0);
+	stats->last_packet = now;
+	stats->stats[src_code]++;
+	stats->stats[dst_code]++;
 
-		if ((t->last_global_update + NSEC) > request->async->recv_time) {
-			RETURN_MODULE_UPDATED;
-		}
+	/*
+	 *	Update destination statistics
+	 */
+	stats = stats_table_find_or_alloc(t, &t->dst, &request->packet->socket.inet.dst_ipaddr, now, 0);
+	stats->last_packet = now;
+	stats->stats[src_code]++;
+	stats->stats[dst_code]++;
 
-		t->last_global_update = request->async->recv_time;
+	RETURN_MODULE_UPDATED;
+}
 
-		pthread_mutex_lock(&inst->mutable->mutex);
-		for (i = 0; i < FR_RADIUS_CODE_MAX; i++) {
-			inst->mutable->stats[i] += t->stats[i];
-			t->stats[i] = 0;
-		}
-		pthread_mutex_unlock(&inst->mutable->mutex);
+/*
+ *	Add statistics to Status-Server replies
+ */
+static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_stats_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_stats_t);
+	rlm_stats_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_stats_thread_t);
+	int			i;
+	uint32_t		stats_type;
 
-		RETURN_MODULE_UPDATED;
-	}
-#endif
+
+	fr_pair_t *vp;
+	char buffer[64];
+	uint64_t local_stats[NUM_ELEMENTS(inst->mutable->stats)];
 
 	/*
 	 *	Ignore "authenticate" and anything other than Status-Server
@@ -279,19 +360,20 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 	MEM(pair_update_reply(&vp, attr_freeradius_stats4_type) >= 0);
 	vp->vp_uint32 = stats_type;
 
+	/*
+	 *	Make sure our own statistics are included.  Other
+	 *	threads' statistics are at most one interval old.
+	 */
+	stats_flush(t);
+
 	switch (stats_type) {
 	case FR_STATS4_TYPE_VALUE_GLOBAL:			/* global */
 		/*
-		 *	Merge our stats with the global stats, and then copy
-		 *	the global stats to a thread-local variable.
+		 *	Copy the global stats to a thread-local variable.
 		 *
 		 *	The copy helps minimize mutex contention.
 		 */
 		pthread_mutex_lock(&inst->mutable->mutex);
-		for (i = 0; i < FR_RADIUS_CODE_MAX; i++) {
-			inst->mutable->stats[i] += t->stats[i];
-			t->stats[i] = 0;
-		}
 		memcpy(&local_stats, inst->mutable->stats, sizeof(inst->mutable->stats));
 		pthread_mutex_unlock(&inst->mutable->mutex);
 		vp = NULL;
@@ -302,8 +384,7 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 		if (!vp) vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_freeradius_stats4_ipv6_address);
 		if (!vp) RETURN_MODULE_NOOP;
 
-		mydata.ipaddr = vp->vp_ip;
-		coalesce(local_stats, t, offsetof(rlm_stats_thread_t, src), &mydata);
+		stats_table_copy(local_stats, inst->mutable, &inst->mutable->src, &vp->vp_ip);
 		break;
 
 	case FR_STATS4_TYPE_VALUE_LISTENER:			/* dst */
@@ -311,8 +392,7 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 		if (!vp) vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_freeradius_stats4_ipv6_address);
 		if (!vp) RETURN_MODULE_NOOP;
 
-		mydata.ipaddr = vp->vp_ip;
-		coalesce(local_stats, t, offsetof(rlm_stats_thread_t, dst), &mydata);
+		stats_table_copy(local_stats, inst->mutable, &inst->mutable->dst, &vp->vp_ip);
 		break;
 
 	default:
@@ -351,15 +431,6 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 	RETURN_MODULE_OK;
 }
 
-
-static int8_t data_cmp(const void *one, const void *two)
-{
-	rlm_stats_data_t const *a = one;
-	rlm_stats_data_t const *b = two;
-
-	return fr_ipaddr_cmp(&a->ipaddr, &b->ipaddr);
-}
-
 /** Instantiate thread data for the submodule.
  *
  */
@@ -371,19 +442,19 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 	(void) talloc_set_type(t, rlm_stats_thread_t);
 
 	t->inst = inst;
+	t->el = mctx->el;
 
-	t->src = fr_rb_inline_talloc_alloc(t, rlm_stats_data_t, src_node, data_cmp, NULL);
-	if (unlikely(!t->src)) return -1;
+	if (unlikely(stats_table_init(t, &t->src) < 0)) return -1;
 
-	t->dst = fr_rb_inline_talloc_alloc(t, rlm_stats_data_t, dst_node, data_cmp, NULL);
-	if (unlikely(!t->dst)) {
-		TALLOC_FREE(t->src);
+	if (unlikely(stats_table_init(t, &t->dst) < 0)) {
+		TALLOC_FREE(t->src.tree);
 		return -1;
 	}
 
-	pthread_mutex_lock(&inst->mutable->mutex);
-	fr_dlist_insert_head(&inst->mutable->list, t);
-	pthread_mutex_unlock(&inst->mutable->mutex);
+	if (fr_event_timer_in(t, t->el, &t->ev, inst->interval, stats_flush_timer, t) < 0) {
+		PERROR("Failed inserting stats timer");
+		return -1;
+	}
 
 	return 0;
 }
@@ -395,16 +466,9 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
 {
 	rlm_stats_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_stats_thread_t);
-	rlm_stats_t		*inst = t->inst;
-	int			i;
 
-	pthread_mutex_lock(&inst->mutable->mutex);
-	for (i = 0; i < FR_RADIUS_CODE_MAX; i++) {
-		inst->mutable->stats[i] += t->stats[i];
-	}
-	fr_dlist_remove(&inst->mutable->list, t);
-	pthread_mutex_unlock(&inst->mutable->mutex);
-	pthread_mutex_destroy(&t->mutex);
+	fr_event_timer_delete(&t->ev);
+	stats_flush(t);
 
 	return 0;
 }
@@ -413,9 +477,17 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	rlm_stats_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_stats_t);
 
+	FR_TIME_DELTA_BOUND_CHECK("interval", inst->interval, >=, fr_time_delta_from_msec(10));
+
 	MEM(inst->mutable = talloc_zero(NULL, rlm_stats_mutable_t));
 	pthread_mutex_init(&inst->mutable->mutex, NULL);
-	fr_dlist_init(&inst->mutable->list, rlm_stats_thread_t, entry);
+
+	if ((stats_table_init(inst->mutable, &inst->mutable->src) < 0) ||
+	    (stats_table_init(inst->mutable, &inst->mutable->dst) < 0)) {
+		pthread_mutex_destroy(&inst->mutable->mutex);
+		TALLOC_FREE(inst->mutable);
+		return -1;
+	}
 
 	return 0;
 }
@@ -460,6 +532,7 @@ module_rlm_t rlm_stats = {
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
+			{ .section = SECTION_NAME("send", CF_IDENT_ANY), .method = mod_stats_send },
 			{ .section = SECTION_NAME(CF_IDENT_ANY, CF_IDENT_ANY), .method = mod_stats },
 			MODULE_BINDING_TERMINATOR
 		}
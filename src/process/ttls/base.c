@@ -511,7 +511,8 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 
 	inst->auth.state_tree = fr_state_tree_init(inst, attr_state, main_config->spawn_workers, inst->auth.session.max,
 						   inst->auth.session.timeout, inst->auth.session.state_server_id,
-						   fr_hash_string(cf_section_name2(inst->server_cs)));
+						   fr_hash_string(cf_section_name2(inst->server_cs)),
+						   cf_section_name2(inst->server_cs));
 
 	return 0;
 }
@@ -1 +1 @@
-SUBMAKEFILES := libfreeradius-radius.mk libfreeradius-radius-bio.mk
+SUBMAKEFILES := libfreeradius-radius.mk libfreeradius-radius-bio.mk sign_batch_tests.mk
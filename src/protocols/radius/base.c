@@ -302,25 +302,28 @@ invalid:
 	return packet_len;
 }
 
-/** Sign a previously encoded packet
+/** Prepare a packet for its Message-Authenticator to be calculated
  *
- * Calculates the request/response authenticator for packets which need it, and fills
- * in the message-authenticator value if the attribute is present in the encoded packet.
+ * Finds Message-Authenticator, and sets the fields it covers to the values
+ * they must have when the HMAC is calculated.
  *
- * @param[in,out] packet	(request or response).
+ * @param[out] msg_p		Where to write a pointer to Message-Authenticator,
+ *				or NULL if the packet doesn't contain one.
+ * @param[in,out] packet	to prepare.
  * @param[in] vector		original packet vector to use
- * @param[in] secret		to sign the packet with.
  * @param[in] secret_len	The length of the secret.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
-		   uint8_t const *secret, size_t secret_len)
+static int radius_sign_message_authenticator_prepare(uint8_t **msg_p, uint8_t *packet, uint8_t const *vector,
+						     size_t secret_len)
 {
 	uint8_t		*msg, *end;
 	size_t		packet_len = fr_nbo_to_uint16(packet + 2);
 
+	*msg_p = NULL;
+
 	/*
 	 *	No real limit on secret length, this is just
 	 *	to catch uninitialised fields.
@@ -378,7 +381,10 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
 		case FR_RADIUS_CODE_DISCONNECT_NAK:
 		case FR_RADIUS_CODE_COA_ACK:
 		case FR_RADIUS_CODE_COA_NAK:
-			if (!vector) goto need_original;
+			if (!vector) {
+				fr_strerror_const("Cannot sign response packet without a request packet");
+				return -1;
+			}
 			memcpy(packet + 4, vector, RADIUS_AUTH_VECTOR_LENGTH);
 			break;
 
@@ -388,19 +394,33 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
 			break;
 
 		default:
-			goto bad_packet;
+			fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
+			return -1;
 		}
 
 		/*
 		 *	Force Message-Authenticator to be zero,
-		 *	calculate the HMAC, and put it into the
-		 *	Message-Authenticator attribute.
+		 *	so the HMAC can be calculated.
 		 */
 		memset(msg + 2, 0, RADIUS_AUTH_VECTOR_LENGTH);
-		fr_hmac_md5(msg + 2, packet, packet_len, secret, secret_len);
+		*msg_p = msg;
 		break;
 	}
 
+	return 0;
+}
+
+/** Prepare a packet for its Request or Response Authenticator to be calculated
+ *
+ * @param[in,out] packet	to prepare.
+ * @param[in] vector		original packet vector to use
+ * @return
+ *	- <0 on error
+ *	- 0 if the packet doesn't need an authenticator calculating.
+ *	- 1 if the authenticator should be set to MD5(packet + secret).
+ */
+static int radius_sign_authenticator_prepare(uint8_t *packet, uint8_t const *vector)
+{
 	/*
 	 *	Initialize the request authenticator.
 	 */
@@ -421,7 +441,6 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
 	case FR_RADIUS_CODE_COA_NAK:
 	case FR_RADIUS_CODE_PROTOCOL_ERROR:
 		if (!vector) {
-		need_original:
 			fr_strerror_const("Cannot sign response packet without a request packet");
 			return -1;
 		}
@@ -438,11 +457,44 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
 		return 0;
 
 	default:
-	bad_packet:
 		fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
 		return -1;
 	}
 
+	return 1;
+}
+
+/** Sign a previously encoded packet
+ *
+ * Calculates the request/response authenticator for packets which need it, and fills
+ * in the message-authenticator value if the attribute is present in the encoded packet.
+ *
+ * @param[in,out] packet	(request or response).
+ * @param[in] vector		original packet vector to use
+ * @param[in] secret		to sign the packet with.
+ * @param[in] secret_len	The length of the secret.
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
+		   uint8_t const *secret, size_t secret_len)
+{
+	uint8_t		*msg;
+	size_t		packet_len = fr_nbo_to_uint16(packet + 2);
+	int		ret;
+
+	if (radius_sign_message_authenticator_prepare(&msg, packet, vector, secret_len) < 0) return -1;
+
+	/*
+	 *	Calculate the HMAC, and put it into the
+	 *	Message-Authenticator attribute.
+	 */
+	if (msg) fr_hmac_md5(msg + 2, packet, packet_len, secret, secret_len);
+
+	ret = radius_sign_authenticator_prepare(packet, vector);
+	if (ret <= 0) return ret;
+
 	/*
 	 *	Request / Response Authenticator = MD5(packet + secret)
 	 */
@@ -459,6 +511,87 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *vector,
 	return 0;
 }
 
+/** Sign the entries in a batch which don't already have an error
+ *
+ */
+static void radius_sign_batch(fr_radius_batch_t *batch, size_t num)
+{
+	fr_hmac_md5_mb_job_t	hmac[FR_MD5_MB_MAX_LANES];
+	fr_md5_mb_job_t		md5[FR_MD5_MB_MAX_LANES];
+	size_t			i, j, chunk, hmac_num, md5_num;
+
+	for (i = 0; i < num; i += chunk) {
+		chunk = num - i;
+		if (chunk > FR_MD5_MB_MAX_LANES) chunk = FR_MD5_MB_MAX_LANES;
+
+		hmac_num = 0;
+		for (j = 0; j < chunk; j++) {
+			fr_radius_batch_t	*b = &batch[i + j];
+			uint8_t			*msg;
+
+			if (b->rcode < 0) continue;
+
+			b->rcode = radius_sign_message_authenticator_prepare(&msg, b->packet, b->vector, b->secret_len);
+			if ((b->rcode < 0) || !msg) continue;
+
+			hmac[hmac_num++] = (fr_hmac_md5_mb_job_t){
+				.in = b->packet,
+				.inlen = fr_nbo_to_uint16(b->packet + 2),
+				.key = b->secret,
+				.key_len = b->secret_len,
+				.out = msg + 2
+			};
+		}
+		fr_hmac_md5_mb_calc(hmac, hmac_num);
+
+		md5_num = 0;
+		for (j = 0; j < chunk; j++) {
+			fr_radius_batch_t	*b = &batch[i + j];
+			int			ret;
+
+			if (b->rcode < 0) continue;
+
+			ret = radius_sign_authenticator_prepare(b->packet, b->vector);
+			if (ret <= 0) {
+				b->rcode = ret;
+				continue;
+			}
+
+			md5[md5_num++] = (fr_md5_mb_job_t){
+				.in = { b->packet, b->secret },
+				.inlen = { fr_nbo_to_uint16(b->packet + 2), b->secret_len },
+				.out = b->packet + 4
+			};
+		}
+		fr_md5_mb_calc(md5, md5_num);
+	}
+}
+
+/** Sign a batch of previously encoded packets
+ *
+ * Produces the same results as calling fr_radius_sign() on each packet,
+ * but the digests of several packets are calculated in parallel.
+ *
+ * @param[in,out] batch		of packets to sign.  The rcode field of each entry
+ *				is set to the value fr_radius_sign() would have returned.
+ * @param[in] num		Number of entries in the batch.
+ * @return
+ *	- <0 if any packet could not be signed.  The error is for the last failure.
+ *	- 0 on success
+ */
+int fr_radius_sign_batch(fr_radius_batch_t *batch, size_t num)
+{
+	size_t	i;
+	int	ret = 0;
+
+	for (i = 0; i < num; i++) batch[i].rcode = 0;
+
+	radius_sign_batch(batch, num);
+
+	for (i = 0; i < num; i++) if (batch[i].rcode < 0) ret = -1;
+
+	return ret;
+}
 
 /** See if the data pointed to by PTR is a valid RADIUS packet.
  *
@@ -716,36 +849,25 @@ finish:
 }
 
 
-/** Verify a request / response packet
+/** Check a packet before it's signed, and save the authenticators it was received with
  *
- *  This function does its work by calling fr_radius_sign(), and then
- *  comparing the signature in the packet with the one we calculated.
- *  If they differ, there's a problem.
- *
- * @param[in] packet				the raw RADIUS packet (request or response)
- * @param[in] vector				the original packet vector
- * @param[in] secret				the shared secret
- * @param[in] secret_len			the length of the secret
+ * @param[in,out] b				batch entry for the packet.
  * @param[in] require_message_authenticator	whether we require Message-Authenticator.
  * @param[in] limit_proxy_state			whether we allow Proxy-State without Message-Authenticator.
  * @return
- *	- -2 if the message authenticator or request authenticator was invalid.
- *	- -1 if we were unable to verify the shared secret, or the packet
- *	     was in some other way malformed.
+ *	- -1 if the packet is malformed.
  *	- 0 on success.
  */
-int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
-		     uint8_t const *secret, size_t secret_len,
-		     bool require_message_authenticator, bool limit_proxy_state)
+static int radius_verify_prepare(fr_radius_batch_t *b, bool require_message_authenticator, bool limit_proxy_state)
 {
 	bool		found_message_authenticator = false;
 	bool		found_proxy_state = false;
-	int		rcode;
 	int		code;
+	uint8_t		*packet = b->packet;
 	uint8_t		*msg, *end;
 	size_t		packet_len = fr_nbo_to_uint16(packet + 2);
-	uint8_t		request_authenticator[RADIUS_AUTH_VECTOR_LENGTH];
-	uint8_t		message_authenticator[RADIUS_AUTH_VECTOR_LENGTH];
+
+	b->msg = NULL;
 
 	if (packet_len < RADIUS_HEADER_LENGTH) {
 		fr_strerror_printf("invalid packet length %zd", packet_len);
@@ -758,7 +880,7 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 		return -1;
 	}
 
-	memcpy(request_authenticator, packet + 4, sizeof(request_authenticator));
+	memcpy(b->request_authenticator, packet + 4, sizeof(b->request_authenticator));
 
 	/*
 	 *	Find Message-Authenticator.  Its value has to be
@@ -798,8 +920,9 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 		/*
 		 *	Found it, save a copy.
 		 */
-		memcpy(message_authenticator, msg + 2, sizeof(message_authenticator));
+		memcpy(b->message_authenticator, msg + 2, sizeof(b->message_authenticator));
 		found_message_authenticator = true;
+		b->msg = msg;
 		break;
 	}
 
@@ -815,15 +938,19 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 		}
 	}
 
-	/*
-	 *	Overwrite the contents of Message-Authenticator
-	 *	with the one we calculate.
-	 */
-	rcode = fr_radius_sign(packet, vector, secret, secret_len);
-	if (rcode < 0) {
-		fr_strerror_const_push("Failed calculating correct authenticator");
-		return -1;
-	}
+	return 0;
+}
+
+/** Compare the authenticators a packet was received with, against the ones we calculated
+ *
+ * @param[in,out] b	batch entry for the packet, after it has been signed.
+ * @return
+ *	- -2 if the message authenticator or request authenticator was invalid.
+ *	- 0 on success.
+ */
+static int radius_verify_check(fr_radius_batch_t *b)
+{
+	uint8_t		*packet = b->packet;
 
 	/*
 	 *	Check the Message-Authenticator first.
@@ -836,10 +963,10 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 	 *	message authenticators are the same, so we don't
 	 *	need to do anything.
 	 */
-	if ((msg < end) &&
-	    (fr_digest_cmp(message_authenticator, msg + 2, sizeof(message_authenticator)) != 0)) {
-		memcpy(msg + 2, message_authenticator, sizeof(message_authenticator));
-		memcpy(packet + 4, request_authenticator, sizeof(request_authenticator));
+	if (b->msg &&
+	    (fr_digest_cmp(b->message_authenticator, b->msg + 2, sizeof(b->message_authenticator)) != 0)) {
+		memcpy(b->msg + 2, b->message_authenticator, sizeof(b->message_authenticator));
+		memcpy(packet + 4, b->request_authenticator, sizeof(b->request_authenticator));
 
 		fr_strerror_const("invalid Message-Authenticator (shared secret is incorrect)");
 		return -2;
@@ -856,9 +983,9 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 	/*
 	 *	Check the Request Authenticator.
 	 */
-	if (fr_digest_cmp(request_authenticator, packet + 4, sizeof(request_authenticator)) != 0) {
-		memcpy(packet + 4, request_authenticator, sizeof(request_authenticator));
-		if (vector) {
+	if (fr_digest_cmp(b->request_authenticator, packet + 4, sizeof(b->request_authenticator)) != 0) {
+		memcpy(packet + 4, b->request_authenticator, sizeof(b->request_authenticator));
+		if (b->vector) {
 			fr_strerror_const("invalid Response Authenticator (shared secret is incorrect)");
 		} else {
 			fr_strerror_const("invalid Request Authenticator (shared secret is incorrect)");
@@ -869,6 +996,85 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 	return 0;
 }
 
+/** Verify a request / response packet
+ *
+ *  This function does its work by calling fr_radius_sign(), and then
+ *  comparing the signature in the packet with the one we calculated.
+ *  If they differ, there's a problem.
+ *
+ * @param[in] packet				the raw RADIUS packet (request or response)
+ * @param[in] vector				the original packet vector
+ * @param[in] secret				the shared secret
+ * @param[in] secret_len			the length of the secret
+ * @param[in] require_message_authenticator	whether we require Message-Authenticator.
+ * @param[in] limit_proxy_state			whether we allow Proxy-State without Message-Authenticator.
+ * @return
+ *	- -2 if the message authenticator or request authenticator was invalid.
+ *	- -1 if we were unable to verify the shared secret, or the packet
+ *	     was in some other way malformed.
+ *	- 0 on success.
+ */
+int fr_radius_verify(uint8_t *packet, uint8_t const *vector,
+		     uint8_t const *secret, size_t secret_len,
+		     bool require_message_authenticator, bool limit_proxy_state)
+{
+	fr_radius_batch_t	b = {
+					.packet = packet,
+					.vector = vector,
+					.secret = secret,
+					.secret_len = secret_len
+				};
+
+	if (radius_verify_prepare(&b, require_message_authenticator, limit_proxy_state) < 0) return -1;
+
+	/*
+	 *	Overwrite the contents of Message-Authenticator
+	 *	with the one we calculate.
+	 */
+	if (fr_radius_sign(packet, vector, secret, secret_len) < 0) {
+		fr_strerror_const_push("Failed calculating correct authenticator");
+		return -1;
+	}
+
+	return radius_verify_check(&b);
+}
+
+/** Verify a batch of request / response packets
+ *
+ * Produces the same results as calling fr_radius_verify() on each packet,
+ * but the digests of several packets are calculated in parallel.
+ *
+ * @param[in,out] batch				of packets to verify.  The rcode field of each entry
+ *						is set to the value fr_radius_verify() would have returned.
+ * @param[in] num				Number of entries in the batch.
+ * @param[in] require_message_authenticator	whether we require Message-Authenticator.
+ * @param[in] limit_proxy_state			whether we allow Proxy-State without Message-Authenticator.
+ * @return
+ *	- <0 if any packet failed verification.  The error is for the last failure.
+ *	- 0 if all packets were verified.
+ */
+int fr_radius_verify_batch(fr_radius_batch_t *batch, size_t num,
+			   bool require_message_authenticator, bool limit_proxy_state)
+{
+	size_t	i;
+	int	ret = 0;
+
+	for (i = 0; i < num; i++) {
+		batch[i].rcode = radius_verify_prepare(&batch[i], require_message_authenticator, limit_proxy_state);
+	}
+
+	radius_sign_batch(batch, num);
+
+	for (i = 0; i < num; i++) {
+		fr_radius_batch_t *b = &batch[i];
+
+		if (b->rcode == 0) b->rcode = radius_verify_check(b);
+		if (b->rcode < 0) ret = b->rcode;
+	}
+
+	return ret;
+}
+
 void *fr_radius_next_encodable(fr_dlist_head_t *list, void *current, void *uctx);
 
 void *fr_radius_next_encodable(fr_dlist_head_t *list, void *current, void *uctx)
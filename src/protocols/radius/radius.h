@@ -179,6 +179,24 @@ extern size_t fr_radius_request_name_table_len;
 
 extern char const *fr_radius_packet_name[FR_RADIUS_CODE_MAX];
 
+/** A packet to sign or verify with fr_radius_sign_batch() or fr_radius_verify_batch()
+ *
+ */
+typedef struct {
+	uint8_t			*packet;		//!< Encoded packet.
+	uint8_t const		*vector;		//!< Original packet vector, for responses.
+	uint8_t const		*secret;		//!< Shared secret.
+	size_t			secret_len;		//!< Length of the shared secret.
+	int			rcode;			//!< Result for this packet.
+
+	/*
+	 *	Private to the batch functions.
+	 */
+	uint8_t			*msg;			//!< Message-Authenticator in the packet.
+	uint8_t			request_authenticator[RADIUS_AUTH_VECTOR_LENGTH];	//!< As received.
+	uint8_t			message_authenticator[RADIUS_AUTH_VECTOR_LENGTH];	//!< As received.
+} fr_radius_batch_t;
+
 /*
  *	protocols/radius/base.c
  */
@@ -191,6 +209,11 @@ int		fr_radius_verify(uint8_t *packet, uint8_t const *vector,
 				 uint8_t const *secret, size_t secret_len,
 				 bool require_message_authenticator, bool limit_proxy_state) CC_HINT(nonnull (1,3));
 
+int		fr_radius_sign_batch(fr_radius_batch_t *batch, size_t num) CC_HINT(nonnull);
+
+int		fr_radius_verify_batch(fr_radius_batch_t *batch, size_t num,
+				       bool require_message_authenticator, bool limit_proxy_state) CC_HINT(nonnull);
+
 bool		fr_radius_ok(uint8_t const *packet, size_t *packet_len_p,
 			     uint32_t max_attributes, bool require_message_authenticator, decode_fail_t *reason) CC_HINT(nonnull (1,2));
 
@@ -0,0 +1,266 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for batched signing and verification of RADIUS packets
+ *
+ * @file src/protocols/radius/sign_batch_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/protocol/radius/rfc2865.h>
+#include <freeradius-devel/protocol/radius/rfc2869.h>
+
+#define TEST_MAX_PACKETS	40
+#define TEST_PACKET_SIZE	512
+
+typedef struct {
+	uint8_t		single[TEST_PACKET_SIZE];	//!< Signed / verified with the single packet functions.
+	uint8_t		batch[TEST_PACKET_SIZE];	//!< Signed / verified with the batch functions.
+	uint8_t		vector[RADIUS_AUTH_VECTOR_LENGTH];
+	uint8_t		secret[100];
+	size_t		secret_len;
+	bool		response;
+} test_packet_t;
+
+static test_packet_t	packets[TEST_MAX_PACKETS];
+
+static void test_random(uint8_t *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) p[i] = fr_rand();
+}
+
+/** Build a packet with random attributes, and optionally a Message-Authenticator
+ *
+ * Secret lengths cover the HMAC key being shorter and longer than the
+ * MD5 block size.
+ */
+static void test_packet_build(test_packet_t *t, uint8_t code, bool response, bool message_authenticator, size_t i)
+{
+	uint8_t	*p = t->single;
+	size_t	num_attrs = fr_rand() % 10, ma_pos = fr_rand() % (num_attrs + 1), j;
+
+	memset(t, 0, sizeof(*t));
+
+	t->response = response;
+	t->secret_len = 1 + ((i * 7) % sizeof(t->secret));
+	test_random(t->secret, t->secret_len);
+	test_random(t->vector, sizeof(t->vector));
+
+	p[0] = code;
+	p[1] = fr_rand();
+	test_random(p + 4, RADIUS_AUTH_VECTOR_LENGTH);
+	p += RADIUS_HEADER_LENGTH;
+
+	for (j = 0; j <= num_attrs; j++) {
+		if (message_authenticator && (j == ma_pos)) {
+			p[0] = FR_MESSAGE_AUTHENTICATOR;
+			p[1] = 2 + RADIUS_AUTH_VECTOR_LENGTH;
+			test_random(p + 2, RADIUS_AUTH_VECTOR_LENGTH);
+			p += p[1];
+		}
+		if (j == num_attrs) break;
+
+		p[0] = FR_USER_NAME;
+		p[1] = 2 + (fr_rand() % 40);
+		test_random(p + 2, p[1] - 2);
+		p += p[1];
+	}
+
+	fr_nbo_from_uint16(t->single + 2, p - t->single);
+	memcpy(t->batch, t->single, sizeof(t->batch));
+}
+
+static void test_batch_init(fr_radius_batch_t *batch, size_t num)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		batch[i] = (fr_radius_batch_t){
+			.packet = packets[i].batch,
+			.vector = packets[i].response ? packets[i].vector : NULL,
+			.secret = packets[i].secret,
+			.secret_len = packets[i].secret_len
+		};
+	}
+}
+
+/** Sign, then verify, the same packets with the single and batch functions, and compare the results
+ *
+ */
+static void test_sign_verify(uint8_t const *codes, size_t num_codes, bool response, bool message_authenticator)
+{
+	fr_radius_batch_t	batch[TEST_MAX_PACKETS];
+	size_t			num, i;
+	int			ret;
+
+	for (num = 1; num <= TEST_MAX_PACKETS; num++) {
+		for (i = 0; i < num; i++) test_packet_build(&packets[i], codes[i % num_codes], response,
+							    message_authenticator, i);
+
+		/*
+		 *	Sign
+		 */
+		test_batch_init(batch, num);
+		TEST_CHECK(fr_radius_sign_batch(batch, num) == 0);
+
+		for (i = 0; i < num; i++) {
+			test_packet_t *t = &packets[i];
+
+			ret = fr_radius_sign(t->single, t->response ? t->vector : NULL, t->secret, t->secret_len);
+			TEST_CHECK(ret == 0);
+			TEST_CHECK(batch[i].rcode == ret);
+			TEST_CHECK(memcmp(t->single, t->batch, fr_nbo_to_uint16(t->single + 2)) == 0);
+			TEST_MSG("Packet %zu of %zu (code %u) signed differently", i, num, t->single[0]);
+		}
+
+		/*
+		 *	Corrupt every third packet, so some fail verification.
+		 */
+		for (i = 0; i < num; i += 3) {
+			size_t len = fr_nbo_to_uint16(packets[i].single + 2);
+
+			packets[i].single[len - 1] ^= 0x01;
+			packets[i].batch[len - 1] ^= 0x01;
+		}
+
+		/*
+		 *	Verify
+		 */
+		test_batch_init(batch, num);
+		(void) fr_radius_verify_batch(batch, num, message_authenticator, false);
+
+		for (i = 0; i < num; i++) {
+			test_packet_t *t = &packets[i];
+
+			ret = fr_radius_verify(t->single, t->response ? t->vector : NULL, t->secret, t->secret_len,
+					       message_authenticator, false);
+			TEST_CHECK(batch[i].rcode == ret);
+			TEST_MSG("Packet %zu of %zu (code %u) expected %d, got %d", i, num, t->single[0], ret, batch[i].rcode);
+			TEST_CHECK(memcmp(t->single, t->batch, fr_nbo_to_uint16(t->single + 2)) == 0);
+			TEST_MSG("Packet %zu of %zu (code %u) verified differently", i, num, t->single[0]);
+		}
+	}
+}
+
+static uint8_t const access_request[] = { FR_RADIUS_CODE_ACCESS_REQUEST };
+static uint8_t const accounting_request[] = { FR_RADIUS_CODE_ACCOUNTING_REQUEST };
+static uint8_t const coa_request[] = { FR_RADIUS_CODE_COA_REQUEST, FR_RADIUS_CODE_DISCONNECT_REQUEST };
+static uint8_t const responses[] = { FR_RADIUS_CODE_ACCESS_ACCEPT, FR_RADIUS_CODE_ACCESS_CHALLENGE,
+				     FR_RADIUS_CODE_ACCOUNTING_RESPONSE, FR_RADIUS_CODE_COA_ACK,
+				     FR_RADIUS_CODE_DISCONNECT_NAK };
+static uint8_t const mixed[] = { FR_RADIUS_CODE_ACCESS_REQUEST, FR_RADIUS_CODE_ACCOUNTING_REQUEST,
+				 FR_RADIUS_CODE_COA_REQUEST, FR_RADIUS_CODE_STATUS_SERVER };
+
+static void test_access_request(void)
+{
+	test_sign_verify(access_request, NUM_ELEMENTS(access_request), false, false);
+}
+
+static void test_access_request_ma(void)
+{
+	test_sign_verify(access_request, NUM_ELEMENTS(access_request), false, true);
+}
+
+static void test_accounting_request(void)
+{
+	test_sign_verify(accounting_request, NUM_ELEMENTS(accounting_request), false, false);
+}
+
+static void test_accounting_request_ma(void)
+{
+	test_sign_verify(accounting_request, NUM_ELEMENTS(accounting_request), false, true);
+}
+
+static void test_coa_request(void)
+{
+	test_sign_verify(coa_request, NUM_ELEMENTS(coa_request), false, false);
+}
+
+static void test_coa_request_ma(void)
+{
+	test_sign_verify(coa_request, NUM_ELEMENTS(coa_request), false, true);
+}
+
+static void test_response(void)
+{
+	test_sign_verify(responses, NUM_ELEMENTS(responses), true, false);
+}
+
+static void test_response_ma(void)
+{
+	test_sign_verify(responses, NUM_ELEMENTS(responses), true, true);
+}
+
+static void test_mixed_ma(void)
+{
+	test_sign_verify(mixed, NUM_ELEMENTS(mixed), false, true);
+}
+
+/** Entries which fail don't affect the rest of the batch
+ *
+ */
+static void test_errors(void)
+{
+	fr_radius_batch_t	batch[TEST_MAX_PACKETS];
+	size_t			i;
+
+	for (i = 0; i < TEST_MAX_PACKETS; i++) test_packet_build(&packets[i], FR_RADIUS_CODE_ACCOUNTING_REQUEST,
+								  false, true, i);
+
+	/*
+	 *	A response without a request vector, and an unknown code.
+	 */
+	packets[5].batch[0] = packets[5].single[0] = FR_RADIUS_CODE_ACCESS_ACCEPT;
+	packets[17].batch[0] = packets[17].single[0] = 0;
+
+	test_batch_init(batch, TEST_MAX_PACKETS);
+	TEST_CHECK(fr_radius_sign_batch(batch, TEST_MAX_PACKETS) < 0);
+
+	for (i = 0; i < TEST_MAX_PACKETS; i++) {
+		test_packet_t	*t = &packets[i];
+		int		ret;
+
+		ret = fr_radius_sign(t->single, NULL, t->secret, t->secret_len);
+		TEST_CHECK(batch[i].rcode == ret);
+		TEST_MSG("Packet %zu expected %d, got %d", i, ret, batch[i].rcode);
+
+		if (ret < 0) continue;
+
+		TEST_CHECK(memcmp(t->single, t->batch, fr_nbo_to_uint16(t->single + 2)) == 0);
+		TEST_MSG("Packet %zu signed differently", i);
+	}
+}
+
+TEST_LIST = {
+	{ "access_request",		test_access_request },
+	{ "access_request_ma",		test_access_request_ma },
+	{ "accounting_request",		test_accounting_request },
+	{ "accounting_request_ma",	test_accounting_request_ma },
+	{ "coa_request",		test_coa_request },
+	{ "coa_request_ma",		test_coa_request_ma },
+	{ "response",			test_response },
+	{ "response_ma",		test_response_ma },
+	{ "mixed_ma",			test_mixed_ma },
+	{ "errors",			test_errors },
+
+	{ NULL }
+};
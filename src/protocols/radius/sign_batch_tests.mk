@@ -0,0 +1,8 @@
+TARGET		:= sign_batch_tests$(E)
+SOURCES		:= sign_batch_tests.c
+
+TGT_LDLIBS	:= $(LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-radius$(L)
+
+TGT_INSTALLDIR	:=
@@ -15,19 +15,32 @@ $(eval $(call TEST_BOOTSTRAP))
 # 	so we copy it manually to the output directory (always), and then
 #	put the server logs into the output file.
 #
+#	Each file is read with and without mmap, and the pairs which
+#	were processed must be the same.  The headers and Timestamps
+#	are the time the file was processed, so they're ignored.
+#
 $(OUTPUT)/%: $(DIR)/% $(addprefix ${BUILD_DIR}/lib/,proto_detail.la proto_detail_file.la proto_detail_work.la)
 	$(eval DIR := $(dir $<))
 	${Q}echo "DETAIL $(notdir $<)"
-	${Q}cp $< $(dir $@)/detail.txt
-	${Q}rm -f $(dir $@)/processed
-	${Q}if ! $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X > $@.log; then \
-		tail $@.log; \
-		echo "cp $< $(dir $@)/detail.txt; $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X "; \
-		exit 1; \
-	fi
-	${Q}if [ ! -e $(dir $@)/processed ] ; then \
-		tail $@.log; \
-		echo "Processing $< failed to produce expected output $(dir $@)/processed"; \
+	${Q}tab=$$(printf '\t'); \
+	for mmap in no yes; do \
+		rm -rf $@.$$mmap; \
+		mkdir -p $@.$$mmap; \
+		cp $< $@.$$mmap/detail.txt; \
+		if ! OUTPUT=$@.$$mmap MMAP=$$mmap $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X > $@.$$mmap.log; then \
+			tail $@.$$mmap.log; \
+			echo "cp $< $@.$$mmap/detail.txt; OUTPUT=$@.$$mmap MMAP=$$mmap $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X "; \
+			exit 1; \
+		fi; \
+		if [ ! -e $@.$$mmap/processed ] ; then \
+			tail $@.$$mmap.log; \
+			echo "Processing $< with mmap = $$mmap failed to produce expected output $@.$$mmap/processed"; \
+			exit 1; \
+		fi; \
+		grep -v -e "^[^$$tab]" -e "^$${tab}Timestamp = " $@.$$mmap/processed > $@.$$mmap.out; \
+	done
+	${Q}if ! diff $@.no.out $@.yes.out; then \
+		echo "Processing $< with mmap = yes produced different output to mmap = no"; \
 		exit 1; \
 	fi
 	${Q}touch $@
@@ -0,0 +1,2 @@
+cache_striped.test:
+
@@ -27,8 +27,8 @@ RCSID("$Id$")
 #include <freeradius-devel/util/syserror.h>
 #include <freeradius-devel/util/talloc.h>
 #include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/event.h>
 
-#include <sys/event.h>
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
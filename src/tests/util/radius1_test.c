@@ -31,6 +31,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/log.h>
 #include <freeradius-devel/util/md5.h>
 #include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/event.h>
 
 #ifdef HAVE_GETOPT_H
 #  include <getopt.h>
@@ -39,8 +40,6 @@ RCSID("$Id$")
 #include <pthread.h>
 #include <signal.h>
 
-#include <sys/event.h>
-
 #define MAX_MESSAGES		(2048)
 #define MAX_CONTROL_PLANE	(1024)
 #define MAX_KEVENTS		(10)
@@ -29,8 +29,8 @@ RCSID("$Id$")
 #include <freeradius-devel/util/inet.h>
 #include <freeradius-devel/util/md5.h>
 #include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/event.h>
 
-#include <sys/event.h>
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>